@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_CAPTURE_H
+#define DBUSLOG_CAPTURE_H
+
+/* Since 1.0.23 */
+
+#include "dbuslog_client_types.h"
+#include "dbuslog_category.h"
+#include "dbuslog_message.h"
+
+#include <gutil_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Binary capture file. Messages are stored in their wire format, along
+ * with the categories they belong to and a sparse index which allows
+ * to skip the parts of the file outside the time range or not
+ * containing the category of interest. See dbuslog_capture.c for
+ * the file layout.
+ */
+typedef struct dbus_log_capture_writer DBusLogCaptureWriter;
+typedef struct dbus_log_capture_reader DBusLogCaptureReader;
+
+/* Returns NULL if the file can't be created */
+DBusLogCaptureWriter*
+dbus_log_capture_writer_new(
+    const char* path);
+
+/*
+ * Makes the writer build the trigram index of the message text, which
+ * gets written along with the rest of the index when the file is closed
+ * and speeds up the content filter. Must be called before anything is
+ * written. The writer keeps the index in memory until then.
+ */
+gboolean
+dbus_log_capture_writer_index_text(
+    DBusLogCaptureWriter* writer);
+
+/* Category may be NULL */
+gboolean
+dbus_log_capture_writer_write(
+    DBusLogCaptureWriter* writer,
+    const DBusLogCategory* category,
+    DBusLogMessage* message);
+
+/* Writes the index, closes the file and frees the writer */
+void
+dbus_log_capture_writer_close(
+    DBusLogCaptureWriter* writer);
+
+/* Returns NULL if the file can't be opened or isn't a capture file */
+DBusLogCaptureReader*
+dbus_log_capture_reader_new(
+    const char* path);
+
+void
+dbus_log_capture_reader_free(
+    DBusLogCaptureReader* reader);
+
+DBusLogCategory*
+dbus_log_capture_reader_category(
+    DBusLogCaptureReader* reader,
+    guint32 id);
+
+DBusLogCategory*
+dbus_log_capture_reader_find_category(
+    DBusLogCaptureReader* reader,
+    const char* name);
+
+/*
+ * Skips the messages logged before the timestamp (microseconds since
+ * the epoch) and restricts the output to a single category (zero
+ * removes the restriction). Both rewind the reader.
+ */
+void
+dbus_log_capture_reader_seek_time(
+    DBusLogCaptureReader* reader,
+    gint64 timestamp);
+
+void
+dbus_log_capture_reader_set_category(
+    DBusLogCaptureReader* reader,
+    guint32 id);
+
+/*
+ * Restricts the output to the messages containing any of the substrings
+ * or matching the regular expression. NULL or empty substrings and regex
+ * remove the restriction. If the file has the text index, the blocks
+ * which can't contain anything matching are skipped. Rewinds the reader.
+ */
+gboolean
+dbus_log_capture_reader_set_content_filter(
+    DBusLogCaptureReader* reader,
+    const GStrV* substrings,
+    const char* regex,
+    GError** error);
+
+/*
+ * Returns a new reference to the next message, NULL at the end.
+ * The category (if any) remains owned by the reader.
+ */
+DBusLogMessage*
+dbus_log_capture_reader_next(
+    DBusLogCaptureReader* reader,
+    DBusLogCategory** category);
+
+G_END_DECLS
+
+#endif /* DBUSLOG_CAPTURE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -45,6 +45,8 @@ G_BEGIN_DECLS
 
 /* dbus_log_client_new flags */
 #define DBUSLOG_CLIENT_FLAG_AUTOSTART (0x01)
+#define DBUSLOG_CLIENT_FLAG_SHM       (0x02) /* Shared memory if possible */
+#define DBUSLOG_CLIENT_FLAG_THREAD    (0x04) /* Read on a separate thread */
 
 typedef struct dbus_log_client_priv DBusLogClientPriv;
 typedef struct dbus_log_client_call DBusLogClientCall;
@@ -52,7 +54,7 @@ typedef struct dbus_log_client_call DBusLogClientCall;
 struct dbus_log_client {
     GObject object;
     DBusLogClientPriv* priv;
-    GPtrArray* categories;
+    GPtrArray* categories;      /* Sorted by name */
     DBUSLOG_LEVEL default_level;
     gboolean connected;
     gboolean started;
@@ -60,6 +62,15 @@ struct dbus_log_client {
     int backlog;
 };
 
+/* Per-session statistics, see dbus_log_client_update_stats() */
+typedef struct dbus_log_client_stats {
+    guint pipe_size;            /* Zero if the pipe isn't used */
+    guint max_pipe_size;
+    guint pipe_resize_count;
+    guint64 dropped_count;      /* Since interface version 7 */
+    guint64 dropped_bytes;
+} DBusLogClientStats;
+
 typedef
 void
 (*DBusLogClientFunc)(
@@ -96,6 +107,20 @@ void
     DBusLogMessage* message,
     gpointer user_data);
 
+/* Since 1.0.23 */
+typedef struct dbus_log_client_message {
+    DBusLogCategory* category;
+    DBusLogMessage* message;
+} DBusLogClientMessage;
+
+typedef
+void
+(*DBusLogClientMessagesFunc)(
+    DBusLogClient* client,
+    const DBusLogClientMessage* messages,
+    guint count,
+    gpointer user_data);
+
 typedef
 void
 (*DBusLogClientSkipFunc)(
@@ -103,6 +128,13 @@ void
     guint count,
     gpointer user_data);
 
+typedef
+void
+(*DBusLogClientDropFunc)(
+    DBusLogClient* client,
+    const DBusLogDropReport* report,
+    gpointer user_data);
+
 DBusLogClient*
 dbus_log_client_new(
     GBusType bus,
@@ -138,6 +170,25 @@ dbus_log_client_start(
     DBusLogClientCallFunc fn,
     gpointer user_data);
 
+/*
+ * Same as dbus_log_client_start() but also asks for the messages which
+ * are still in the server's backlog. If flags contain
+ * DBUSLOG_OPEN_FLAG_HISTORY_SINCE, history is the index of the first
+ * message, otherwise it's the number of the most recent messages.
+ * Servers older than interface version 4 only send the new messages.
+ * If the client has been created with DBUSLOG_CLIENT_FLAG_SHM, servers
+ * supporting interface version 5 deliver the messages through shared
+ * memory rather than a pipe.
+ * Since 1.0.23
+ */
+DBusLogClientCall*
+dbus_log_client_start_with_history(
+    DBusLogClient* client,
+    guint flags,
+    guint history,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
 DBusLogClientCall*
 dbus_log_client_enable_category(
     DBusLogClient* client,
@@ -180,6 +231,89 @@ dbus_log_client_disable_pattern(
     DBusLogClientCallFunc fn,
     gpointer user_data);
 
+/*
+ * Pipe and statistics control for the running session. These require
+ * interface version 6 and return NULL if the log hasn't been started
+ * or the server is too old. The server may limit the pipe size.
+ * dbus_log_client_stats() returns the statistics as of the last
+ * completed dbus_log_client_update_stats() call. Since 1.0.23
+ */
+DBusLogClientCall*
+dbus_log_client_set_pipe_size(
+    DBusLogClient* client,
+    guint size,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+DBusLogClientCall*
+dbus_log_client_update_stats(
+    DBusLogClient* client,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+const DBusLogClientStats*
+dbus_log_client_stats(
+    DBusLogClient* client);
+
+/*
+ * What the server does when this client falls behind by more than
+ * the backlog. Requires interface version 7. Since 1.0.23
+ */
+DBusLogClientCall*
+dbus_log_client_set_overflow_policy(
+    DBusLogClient* client,
+    DBUSLOG_OVERFLOW policy,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+/*
+ * Per-session filters, applied by the server before the messages get
+ * written to this client. They don't affect what is logged, only what
+ * is sent to this client. Level DBUSLOG_LEVEL_UNDEFINED means no limit
+ * (for a category, that the session's level applies). Only the listed
+ * categories (and uncategorized messages) get through, NULL or empty
+ * list removes the category filter. Requires interface version 8.
+ * Once a session filter is set, gaps in the message indices are no
+ * longer reported as skipped, only the actual losses are reported as
+ * dropped. Since 1.0.23
+ */
+DBusLogClientCall*
+dbus_log_client_session_set_level(
+    DBusLogClient* client,
+    DBUSLOG_LEVEL level,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+DBusLogClientCall*
+dbus_log_client_session_set_category_level(
+    DBusLogClient* client,
+    const char* name,
+    DBUSLOG_LEVEL level,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+DBusLogClientCall*
+dbus_log_client_session_set_categories(
+    DBusLogClient* client,
+    const GStrV* names,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
+/*
+ * Only lets through the messages containing any of the substrings or
+ * matching the regular expression. NULL or empty substrings and regex
+ * remove the content filter. Messages queued before the filter takes
+ * effect (e.g. the history) are still delivered. Requires interface
+ * version 9. Since 1.0.23
+ */
+DBusLogClientCall*
+dbus_log_client_session_set_content_filter(
+    DBusLogClient* client,
+    const GStrV* substrings,
+    const char* regex,
+    DBusLogClientCallFunc fn,
+    gpointer user_data);
+
 void
 dbus_log_client_call_cancel(
     DBusLogClientCall* call);
@@ -240,12 +374,30 @@ dbus_log_client_add_message_handler(
     DBusLogClientMessageFunc fn,
     gpointer user_data);
 
+/*
+ * Delivers all messages received in one go with a single emission,
+ * which is a lot cheaper than a signal per message. The array is only
+ * valid during the call. Since 1.0.23
+ */
+gulong
+dbus_log_client_add_messages_handler(
+    DBusLogClient* client,
+    DBusLogClientMessagesFunc fn,
+    gpointer user_data);
+
 gulong
 dbus_log_client_add_skip_handler(
     DBusLogClient* client,
     DBusLogClientSkipFunc fn,
     gpointer user_data);
 
+/* Reports the messages dropped by the server, since 1.0.23 */
+gulong
+dbus_log_client_add_dropped_handler(
+    DBusLogClient* client,
+    DBusLogClientDropFunc fn,
+    gpointer user_data);
+
 void
 dbus_log_client_remove_handler(
     DBusLogClient* client,
@@ -41,6 +41,19 @@ G_BEGIN_DECLS
 
 typedef struct dbus_log_client DBusLogClient;
 
+/* Messages dropped by the server, since 1.0.23 */
+typedef struct dbus_log_drop_count {
+    guint32 category;           /* Category id */
+    guint32 count;
+} DBusLogDropCount;
+
+typedef struct dbus_log_drop_report {
+    guint32 count;              /* Total, including uncategorized */
+    guint64 bytes;
+    guint n_categories;
+    const DBusLogDropCount* categories;
+} DBusLogDropReport;
+
 G_END_DECLS
 
 #endif /* DBUSLOG_CLIENT_TYPES_H */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_READER_H
+#define DBUSLOG_READER_H
+
+/* Since 1.0.23 */
+
+#include "dbuslog_client_types.h"
+#include "dbuslog_message.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Synchronous reader of the log pipe (as returned by LogOpen, LogOpen2
+ * or LogOpen3) for programs which don't run a GLib main loop. Wait
+ * until the descriptor becomes readable (poll, epoll or whatever) and
+ * call dbus_log_reader_next_batch() until it returns zero. No signals
+ * are emitted and nothing is allocated per message. Plain text points
+ * into the read buffer, binary messages are formatted into a text arena
+ * which is reused by the next batch (and only grows when a batch needs
+ * more room than any previous one).
+ *
+ * The shared memory transport (LogOpenShm) is not supported.
+ */
+typedef struct dbus_log_reader DBusLogReader;
+
+typedef struct dbus_log_reader_message {
+    gint64 timestamp;
+    guint32 index;
+    guint32 category;
+    DBUSLOG_LEVEL level;
+    gsize length;
+    const char* text;       /* Not NUL-terminated */
+} DBusLogReaderMessage;
+
+/* Switches the descriptor to non-blocking mode */
+DBusLogReader*
+dbus_log_reader_new(
+    int fd,
+    gboolean close_when_done);
+
+void
+dbus_log_reader_free(
+    DBusLogReader* reader);
+
+int
+dbus_log_reader_fd(
+    DBusLogReader* reader);
+
+/*
+ * Fills in up to max messages, returns their number, zero if nothing
+ * is available at the moment or negative value at the end of stream.
+ * The text points into the reader's buffer and remains valid until
+ * the next call.
+ */
+int
+dbus_log_reader_next_batch(
+    DBusLogReader* reader,
+    DBusLogReaderMessage* messages,
+    guint max);
+
+/*
+ * Call this after setting a session filter (SessionSetLevel and such).
+ * The indices of the filtered messages are missing from the stream and
+ * are no longer counted as skipped. Messages actually lost by the server
+ * are counted as dropped if the log has been opened with the
+ * DBUSLOG_OPEN_FLAG_DROP_REPORT flag.
+ */
+void
+dbus_log_reader_set_filtered(
+    DBusLogReader* reader,
+    gboolean filtered);
+
+/* Messages skipped and dropped by the server so far */
+guint64
+dbus_log_reader_skipped(
+    DBusLogReader* reader);
+
+guint64
+dbus_log_reader_dropped(
+    DBusLogReader* reader);
+
+G_END_DECLS
+
+#endif /* DBUSLOG_READER_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_STORE_H
+#define DBUSLOG_STORE_H
+
+/* Since 1.0.23 */
+
+#include "dbuslog_client_types.h"
+#include "dbuslog_message.h"
+
+#include <gutil_types.h>
+
+G_BEGIN_DECLS
+
+/*
+ * In-memory storage for the received messages. Messages are copied
+ * into column-oriented chunks, which are indexed by category and log
+ * level, so that filtered views can be produced without looking at
+ * every message. Rows are numbered sequentially, starting from zero.
+ * If the store has a limit, the oldest messages get dropped (one
+ * chunk at a time) and the first valid row moves forward.
+ */
+typedef struct dbus_log_store DBusLogStore;
+
+typedef struct dbus_log_store_entry {
+    gint64 timestamp;
+    guint32 index;
+    guint32 category;
+    DBUSLOG_LEVEL level;
+    gsize length;
+    const char* text;       /* Valid until the store is modified */
+} DBusLogStoreEntry;
+
+typedef struct dbus_log_store_filter {
+    const guint32* categories;  /* Category ids, none means any */
+    guint n_categories;
+    DBUSLOG_LEVEL max_level;    /* DBUSLOG_LEVEL_UNDEFINED means any */
+    const GStrV* substrings;    /* The text must contain any of these... */
+    GRegex* regex;              /* ...or match this */
+} DBusLogStoreFilter;
+
+/* Zero max_count means no limit */
+DBusLogStore*
+dbus_log_store_new(
+    guint64 max_count);
+
+void
+dbus_log_store_free(
+    DBusLogStore* store);
+
+/*
+ * Enables the trigram index for the messages added from now on, which
+ * makes the text filters faster at the cost of (roughly) a couple of
+ * bytes per each character of the text.
+ */
+void
+dbus_log_store_index_text(
+    DBusLogStore* store,
+    gboolean enable);
+
+/*
+ * The row number of the new message is dbus_log_store_end() - 1. The
+ * text of a deferred format message gets formatted (and cached in the
+ * message).
+ */
+gboolean
+dbus_log_store_add(
+    DBusLogStore* store,
+    DBusLogMessage* message);
+
+/* Also restarts row numbering from zero */
+void
+dbus_log_store_clear(
+    DBusLogStore* store);
+
+/* The first valid row and the one after the last */
+guint64
+dbus_log_store_first(
+    DBusLogStore* store);
+
+guint64
+dbus_log_store_end(
+    DBusLogStore* store);
+
+gboolean
+dbus_log_store_get(
+    DBusLogStore* store,
+    guint64 row,
+    DBusLogStoreEntry* entry);
+
+/*
+ * Stores up to max numbers of the rows matching the filter, starting
+ * at the given row, and returns how many have been stored. NULL filter
+ * matches everything.
+ */
+guint
+dbus_log_store_select(
+    DBusLogStore* store,
+    const DBusLogStoreFilter* filter,
+    guint64 from,
+    guint64* rows,
+    guint max);
+
+/* Number of rows matching the filter */
+guint64
+dbus_log_store_count(
+    DBusLogStore* store,
+    const DBusLogStoreFilter* filter);
+
+G_END_DECLS
+
+#endif /* DBUSLOG_STORE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
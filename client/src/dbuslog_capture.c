@@ -0,0 +1,1156 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_capture.h"
+#include "dbuslog_trigram.h"
+#include "dbuslog_client_log.h"
+
+#include <stdio.h>
+#include <errno.h>
+
+/*
+ * Capture file layout (all numbers are little-endian):
+ *
+ *   Header (16 bytes): "DBUSLOGC" magic, version (u32), reserved (u32)
+ *
+ * followed by the records, framed the same way as the packets on the
+ * wire (type u8 + payload size u32 + payload):
+ *
+ *   DBUSLOG_PACKET_TYPE_MESSAGE (1): same payload as on the wire
+ *   DBUSLOG_CAPTURE_RECORD_CATEGORY (0x80): id u32, flags u32, name
+ *   DBUSLOG_CAPTURE_RECORD_BLOCK (0x81): offset u64, size u64,
+ *       min timestamp u64, max timestamp u64, first index u32,
+ *       count u32, category bitmap (bit N is set if the block
+ *       contains messages from category N, empty if it could
+ *       contain anything)
+ *   DBUSLOG_CAPTURE_RECORD_TRIGRAM (0x82): trigram u32, followed by the
+ *       numbers of the blocks containing it (varints, each one except
+ *       the first is the difference from the previous one)
+ *
+ * The category record precedes the first message from that category.
+ * Messages are grouped into blocks, each block is followed by the
+ * block record describing it. The file is flushed after each block,
+ * so that it remains usable even if it never gets properly closed.
+ * When the file is closed, all categories and blocks are written
+ * once again (that's the index), followed by the trailer (16 bytes):
+ * the offset of the index (u64) and "DBUSLIDX" magic. Without the
+ * trailer, the reader has to scan the whole file to build the index.
+ *
+ * Trigram records are optional and only written as a part of the index,
+ * one per trigram, sorted. The reader only keeps track of where they
+ * are and reads those it needs for the particular search. They are
+ * ignored when the index is missing, because they may be incomplete.
+ */
+
+#define DBUSLOG_CAPTURE_MAGIC               "DBUSLOGC"
+#define DBUSLOG_CAPTURE_INDEX_MAGIC         "DBUSLIDX"
+#define DBUSLOG_CAPTURE_MAGIC_SIZE          (8)
+#define DBUSLOG_CAPTURE_VERSION             (1)
+#define DBUSLOG_CAPTURE_HEADER_SIZE         (16)
+#define DBUSLOG_CAPTURE_TRAILER_SIZE        (16)
+
+#define DBUSLOG_CAPTURE_RECORD_CATEGORY     (0x80)
+#define DBUSLOG_CAPTURE_CATEGORY_PREFIX_SIZE (8)
+#define DBUSLOG_CAPTURE_RECORD_BLOCK        (0x81)
+#define DBUSLOG_CAPTURE_BLOCK_PREFIX_SIZE   (40)
+#define DBUSLOG_CAPTURE_RECORD_TRIGRAM      (0x82)
+#define DBUSLOG_CAPTURE_TRIGRAM_PREFIX_SIZE (4)
+
+#define DBUSLOG_CAPTURE_BLOCK_MAX_COUNT     (1000)
+#define DBUSLOG_CAPTURE_BLOCK_MAX_SIZE      (0x40000)
+#define DBUSLOG_CAPTURE_BITMAP_MAX_SIZE     (0x2000)
+
+typedef struct dbus_log_capture_block {
+    guint64 offset;
+    guint64 size;
+    gint64 min_ts;
+    gint64 max_ts;
+    guint32 first_index;
+    guint32 count;
+    guchar* bitmap;
+    guint bitmap_size;
+} DBusLogCaptureBlock;
+
+/* Blocks containing the trigram, as written to the file */
+typedef struct dbus_log_capture_trigram {
+    guint32 trigram;
+    guint32 last_block;
+    GByteArray* blocks;
+} DBusLogCaptureTrigram;
+
+/* Where the list of blocks for the trigram is */
+typedef struct dbus_log_capture_posting {
+    guint32 trigram;
+    guint32 size;
+    guint64 offset;
+} DBusLogCapturePosting;
+
+struct dbus_log_capture_writer {
+    FILE* f;
+    char* path;
+    guint64 pos;
+    gboolean failed;
+    gboolean any_category;
+    GHashTable* categories;
+    GHashTable* trigrams;
+    GArray* blocks;
+    DBusLogCaptureBlock block;
+};
+
+struct dbus_log_capture_reader {
+    FILE* f;
+    GHashTable* categories;
+    GArray* blocks;
+    GArray* postings;
+    GByteArray* buf;
+    guint next_block;
+    guint64 pos;
+    guint64 block_end;
+    gint64 since;
+    guint32 category;
+    DBusLogTrigramQuery* query;
+    guchar* text_blocks;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+dbus_log_capture_put_uint32(
+    guchar* ptr,
+    guint32 data)
+{
+    ptr[0] = (guchar)data;
+    ptr[1] = (guchar)(data >> 8);
+    ptr[2] = (guchar)(data >> 16);
+    ptr[3] = (guchar)(data >> 24);
+}
+
+static
+void
+dbus_log_capture_put_uint64(
+    guchar* ptr,
+    guint64 data)
+{
+    dbus_log_capture_put_uint32(ptr, (guint32)(data));
+    dbus_log_capture_put_uint32(ptr + 4, (guint32)(data >> 32));
+}
+
+static
+void
+dbus_log_capture_put_varint(
+    GByteArray* out,
+    guint32 value)
+{
+    guchar buf[5];
+    guint n = 0;
+
+    while (value >= 0x80) {
+        buf[n++] = (guchar)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (guchar)value;
+    g_byte_array_append(out, buf, n);
+}
+
+static
+const guchar*
+dbus_log_capture_get_varint(
+    const guchar* ptr,
+    const guchar* end,
+    guint32* value)
+{
+    guint32 result = 0;
+    guint shift;
+
+    for (shift = 0; ptr < end && shift < 32; shift += 7) {
+        const guchar b = *ptr++;
+
+        result |= ((guint32)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+static
+guint32
+dbus_log_capture_get_uint32(
+    const guchar* ptr)
+{
+    return ((guint32)(ptr[3]) << 24) |
+        ((guint32)(ptr[2]) << 16) |
+        ((guint32)(ptr[1]) << 8) |
+        ptr[0];
+}
+
+static
+guint64
+dbus_log_capture_get_uint64(
+    const guchar* ptr)
+{
+    return ((guint64)dbus_log_capture_get_uint32(ptr)) |
+        (((guint64)dbus_log_capture_get_uint32(ptr + 4)) << 32);
+}
+
+static
+void
+dbus_log_capture_block_clear(
+    gpointer data)
+{
+    DBusLogCaptureBlock* block = data;
+
+    g_free(block->bitmap);
+    block->bitmap = NULL;
+    block->bitmap_size = 0;
+}
+
+static
+GArray*
+dbus_log_capture_blocks_new(
+    void)
+{
+    GArray* blocks = g_array_new(FALSE, FALSE, sizeof(DBusLogCaptureBlock));
+
+    g_array_set_clear_func(blocks, dbus_log_capture_block_clear);
+    return blocks;
+}
+
+static
+GHashTable*
+dbus_log_capture_categories_new(
+    void)
+{
+    return g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+        dbus_log_category_free);
+}
+
+static
+void
+dbus_log_capture_add_category(
+    GHashTable* categories,
+    guint32 id,
+    gulong flags,
+    const char* name)
+{
+    DBusLogCategory* cat = dbus_log_category_new(name, id);
+
+    cat->flags = flags;
+    g_hash_table_replace(categories, GUINT_TO_POINTER(id), cat);
+}
+
+/*==========================================================================*
+ * Writer
+ *==========================================================================*/
+
+static
+void
+dbus_log_capture_writer_record(
+    DBusLogCaptureWriter* self,
+    guchar type,
+    const void* prefix,
+    gsize prefix_size,
+    const void* data,
+    gsize data_size)
+{
+    guchar header[DBUSLOG_PACKET_HEADER_SIZE];
+
+    header[DBUSLOG_PACKET_TYPE_OFFSET] = type;
+    dbus_log_capture_put_uint32(header + DBUSLOG_PACKET_SIZE_OFFSET,
+        prefix_size + data_size);
+    if ((fwrite(header, sizeof(header), 1, self->f) != 1 ||
+        (prefix_size && fwrite(prefix, prefix_size, 1, self->f) != 1) ||
+        (data_size && fwrite(data, data_size, 1, self->f) != 1)) &&
+        !self->failed) {
+        GERR("Failed to write %s: %s", self->path, strerror(errno));
+        self->failed = TRUE;
+    }
+    self->pos += sizeof(header) + prefix_size + data_size;
+}
+
+static
+void
+dbus_log_capture_writer_category(
+    DBusLogCaptureWriter* self,
+    const DBusLogCategory* cat)
+{
+    guchar prefix[DBUSLOG_CAPTURE_CATEGORY_PREFIX_SIZE];
+
+    dbus_log_capture_put_uint32(prefix, cat->id);
+    dbus_log_capture_put_uint32(prefix + 4, (guint32)cat->flags);
+    dbus_log_capture_writer_record(self, DBUSLOG_CAPTURE_RECORD_CATEGORY,
+        prefix, sizeof(prefix), cat->name, strlen(cat->name));
+}
+
+static
+void
+dbus_log_capture_writer_block(
+    DBusLogCaptureWriter* self,
+    const DBusLogCaptureBlock* block)
+{
+    guchar prefix[DBUSLOG_CAPTURE_BLOCK_PREFIX_SIZE];
+
+    dbus_log_capture_put_uint64(prefix, block->offset);
+    dbus_log_capture_put_uint64(prefix + 8, block->size);
+    dbus_log_capture_put_uint64(prefix + 16, block->min_ts);
+    dbus_log_capture_put_uint64(prefix + 24, block->max_ts);
+    dbus_log_capture_put_uint32(prefix + 32, block->first_index);
+    dbus_log_capture_put_uint32(prefix + 36, block->count);
+    dbus_log_capture_writer_record(self, DBUSLOG_CAPTURE_RECORD_BLOCK,
+        prefix, sizeof(prefix), block->bitmap, block->bitmap_size);
+}
+
+static
+void
+dbus_log_capture_writer_finish_block(
+    DBusLogCaptureWriter* self)
+{
+    DBusLogCaptureBlock* block = &self->block;
+
+    if (block->count) {
+        block->size = self->pos - block->offset;
+        if (self->any_category) {
+            /* Empty bitmap matches any category */
+            dbus_log_capture_block_clear(block);
+        }
+        dbus_log_capture_writer_block(self, block);
+        g_array_append_vals(self->blocks, block, 1);
+        fflush(self->f);
+    } else {
+        dbus_log_capture_block_clear(block);
+    }
+    memset(block, 0, sizeof(*block));
+    block->offset = self->pos;
+    self->any_category = FALSE;
+}
+
+static
+void
+dbus_log_capture_writer_mark_category(
+    DBusLogCaptureWriter* self,
+    guint32 id)
+{
+    DBusLogCaptureBlock* block = &self->block;
+    const guint byte = id / 8;
+
+    if (byte >= DBUSLOG_CAPTURE_BITMAP_MAX_SIZE) {
+        /* Not worth the space, the block will match any category */
+        self->any_category = TRUE;
+    } else {
+        if (byte >= block->bitmap_size) {
+            const guint size = byte + 1;
+
+            block->bitmap = g_realloc(block->bitmap, size);
+            memset(block->bitmap + block->bitmap_size, 0,
+                size - block->bitmap_size);
+            block->bitmap_size = size;
+        }
+        block->bitmap[byte] |= (1 << (id % 8));
+    }
+}
+
+static
+void
+dbus_log_capture_writer_trigram_free(
+    gpointer data)
+{
+    DBusLogCaptureTrigram* tri = data;
+
+    g_byte_array_unref(tri->blocks);
+    g_slice_free(DBusLogCaptureTrigram, tri);
+}
+
+static
+void
+dbus_log_capture_writer_index_message(
+    DBusLogCaptureWriter* self,
+    const char* text,
+    gsize length)
+{
+    /* Number of the block being written */
+    const guint32 block = self->blocks->len;
+    const guchar* ptr = (const guchar*)text;
+    gsize i;
+
+    for (i = 0; i + DBUSLOG_TRIGRAM_SIZE <= length; i++) {
+        const guint32 t = DBUSLOG_TRIGRAM(ptr + i);
+        DBusLogCaptureTrigram* tri = g_hash_table_lookup(self->trigrams,
+            GUINT_TO_POINTER(t));
+
+        if (!tri) {
+            tri = g_slice_new(DBusLogCaptureTrigram);
+            tri->trigram = t;
+            tri->last_block = block;
+            tri->blocks = g_byte_array_new();
+            dbus_log_capture_put_varint(tri->blocks, block);
+            g_hash_table_insert(self->trigrams, GUINT_TO_POINTER(t), tri);
+        } else if (tri->last_block != block) {
+            dbus_log_capture_put_varint(tri->blocks, block - tri->last_block);
+            tri->last_block = block;
+        }
+    }
+}
+
+static
+gint
+dbus_log_capture_writer_trigram_compare(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const DBusLogCaptureTrigram* t1 = *(DBusLogCaptureTrigram**)a;
+    const DBusLogCaptureTrigram* t2 = *(DBusLogCaptureTrigram**)b;
+
+    return (t1->trigram < t2->trigram) ? -1 :
+        (t1->trigram > t2->trigram) ? 1 : 0;
+}
+
+static
+void
+dbus_log_capture_writer_trigrams(
+    DBusLogCaptureWriter* self)
+{
+    GPtrArray* list = g_ptr_array_sized_new(g_hash_table_size(self->trigrams));
+    GHashTableIter it;
+    gpointer value;
+    guint i;
+
+    g_hash_table_iter_init(&it, self->trigrams);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        g_ptr_array_add(list, value);
+    }
+    g_ptr_array_sort(list, dbus_log_capture_writer_trigram_compare);
+    for (i = 0; i < list->len; i++) {
+        const DBusLogCaptureTrigram* tri = list->pdata[i];
+        guchar prefix[DBUSLOG_CAPTURE_TRIGRAM_PREFIX_SIZE];
+
+        dbus_log_capture_put_uint32(prefix, tri->trigram);
+        dbus_log_capture_writer_record(self, DBUSLOG_CAPTURE_RECORD_TRIGRAM,
+            prefix, sizeof(prefix), tri->blocks->data, tri->blocks->len);
+    }
+    g_ptr_array_free(list, TRUE);
+}
+
+DBusLogCaptureWriter*
+dbus_log_capture_writer_new(
+    const char* path)
+{
+    FILE* f = fopen(path, "wb");
+
+    if (f) {
+        guchar header[DBUSLOG_CAPTURE_HEADER_SIZE];
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, DBUSLOG_CAPTURE_MAGIC, DBUSLOG_CAPTURE_MAGIC_SIZE);
+        dbus_log_capture_put_uint32(header + DBUSLOG_CAPTURE_MAGIC_SIZE,
+            DBUSLOG_CAPTURE_VERSION);
+        if (fwrite(header, sizeof(header), 1, f) == 1) {
+            DBusLogCaptureWriter* self = g_new0(DBusLogCaptureWriter, 1);
+
+            self->f = f;
+            self->path = g_strdup(path);
+            self->pos = sizeof(header);
+            self->categories = dbus_log_capture_categories_new();
+            self->blocks = dbus_log_capture_blocks_new();
+            self->block.offset = self->pos;
+            return self;
+        }
+        GERR("Failed to write %s: %s", path, strerror(errno));
+        fclose(f);
+    } else {
+        GERR("Failed to create %s: %s", path, strerror(errno));
+    }
+    return NULL;
+}
+
+gboolean
+dbus_log_capture_writer_index_text(
+    DBusLogCaptureWriter* self)
+{
+    /* The index has to cover every block */
+    if (G_LIKELY(self) && !self->blocks->len && !self->block.count) {
+        if (!self->trigrams) {
+            self->trigrams = g_hash_table_new_full(g_direct_hash,
+                g_direct_equal, NULL, dbus_log_capture_writer_trigram_free);
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_capture_writer_write(
+    DBusLogCaptureWriter* self,
+    const DBusLogCategory* category,
+    DBusLogMessage* message)
+{
+    if (G_LIKELY(self) && G_LIKELY(message)) {
+        DBusLogCaptureBlock* block = &self->block;
+        const char* text = dbus_log_message_text(message);
+        guchar prefix[DBUSLOG_MESSAGE_PREFIX_SIZE];
+
+        if (category && !g_hash_table_contains(self->categories,
+            GUINT_TO_POINTER(category->id))) {
+            dbus_log_capture_add_category(self->categories, category->id,
+                category->flags, category->name);
+            dbus_log_capture_writer_category(self, category);
+        }
+
+        if (block->count) {
+            if (block->min_ts > message->timestamp) {
+                block->min_ts = message->timestamp;
+            }
+            if (block->max_ts < message->timestamp) {
+                block->max_ts = message->timestamp;
+            }
+        } else {
+            block->first_index = message->index;
+            block->min_ts = block->max_ts = message->timestamp;
+        }
+        block->count++;
+        dbus_log_capture_writer_mark_category(self, message->category);
+        if (self->trigrams) {
+            dbus_log_capture_writer_index_message(self, text,
+                message->length);
+        }
+
+        dbus_log_capture_put_uint64(prefix, message->timestamp);
+        dbus_log_capture_put_uint32(prefix + 8, message->index);
+        dbus_log_capture_put_uint32(prefix + 12, message->category);
+        prefix[16] = (guchar)message->level;
+        dbus_log_capture_writer_record(self, DBUSLOG_PACKET_TYPE_MESSAGE,
+            prefix, sizeof(prefix), text, message->length);
+
+        if (block->count >= DBUSLOG_CAPTURE_BLOCK_MAX_COUNT ||
+            (self->pos - block->offset) >= DBUSLOG_CAPTURE_BLOCK_MAX_SIZE) {
+            dbus_log_capture_writer_finish_block(self);
+        }
+        return !self->failed;
+    }
+    return FALSE;
+}
+
+void
+dbus_log_capture_writer_close(
+    DBusLogCaptureWriter* self)
+{
+    if (G_LIKELY(self)) {
+        GPtrArray* categories;
+        guchar trailer[DBUSLOG_CAPTURE_TRAILER_SIZE];
+        guint64 index_pos;
+        guint i;
+
+        dbus_log_capture_writer_finish_block(self);
+
+        /* Index */
+        index_pos = self->pos;
+        categories = dbus_log_category_values(self->categories);
+        for (i = 0; i < categories->len; i++) {
+            dbus_log_capture_writer_category(self, categories->pdata[i]);
+        }
+        g_ptr_array_free(categories, TRUE);
+        for (i = 0; i < self->blocks->len; i++) {
+            dbus_log_capture_writer_block(self, &g_array_index(self->blocks,
+                DBusLogCaptureBlock, i));
+        }
+        if (self->trigrams) {
+            dbus_log_capture_writer_trigrams(self);
+        }
+
+        /* Trailer */
+        dbus_log_capture_put_uint64(trailer, index_pos);
+        memcpy(trailer + 8, DBUSLOG_CAPTURE_INDEX_MAGIC,
+            DBUSLOG_CAPTURE_MAGIC_SIZE);
+        if ((fwrite(trailer, sizeof(trailer), 1, self->f) != 1 ||
+            fclose(self->f)) && !self->failed) {
+            GERR("Failed to write %s: %s", self->path, strerror(errno));
+        }
+
+        dbus_log_capture_block_clear(&self->block);
+        g_array_free(self->blocks, TRUE);
+        g_hash_table_destroy(self->categories);
+        if (self->trigrams) {
+            g_hash_table_destroy(self->trigrams);
+        }
+        g_free(self->path);
+        g_free(self);
+    }
+}
+
+/*==========================================================================*
+ * Reader
+ *==========================================================================*/
+
+static
+gboolean
+dbus_log_capture_reader_header(
+    DBusLogCaptureReader* self,
+    guchar* type,
+    guint32* size)
+{
+    guchar header[DBUSLOG_PACKET_HEADER_SIZE];
+
+    if (fread(header, sizeof(header), 1, self->f) == 1) {
+        *type = header[DBUSLOG_PACKET_TYPE_OFFSET];
+        *size = dbus_log_capture_get_uint32(header +
+            DBUSLOG_PACKET_SIZE_OFFSET);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Reads the payload of the record into the buffer */
+static
+gboolean
+dbus_log_capture_reader_payload(
+    DBusLogCaptureReader* self,
+    guint32 size)
+{
+    g_byte_array_set_size(self->buf, size);
+    return !size || fread(self->buf->data, size, 1, self->f) == 1;
+}
+
+/*
+ * Picks up the categories and blocks from the records between pos and
+ * end. Returns the position of the first incomplete record (or end),
+ * and the position right after the last block record. Blocks must not
+ * overlap, which takes care of the partially written index when the
+ * whole file is being scanned.
+ */
+static
+guint64
+dbus_log_capture_reader_load(
+    DBusLogCaptureReader* self,
+    guint64 pos,
+    guint64 end,
+    guint64* last_block_end)
+{
+    guint64 next_block = DBUSLOG_CAPTURE_HEADER_SIZE;
+    guchar type;
+    guint32 size;
+
+    *last_block_end = pos;
+    if (fseeko(self->f, pos, SEEK_SET)) {
+        return pos;
+    }
+    while (pos < end && dbus_log_capture_reader_header(self, &type, &size) &&
+        (pos + DBUSLOG_PACKET_HEADER_SIZE + size) <= end) {
+        const guchar* data = NULL;
+
+        if (type == DBUSLOG_CAPTURE_RECORD_CATEGORY ||
+            type == DBUSLOG_CAPTURE_RECORD_BLOCK) {
+            if (!dbus_log_capture_reader_payload(self, size)) {
+                break;
+            }
+            data = self->buf->data;
+        } else if (type == DBUSLOG_CAPTURE_RECORD_TRIGRAM &&
+            size >= DBUSLOG_CAPTURE_TRIGRAM_PREFIX_SIZE) {
+            guchar prefix[DBUSLOG_CAPTURE_TRIGRAM_PREFIX_SIZE];
+            DBusLogCapturePosting posting;
+
+            /* The list itself is only read when it's needed */
+            if (fread(prefix, sizeof(prefix), 1, self->f) != 1 ||
+                fseeko(self->f, size - sizeof(prefix), SEEK_CUR)) {
+                break;
+            }
+            posting.trigram = dbus_log_capture_get_uint32(prefix);
+            posting.offset = pos + DBUSLOG_PACKET_HEADER_SIZE +
+                sizeof(prefix);
+            posting.size = size - sizeof(prefix);
+            g_array_append_vals(self->postings, &posting, 1);
+        } else if (fseeko(self->f, size, SEEK_CUR)) {
+            /* Don't need to look at the messages */
+            break;
+        }
+        pos += DBUSLOG_PACKET_HEADER_SIZE + size;
+        if (type == DBUSLOG_CAPTURE_RECORD_CATEGORY &&
+            size >= DBUSLOG_CAPTURE_CATEGORY_PREFIX_SIZE) {
+            char* name = g_strndup((const char*)data +
+                DBUSLOG_CAPTURE_CATEGORY_PREFIX_SIZE, size -
+                DBUSLOG_CAPTURE_CATEGORY_PREFIX_SIZE);
+
+            dbus_log_capture_add_category(self->categories,
+                dbus_log_capture_get_uint32(data),
+                dbus_log_capture_get_uint32(data + 4), name);
+            g_free(name);
+        } else if (type == DBUSLOG_CAPTURE_RECORD_BLOCK &&
+            size >= DBUSLOG_CAPTURE_BLOCK_PREFIX_SIZE) {
+            DBusLogCaptureBlock block;
+
+            block.offset = dbus_log_capture_get_uint64(data);
+            block.size = dbus_log_capture_get_uint64(data + 8);
+            block.min_ts = dbus_log_capture_get_uint64(data + 16);
+            block.max_ts = dbus_log_capture_get_uint64(data + 24);
+            block.first_index = dbus_log_capture_get_uint32(data + 32);
+            block.count = dbus_log_capture_get_uint32(data + 36);
+            if (block.offset < next_block) {
+                continue;
+            }
+            block.bitmap_size = size - DBUSLOG_CAPTURE_BLOCK_PREFIX_SIZE;
+            block.bitmap = NULL;
+            if (block.bitmap_size) {
+                block.bitmap = g_malloc(block.bitmap_size);
+                memcpy(block.bitmap, data + DBUSLOG_CAPTURE_BLOCK_PREFIX_SIZE,
+                    block.bitmap_size);
+            }
+            g_array_append_vals(self->blocks, &block, 1);
+            next_block = block.offset + block.size;
+            *last_block_end = pos;
+        }
+    }
+    return pos;
+}
+
+static
+gint
+dbus_log_capture_posting_compare(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const DBusLogCapturePosting* p1 = a;
+    const DBusLogCapturePosting* p2 = b;
+
+    return (p1->trigram < p2->trigram) ? -1 :
+        (p1->trigram > p2->trigram) ? 1 : 0;
+}
+
+static
+gboolean
+dbus_log_capture_reader_load_index(
+    DBusLogCaptureReader* self,
+    guint64 file_size)
+{
+    guchar trailer[DBUSLOG_CAPTURE_TRAILER_SIZE];
+
+    if (file_size >= (DBUSLOG_CAPTURE_HEADER_SIZE +
+        DBUSLOG_CAPTURE_TRAILER_SIZE) &&
+        !fseeko(self->f, file_size - sizeof(trailer), SEEK_SET) &&
+        fread(trailer, sizeof(trailer), 1, self->f) == 1 &&
+        !memcmp(trailer + 8, DBUSLOG_CAPTURE_INDEX_MAGIC,
+        DBUSLOG_CAPTURE_MAGIC_SIZE)) {
+        const guint64 index_pos = dbus_log_capture_get_uint64(trailer);
+        const guint64 index_end = file_size - sizeof(trailer);
+        guint64 last_block_end;
+
+        if (index_pos >= DBUSLOG_CAPTURE_HEADER_SIZE &&
+            index_pos <= index_end &&
+            dbus_log_capture_reader_load(self, index_pos, index_end,
+            &last_block_end) == index_end) {
+            g_array_sort(self->postings, dbus_log_capture_posting_compare);
+            return TRUE;
+        }
+        GWARN("Corrupted capture file index");
+        g_array_set_size(self->postings, 0);
+        g_array_set_size(self->blocks, 0);
+        g_hash_table_remove_all(self->categories);
+    }
+    return FALSE;
+}
+
+static
+void
+dbus_log_capture_reader_scan(
+    DBusLogCaptureReader* self,
+    guint64 file_size)
+{
+    guint64 last_block_end;
+    const guint64 end = dbus_log_capture_reader_load(self,
+        DBUSLOG_CAPTURE_HEADER_SIZE, file_size, &last_block_end);
+
+    GDEBUG("No capture index, scanned %" G_GUINT64_FORMAT " bytes", end);
+    g_array_set_size(self->postings, 0);
+    if (end > last_block_end) {
+        DBusLogCaptureBlock block;
+
+        /* Whatever follows the last complete block */
+        memset(&block, 0, sizeof(block));
+        block.offset = last_block_end;
+        block.size = end - last_block_end;
+        block.min_ts = G_MININT64;
+        block.max_ts = G_MAXINT64;
+        g_array_append_vals(self->blocks, &block, 1);
+    }
+}
+
+static
+gboolean
+dbus_log_capture_reader_block_matches(
+    DBusLogCaptureReader* self,
+    guint i)
+{
+    const DBusLogCaptureBlock* block = &g_array_index(self->blocks,
+        DBusLogCaptureBlock, i);
+
+    if (block->max_ts < self->since ||
+        (self->text_blocks && !self->text_blocks[i])) {
+        return FALSE;
+    } else if (self->category && block->bitmap_size) {
+        const guint byte = self->category / 8;
+
+        return byte < block->bitmap_size &&
+            (block->bitmap[byte] & (1 << (self->category % 8)));
+    } else {
+        return TRUE;
+    }
+}
+
+static
+const DBusLogCapturePosting*
+dbus_log_capture_reader_posting(
+    DBusLogCaptureReader* self,
+    guint32 trigram)
+{
+    const DBusLogCapturePosting* postings = (DBusLogCapturePosting*)
+        self->postings->data;
+    guint low = 0, high = self->postings->len;
+
+    while (low < high) {
+        const guint mid = (low + high) / 2;
+
+        if (postings[mid].trigram < trigram) {
+            low = mid + 1;
+        } else if (postings[mid].trigram > trigram) {
+            high = mid;
+        } else {
+            return postings + mid;
+        }
+    }
+    return NULL;
+}
+
+/* Marks the blocks containing the trigram */
+static
+void
+dbus_log_capture_reader_trigram_blocks(
+    DBusLogCaptureReader* self,
+    guint32 trigram,
+    guchar* blocks)
+{
+    const DBusLogCapturePosting* posting =
+        dbus_log_capture_reader_posting(self, trigram);
+    const guint n = self->blocks->len;
+
+    memset(blocks, 0, n);
+    if (posting) {
+        if (!fseeko(self->f, posting->offset, SEEK_SET) &&
+            dbus_log_capture_reader_payload(self, posting->size)) {
+            const guchar* ptr = self->buf->data;
+            const guchar* end = ptr + self->buf->len;
+            guint32 block = 0, delta;
+
+            while ((ptr = dbus_log_capture_get_varint(ptr, end, &delta))) {
+                block += delta;
+                if (block < n) {
+                    blocks[block] = TRUE;
+                }
+            }
+        } else {
+            /* Don't miss anything because of the I/O error */
+            memset(blocks, TRUE, n);
+        }
+    }
+}
+
+/* Candidate blocks for the query, NULL if it's all of them */
+static
+guchar*
+dbus_log_capture_reader_text_blocks(
+    DBusLogCaptureReader* self,
+    DBusLogTrigramQuery* query)
+{
+    const guint n = self->blocks->len;
+
+    if (query && query->alternatives && self->postings->len && n) {
+        guchar* result = g_new0(guchar, n);
+        guchar* alt = g_new(guchar, n);
+        guchar* blocks = g_new(guchar, n);
+        guint i, k, t;
+
+        for (i = 0; i < query->alternatives->len; i++) {
+            GArray* trigrams = query->alternatives->pdata[i];
+
+            memset(alt, TRUE, n);
+            for (t = 0; t < trigrams->len; t++) {
+                dbus_log_capture_reader_trigram_blocks(self,
+                    g_array_index(trigrams, guint32, t), blocks);
+                for (k = 0; k < n; k++) {
+                    alt[k] &= blocks[k];
+                }
+            }
+            for (k = 0; k < n; k++) {
+                result[k] |= alt[k];
+            }
+        }
+        g_free(alt);
+        g_free(blocks);
+        return result;
+    }
+    return NULL;
+}
+
+static
+void
+dbus_log_capture_reader_rewind(
+    DBusLogCaptureReader* self)
+{
+    self->next_block = 0;
+    self->pos = self->block_end = 0;
+}
+
+DBusLogCaptureReader*
+dbus_log_capture_reader_new(
+    const char* path)
+{
+    FILE* f = fopen(path, "rb");
+
+    if (f) {
+        guchar header[DBUSLOG_CAPTURE_HEADER_SIZE];
+
+        if (fread(header, sizeof(header), 1, f) == 1 &&
+            !memcmp(header, DBUSLOG_CAPTURE_MAGIC,
+            DBUSLOG_CAPTURE_MAGIC_SIZE)) {
+            const guint32 version = dbus_log_capture_get_uint32(header +
+                DBUSLOG_CAPTURE_MAGIC_SIZE);
+
+            if (version == DBUSLOG_CAPTURE_VERSION &&
+                !fseeko(f, 0, SEEK_END)) {
+                DBusLogCaptureReader* self =
+                    g_new0(DBusLogCaptureReader, 1);
+                const guint64 file_size = ftello(f);
+
+                self->f = f;
+                self->buf = g_byte_array_new();
+                self->categories = dbus_log_capture_categories_new();
+                self->blocks = dbus_log_capture_blocks_new();
+                self->postings = g_array_new(FALSE, FALSE,
+                    sizeof(DBusLogCapturePosting));
+                if (!dbus_log_capture_reader_load_index(self, file_size)) {
+                    dbus_log_capture_reader_scan(self, file_size);
+                }
+                return self;
+            }
+            GERR("Unsupported capture file version %u", version);
+        } else {
+            GERR("%s is not a capture file", path);
+        }
+        fclose(f);
+    } else {
+        GERR("Failed to open %s: %s", path, strerror(errno));
+    }
+    return NULL;
+}
+
+void
+dbus_log_capture_reader_free(
+    DBusLogCaptureReader* self)
+{
+    if (G_LIKELY(self)) {
+        fclose(self->f);
+        dbus_log_trigram_query_free(self->query);
+        g_free(self->text_blocks);
+        g_byte_array_unref(self->buf);
+        g_array_free(self->postings, TRUE);
+        g_array_free(self->blocks, TRUE);
+        g_hash_table_destroy(self->categories);
+        g_free(self);
+    }
+}
+
+DBusLogCategory*
+dbus_log_capture_reader_category(
+    DBusLogCaptureReader* self,
+    guint32 id)
+{
+    return G_LIKELY(self) ? g_hash_table_lookup(self->categories,
+        GUINT_TO_POINTER(id)) : NULL;
+}
+
+DBusLogCategory*
+dbus_log_capture_reader_find_category(
+    DBusLogCaptureReader* self,
+    const char* name)
+{
+    if (G_LIKELY(self) && G_LIKELY(name)) {
+        GHashTableIter it;
+        gpointer value;
+
+        g_hash_table_iter_init(&it, self->categories);
+        while (g_hash_table_iter_next(&it, NULL, &value)) {
+            DBusLogCategory* cat = value;
+
+            if (!strcmp(cat->name, name)) {
+                return cat;
+            }
+        }
+    }
+    return NULL;
+}
+
+void
+dbus_log_capture_reader_seek_time(
+    DBusLogCaptureReader* self,
+    gint64 timestamp)
+{
+    if (G_LIKELY(self)) {
+        self->since = timestamp;
+        dbus_log_capture_reader_rewind(self);
+    }
+}
+
+void
+dbus_log_capture_reader_set_category(
+    DBusLogCaptureReader* self,
+    guint32 id)
+{
+    if (G_LIKELY(self)) {
+        self->category = id;
+        dbus_log_capture_reader_rewind(self);
+    }
+}
+
+gboolean
+dbus_log_capture_reader_set_content_filter(
+    DBusLogCaptureReader* self,
+    const GStrV* substrings,
+    const char* regex,
+    GError** error)
+{
+    if (G_LIKELY(self)) {
+        GRegex* re = NULL;
+
+        if (regex && regex[0]) {
+            /* Log messages aren't necessarily valid UTF-8 */
+            re = g_regex_new(regex, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, error);
+            if (!re) {
+                return FALSE;
+            }
+        }
+        dbus_log_trigram_query_free(self->query);
+        g_free(self->text_blocks);
+        self->query = dbus_log_trigram_query_new(substrings, re);
+        self->text_blocks = dbus_log_capture_reader_text_blocks(self,
+            self->query);
+        if (re) {
+            g_regex_unref(re);
+        }
+        dbus_log_capture_reader_rewind(self);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+DBusLogMessage*
+dbus_log_capture_reader_next(
+    DBusLogCaptureReader* self,
+    DBusLogCategory** category)
+{
+    if (G_LIKELY(self)) {
+        while (TRUE) {
+            if (self->pos < self->block_end) {
+                const guchar* data;
+                guint32 size;
+                guchar type;
+
+                /* The record must not stick out of its block */
+                if (self->block_end - self->pos < DBUSLOG_PACKET_HEADER_SIZE ||
+                    !dbus_log_capture_reader_header(self, &type, &size) ||
+                    size > (self->block_end - self->pos -
+                    DBUSLOG_PACKET_HEADER_SIZE) ||
+                    !dbus_log_capture_reader_payload(self, size)) {
+                    /* Truncated or corrupted file */
+                    self->next_block = self->blocks->len;
+                    self->pos = self->block_end = 0;
+                    break;
+                }
+                data = self->buf->data;
+                self->pos += DBUSLOG_PACKET_HEADER_SIZE + size;
+                if (type == DBUSLOG_PACKET_TYPE_MESSAGE &&
+                    size >= DBUSLOG_MESSAGE_PREFIX_SIZE) {
+                    const gint64 ts = dbus_log_capture_get_uint64(data);
+                    const guint32 id = dbus_log_capture_get_uint32(data + 12);
+
+                    if (ts >= self->since &&
+                        (!self->category || self->category == id) &&
+                        (!self->query || dbus_log_trigram_query_match(
+                        self->query, (const char*)data +
+                        DBUSLOG_MESSAGE_PREFIX_SIZE, size -
+                        DBUSLOG_MESSAGE_PREFIX_SIZE))) {
+                        DBusLogMessage* msg = dbus_log_message_new_len((char*)
+                            data + DBUSLOG_MESSAGE_PREFIX_SIZE, size -
+                            DBUSLOG_MESSAGE_PREFIX_SIZE);
+
+                        msg->timestamp = ts;
+                        msg->index = dbus_log_capture_get_uint32(data + 8);
+                        msg->category = id;
+                        msg->level = data[16];
+                        if (category) {
+                            *category = g_hash_table_lookup(self->categories,
+                                GUINT_TO_POINTER(id));
+                        }
+                        return msg;
+                    }
+                }
+            } else {
+                const DBusLogCaptureBlock* block = NULL;
+
+                /* Skip the blocks which have nothing for us */
+                while (self->next_block < self->blocks->len && !block) {
+                    const guint i = self->next_block++;
+
+                    if (dbus_log_capture_reader_block_matches(self, i)) {
+                        block = &g_array_index(self->blocks,
+                            DBusLogCaptureBlock, i);
+                    }
+                }
+                if (!block || fseeko(self->f, block->offset, SEEK_SET)) {
+                    break;
+                }
+                self->pos = block->offset;
+                self->block_end = block->offset + block->size;
+            }
+        }
+    }
+    if (category) {
+        *category = NULL;
+    }
+    return NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -41,6 +41,8 @@
 
 #include <gio/gunixfdlist.h>
 
+#include <unistd.h>
+
 /* Generated headers */
 #include "org.nemomobile.Logger.h"
 
@@ -67,8 +69,9 @@ enum dbus_log_client_proxy_signal {
 };
 
 enum dbus_log_client_receiver_signal {
-    RECEIVER_SIGNAL_MESSAGE,
+    RECEIVER_SIGNAL_MESSAGES,
     RECEIVER_SIGNAL_SKIP,
+    RECEIVER_SIGNAL_DROPPED,
     RECEIVER_SIGNAL_CLOSED,
     RECEIVER_SIGNAL_COUNT
 };
@@ -95,6 +98,7 @@ struct dbus_log_client_priv {
     gulong proxy_signal_id[PROXY_SIGNAL_COUNT];
     DBusLogReceiver* receiver;
     gulong receiver_signal_id[RECEIVER_SIGNAL_COUNT];
+    DBusLogClientStats stats;
 };
 
 typedef GObjectClass DBusLogClientClass;
@@ -114,7 +118,9 @@ enum dbus_log_client_signal {
     SIGNAL_LOG_START_ERROR,
     SIGNAL_LOG_STARTED_CHANGED,
     SIGNAL_LOG_MESSAGE,
+    SIGNAL_LOG_MESSAGES,
     SIGNAL_LOG_SKIP,
+    SIGNAL_LOG_DROPPED,
     SIGNAL_COUNT
 };
 
@@ -127,7 +133,9 @@ enum dbus_log_client_signal {
 #define SIGNAL_LOG_START_ERROR_NAME     "dbuslog-client-log-start-error"
 #define SIGNAL_LOG_STARTED_CHANGED_NAME "dbuslog-client-log-started-changed"
 #define SIGNAL_LOG_MESSAGE_NAME         "dbuslog-client-log-message"
+#define SIGNAL_LOG_MESSAGES_NAME        "dbuslog-client-log-messages"
 #define SIGNAL_LOG_SKIP_NAME            "dbuslog-client-log-skip"
+#define SIGNAL_LOG_DROPPED_NAME         "dbuslog-client-log-dropped"
 
 static guint dbus_log_client_signals[SIGNAL_COUNT] = { 0 };
 
@@ -190,6 +198,30 @@ dbus_log_client_category(
         NULL;
 }
 
+/*
+ * The public array is kept sorted by name. Returns the position of
+ * the first category which is not less than the name, i.e. where
+ * the category with this name is or would be inserted.
+ */
+static
+guint
+dbus_log_client_category_position(
+    GPtrArray* categories,
+    const char* name)
+{
+    guint lo = 0, hi = categories->len;
+    while (lo < hi) {
+        const guint mid = (lo + hi) / 2;
+        const DBusLogCategory* cat = g_ptr_array_index(categories, mid);
+        if (g_strcmp0(cat->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 static
 gint
 dbus_log_client_category_index(
@@ -197,10 +229,16 @@ dbus_log_client_category_index(
     DBusLogCategory* category)
 {
     if (category) {
-        guint i;
-        for (i=0; i<self->categories->len; i++) {
-            if (g_ptr_array_index(self->categories, i) == category) {
+        GPtrArray* categories = self->categories;
+        guint i = dbus_log_client_category_position(categories,
+            category->name);
+        /* Names are unique on the server side but let's be careful */
+        for (; i<categories->len; i++) {
+            DBusLogCategory* cat = g_ptr_array_index(categories, i);
+            if (cat == category) {
                 return i;
+            } else if (g_strcmp0(cat->name, category->name)) {
+                break;
             }
         }
     }
@@ -270,26 +308,13 @@ dbus_log_client_category_remove(
     DBusLogCategory* category = dbus_log_client_category(self, id);
     const int index = dbus_log_client_category_index(self, category);
     if (index >= 0) {
-        guint i;
         DBusLogClientPriv* priv = self->priv;
-        GPtrArray* old_array = self->categories;
-        GPtrArray* new_array = g_ptr_array_new_full(old_array->len-1,
-            dbus_log_category_free);
         GDEBUG_("%d (%s)", index, category->name);
-        for (i=0; i<(guint)index; i++) {
-            g_ptr_array_add(new_array, dbus_log_category_ref(
-                g_ptr_array_index(old_array, i)));
-        }
-        for (i++; i<old_array->len; i++) {
-            g_ptr_array_add(new_array, dbus_log_category_ref(
-                g_ptr_array_index(old_array, i)));
-        }
-        self->categories = new_array;
-        GVERIFY(g_hash_table_remove(priv->categories, GINT_TO_POINTER(id)));
         dbus_log_category_ref(category);
+        g_ptr_array_remove_index(self->categories, index);
+        GVERIFY(g_hash_table_remove(priv->categories, GINT_TO_POINTER(id)));
         dbus_log_client_emit(self, SIGNAL_CATEGORY_REMOVED, category, index);
         dbus_log_category_unref(category);
-        g_ptr_array_unref(old_array);
         return TRUE;
     } else {
         return FALSE;
@@ -319,10 +344,7 @@ dbus_log_client_category_added(
     DBusLogClient* self = DBUSLOG_CLIENT(user_data);
     DBusLogClientPriv* priv = self->priv;
     DBusLogCategory* category = dbus_log_category_new(name, id);
-    GPtrArray* old_array;
-    GPtrArray* new_array;
-    guint i;
-    int index = -1;
+    guint index;
     GDEBUG_("%s %u 0x%04x", name, id, flags);
     GVERIFY_FALSE(dbus_log_client_category_remove(self, id));
 
@@ -330,27 +352,15 @@ dbus_log_client_category_added(
     category->flags = flags;
     g_hash_table_replace(priv->categories, GINT_TO_POINTER(id), category);
 
-    /* Replace the public array */
-    old_array = self->categories;
-    new_array = dbus_log_category_values(priv->categories);
-    g_ptr_array_sort(new_array, dbus_log_category_sort_name);
-    self->categories = new_array;
-
-    /* Find the index of the new category */
-    for (i=0; i<new_array->len; i++) {
-        if (g_ptr_array_index(new_array, i) !=
-            g_ptr_array_index(old_array, i)) {
-            index = i;
-            break;
-        }
-    }
+    /* Insert it into the public array, keeping it sorted */
+    index = dbus_log_client_category_position(self->categories, name);
+    g_ptr_array_insert(self->categories, index,
+        dbus_log_category_ref(category));
 
     /* Notify the listeners */
-    GASSERT(index >= 0);
     dbus_log_category_ref(category);
     dbus_log_client_emit(self, SIGNAL_CATEGORY_ADDED, category, index);
     dbus_log_category_unref(category);
-    g_ptr_array_unref(old_array);
 }
 
 static
@@ -374,19 +384,55 @@ dbus_log_client_category_flags_changed(
    }
 }
 
+/*
+ * The receiver hands over everything it has parsed in one go. Each
+ * message is emitted separately only if someone is listening to that
+ * signal, the batch goes out with a single emission.
+ */
 static
 void
-dbus_log_client_receiver_message(
+dbus_log_client_receiver_messages(
     DBusLogReceiver* receiver,
-    DBusLogMessage* msg,
+    DBusLogMessage** msgs,
+    guint count,
     gpointer user_data)
 {
     DBusLogClient* self = DBUSLOG_CLIENT(user_data);
-    DBusLogCategory* category = dbus_log_client_category(self, msg->category);
-    GVERBOSE_("%s", msg->string);
-    dbus_log_category_ref(category);
-    dbus_log_client_emit(self, SIGNAL_LOG_MESSAGE, category, msg);
-    dbus_log_category_unref(category);
+    DBusLogClientPriv* priv = self->priv;
+    const gboolean each = g_signal_has_handler_pending(self,
+        dbus_log_client_signals[SIGNAL_LOG_MESSAGE], 0, FALSE);
+    GArray* batch = g_signal_has_handler_pending(self,
+        dbus_log_client_signals[SIGNAL_LOG_MESSAGES], 0, FALSE) ?
+        g_array_sized_new(FALSE, FALSE, sizeof(DBusLogClientMessage),
+        count) : NULL;
+    guint i;
+
+    dbus_log_client_ref(self);
+    /* Stop if one of the handlers stops the log */
+    for (i=0; i<count && priv->receiver == receiver; i++) {
+        DBusLogClientMessage entry;
+        entry.message = msgs[i];
+        entry.category = dbus_log_client_category(self,
+            entry.message->category);
+        GVERBOSE_("%s", entry.message->string);
+        if (each) {
+            dbus_log_category_ref(entry.category);
+            g_signal_emit(self, dbus_log_client_signals[SIGNAL_LOG_MESSAGE],
+                0, entry.category, entry.message);
+            dbus_log_category_unref(entry.category);
+        }
+        if (batch) {
+            g_array_append_vals(batch, &entry, 1);
+        }
+    }
+    if (batch) {
+        if (batch->len) {
+            g_signal_emit(self, dbus_log_client_signals[SIGNAL_LOG_MESSAGES],
+                0, batch->data, batch->len);
+        }
+        g_array_free(batch, TRUE);
+    }
+    dbus_log_client_unref(self);
 }
 
 static
@@ -400,6 +446,18 @@ dbus_log_client_receiver_skip(
     dbus_log_client_emit(DBUSLOG_CLIENT(user_data), SIGNAL_LOG_SKIP, count);
 }
 
+static
+void
+dbus_log_client_receiver_dropped(
+    DBusLogReceiver* receiver,
+    const DBusLogDropReport* report,
+    gpointer user_data)
+{
+    GVERBOSE_("%u", report->count);
+    dbus_log_client_emit(DBUSLOG_CLIENT(user_data), SIGNAL_LOG_DROPPED,
+        report);
+}
+
 static
 void
 dbus_log_client_receiver_closed(
@@ -414,22 +472,29 @@ static
 void
 dbus_log_client_started(
     DBusLogClient* self,
-    int fd,
+    DBusLogReceiver* receiver,
     int cookie)
 {
     DBusLogClientPriv* priv = self->priv;
     const gboolean was_started = self->started;
     dbus_log_client_stop(self, FALSE);
     priv->cookie = cookie;
-    priv->receiver = dbus_log_receiver_new(fd, TRUE);
+    priv->receiver = receiver;
+    memset(&priv->stats, 0, sizeof(priv->stats));
     self->started = (priv->receiver != NULL);
     if (priv->receiver) {
-        priv->receiver_signal_id[RECEIVER_SIGNAL_MESSAGE] =
-            dbus_log_receiver_add_message_handler(priv->receiver,
-                dbus_log_client_receiver_message, self);
+        if (priv->flags & DBUSLOG_CLIENT_FLAG_THREAD) {
+            dbus_log_receiver_start_thread(priv->receiver);
+        }
+        priv->receiver_signal_id[RECEIVER_SIGNAL_MESSAGES] =
+            dbus_log_receiver_add_messages_handler(priv->receiver,
+                dbus_log_client_receiver_messages, self);
         priv->receiver_signal_id[RECEIVER_SIGNAL_SKIP] =
             dbus_log_receiver_add_skip_handler(priv->receiver,
                 dbus_log_client_receiver_skip, self);
+        priv->receiver_signal_id[RECEIVER_SIGNAL_DROPPED] =
+            dbus_log_receiver_add_dropped_handler(priv->receiver,
+                dbus_log_client_receiver_dropped, self);
         priv->receiver_signal_id[RECEIVER_SIGNAL_CLOSED] =
             dbus_log_receiver_add_closed_handler(priv->receiver,
                 dbus_log_client_receiver_closed, self);
@@ -766,6 +831,15 @@ dbus_log_client_unref(
     }
 }
 
+static
+gboolean
+dbus_log_client_use_shm(
+    DBusLogClient* self)
+{
+    return self->api_version >= 5 &&
+        (self->priv->flags & DBUSLOG_CLIENT_FLAG_SHM);
+}
+
 static
 void
 dbus_log_client_start_finished(
@@ -778,11 +852,46 @@ dbus_log_client_start_finished(
     guint cookie;
     GUnixFDList* fdl = NULL;
     GError* error = NULL;
-    if (org_nemomobile_logger_call_log_open_finish(
+    const int api_version = call->client->api_version;
+    if (dbus_log_client_use_shm(call->client)) {
+        GVariant* data = NULL;
+        GVariant* space = NULL;
+        if (org_nemomobile_logger_call_log_open_shm_finish(
+            ORG_NEMOMOBILE_LOGGER(proxy), &fd, &data, &space, &cookie,
+            &fdl, result, &error)) {
+            gint i, n = 0;
+            gint* fds = g_unix_fd_list_steal_fds(fdl, &n);
+            if (n == 3) {
+                /* The receiver takes ownership of the descriptors */
+                dbus_log_client_started(call->client,
+                    dbus_log_receiver_new_shm(fds[0], fds[1], fds[2]),
+                    cookie);
+            } else {
+                for (i = 0; i < n; i++) {
+                    close(fds[i]);
+                }
+            }
+            g_free(fds);
+            g_variant_unref(fd);
+            g_variant_unref(data);
+            g_variant_unref(space);
+            g_object_unref(fdl);
+        } else {
+            GERR("Failed to start logging: %s", GERRMSG(error));
+            dbus_log_client_emit(call->client, SIGNAL_LOG_START_ERROR, error);
+        }
+    } else if (api_version >= 4 ?
+        org_nemomobile_logger_call_log_open3_finish(
+        ORG_NEMOMOBILE_LOGGER(proxy), &fd, &cookie, &fdl, result, &error) :
+        api_version >= 3 ?
+        org_nemomobile_logger_call_log_open2_finish(
+        ORG_NEMOMOBILE_LOGGER(proxy), &fd, &cookie, &fdl, result, &error) :
+        org_nemomobile_logger_call_log_open_finish(
         ORG_NEMOMOBILE_LOGGER(proxy), &fd, &cookie, &fdl, result, &error)) {
         if (g_unix_fd_list_get_length(fdl) == 1) {
             gint* fds = g_unix_fd_list_steal_fds(fdl, NULL);
-            dbus_log_client_started(call->client, fds[0], cookie);
+            dbus_log_client_started(call->client,
+                dbus_log_receiver_new(fds[0], TRUE), cookie);
             g_free(fds);
         }
         g_variant_unref(fd);
@@ -805,14 +914,49 @@ dbus_log_client_start(
     DBusLogClient* self,
     DBusLogClientCallFunc fn,
     gpointer data)
+{
+    return dbus_log_client_start_with_history(self, 0, 0, fn, data);
+}
+
+DBusLogClientCall*
+dbus_log_client_start_with_history(
+    DBusLogClient* self,
+    guint flags,
+    guint history,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
 {
     DBusLogClientCall* call = NULL;
     if (G_LIKELY(self)) {
         DBusLogClientPriv* priv = self->priv;
         if (priv->proxy) {
+            /* Let the server skip formatting and batch the messages,
+             * DBusLogReceiver takes care of both */
+            flags = (flags & DBUSLOG_OPEN_FLAG_HISTORY_SINCE) |
+                DBUSLOG_OPEN_FLAG_BINARY | DBUSLOG_OPEN_FLAG_BATCH;
+            if (self->api_version >= 7) {
+                /* Tell us when the server has to drop something */
+                flags |= DBUSLOG_OPEN_FLAG_DROP_REPORT;
+            }
             call = dbus_log_client_call_new(self, NULL, fn, data);
-            org_nemomobile_logger_call_log_open(priv->proxy, NULL,
-                call->cancel, dbus_log_client_start_finished, call);
+            if (dbus_log_client_use_shm(self)) {
+                /* Default size of the shared memory ring */
+                org_nemomobile_logger_call_log_open_shm(priv->proxy,
+                    flags, history, 0, NULL, call->cancel,
+                    dbus_log_client_start_finished, call);
+            } else if (self->api_version >= 4) {
+                org_nemomobile_logger_call_log_open3(priv->proxy,
+                    flags, history, NULL, call->cancel,
+                    dbus_log_client_start_finished, call);
+            } else if (self->api_version >= 3) {
+                /* No history, only the new messages */
+                org_nemomobile_logger_call_log_open2(priv->proxy,
+                    flags & ~DBUSLOG_OPEN_FLAG_HISTORY_SINCE, NULL,
+                    call->cancel, dbus_log_client_start_finished, call);
+            } else {
+                org_nemomobile_logger_call_log_open(priv->proxy, NULL,
+                    call->cancel, dbus_log_client_start_finished, call);
+            }
         }
     }
     return call;
@@ -1000,6 +1144,209 @@ dbus_log_client_disable_pattern(
     return call;
 }
 
+DBusLogClientCall*
+dbus_log_client_set_pipe_size(
+    DBusLogClient* self,
+    guint size,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 6) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_set_pipe_size_finish, fn, data);
+            org_nemomobile_logger_call_set_pipe_size(priv->proxy,
+                priv->cookie, size, call->cancel,
+                dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+DBusLogClientCall*
+dbus_log_client_set_overflow_policy(
+    DBusLogClient* self,
+    DBUSLOG_OVERFLOW policy,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 7) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_set_overflow_policy_finish,
+                fn, data);
+            org_nemomobile_logger_call_set_overflow_policy(priv->proxy,
+                priv->cookie, policy, call->cancel,
+                dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+DBusLogClientCall*
+dbus_log_client_session_set_level(
+    DBusLogClient* self,
+    DBUSLOG_LEVEL level,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 8) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_session_set_level_finish,
+                fn, data);
+            dbus_log_receiver_set_filtered(priv->receiver, TRUE);
+            org_nemomobile_logger_call_session_set_level(priv->proxy,
+                priv->cookie, level, call->cancel,
+                dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+DBusLogClientCall*
+dbus_log_client_session_set_category_level(
+    DBusLogClient* self,
+    const char* name,
+    DBUSLOG_LEVEL level,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && G_LIKELY(name) && self->api_version >= 8) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_session_set_category_level_finish,
+                fn, data);
+            dbus_log_receiver_set_filtered(priv->receiver, TRUE);
+            org_nemomobile_logger_call_session_set_category_level(
+                priv->proxy, priv->cookie, name, level, call->cancel,
+                dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+DBusLogClientCall*
+dbus_log_client_session_set_categories(
+    DBusLogClient* self,
+    const GStrV* names,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 8) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            static const char* none[] = { NULL };
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_session_set_categories_finish,
+                fn, data);
+            dbus_log_receiver_set_filtered(priv->receiver, TRUE);
+            org_nemomobile_logger_call_session_set_categories(priv->proxy,
+                priv->cookie, names ? (const gchar* const*)names : none,
+                call->cancel, dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+DBusLogClientCall*
+dbus_log_client_session_set_content_filter(
+    DBusLogClient* self,
+    const GStrV* substrings,
+    const char* regex,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 9) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            static const char* none[] = { NULL };
+            call = dbus_log_client_call_new(self,
+                org_nemomobile_logger_call_session_set_content_filter_finish,
+                fn, data);
+            dbus_log_receiver_set_filtered(priv->receiver, TRUE);
+            org_nemomobile_logger_call_session_set_content_filter(
+                priv->proxy, priv->cookie, substrings ?
+                (const gchar* const*)substrings : none, regex ? regex : "",
+                call->cancel, dbus_log_client_generic_call_finished, call);
+        }
+    }
+    return call;
+}
+
+static
+void
+dbus_log_client_get_stats_finished(
+    GObject* proxy,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    DBusLogClientCall* call = user_data;
+    GVariant* dict = NULL;
+    GError* error = NULL;
+    if (org_nemomobile_logger_call_get_statistics_finish(
+        ORG_NEMOMOBILE_LOGGER(proxy), &dict, result, &error)) {
+        DBusLogClientStats* stats = &call->client->priv->stats;
+        /* Keys which aren't there are left untouched */
+        g_variant_lookup(dict, DBUSLOG_STATS_PIPE_SIZE, "u",
+            &stats->pipe_size);
+        g_variant_lookup(dict, DBUSLOG_STATS_MAX_PIPE_SIZE, "u",
+            &stats->max_pipe_size);
+        g_variant_lookup(dict, DBUSLOG_STATS_PIPE_RESIZE_COUNT, "u",
+            &stats->pipe_resize_count);
+        g_variant_lookup(dict, DBUSLOG_STATS_DROPPED_COUNT, "t",
+            &stats->dropped_count);
+        g_variant_lookup(dict, DBUSLOG_STATS_DROPPED_BYTES, "t",
+            &stats->dropped_bytes);
+        g_variant_unref(dict);
+    } else {
+        GERR("%s", GERRMSG(error));
+    }
+    if (call->fn) {
+        call->fn(call, error, call->user_data);
+    }
+    if (error) {
+        g_error_free(error);
+    }
+    dbus_log_client_call_free(call);
+}
+
+DBusLogClientCall*
+dbus_log_client_update_stats(
+    DBusLogClient* self,
+    DBusLogClientCallFunc fn,
+    gpointer data) /* Since 1.0.23 */
+{
+    DBusLogClientCall* call = NULL;
+    if (G_LIKELY(self) && self->api_version >= 6) {
+        DBusLogClientPriv* priv = self->priv;
+        if (priv->proxy && priv->cookie) {
+            call = dbus_log_client_call_new(self, NULL, fn, data);
+            org_nemomobile_logger_call_get_statistics(priv->proxy,
+                priv->cookie, call->cancel,
+                dbus_log_client_get_stats_finished, call);
+        }
+    }
+    return call;
+}
+
+const DBusLogClientStats*
+dbus_log_client_stats(
+    DBusLogClient* self) /* Since 1.0.23 */
+{
+    return G_LIKELY(self) ? &self->priv->stats : NULL;
+}
+
 void
 dbus_log_client_call_cancel(
     DBusLogClientCall* call)
@@ -1101,6 +1448,16 @@ dbus_log_client_add_message_handler(
         SIGNAL_LOG_MESSAGE_NAME, G_CALLBACK(fn), user_data) : 0;
 }
 
+gulong
+dbus_log_client_add_messages_handler(
+    DBusLogClient* self,
+    DBusLogClientMessagesFunc fn,
+    gpointer user_data) /* Since 1.0.23 */
+{
+    return (G_LIKELY(self) && G_LIKELY(fn)) ? g_signal_connect(self,
+        SIGNAL_LOG_MESSAGES_NAME, G_CALLBACK(fn), user_data) : 0;
+}
+
 gulong
 dbus_log_client_add_skip_handler(
     DBusLogClient* self,
@@ -1111,6 +1468,16 @@ dbus_log_client_add_skip_handler(
         SIGNAL_LOG_SKIP_NAME, G_CALLBACK(fn), user_data) : 0;
 }
 
+gulong
+dbus_log_client_add_dropped_handler(
+    DBusLogClient* self,
+    DBusLogClientDropFunc fn,
+    gpointer user_data) /* Since 1.0.23 */
+{
+    return (G_LIKELY(self) && G_LIKELY(fn)) ? g_signal_connect(self,
+        SIGNAL_LOG_DROPPED_NAME, G_CALLBACK(fn), user_data) : 0;
+}
+
 void
 dbus_log_client_remove_handler(
     DBusLogClient* self,
@@ -1225,10 +1592,18 @@ dbus_log_client_class_init(
         g_signal_new(SIGNAL_LOG_MESSAGE_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
             G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_POINTER);
+    dbus_log_client_signals[SIGNAL_LOG_MESSAGES] =
+        g_signal_new(SIGNAL_LOG_MESSAGES_NAME, class_type,
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_UINT);
     dbus_log_client_signals[SIGNAL_LOG_SKIP] =
         g_signal_new(SIGNAL_LOG_SKIP_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
             G_TYPE_NONE, 1, G_TYPE_UINT);
+    dbus_log_client_signals[SIGNAL_LOG_DROPPED] =
+        g_signal_new(SIGNAL_LOG_DROPPED_NAME, class_type,
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 1, G_TYPE_POINTER);
 }
 
 /*
@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_reader.h"
+#include "dbuslog_protocol.h"
+#include "dbuslog_client_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Messages are parsed straight from the buffer, which means that the
+ * buffer can't be touched until the caller is done with the previous
+ * batch. Hence, the pipe is only read when there's no complete packet
+ * left in the buffer and no message has been returned by this call.
+ * A message batch packet may get split between several calls, in which
+ * case it stays at the head of the buffer and batch_pos points to the
+ * next message in it.
+ */
+#define DBUSLOG_READER_BUF_SIZE (0x10000)
+
+struct dbus_log_reader {
+    int fd;
+    gboolean close_when_done;
+    gboolean eof;
+    guchar* buf;
+    gsize buf_size;
+    gsize buf_start;
+    gsize buf_end;
+    gsize batch_pos;
+    gint64 batch_timestamp;
+    guint32 batch_index;
+    gboolean message_received;
+    gboolean filtered;
+    guint32 last_message_index;
+    guint64 skipped;
+    guint64 dropped;
+    GHashTable* formats;
+    GString* text;          /* Formatted text, reused batch after batch */
+    GArray* text_offsets;   /* Where each formatted message starts */
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+inline static
+guint32
+dbus_log_reader_get_uint32(
+    const guchar* packet,
+    guint offset)
+{
+    const guchar* ptr = packet + offset;
+    return ((guint32)(ptr[3]) << 24) |
+        ((guint32)(ptr[2]) << 16) |
+        ((guint32)(ptr[1]) << 8) |
+        ptr[0];
+}
+
+inline static
+guint64
+dbus_log_reader_get_uint64(
+    const guchar* packet,
+    guint offset)
+{
+    return ((guint64)dbus_log_reader_get_uint32(packet, offset)) |
+        (((guint64)dbus_log_reader_get_uint32(packet, offset + 4)) << 32);
+}
+
+static
+const guchar*
+dbus_log_reader_get_varint(
+    const guchar* ptr,
+    const guchar* end,
+    guint64* value)
+{
+    guint64 result = 0;
+    guint shift;
+
+    for (shift = 0; ptr < end && shift < 64; shift += 7) {
+        const guchar b = *ptr++;
+
+        result |= ((guint64)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+inline static
+gsize
+dbus_log_reader_packet_size(
+    const guchar* packet)
+{
+    return DBUSLOG_PACKET_HEADER_SIZE + dbus_log_reader_get_uint32(packet,
+        DBUSLOG_PACKET_SIZE_OFFSET);
+}
+
+static
+void
+dbus_log_reader_check_index(
+    DBusLogReader* self,
+    guint32 index)
+{
+    /* Indices going backwards don't mean that anything has been lost */
+    const gint32 skipped = self->message_received ?
+        (gint32)(index - (self->last_message_index + 1)) : 0;
+
+    /* Gaps left by the session filter are expected */
+    if (skipped > 0 && !self->filtered) {
+        self->skipped += skipped;
+    }
+    if (skipped >= 0) {
+        self->last_message_index = index;
+    }
+    self->message_received = TRUE;
+}
+
+static
+void
+dbus_log_reader_fill_message(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msg,
+    const guchar* packet)
+{
+    msg->timestamp = dbus_log_reader_get_uint64(packet,
+        DBUSLOG_MESSAGE_TIMESTAMP_OFFSET);
+    msg->index = dbus_log_reader_get_uint32(packet,
+        DBUSLOG_MESSAGE_INDEX_OFFSET);
+    msg->category = dbus_log_reader_get_uint32(packet,
+        DBUSLOG_MESSAGE_CATEGORY_OFFSET);
+    msg->level = packet[DBUSLOG_MESSAGE_LEVEL_OFFSET];
+    dbus_log_reader_check_index(self, msg->index);
+}
+
+static
+void
+dbus_log_reader_format_message(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msg,
+    const guchar* packet,
+    gsize size)
+{
+    const gsize fixed = DBUSLOG_PACKET_HEADER_SIZE +
+        DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE;
+    const guint32 id = dbus_log_reader_get_uint32(packet,
+        DBUSLOG_BINARY_MESSAGE_FORMAT_OFFSET);
+    DBusLogFormat* fmt = g_hash_table_lookup(self->formats,
+        GUINT_TO_POINTER(id));
+    const gsize start = self->text->len;
+
+    dbus_log_reader_fill_message(self, msg, packet);
+    if (fmt) {
+        if (!dbus_log_format_unpack_append(fmt, packet + fixed,
+            size - fixed, self->text)) {
+            /* Better than nothing */
+            g_string_append(self->text, fmt->format);
+        }
+    } else {
+        GWARN("Unknown format id %u", id);
+    }
+
+    /*
+     * The arena may move as it grows, the pointer is filled in by
+     * dbus_log_reader_next_batch once the whole batch is formatted.
+     */
+    msg->length = self->text->len - start;
+    msg->text = NULL;
+    g_array_append_val(self->text_offsets, start);
+}
+
+/* Returns FALSE if the batch is finished (or broken) */
+static
+gboolean
+dbus_log_reader_unpack_next(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msg)
+{
+    const guchar* packet = self->buf + self->buf_start;
+    const guchar* ptr = packet + self->batch_pos;
+    const guchar* end = packet + dbus_log_reader_packet_size(packet);
+    guint64 delta, category, len;
+    guchar level = DBUSLOG_LEVEL_UNDEFINED;
+
+    if (ptr >= end) {
+        return FALSE;
+    }
+
+    if ((ptr = dbus_log_reader_get_varint(ptr, end, &delta)) &&
+        (ptr = dbus_log_reader_get_varint(ptr, end, &category)) &&
+        ptr < end) {
+        level = *ptr++;
+        ptr = dbus_log_reader_get_varint(ptr, end, &len);
+    } else {
+        ptr = NULL;
+    }
+    if (!ptr || len > (guint64)(end - ptr)) {
+        GWARN("Malformed message batch");
+        return FALSE;
+    }
+
+    /* Zigzag decoding */
+    self->batch_timestamp += (delta >> 1) ^ (-(delta & 1));
+    msg->timestamp = self->batch_timestamp;
+    msg->index = self->batch_index++;
+    msg->category = (guint32)category;
+    msg->level = level;
+    msg->length = len;
+    msg->text = (const char*)ptr;
+    dbus_log_reader_check_index(self, msg->index);
+    self->batch_pos = (ptr + len) - packet;
+    return TRUE;
+}
+
+/* Returns TRUE if the packet produced a message */
+static
+gboolean
+dbus_log_reader_handle_packet(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msg,
+    const guchar* packet,
+    gsize size)
+{
+    const guchar type = packet[DBUSLOG_PACKET_TYPE_OFFSET];
+    gsize fixed = DBUSLOG_PACKET_HEADER_SIZE;
+
+    switch (type) {
+    case DBUSLOG_PACKET_TYPE_MESSAGE:
+        fixed += DBUSLOG_MESSAGE_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_FORMAT:
+        fixed += DBUSLOG_FORMAT_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_BINARY_MESSAGE:
+        fixed += DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_MESSAGE_BATCH:
+        fixed += DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_DROPPED:
+        fixed += DBUSLOG_DROPPED_PREFIX_SIZE;
+        break;
+    }
+
+    if (size < fixed) {
+        GWARN("Packet type %u is too short (%u bytes)", type, (guint)size);
+        return FALSE;
+    }
+
+    switch (type) {
+    case DBUSLOG_PACKET_TYPE_PING:
+        break;
+    case DBUSLOG_PACKET_TYPE_BYE:
+        GDEBUG("Bye");
+        self->eof = TRUE;
+        break;
+    case DBUSLOG_PACKET_TYPE_MESSAGE:
+        dbus_log_reader_fill_message(self, msg, packet);
+        msg->length = size - fixed;
+        msg->text = (const char*)packet + fixed;
+        return TRUE;
+    case DBUSLOG_PACKET_TYPE_BINARY_MESSAGE:
+        dbus_log_reader_format_message(self, msg, packet, size);
+        return TRUE;
+    case DBUSLOG_PACKET_TYPE_MESSAGE_BATCH:
+        /* Messages are picked up one by one by dbus_log_reader_parse */
+        self->batch_pos = fixed;
+        self->batch_timestamp = dbus_log_reader_get_uint64(packet,
+            DBUSLOG_MESSAGE_BATCH_TIMESTAMP_OFFSET);
+        self->batch_index = dbus_log_reader_get_uint32(packet,
+            DBUSLOG_MESSAGE_BATCH_INDEX_OFFSET);
+        break;
+    case DBUSLOG_PACKET_TYPE_DROPPED:
+        self->dropped += dbus_log_reader_get_uint32(packet,
+            DBUSLOG_DROPPED_COUNT_OFFSET);
+        break;
+    case DBUSLOG_PACKET_TYPE_FORMAT:
+        {
+            const guint32 id = dbus_log_reader_get_uint32(packet,
+                DBUSLOG_FORMAT_ID_OFFSET);
+            char* format = g_strndup((const char*)packet + fixed,
+                size - fixed);
+
+            g_hash_table_replace(self->formats, GUINT_TO_POINTER(id),
+                dbus_log_format_new(format, id));
+            g_free(format);
+        }
+        break;
+    default:
+        GDEBUG("Unexpected packet type %u", type);
+        break;
+    }
+    return FALSE;
+}
+
+/* Parses complete packets, returns the number of messages */
+static
+guint
+dbus_log_reader_parse(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msgs,
+    guint max)
+{
+    guint n = 0;
+
+    while (n < max) {
+        const guchar* packet = self->buf + self->buf_start;
+        const gsize avail = self->buf_end - self->buf_start;
+        gsize size;
+
+        if (self->batch_pos) {
+            /* In the middle of a message batch */
+            if (dbus_log_reader_unpack_next(self, msgs + n)) {
+                n++;
+                continue;
+            }
+            self->batch_pos = 0;
+            self->buf_start += dbus_log_reader_packet_size(packet);
+            continue;
+        }
+
+        if (self->eof || avail < DBUSLOG_PACKET_HEADER_SIZE ||
+            avail < (size = dbus_log_reader_packet_size(packet))) {
+            break;
+        }
+
+        /* Message batch stays in the buffer until it's fully unpacked */
+        if (dbus_log_reader_handle_packet(self, msgs + n, packet, size)) {
+            n++;
+        }
+        if (!self->batch_pos) {
+            self->buf_start += size;
+        }
+    }
+    return n;
+}
+
+/* Returns TRUE if something has been read. Moves the data around. */
+static
+gboolean
+dbus_log_reader_read(
+    DBusLogReader* self)
+{
+    const gsize avail = self->buf_end - self->buf_start;
+    gsize needed = DBUSLOG_READER_BUF_SIZE;
+    ssize_t bytes_read;
+
+    /* Move the incomplete packet to the beginning of the buffer */
+    if (self->buf_start > 0) {
+        memmove(self->buf, self->buf + self->buf_start, avail);
+        self->buf_start = 0;
+        self->buf_end = avail;
+    }
+
+    /* Make sure that the whole packet fits */
+    if (avail >= DBUSLOG_PACKET_HEADER_SIZE) {
+        needed = MAX(needed, dbus_log_reader_packet_size(self->buf));
+    }
+    if (self->buf_size < needed) {
+        self->buf_size = needed;
+        self->buf = g_realloc(self->buf, needed);
+    }
+
+    bytes_read = read(self->fd, self->buf + self->buf_end,
+        self->buf_size - self->buf_end);
+    if (bytes_read > 0) {
+        self->buf_end += bytes_read;
+        return TRUE;
+    } else if (!bytes_read) {
+        GDEBUG("End of stream");
+        self->eof = TRUE;
+    } else if (errno == EINTR) {
+        return TRUE;
+    } else if (errno != EAGAIN) {
+        GERR("Read failed: %s", strerror(errno));
+        self->eof = TRUE;
+    }
+    return FALSE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogReader*
+dbus_log_reader_new(
+    int fd,
+    gboolean close_when_done)
+{
+    if (fd >= 0) {
+        DBusLogReader* self = g_new0(DBusLogReader, 1);
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (flags >= 0 && !(flags & O_NONBLOCK)) {
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        self->fd = fd;
+        self->close_when_done = close_when_done;
+        self->buf_size = DBUSLOG_READER_BUF_SIZE;
+        self->buf = g_malloc(self->buf_size);
+        self->formats = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+            NULL, dbus_log_format_free);
+        self->text = g_string_new(NULL);
+        self->text_offsets = g_array_new(FALSE, FALSE, sizeof(gsize));
+        return self;
+    }
+    return NULL;
+}
+
+void
+dbus_log_reader_free(
+    DBusLogReader* self)
+{
+    if (G_LIKELY(self)) {
+        if (self->close_when_done) {
+            close(self->fd);
+        }
+        g_hash_table_destroy(self->formats);
+        g_string_free(self->text, TRUE);
+        g_array_free(self->text_offsets, TRUE);
+        g_free(self->buf);
+        g_free(self);
+    }
+}
+
+int
+dbus_log_reader_fd(
+    DBusLogReader* self)
+{
+    return G_LIKELY(self) ? self->fd : -1;
+}
+
+int
+dbus_log_reader_next_batch(
+    DBusLogReader* self,
+    DBusLogReaderMessage* msgs,
+    guint max)
+{
+    if (G_LIKELY(self) && G_LIKELY(msgs || !max)) {
+        guint i, k;
+        guint n;
+
+        /* The caller is done with the previous batch */
+        g_string_truncate(self->text, 0);
+        g_array_set_size(self->text_offsets, 0);
+
+        /* Zero means that the pipe has been drained */
+        n = dbus_log_reader_parse(self, msgs, max);
+        while (!n && max && !self->eof && dbus_log_reader_read(self)) {
+            n = dbus_log_reader_parse(self, msgs, max);
+        }
+
+        /* Point the formatted messages to their text */
+        for (i = 0, k = 0; i < n && k < self->text_offsets->len; i++) {
+            if (!msgs[i].text) {
+                msgs[i].text = self->text->str +
+                    g_array_index(self->text_offsets, gsize, k++);
+            }
+        }
+        return (n || !self->eof) ? (int)n : -1;
+    }
+    return -1;
+}
+
+void
+dbus_log_reader_set_filtered(
+    DBusLogReader* self,
+    gboolean filtered)
+{
+    if (G_LIKELY(self)) {
+        self->filtered = filtered;
+    }
+}
+
+guint64
+dbus_log_reader_skipped(
+    DBusLogReader* self)
+{
+    return G_LIKELY(self) ? self->skipped : 0;
+}
+
+guint64
+dbus_log_reader_dropped(
+    DBusLogReader* self)
+{
+    return G_LIKELY(self) ? self->dropped : 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -38,22 +38,78 @@
 
 #include <glib-object.h>
 
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
 /* Log module */
 GLOG_MODULE_DEFINE("dbuslog");
 
+/*
+ * Everything available in the pipe is read into one buffer and all
+ * complete packets are parsed straight from there. The buffer only
+ * grows beyond the default size if a packet doesn't fit into it.
+ *
+ * With the shared memory transport, packets are parsed straight from
+ * the ring. The buffer is only used for packets larger than the ring.
+ */
+#define DBUSLOG_RECEIVER_BUF_SIZE (0x10000)
+
+/*
+ * In the threaded mode, the pipe is read and parsed by a dedicated
+ * thread, which hands the results over to the thread which created
+ * the receiver through a single-producer single-consumer ring. When
+ * the ring is full, the reader blocks and the pipe (or the shared
+ * memory ring) fills up, just like it does when the receiver is paused.
+ */
+#define DBUSLOG_RECEIVER_QUEUE_SIZE (0x1000) /* Must be a power of 2 */
+#define DBUSLOG_RECEIVER_QUEUE_MASK (DBUSLOG_RECEIVER_QUEUE_SIZE - 1)
+
+typedef enum dbus_log_receiver_event_type {
+    DBUSLOG_RECEIVER_EVENT_MESSAGE,     /* data is DBusLogMessage */
+    DBUSLOG_RECEIVER_EVENT_DROPPED,     /* data is DBusLogDropReport */
+    DBUSLOG_RECEIVER_EVENT_CLOSED       /* no data */
+} DBUSLOG_RECEIVER_EVENT_TYPE;
+
+typedef struct dbus_log_receiver_event {
+    DBUSLOG_RECEIVER_EVENT_TYPE type;
+    gpointer data;
+} DBusLogReceiverEvent;
+
 /* Object definition */
 struct dbus_log_receiver {
     GObject object;
     GIOChannel* io;
     int paused;
     guint read_watch_id;
+    guint parse_id;
     guint32 last_message_index;
     gboolean message_received;
-    guchar packet[DBUSLOG_PACKET_MAX_FIXED_PART];
-    guint packet_size;
-    guint packet_fixed_part;
-    guint packet_read;
-    char* packet_buffer;
+    gboolean filtered;
+    guchar* buf;
+    gsize buf_size;
+    gsize buf_start;
+    gsize buf_end;
+    DBusLogShm* shm;
+    int spacefd;
+    GHashTable* formats;
+    GPtrArray* batch;
+    gboolean batching;
+    gboolean per_message;
+    /* Threaded mode */
+    gboolean threaded;
+    GThread* thread;
+    GMainContext* context;
+    GMainLoop* loop;
+    GIOChannel* notify;
+    DBusLogReceiverEvent* queue;
+    gint head;      /* Only written by the consumer */
+    gint tail;      /* Only written by the reader thread */
+    gint notified;
+    gint waiting;
+    gint stop;
+    GMutex mutex;
+    GCond cond;
 };
 
 typedef GObjectClass DBusLogReceiverClass;
@@ -65,13 +121,17 @@ G_DEFINE_TYPE(DBusLogReceiver, dbus_log_receiver, G_TYPE_OBJECT)
 
 enum dbus_log_receiver_signal {
     DBUSLOG_RECEIVER_SIGNAL_MESSAGE,
+    DBUSLOG_RECEIVER_SIGNAL_MESSAGES,
     DBUSLOG_RECEIVER_SIGNAL_SKIP,
+    DBUSLOG_RECEIVER_SIGNAL_DROPPED,
     DBUSLOG_RECEIVER_SIGNAL_CLOSED,
     DBUSLOG_RECEIVER_SIGNAL_COUNT
 };
 
 #define DBUSLOG_RECEIVER_SIGNAL_MESSAGE_NAME    "dbuslog-receiver-message"
+#define DBUSLOG_RECEIVER_SIGNAL_MESSAGES_NAME   "dbuslog-receiver-messages"
 #define DBUSLOG_RECEIVER_SIGNAL_SKIP_NAME       "dbuslog-receiver-skip"
+#define DBUSLOG_RECEIVER_SIGNAL_DROPPED_NAME    "dbuslog-receiver-dropped"
 #define DBUSLOG_RECEIVER_SIGNAL_CLOSED_NAME     "dbuslog-receiver-closed"
 
 static guint dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_COUNT] = { 0 };
@@ -106,10 +166,10 @@ dbus_log_receiver_read_chars(
 inline static
 guint32
 dbus_log_receiver_get_uint32(
-    DBusLogReceiver* self,
+    const guchar* packet,
     guint offset)
 {
-    const guchar* ptr = self->packet + offset;
+    const guchar* ptr = packet + offset;
     return ((guint32)(ptr[3]) << 24) |
         ((guint32)(ptr[2]) << 16) |
         ((guint32)(ptr[1]) << 8) |
@@ -119,147 +179,561 @@ dbus_log_receiver_get_uint32(
 inline static
 guint64
 dbus_log_receiver_get_uint64(
-    DBusLogReceiver* self,
+    const guchar* packet,
     guint offset)
 {
-    return ((guint64)dbus_log_receiver_get_uint32(self, offset)) |
-        (((guint64)dbus_log_receiver_get_uint32(self, offset + 4)) << 32);
+    return ((guint64)dbus_log_receiver_get_uint32(packet, offset)) |
+        (((guint64)dbus_log_receiver_get_uint32(packet, offset + 4)) << 32);
+}
+
+static
+const guchar*
+dbus_log_receiver_get_varint(
+    const guchar* ptr,
+    const guchar* end,
+    guint64* value)
+{
+    guint64 result = 0;
+    guint shift;
+
+    for (shift = 0; ptr < end && shift < 64; shift += 7) {
+        const guchar b = *ptr++;
+
+        result |= ((guint64)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+static
+DBusLogMessage*
+dbus_log_receiver_fill_message(
+    DBusLogMessage* msg,
+    const guchar* packet)
+{
+    msg->timestamp = dbus_log_receiver_get_uint64(packet,
+        DBUSLOG_MESSAGE_TIMESTAMP_OFFSET);
+    msg->index = dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_MESSAGE_INDEX_OFFSET);
+    msg->category = dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_MESSAGE_CATEGORY_OFFSET);
+    msg->level = packet[DBUSLOG_MESSAGE_LEVEL_OFFSET];
+    return msg;
+}
+
+static
+DBusLogMessage*
+dbus_log_receiver_format_message(
+    DBusLogReceiver* self,
+    const guchar* packet,
+    gsize size)
+{
+    const gsize fixed = DBUSLOG_PACKET_HEADER_SIZE +
+        DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE;
+    DBusLogMessage* msg = dbus_log_receiver_fill_message(
+        dbus_log_message_new(NULL), packet);
+    const guint32 id = dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_BINARY_MESSAGE_FORMAT_OFFSET);
+    DBusLogFormat* fmt = g_hash_table_lookup(self->formats,
+        GUINT_TO_POINTER(id));
+
+    if (fmt) {
+        msg->string = dbus_log_format_unpack(fmt, packet + fixed,
+            size - fixed, &msg->length);
+        if (!msg->string) {
+            /* Better than nothing */
+            msg->length = strlen(fmt->format);
+            msg->string = g_strdup(fmt->format);
+        }
+    } else {
+        GWARN("Unknown format id %u", id);
+        msg->string = g_strdup("");
+    }
+    return msg;
+}
+
+static
+void
+dbus_log_receiver_free_message(
+    gpointer msg)
+{
+    dbus_log_message_unref(msg);
 }
 
 static
+void
+dbus_log_receiver_flush(
+    DBusLogReceiver* self)
+{
+    GPtrArray* batch = self->batch;
+
+    if (batch->len) {
+        g_signal_emit(self, dbus_log_receiver_signals[
+            DBUSLOG_RECEIVER_SIGNAL_MESSAGES], 0, batch->pdata, batch->len);
+        g_ptr_array_set_size(batch, 0);
+    }
+}
+
+static
+void
+dbus_log_receiver_deliver(
+    DBusLogReceiver* self,
+    DBusLogMessage* msg)
+{
+    /* Indices going backwards don't mean that anything has been lost */
+    const gint32 skipped = self->message_received ?
+        (gint32)(msg->index - (self->last_message_index + 1)) : 0;
+
+    /* Gaps left by the session filter are expected */
+    if (skipped > 0 && !self->filtered) {
+        dbus_log_receiver_flush(self);
+        g_signal_emit(self, dbus_log_receiver_signals[
+            DBUSLOG_RECEIVER_SIGNAL_SKIP], 0, (guint)skipped);
+    }
+    if (skipped >= 0) {
+        self->last_message_index = msg->index;
+    }
+    self->message_received = TRUE;
+    if (self->batching) {
+        g_ptr_array_add(self->batch, dbus_log_message_ref(msg));
+    }
+    if (self->per_message) {
+        g_signal_emit(self, dbus_log_receiver_signals[
+            DBUSLOG_RECEIVER_SIGNAL_MESSAGE], 0, msg);
+    }
+}
+
+/* Checked once per parse rather than on every message */
+static
+void
+dbus_log_receiver_check_handlers(
+    DBusLogReceiver* self)
+{
+    self->batching = g_signal_has_handler_pending(self,
+        dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_MESSAGES], 0,
+        FALSE);
+    self->per_message = g_signal_has_handler_pending(self,
+        dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_MESSAGE], 0,
+        FALSE);
+}
+
+static
+void
+dbus_log_receiver_emit_dropped(
+    DBusLogReceiver* self,
+    const DBusLogDropReport* report)
+{
+    GDEBUG("%u message(s) dropped", report->count);
+    dbus_log_receiver_flush(self);
+    g_signal_emit(self, dbus_log_receiver_signals
+        [DBUSLOG_RECEIVER_SIGNAL_DROPPED], 0, report);
+}
+
+/* Handlers may pause or close the receiver, the reader thread is stopped */
+inline static
 gboolean
-dbus_log_receiver_read(
+dbus_log_receiver_parsing(
     DBusLogReceiver* self)
 {
-    gsize bytes_read;
+    return self->threaded ? !g_atomic_int_get(&self->stop) :
+        (!self->paused && self->io);
+}
 
-    /* Read the header */
-    if (self->packet_read < DBUSLOG_PACKET_HEADER_SIZE) {
-        if (!dbus_log_receiver_read_chars(self,
-            self->packet + self->packet_read,
-            DBUSLOG_PACKET_HEADER_SIZE - self->packet_read,
-            &bytes_read)) {
-            return FALSE;
+static
+void
+dbus_log_receiver_wake_reader(
+    DBusLogReceiver* self)
+{
+    g_mutex_lock(&self->mutex);
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->mutex);
+}
+
+/* Called on the reader thread. Takes ownership of the data. */
+static
+gboolean
+dbus_log_receiver_push(
+    DBusLogReceiver* self,
+    DBUSLOG_RECEIVER_EVENT_TYPE type,
+    gpointer data)
+{
+    const guint tail = self->tail;
+    DBusLogReceiverEvent* event;
+
+    if (tail - (guint)g_atomic_int_get(&self->head) >=
+        DBUSLOG_RECEIVER_QUEUE_SIZE) {
+        /* Wait for the consumer to catch up */
+        g_mutex_lock(&self->mutex);
+        g_atomic_int_set(&self->waiting, TRUE);
+        while (tail - (guint)g_atomic_int_get(&self->head) >=
+            DBUSLOG_RECEIVER_QUEUE_SIZE && !g_atomic_int_get(&self->stop)) {
+            g_cond_wait(&self->cond, &self->mutex);
         }
-        self->packet_read += bytes_read;
-        if (self->packet_read < DBUSLOG_PACKET_HEADER_SIZE) {
-            /* Have to wait */
-            return TRUE;
+        g_atomic_int_set(&self->waiting, FALSE);
+        g_mutex_unlock(&self->mutex);
+    }
+
+    if (g_atomic_int_get(&self->stop)) {
+        if (type == DBUSLOG_RECEIVER_EVENT_MESSAGE) {
+            dbus_log_message_unref(data);
+        } else {
+            g_free(data);
         }
+        return FALSE;
+    }
 
-        self->packet_size = dbus_log_receiver_get_uint32(self,
-            DBUSLOG_PACKET_SIZE_OFFSET) + DBUSLOG_PACKET_HEADER_SIZE;
+    event = self->queue + (tail & DBUSLOG_RECEIVER_QUEUE_MASK);
+    event->type = type;
+    event->data = data;
+    g_atomic_int_set(&self->tail, tail + 1);
 
-        switch (self->packet[DBUSLOG_PACKET_TYPE_OFFSET]) {
-        case DBUSLOG_PACKET_TYPE_PING:
-        case DBUSLOG_PACKET_TYPE_BYE:
-            GASSERT(self->packet_size == DBUSLOG_PACKET_HEADER_SIZE);
-            self->packet_fixed_part = DBUSLOG_PACKET_HEADER_SIZE;
-            break;
-        case DBUSLOG_PACKET_TYPE_MESSAGE:
-            self->packet_fixed_part = DBUSLOG_PACKET_HEADER_SIZE +
-                DBUSLOG_MESSAGE_PREFIX_SIZE;
-            break;
-        default:
-            self->packet_fixed_part = DBUSLOG_PACKET_MAX_FIXED_PART;
+    /* One wakeup is enough until the consumer gets to the queue */
+    if (g_atomic_int_compare_and_exchange(&self->notified, FALSE, TRUE)) {
+        eventfd_write(g_io_channel_unix_get_fd(self->notify), 1);
+    }
+    return TRUE;
+}
+
+/* Takes ownership of the message */
+static
+void
+dbus_log_receiver_take_message(
+    DBusLogReceiver* self,
+    DBusLogMessage* msg)
+{
+    if (self->threaded) {
+        dbus_log_receiver_push(self, DBUSLOG_RECEIVER_EVENT_MESSAGE, msg);
+    } else {
+        dbus_log_receiver_deliver(self, msg);
+        dbus_log_message_unref(msg);
+    }
+}
+
+static
+void
+dbus_log_receiver_unpack_batch(
+    DBusLogReceiver* self,
+    const guchar* packet,
+    gsize size)
+{
+    const guchar* ptr = packet + DBUSLOG_PACKET_HEADER_SIZE +
+        DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE;
+    const guchar* end = packet + size;
+    guint64 timestamp = dbus_log_receiver_get_uint64(packet,
+        DBUSLOG_MESSAGE_BATCH_TIMESTAMP_OFFSET);
+    guint32 index = dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_MESSAGE_BATCH_INDEX_OFFSET);
+
+    /* Stop if one of the handlers closes the receiver */
+    while (ptr < end && (self->threaded ? !g_atomic_int_get(&self->stop) :
+        (self->io != NULL))) {
+        DBusLogMessage* msg;
+        guint64 delta, category, len;
+        guchar level = DBUSLOG_LEVEL_UNDEFINED;
+
+        if ((ptr = dbus_log_receiver_get_varint(ptr, end, &delta)) &&
+            (ptr = dbus_log_receiver_get_varint(ptr, end, &category)) &&
+            ptr < end) {
+            level = *ptr++;
+            ptr = dbus_log_receiver_get_varint(ptr, end, &len);
+        } else {
+            ptr = NULL;
+        }
+        if (!ptr || len > (guint64)(end - ptr)) {
+            GWARN("Malformed message batch");
             break;
         }
+
+        /* Zigzag decoding */
+        timestamp += (delta >> 1) ^ (-(delta & 1));
+        msg = dbus_log_message_new_len((const char*)ptr, len);
+        msg->timestamp = timestamp;
+        msg->index = index++;
+        msg->category = (guint32)category;
+        msg->level = level;
+        ptr += len;
+        dbus_log_receiver_take_message(self, msg);
     }
+}
 
-    /* Read the fixed part of the packet */
-    if (self->packet_read < self->packet_fixed_part) {
-        if (!dbus_log_receiver_read_chars(self,
-            self->packet + self->packet_read,
-            self->packet_fixed_part - self->packet_read,
-            &bytes_read)) {
-            return FALSE;
+static
+void
+dbus_log_receiver_report_dropped(
+    DBusLogReceiver* self,
+    const guchar* packet,
+    gsize size)
+{
+    const guint32 n = dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_DROPPED_CATEGORIES_OFFSET);
+    const gsize avail = size - DBUSLOG_PACKET_HEADER_SIZE -
+        DBUSLOG_DROPPED_PREFIX_SIZE;
+
+    if (avail / DBUSLOG_DROPPED_ENTRY_SIZE < n) {
+        GWARN("Broken drop report (%u categories, %u bytes)", n, (guint)
+            size);
+    } else {
+        const guchar* ptr = packet + DBUSLOG_PACKET_HEADER_SIZE +
+            DBUSLOG_DROPPED_PREFIX_SIZE;
+        /* The counts follow the report in the same block of memory */
+        DBusLogDropReport* report = g_malloc(sizeof(DBusLogDropReport) +
+            n * sizeof(DBusLogDropCount));
+        DBusLogDropCount* counts = (DBusLogDropCount*)(report + 1);
+        guint i;
+
+        for (i = 0; i < n; i++, ptr += DBUSLOG_DROPPED_ENTRY_SIZE) {
+            counts[i].category = dbus_log_receiver_get_uint32(ptr, 0);
+            counts[i].count = dbus_log_receiver_get_uint32(ptr, 4);
         }
-        self->packet_read += bytes_read;
-        if (self->packet_read < self->packet_fixed_part) {
-            /* Have to wait */
-            return TRUE;
+        report->count = dbus_log_receiver_get_uint32(packet,
+            DBUSLOG_DROPPED_COUNT_OFFSET);
+        report->bytes = dbus_log_receiver_get_uint64(packet,
+            DBUSLOG_DROPPED_BYTES_OFFSET);
+        report->n_categories = n;
+        report->categories = n ? counts : NULL;
+        if (self->threaded) {
+            dbus_log_receiver_push(self, DBUSLOG_RECEIVER_EVENT_DROPPED,
+                report);
+        } else {
+            dbus_log_receiver_emit_dropped(self, report);
+            g_free(report);
         }
+    }
+}
 
-        if (self->packet_size > self->packet_fixed_part) {
-            /* Allocate extra byte for NULL terminator */
-            self->packet_buffer = g_malloc(self->packet_size -
-                self->packet_fixed_part + 1);
-        }
+/* Returns FALSE if no more packets are expected */
+static
+gboolean
+dbus_log_receiver_handle_packet(
+    DBusLogReceiver* self,
+    const guchar* packet,
+    gsize size)
+{
+    const guchar type = packet[DBUSLOG_PACKET_TYPE_OFFSET];
+    gsize fixed = DBUSLOG_PACKET_HEADER_SIZE;
+
+    switch (type) {
+    case DBUSLOG_PACKET_TYPE_MESSAGE:
+        fixed += DBUSLOG_MESSAGE_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_FORMAT:
+        fixed += DBUSLOG_FORMAT_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_BINARY_MESSAGE:
+        fixed += DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_MESSAGE_BATCH:
+        fixed += DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE;
+        break;
+    case DBUSLOG_PACKET_TYPE_DROPPED:
+        fixed += DBUSLOG_DROPPED_PREFIX_SIZE;
+        break;
     }
 
-    /* Read the rest of the data */
-    if (self->packet_read < self->packet_size) {
-        if (!dbus_log_receiver_read_chars(self, self->packet_buffer +
-            (self->packet_read - self->packet_fixed_part),
-            self->packet_size - self->packet_read,
-            &bytes_read)) {
-            return FALSE;
-        }
-        self->packet_read += bytes_read;
-        if (self->packet_read < self->packet_size) {
-            /* Have to wait */
-            return TRUE;
+    if (size < fixed) {
+        GWARN("Packet type %u is too short (%u bytes)", type, (guint)size);
+        return TRUE;
+    }
+
+    switch (type) {
+    case DBUSLOG_PACKET_TYPE_PING:
+        GDEBUG("Ping");
+        break;
+    case DBUSLOG_PACKET_TYPE_BYE:
+        GDEBUG("Bye");
+        return FALSE;
+    case DBUSLOG_PACKET_TYPE_MESSAGE:
+        /* Copy the text straight from the buffer into the message */
+        dbus_log_receiver_take_message(self, dbus_log_receiver_fill_message(
+            dbus_log_message_new_len((const char*)packet + fixed,
+            size - fixed), packet));
+        break;
+    case DBUSLOG_PACKET_TYPE_BINARY_MESSAGE:
+        dbus_log_receiver_take_message(self,
+            dbus_log_receiver_format_message(self, packet, size));
+        break;
+    case DBUSLOG_PACKET_TYPE_MESSAGE_BATCH:
+        dbus_log_receiver_unpack_batch(self, packet, size);
+        break;
+    case DBUSLOG_PACKET_TYPE_DROPPED:
+        dbus_log_receiver_report_dropped(self, packet, size);
+        break;
+    case DBUSLOG_PACKET_TYPE_FORMAT:
+        {
+            const guint32 id = dbus_log_receiver_get_uint32(packet,
+                DBUSLOG_FORMAT_ID_OFFSET);
+            char* format = g_strndup((const char*)packet + fixed,
+                size - fixed);
+
+            GVERBOSE("Format %u \"%s\"", id, format);
+            g_hash_table_replace(self->formats, GUINT_TO_POINTER(id),
+                dbus_log_format_new(format, id));
+            g_free(format);
         }
+        break;
+    default:
+        GDEBUG("Unexpected packet type %u", type);
+        break;
     }
+    return TRUE;
+}
+
+inline static
+gsize
+dbus_log_receiver_packet_size(
+    const guchar* packet)
+{
+    return DBUSLOG_PACKET_HEADER_SIZE + dbus_log_receiver_get_uint32(packet,
+        DBUSLOG_PACKET_SIZE_OFFSET);
+}
 
-    /* We have received the entire packet */
-    if (self->packet[DBUSLOG_PACKET_TYPE_OFFSET] ==
-        DBUSLOG_PACKET_TYPE_MESSAGE) {
-        DBusLogMessage* msg = dbus_log_message_new(NULL);
-        msg->timestamp = dbus_log_receiver_get_uint64(self,
-            DBUSLOG_MESSAGE_TIMESTAMP_OFFSET);
-        msg->index = dbus_log_receiver_get_uint32(self,
-            DBUSLOG_MESSAGE_INDEX_OFFSET);
-        msg->category = dbus_log_receiver_get_uint32(self,
-            DBUSLOG_MESSAGE_CATEGORY_OFFSET);
-        msg->level = self->packet[DBUSLOG_MESSAGE_LEVEL_OFFSET];
-
-        /* Transfer buffer ownership to DBusLogMessage */
-        if (self->packet_buffer) {
-            msg->length = self->packet_size - self->packet_fixed_part;
-            msg->string = self->packet_buffer;
-            msg->string[msg->length] = 0; /* We allocated the extra byte */
-            GASSERT(strlen(msg->string) == msg->length);
-            self->packet_buffer = NULL;
+/* Handles all complete packets in the data, returns FALSE on Bye */
+static
+gboolean
+dbus_log_receiver_parse(
+    DBusLogReceiver* self,
+    const guchar* data,
+    gsize avail,
+    gsize* consumed)
+{
+    gsize pos = 0;
+    gboolean more = TRUE;
+
+    /* Messages are batched only if someone wants them that way */
+    if (!self->threaded) {
+        dbus_log_receiver_check_handlers(self);
+    }
+
+    while (more && dbus_log_receiver_parsing(self) &&
+        (avail - pos) >= DBUSLOG_PACKET_HEADER_SIZE) {
+        const guchar* packet = data + pos;
+        const gsize size = dbus_log_receiver_packet_size(packet);
+
+        if ((avail - pos) < size) {
+            break;
         }
+        pos += size;
+        more = dbus_log_receiver_handle_packet(self, packet, size);
+    }
+    if (!self->threaded) {
+        dbus_log_receiver_flush(self);
+    }
+    *consumed = pos;
+    return more;
+}
+
+static
+gboolean
+dbus_log_receiver_parse_buf(
+    DBusLogReceiver* self)
+{
+    gsize consumed;
+    const gboolean more = dbus_log_receiver_parse(self,
+        self->buf + self->buf_start, self->buf_end - self->buf_start,
+        &consumed);
+
+    /* Closing the receiver empties the buffer */
+    if (self->io) {
+        self->buf_start += consumed;
+    }
+    return more;
+}
+
+static
+void
+dbus_log_receiver_reserve(
+    DBusLogReceiver* self,
+    gsize size)
+{
+    if (self->buf_size < size) {
+        self->buf_size = size;
+        self->buf = g_realloc(self->buf, size);
+    }
+}
 
-        if (self->message_received) {
-            const guint32 expected = self->last_message_index + 1;
-            if (msg->index != expected) {
-                guint32 skipped = (msg->index > expected) ?
-                    (msg->index - expected) : (expected - msg->index);
-                g_signal_emit(self, dbus_log_receiver_signals[
-                    DBUSLOG_RECEIVER_SIGNAL_SKIP], 0, skipped);
+static
+gboolean
+dbus_log_receiver_read_shm(
+    DBusLogReceiver* self)
+{
+    gboolean more = TRUE;
+
+    while (more && dbus_log_receiver_parsing(self)) {
+        gsize avail, used = 0;
+        const guchar* data = dbus_log_shm_peek(self->shm, &avail);
+
+        if (self->buf_end > self->buf_start) {
+            /* Assembling the packet which doesn't fit into the ring */
+            const gsize size = dbus_log_receiver_packet_size(self->buf +
+                self->buf_start);
+
+            used = MIN(avail, size - (self->buf_end - self->buf_start));
+            memcpy(self->buf + self->buf_end, data, used);
+            self->buf_end += used;
+            more = dbus_log_receiver_parse_buf(self);
+        } else {
+            more = dbus_log_receiver_parse(self, data, avail, &used);
+            if (!used && avail >= DBUSLOG_PACKET_HEADER_SIZE &&
+                dbus_log_receiver_packet_size(data) >
+                dbus_log_shm_size(self->shm)) {
+                /* This one has to be copied */
+                dbus_log_receiver_reserve(self,
+                    dbus_log_receiver_packet_size(data));
+                memcpy(self->buf, data, avail);
+                self->buf_start = 0;
+                self->buf_end = used = avail;
             }
         }
 
-        self->message_received = TRUE;
-        self->last_message_index = msg->index;
-        self->packet_size = self->packet_fixed_part = self->packet_read = 0;
-        g_signal_emit(self, dbus_log_receiver_signals[
-            DBUSLOG_RECEIVER_SIGNAL_MESSAGE], 0, msg);
-        dbus_log_message_unref(msg);
-    } else {
-        self->packet_size = self->packet_fixed_part = self->packet_read = 0;
-        if (self->packet_buffer) {
-            g_free(self->packet_buffer);
-            self->packet_buffer = NULL;
+        if (self->io && dbus_log_shm_consume(self->shm, used)) {
+            eventfd_write(self->spacefd, 1);
         }
-        switch (self->packet[DBUSLOG_PACKET_TYPE_OFFSET]) {
-        case DBUSLOG_PACKET_TYPE_PING:
-            GDEBUG("Ping");
-            break;
-        case DBUSLOG_PACKET_TYPE_BYE:
-            GDEBUG("Bye");
-            return FALSE;
-        default:
-            GDEBUG("Unexpected packet type %u",
-                self->packet[DBUSLOG_PACKET_TYPE_OFFSET]);
+        if (!used && dbus_log_shm_wait_data(self->shm)) {
+            /* Nothing to do until the server wakes us up */
             break;
         }
     }
+    return more;
+}
 
-    return TRUE;
+static
+gboolean
+dbus_log_receiver_read(
+    DBusLogReceiver* self)
+{
+    const gsize avail = self->buf_end - self->buf_start;
+    gsize bytes_read, needed = DBUSLOG_RECEIVER_BUF_SIZE;
+
+    if (self->shm) {
+        eventfd_t value;
+
+        /* Reset the eventfd counter */
+        eventfd_read(g_io_channel_unix_get_fd(self->io), &value);
+        return dbus_log_receiver_read_shm(self);
+    }
+
+    /* Move the incomplete packet to the beginning of the buffer */
+    if (self->buf_start > 0) {
+        memmove(self->buf, self->buf + self->buf_start, avail);
+        self->buf_start = 0;
+        self->buf_end = avail;
+    }
+
+    /* Make sure that the whole packet fits */
+    if (avail >= DBUSLOG_PACKET_HEADER_SIZE) {
+        needed = MAX(needed, dbus_log_receiver_packet_size(self->buf));
+    }
+    dbus_log_receiver_reserve(self, needed);
+
+    /* Read as much as there is room for */
+    if (!dbus_log_receiver_read_chars(self, self->buf + self->buf_end,
+        self->buf_size - self->buf_end, &bytes_read)) {
+        return FALSE;
+    }
+    self->buf_end += bytes_read;
+    return dbus_log_receiver_parse_buf(self);
 }
 
 static
@@ -283,6 +757,203 @@ dbus_log_receiver_read_callback(
     return disposition;
 }
 
+static
+void
+dbus_log_receiver_free_event(
+    DBusLogReceiverEvent* event)
+{
+    switch (event->type) {
+    case DBUSLOG_RECEIVER_EVENT_MESSAGE:
+        dbus_log_message_unref(event->data);
+        break;
+    case DBUSLOG_RECEIVER_EVENT_DROPPED:
+        g_free(event->data);
+        break;
+    case DBUSLOG_RECEIVER_EVENT_CLOSED:
+        break;
+    }
+}
+
+/* Delivers whatever the reader thread has queued so far */
+static
+void
+dbus_log_receiver_drain(
+    DBusLogReceiver* self)
+{
+    guint head = self->head;
+    guint tail;
+
+    /* Anything queued after this point will trigger another wakeup */
+    g_atomic_int_set(&self->notified, FALSE);
+    tail = g_atomic_int_get(&self->tail);
+    dbus_log_receiver_check_handlers(self);
+
+    /* Handlers may pause or close the receiver */
+    while (head != tail && !self->paused && self->queue) {
+        DBusLogReceiverEvent event =
+            self->queue[head & DBUSLOG_RECEIVER_QUEUE_MASK];
+
+        g_atomic_int_set(&self->head, ++head);
+        switch (event.type) {
+        case DBUSLOG_RECEIVER_EVENT_MESSAGE:
+            dbus_log_receiver_deliver(self, event.data);
+            break;
+        case DBUSLOG_RECEIVER_EVENT_DROPPED:
+            dbus_log_receiver_emit_dropped(self, event.data);
+            break;
+        case DBUSLOG_RECEIVER_EVENT_CLOSED:
+            dbus_log_receiver_flush(self);
+            dbus_log_receiver_close(self);
+            break;
+        }
+        dbus_log_receiver_free_event(&event);
+    }
+    dbus_log_receiver_flush(self);
+    if (g_atomic_int_get(&self->waiting)) {
+        dbus_log_receiver_wake_reader(self);
+    }
+}
+
+static
+gboolean
+dbus_log_receiver_notify_callback(
+    GIOChannel* source,
+    GIOCondition condition,
+    gpointer data)
+{
+    DBusLogReceiver* self = DBUSLOG_RECEIVER(data);
+    gboolean disposition;
+    dbus_log_receiver_ref(self);
+    if (condition & G_IO_IN) {
+        eventfd_t value;
+
+        /* Reset the eventfd counter */
+        eventfd_read(g_io_channel_unix_get_fd(source), &value);
+        dbus_log_receiver_drain(self);
+        disposition = G_SOURCE_CONTINUE;
+    } else {
+        self->read_watch_id = 0;
+        dbus_log_receiver_close(self);
+        disposition = G_SOURCE_REMOVE;
+    }
+    dbus_log_receiver_unref(self);
+    return disposition;
+}
+
+static
+gboolean
+dbus_log_receiver_parse_callback(
+    gpointer data)
+{
+    DBusLogReceiver* self = DBUSLOG_RECEIVER(data);
+
+    /* Packets left in the buffer when the receiver was paused */
+    self->parse_id = 0;
+    dbus_log_receiver_ref(self);
+    if (self->threaded) {
+        dbus_log_receiver_drain(self);
+    } else if (!(self->shm ? dbus_log_receiver_read_shm(self) :
+        dbus_log_receiver_parse_buf(self))) {
+        dbus_log_receiver_close(self);
+    }
+    dbus_log_receiver_unref(self);
+    return G_SOURCE_REMOVE;
+}
+
+/* Reader thread side */
+
+static
+gboolean
+dbus_log_receiver_thread_read_callback(
+    GIOChannel* source,
+    GIOCondition condition,
+    gpointer data)
+{
+    DBusLogReceiver* self = DBUSLOG_RECEIVER(data);
+    if (g_atomic_int_get(&self->stop)) {
+        return G_SOURCE_REMOVE;
+    } else if ((condition & G_IO_IN) && dbus_log_receiver_read(self)) {
+        return G_SOURCE_CONTINUE;
+    } else {
+        dbus_log_receiver_push(self, DBUSLOG_RECEIVER_EVENT_CLOSED, NULL);
+        g_main_loop_quit(self->loop);
+        return G_SOURCE_REMOVE;
+    }
+}
+
+static
+gboolean
+dbus_log_receiver_thread_quit_callback(
+    gpointer loop)
+{
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gpointer
+dbus_log_receiver_thread(
+    gpointer data)
+{
+    DBusLogReceiver* self = DBUSLOG_RECEIVER(data);
+    GSource* watch = g_io_create_watch(self->io,
+        G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL);
+
+    g_main_context_push_thread_default(self->context);
+    g_source_set_callback(watch, (GSourceFunc)
+        dbus_log_receiver_thread_read_callback, self, NULL);
+    g_source_attach(watch, self->context);
+    g_source_unref(watch);
+
+    /* The shared memory ring may already have something for us */
+    if (self->shm && !dbus_log_receiver_read_shm(self)) {
+        dbus_log_receiver_push(self, DBUSLOG_RECEIVER_EVENT_CLOSED, NULL);
+    } else {
+        g_main_loop_run(self->loop);
+    }
+    g_main_context_pop_thread_default(self->context);
+    return NULL;
+}
+
+static
+void
+dbus_log_receiver_stop_thread(
+    DBusLogReceiver* self)
+{
+    if (self->thread) {
+        guint head = self->head;
+        GSource* quit = g_idle_source_new();
+
+        /* Unblock the reader if it's waiting for space */
+        g_atomic_int_set(&self->stop, TRUE);
+        dbus_log_receiver_wake_reader(self);
+
+        g_source_set_priority(quit, G_PRIORITY_HIGH);
+        g_source_set_callback(quit, dbus_log_receiver_thread_quit_callback,
+            self->loop, NULL);
+        g_source_attach(quit, self->context);
+        g_source_unref(quit);
+        g_thread_join(self->thread);
+        self->thread = NULL;
+
+        /* Drop whatever hasn't been delivered */
+        while (head != (guint)g_atomic_int_get(&self->tail)) {
+            dbus_log_receiver_free_event(self->queue +
+                (head++ & DBUSLOG_RECEIVER_QUEUE_MASK));
+        }
+        self->head = head;
+        g_free(self->queue);
+        self->queue = NULL;
+        g_main_loop_unref(self->loop);
+        g_main_context_unref(self->context);
+        self->loop = NULL;
+        self->context = NULL;
+        g_io_channel_shutdown(self->notify, FALSE, NULL);
+        g_io_channel_unref(self->notify);
+        self->notify = NULL;
+    }
+}
+
 /*==========================================================================*
  * API
  *==========================================================================*/
@@ -308,6 +979,29 @@ dbus_log_receiver_new(
     }
 }
 
+DBusLogReceiver*
+dbus_log_receiver_new_shm(
+    int shmfd,
+    int datafd,
+    int spacefd)
+{
+    /* The mapping stays valid after the descriptor is closed */
+    DBusLogShm* shm = dbus_log_shm_map(shmfd);
+    close(shmfd);
+    if (shm) {
+        DBusLogReceiver* self = dbus_log_receiver_new(datafd, TRUE);
+        if (self) {
+            self->shm = shm;
+            self->spacefd = spacefd;
+            return self;
+        }
+        dbus_log_shm_free(shm);
+    }
+    close(datafd);
+    close(spacefd);
+    return NULL;
+}
+
 DBusLogReceiver*
 dbus_log_receiver_ref(
     DBusLogReceiver* self)
@@ -329,6 +1023,33 @@ dbus_log_receiver_unref(
     }
 }
 
+gboolean
+dbus_log_receiver_start_thread(
+    DBusLogReceiver* self)
+{
+    if (G_LIKELY(self) && self->io && !self->threaded) {
+        const int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if (fd >= 0) {
+            /* Switch the watch over to the notification channel */
+            dbus_log_receiver_pause(self);
+            self->notify = g_io_channel_unix_new(fd);
+            g_io_channel_set_close_on_unref(self->notify, TRUE);
+            self->queue = g_new(DBusLogReceiverEvent,
+                DBUSLOG_RECEIVER_QUEUE_SIZE);
+            self->context = g_main_context_new();
+            self->loop = g_main_loop_new(self->context, FALSE);
+            self->threaded = TRUE;
+            self->thread = g_thread_new("dbuslog-receiver",
+                dbus_log_receiver_thread, self);
+            dbus_log_receiver_resume(self);
+            return TRUE;
+        }
+        GERR("Failed to create eventfd: %s", strerror(errno));
+    }
+    return FALSE;
+}
+
 void
 dbus_log_receiver_pause(
     DBusLogReceiver* self)
@@ -339,6 +1060,10 @@ dbus_log_receiver_pause(
             g_source_remove(self->read_watch_id);
             self->read_watch_id = 0;
         }
+        if (self->parse_id) {
+            g_source_remove(self->parse_id);
+            self->parse_id = 0;
+        }
     }
 }
 
@@ -350,29 +1075,62 @@ dbus_log_receiver_resume(
         GASSERT(self->paused);
         if (self->paused > 0 && !(--(self->paused))) {
             GASSERT(!self->read_watch_id);
-            if (self->io) {
+            if (self->threaded) {
+                if (self->io) {
+                    self->read_watch_id = g_io_add_watch(self->notify,
+                        G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+                        dbus_log_receiver_notify_callback, self);
+                    /* Events may have been queued while we were paused */
+                    GASSERT(!self->parse_id);
+                    self->parse_id = g_idle_add(
+                        dbus_log_receiver_parse_callback, self);
+                }
+            } else if (self->io) {
                 self->read_watch_id = g_io_add_watch(self->io,
                     G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
                     dbus_log_receiver_read_callback, self);
+                if (self->shm || self->buf_end > self->buf_start) {
+                    /* The pipe may have nothing more to say */
+                    GASSERT(!self->parse_id);
+                    self->parse_id = g_idle_add(
+                        dbus_log_receiver_parse_callback, self);
+                }
             }
         }
     }
 }
 
+void
+dbus_log_receiver_set_filtered(
+    DBusLogReceiver* self,
+    gboolean filtered)
+{
+    if (G_LIKELY(self)) {
+        self->filtered = filtered;
+    }
+}
+
 void
 dbus_log_receiver_close(
     DBusLogReceiver* self)
 {
     if (G_LIKELY(self)) {
-        self->packet_size = self->packet_fixed_part = self->packet_read = 0;
-        if (self->packet_buffer) {
-            g_free(self->packet_buffer);
-            self->packet_buffer = NULL;
-        }
         if (self->read_watch_id) {
             g_source_remove(self->read_watch_id);
             self->read_watch_id = 0;
         }
+        if (self->parse_id) {
+            g_source_remove(self->parse_id);
+            self->parse_id = 0;
+        }
+        /* The reader thread has to be gone before the pipe is closed */
+        dbus_log_receiver_stop_thread(self);
+        /* The buffer may still be in use, it's freed by finalize */
+        self->buf_start = self->buf_end = 0;
+        if (self->spacefd >= 0) {
+            close(self->spacefd);
+            self->spacefd = -1;
+        }
         if (self->io) {
             g_io_channel_shutdown(self->io, FALSE, NULL);
             g_io_channel_unref(self->io);
@@ -393,6 +1151,16 @@ dbus_log_receiver_add_message_handler(
         DBUSLOG_RECEIVER_SIGNAL_MESSAGE_NAME, G_CALLBACK(fn), user_data) : 0;
 }
 
+gulong
+dbus_log_receiver_add_messages_handler(
+    DBusLogReceiver* self,
+    DBusLogReceiverMessagesFunc fn,
+    gpointer user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(fn)) ? g_signal_connect(self,
+        DBUSLOG_RECEIVER_SIGNAL_MESSAGES_NAME, G_CALLBACK(fn), user_data) : 0;
+}
+
 gulong
 dbus_log_receiver_add_skip_handler(
     DBusLogReceiver* self,
@@ -403,6 +1171,16 @@ dbus_log_receiver_add_skip_handler(
         DBUSLOG_RECEIVER_SIGNAL_SKIP_NAME, G_CALLBACK(fn), user_data) : 0;
 }
 
+gulong
+dbus_log_receiver_add_dropped_handler(
+    DBusLogReceiver* self,
+    DBusLogReceiverDropFunc fn,
+    gpointer user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(fn)) ? g_signal_connect(self,
+        DBUSLOG_RECEIVER_SIGNAL_DROPPED_NAME, G_CALLBACK(fn), user_data) : 0;
+}
+
 gulong
 dbus_log_receiver_add_closed_handler(
     DBusLogReceiver* self,
@@ -444,6 +1222,13 @@ void
 dbus_log_receiver_init(
     DBusLogReceiver* self)
 {
+    self->formats = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, dbus_log_format_free);
+    self->batch = g_ptr_array_new_with_free_func(
+        dbus_log_receiver_free_message);
+    self->spacefd = -1;
+    g_mutex_init(&self->mutex);
+    g_cond_init(&self->cond);
 }
 
 /**
@@ -459,6 +1244,24 @@ dbus_log_receiver_dispose(
     G_OBJECT_CLASS(PARENT_CLASS)->dispose(object);
 }
 
+/**
+ * Final stage of deinitialization
+ */
+static
+void
+dbus_log_receiver_finalize(
+    GObject* object)
+{
+    DBusLogReceiver* self = DBUSLOG_RECEIVER(object);
+    g_hash_table_destroy(self->formats);
+    g_ptr_array_unref(self->batch);
+    dbus_log_shm_free(self->shm);
+    g_free(self->buf);
+    g_mutex_clear(&self->mutex);
+    g_cond_clear(&self->cond);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
 /**
  * Per class initializer
  */
@@ -470,14 +1273,23 @@ dbus_log_receiver_class_init(
     GObjectClass* object_class = G_OBJECT_CLASS(klass);
     GType class_type = G_OBJECT_CLASS_TYPE(klass);
     object_class->dispose = dbus_log_receiver_dispose;
+    object_class->finalize = dbus_log_receiver_finalize;
     dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_MESSAGE] =
         g_signal_new(DBUSLOG_RECEIVER_SIGNAL_MESSAGE_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
             G_TYPE_NONE, 1, G_TYPE_POINTER);
+    dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_MESSAGES] =
+        g_signal_new(DBUSLOG_RECEIVER_SIGNAL_MESSAGES_NAME, class_type,
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_UINT);
     dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_SKIP] =
         g_signal_new(DBUSLOG_RECEIVER_SIGNAL_SKIP_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
             G_TYPE_NONE, 1, G_TYPE_UINT);
+    dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_DROPPED] =
+        g_signal_new(DBUSLOG_RECEIVER_SIGNAL_DROPPED_NAME, class_type,
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 1, G_TYPE_POINTER);
     dbus_log_receiver_signals[DBUSLOG_RECEIVER_SIGNAL_CLOSED] =
         g_signal_new(DBUSLOG_RECEIVER_SIGNAL_CLOSED_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
@@ -35,6 +35,7 @@
 
 #include "dbuslog_client_types.h"
 #include "dbuslog_message.h"
+#include "dbuslog_shm.h"
 
 typedef struct dbus_log_receiver DBusLogReceiver;
 
@@ -45,6 +46,14 @@ void
     DBusLogMessage* message,
     gpointer user_data);
 
+typedef
+void
+(*DBusLogReceiverMessagesFunc)(
+    DBusLogReceiver* receiver,
+    DBusLogMessage** messages,
+    guint count,
+    gpointer user_data);
+
 typedef
 void
 (*DBusLogReceiverSkipFunc)(
@@ -52,6 +61,13 @@ void
     guint count,
     gpointer user_data);
 
+typedef
+void
+(*DBusLogReceiverDropFunc)(
+    DBusLogReceiver* receiver,
+    const DBusLogDropReport* report,
+    gpointer user_data);
+
 typedef
 void
 (*DBusLogReceiverFunc)(
@@ -63,6 +79,13 @@ dbus_log_receiver_new(
     int fd,
     gboolean close_when_done);
 
+/* Takes ownership of all three descriptors */
+DBusLogReceiver*
+dbus_log_receiver_new_shm(
+    int shmfd,
+    int datafd,
+    int spacefd);
+
 DBusLogReceiver*
 dbus_log_receiver_ref(
     DBusLogReceiver* receiver);
@@ -71,6 +94,14 @@ void
 dbus_log_receiver_unref(
     DBusLogReceiver* receiver);
 
+/*
+ * Moves reading and parsing to a dedicated thread. The signals are
+ * still emitted on the thread which created the receiver, in batches.
+ */
+gboolean
+dbus_log_receiver_start_thread(
+    DBusLogReceiver* receiver);
+
 void
 dbus_log_receiver_pause(
     DBusLogReceiver* receiver);
@@ -79,6 +110,17 @@ void
 dbus_log_receiver_resume(
     DBusLogReceiver* receiver);
 
+/*
+ * Tells the receiver that the server is filtering the messages. Gaps
+ * in the message indices are expected then and don't get reported as
+ * skipped. Whatever the server actually loses is still reported by
+ * the dropped handlers.
+ */
+void
+dbus_log_receiver_set_filtered(
+    DBusLogReceiver* receiver,
+    gboolean filtered);
+
 void
 dbus_log_receiver_close(
     DBusLogReceiver* receiver);
@@ -89,12 +131,28 @@ dbus_log_receiver_add_message_handler(
     DBusLogReceiverMessageFunc fn,
     gpointer user_data);
 
+/*
+ * Gets all the messages parsed in one go. Skip and drop reports
+ * split the batch, so that the order of events is preserved.
+ */
+gulong
+dbus_log_receiver_add_messages_handler(
+    DBusLogReceiver* receiver,
+    DBusLogReceiverMessagesFunc fn,
+    gpointer user_data);
+
 gulong
 dbus_log_receiver_add_skip_handler(
     DBusLogReceiver* receiver,
     DBusLogReceiverSkipFunc fn,
     gpointer user_data);
 
+gulong
+dbus_log_receiver_add_dropped_handler(
+    DBusLogReceiver* receiver,
+    DBusLogReceiverDropFunc fn,
+    gpointer user_data);
+
 gulong
 dbus_log_receiver_add_closed_handler(
     DBusLogReceiver* receiver,
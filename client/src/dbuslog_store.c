@@ -0,0 +1,616 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_store.h"
+#include "dbuslog_trigram.h"
+#include "dbuslog_protocol.h"
+
+/*
+ * Messages are stored in chunks of DBUSLOG_STORE_CHUNK_SIZE rows. Each
+ * column is a plain array, and the text of all messages in the chunk
+ * lives in a single NUL-separated arena, so that a stored message takes
+ * 21 bytes plus its text, instead of a refcounted structure and a
+ * separate allocation for the string. Each chunk also keeps sorted
+ * lists of row offsets for each category and each log level, which
+ * are used to build a bitmap of matching rows without touching the
+ * rows themselves. Optionally, the same is done for each trigram of
+ * the text, which narrows down the rows that have to be searched.
+ */
+#define DBUSLOG_STORE_CHUNK_SIZE (0x1000)
+#define DBUSLOG_STORE_CHUNK_WORDS (DBUSLOG_STORE_CHUNK_SIZE/32)
+
+typedef struct dbus_log_store_chunk {
+    guint count;
+    gint64 timestamp[DBUSLOG_STORE_CHUNK_SIZE];
+    guint32 index[DBUSLOG_STORE_CHUNK_SIZE];
+    guint32 category[DBUSLOG_STORE_CHUNK_SIZE];
+    guint32 offset[DBUSLOG_STORE_CHUNK_SIZE];
+    guchar level[DBUSLOG_STORE_CHUNK_SIZE];
+    GByteArray* text;
+    GHashTable* by_category;
+    GArray* by_level[DBUSLOG_LEVEL_COUNT];
+    GHashTable* by_trigram;
+} DBusLogStoreChunk;
+
+struct dbus_log_store {
+    GPtrArray* chunks;
+    gboolean index_text;
+    guint64 max_count;
+    guint64 first;
+    guint64 end;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+GArray*
+dbus_log_store_rows_new(
+    void)
+{
+    return g_array_new(FALSE, FALSE, sizeof(guint16));
+}
+
+static
+void
+dbus_log_store_rows_free(
+    gpointer rows)
+{
+    g_array_free(rows, TRUE);
+}
+
+/* The text arena starts as large as the previous chunk's one ended up */
+static
+DBusLogStoreChunk*
+dbus_log_store_chunk_new(
+    gboolean index_text,
+    guint text_size)
+{
+    DBusLogStoreChunk* chunk = g_new(DBusLogStoreChunk, 1);
+    guint i;
+
+    chunk->count = 0;
+    chunk->text = g_byte_array_sized_new(text_size);
+    chunk->by_category = g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, dbus_log_store_rows_free);
+    for (i = 0; i < G_N_ELEMENTS(chunk->by_level); i++) {
+        chunk->by_level[i] = dbus_log_store_rows_new();
+    }
+    chunk->by_trigram = index_text ? g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, dbus_log_store_rows_free) : NULL;
+    return chunk;
+}
+
+static
+void
+dbus_log_store_chunk_free(
+    gpointer data)
+{
+    DBusLogStoreChunk* chunk = data;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(chunk->by_level); i++) {
+        g_array_free(chunk->by_level[i], TRUE);
+    }
+    if (chunk->by_trigram) {
+        g_hash_table_destroy(chunk->by_trigram);
+    }
+    g_hash_table_destroy(chunk->by_category);
+    g_byte_array_free(chunk->text, TRUE);
+    g_free(chunk);
+}
+
+static
+void
+dbus_log_store_chunk_index_text(
+    DBusLogStoreChunk* chunk,
+    guint16 pos,
+    const char* text,
+    gsize length)
+{
+    const guchar* ptr = (const guchar*)text;
+    gsize i;
+
+    for (i = 0; i + DBUSLOG_TRIGRAM_SIZE <= length; i++) {
+        gpointer key = GUINT_TO_POINTER(DBUSLOG_TRIGRAM(ptr + i));
+        GArray* rows = g_hash_table_lookup(chunk->by_trigram, key);
+
+        if (!rows) {
+            rows = dbus_log_store_rows_new();
+            g_hash_table_insert(chunk->by_trigram, key, rows);
+        }
+        /* Repeated trigrams are only recorded once */
+        if (!rows->len || g_array_index(rows, guint16, rows->len - 1) != pos) {
+            g_array_append_val(rows, pos);
+        }
+    }
+}
+
+static
+void
+dbus_log_store_chunk_add(
+    DBusLogStoreChunk* chunk,
+    DBusLogMessage* msg)
+{
+    /* Deferred formatting sets the length too */
+    const char* text = dbus_log_message_text(msg);
+    const guint16 pos = chunk->count++;
+    const guint level = (msg->level < DBUSLOG_LEVEL_COUNT) ?
+        msg->level : DBUSLOG_LEVEL_UNDEFINED;
+    gpointer key = GUINT_TO_POINTER(msg->category);
+    GArray* rows = g_hash_table_lookup(chunk->by_category, key);
+    static const guint8 nul = 0;
+
+    chunk->timestamp[pos] = msg->timestamp;
+    chunk->index[pos] = msg->index;
+    chunk->category[pos] = msg->category;
+    chunk->level[pos] = (guchar)level;
+    chunk->offset[pos] = chunk->text->len;
+    if (text && msg->length) {
+        g_byte_array_append(chunk->text, (const guint8*)text, msg->length);
+    }
+    g_byte_array_append(chunk->text, &nul, 1);
+
+    if (!rows) {
+        rows = dbus_log_store_rows_new();
+        g_hash_table_insert(chunk->by_category, key, rows);
+    }
+    g_array_append_val(rows, pos);
+    g_array_append_val(chunk->by_level[level], pos);
+    if (chunk->by_trigram && text) {
+        dbus_log_store_chunk_index_text(chunk, pos, text, msg->length);
+    }
+}
+
+static
+void
+dbus_log_store_bitmap_set(
+    guint32* bitmap,
+    GArray* rows)
+{
+    if (rows) {
+        const guint16* pos = (const guint16*)rows->data;
+        guint i;
+
+        for (i = 0; i < rows->len; i++) {
+            bitmap[pos[i] / 32] |= (1u << (pos[i] % 32));
+        }
+    }
+}
+
+/* Rows containing all the trigrams */
+static
+void
+dbus_log_store_chunk_trigrams(
+    DBusLogStoreChunk* chunk,
+    GArray* trigrams,
+    guint32* bitmap,
+    guint nwords)
+{
+    guint32 rows[DBUSLOG_STORE_CHUNK_WORDS];
+    guint i, k;
+
+    memset(bitmap, 0xff, sizeof(bitmap[0]) * nwords);
+    for (i = 0; i < trigrams->len; i++) {
+        GArray* list = g_hash_table_lookup(chunk->by_trigram,
+            GUINT_TO_POINTER(g_array_index(trigrams, guint32, i)));
+
+        if (!list) {
+            memset(bitmap, 0, sizeof(bitmap[0]) * nwords);
+            break;
+        }
+        memset(rows, 0, sizeof(rows[0]) * nwords);
+        dbus_log_store_bitmap_set(rows, list);
+        for (k = 0; k < nwords; k++) {
+            bitmap[k] &= rows[k];
+        }
+    }
+}
+
+/* Leaves only the rows which may match the text filter */
+static
+void
+dbus_log_store_chunk_text(
+    DBusLogStoreChunk* chunk,
+    DBusLogTrigramQuery* query,
+    guint32* bitmap,
+    guint nwords)
+{
+    if (chunk->by_trigram && query->alternatives) {
+        guint32 text[DBUSLOG_STORE_CHUNK_WORDS];
+        guint32 alt[DBUSLOG_STORE_CHUNK_WORDS];
+        guint i, k;
+
+        memset(text, 0, sizeof(text[0]) * nwords);
+        for (i = 0; i < query->alternatives->len; i++) {
+            dbus_log_store_chunk_trigrams(chunk,
+                query->alternatives->pdata[i], alt, nwords);
+            for (k = 0; k < nwords; k++) {
+                text[k] |= alt[k];
+            }
+        }
+        for (k = 0; k < nwords; k++) {
+            bitmap[k] &= text[k];
+        }
+    }
+}
+
+/* Matches the text of the remaining rows for real */
+static
+void
+dbus_log_store_chunk_verify(
+    DBusLogStoreChunk* chunk,
+    DBusLogTrigramQuery* query,
+    guint32* bitmap,
+    guint nwords)
+{
+    const char* text = (const char*)chunk->text->data;
+    guint i;
+
+    for (i = 0; i < nwords; i++) {
+        guint32 word = bitmap[i];
+
+        while (word) {
+            const guint pos = i * 32 + g_bit_nth_lsf(word, -1);
+            const guint32 start = chunk->offset[pos];
+            const guint32 next = (pos + 1 < chunk->count) ?
+                chunk->offset[pos + 1] : chunk->text->len;
+
+            if (!dbus_log_trigram_query_match(query, text + start,
+                next - start - 1)) {
+                bitmap[i] &= ~(1u << (pos % 32));
+            }
+            word &= word - 1;
+        }
+    }
+}
+
+/* Returns FALSE if no row in the chunk can match the filter */
+static
+gboolean
+dbus_log_store_chunk_match(
+    DBusLogStoreChunk* chunk,
+    const DBusLogStoreFilter* filter,
+    DBusLogTrigramQuery* query,
+    guint32* bitmap)
+{
+    const guint nwords = (chunk->count + 31) / 32;
+    gboolean any = FALSE;
+    guint i;
+
+    if (filter && filter->n_categories) {
+        memset(bitmap, 0, sizeof(bitmap[0]) * nwords);
+        for (i = 0; i < filter->n_categories; i++) {
+            dbus_log_store_bitmap_set(bitmap, g_hash_table_lookup(
+                chunk->by_category,
+                GUINT_TO_POINTER(filter->categories[i])));
+        }
+        any = TRUE;
+    }
+
+    if (filter && filter->max_level > DBUSLOG_LEVEL_UNDEFINED &&
+        filter->max_level < (DBUSLOG_LEVEL_COUNT - 1)) {
+        guint32 levels[DBUSLOG_STORE_CHUNK_WORDS];
+
+        memset(levels, 0, sizeof(levels[0]) * nwords);
+        for (i = DBUSLOG_LEVEL_UNDEFINED; i <= filter->max_level; i++) {
+            dbus_log_store_bitmap_set(levels, chunk->by_level[i]);
+        }
+        if (any) {
+            for (i = 0; i < nwords; i++) {
+                bitmap[i] &= levels[i];
+            }
+        } else {
+            memcpy(bitmap, levels, sizeof(levels[0]) * nwords);
+            any = TRUE;
+        }
+    }
+
+    if (!any) {
+        /* Everything matches */
+        memset(bitmap, 0xff, sizeof(bitmap[0]) * nwords);
+    }
+
+    /* Clear the bits past the end of the chunk */
+    if (chunk->count % 32) {
+        bitmap[nwords - 1] &= (1u << (chunk->count % 32)) - 1;
+    }
+
+    if (query) {
+        dbus_log_store_chunk_text(chunk, query, bitmap, nwords);
+        dbus_log_store_chunk_verify(chunk, query, bitmap, nwords);
+    }
+
+    for (i = 0; i < nwords; i++) {
+        if (bitmap[i]) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static
+DBusLogStoreChunk*
+dbus_log_store_chunk_at(
+    DBusLogStore* self,
+    guint64 row)
+{
+    return (row >= self->first && row < self->end) ?
+        g_ptr_array_index(self->chunks, (row - self->first) /
+            DBUSLOG_STORE_CHUNK_SIZE) : NULL;
+}
+
+static
+void
+dbus_log_store_trim(
+    DBusLogStore* self)
+{
+    /* Only drop the whole chunks, and keep at least max_count rows */
+    while (self->chunks->len > 1 &&
+        (self->end - self->first - DBUSLOG_STORE_CHUNK_SIZE) >=
+        self->max_count) {
+        g_ptr_array_remove_index(self->chunks, 0);
+        self->first += DBUSLOG_STORE_CHUNK_SIZE;
+    }
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogStore*
+dbus_log_store_new(
+    guint64 max_count)
+{
+    DBusLogStore* self = g_new0(DBusLogStore, 1);
+
+    self->chunks = g_ptr_array_new_with_free_func(dbus_log_store_chunk_free);
+    self->max_count = max_count;
+    return self;
+}
+
+void
+dbus_log_store_free(
+    DBusLogStore* self)
+{
+    if (G_LIKELY(self)) {
+        g_ptr_array_free(self->chunks, TRUE);
+        g_free(self);
+    }
+}
+
+void
+dbus_log_store_index_text(
+    DBusLogStore* self,
+    gboolean enable)
+{
+    if (G_LIKELY(self)) {
+        self->index_text = enable;
+        if (enable && self->chunks->len) {
+            DBusLogStoreChunk* chunk = g_ptr_array_index(self->chunks,
+                self->chunks->len - 1);
+
+            /* Catch up with the chunk being filled */
+            if (!chunk->by_trigram) {
+                const char* text = (const char*)chunk->text->data;
+                guint pos;
+
+                chunk->by_trigram = g_hash_table_new_full(g_direct_hash,
+                    g_direct_equal, NULL, dbus_log_store_rows_free);
+                for (pos = 0; pos < chunk->count; pos++) {
+                    const guint32 start = chunk->offset[pos];
+                    const guint32 next = (pos + 1 < chunk->count) ?
+                        chunk->offset[pos + 1] : chunk->text->len;
+
+                    dbus_log_store_chunk_index_text(chunk, pos, text + start,
+                        next - start - 1);
+                }
+            }
+        }
+    }
+}
+
+gboolean
+dbus_log_store_add(
+    DBusLogStore* self,
+    DBusLogMessage* message)
+{
+    if (G_LIKELY(self) && G_LIKELY(message)) {
+        DBusLogStoreChunk* chunk = self->chunks->len ?
+            g_ptr_array_index(self->chunks, self->chunks->len - 1) : NULL;
+
+        if (!chunk || chunk->count == DBUSLOG_STORE_CHUNK_SIZE) {
+            chunk = dbus_log_store_chunk_new(self->index_text,
+                chunk ? chunk->text->len : 0);
+            g_ptr_array_add(self->chunks, chunk);
+        }
+        dbus_log_store_chunk_add(chunk, message);
+        self->end++;
+        if (self->max_count) {
+            dbus_log_store_trim(self);
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+dbus_log_store_clear(
+    DBusLogStore* self)
+{
+    if (G_LIKELY(self)) {
+        g_ptr_array_set_size(self->chunks, 0);
+        self->first = self->end = 0;
+    }
+}
+
+guint64
+dbus_log_store_first(
+    DBusLogStore* self)
+{
+    return G_LIKELY(self) ? self->first : 0;
+}
+
+guint64
+dbus_log_store_end(
+    DBusLogStore* self)
+{
+    return G_LIKELY(self) ? self->end : 0;
+}
+
+gboolean
+dbus_log_store_get(
+    DBusLogStore* self,
+    guint64 row,
+    DBusLogStoreEntry* entry)
+{
+    if (G_LIKELY(self)) {
+        DBusLogStoreChunk* chunk = dbus_log_store_chunk_at(self, row);
+
+        if (chunk) {
+            const guint pos = (row - self->first) % DBUSLOG_STORE_CHUNK_SIZE;
+            const guint32 start = chunk->offset[pos];
+            const guint32 next = (pos + 1 < chunk->count) ?
+                chunk->offset[pos + 1] : chunk->text->len;
+
+            if (entry) {
+                entry->timestamp = chunk->timestamp[pos];
+                entry->index = chunk->index[pos];
+                entry->category = chunk->category[pos];
+                entry->level = chunk->level[pos];
+                entry->length = next - start - 1;
+                entry->text = (const char*)chunk->text->data + start;
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+guint
+dbus_log_store_select(
+    DBusLogStore* self,
+    const DBusLogStoreFilter* filter,
+    guint64 from,
+    guint64* rows,
+    guint max)
+{
+    guint n = 0;
+
+    if (G_LIKELY(self) && G_LIKELY(rows || !max)) {
+        DBusLogTrigramQuery* query = filter ? dbus_log_trigram_query_new(
+            filter->substrings, filter->regex) : NULL;
+        guint32 bitmap[DBUSLOG_STORE_CHUNK_WORDS];
+        guint c;
+
+        if (from < self->first) {
+            from = self->first;
+        }
+        for (c = (from < self->end) ? (guint)((from - self->first) /
+            DBUSLOG_STORE_CHUNK_SIZE) : self->chunks->len;
+            c < self->chunks->len && n < max; c++) {
+            DBusLogStoreChunk* chunk = g_ptr_array_index(self->chunks, c);
+            const guint64 base = self->first +
+                (guint64)c * DBUSLOG_STORE_CHUNK_SIZE;
+            const guint start = (from > base) ? (guint)(from - base) : 0;
+            guint i;
+
+            if (!dbus_log_store_chunk_match(chunk, filter, query, bitmap)) {
+                continue;
+            }
+
+            /* Skip the rows before the starting one */
+            for (i = 0; i < start / 32; i++) {
+                bitmap[i] = 0;
+            }
+            if (start % 32) {
+                bitmap[start / 32] &= ~((1u << (start % 32)) - 1);
+            }
+
+            for (i = start / 32; i < (chunk->count + 31) / 32 && n < max;
+                i++) {
+                guint32 word = bitmap[i];
+
+                while (word && n < max) {
+                    const guint bit = g_bit_nth_lsf(word, -1);
+
+                    rows[n++] = base + i * 32 + bit;
+                    word &= word - 1;
+                }
+            }
+        }
+        dbus_log_trigram_query_free(query);
+    }
+    return n;
+}
+
+guint64
+dbus_log_store_count(
+    DBusLogStore* self,
+    const DBusLogStoreFilter* filter)
+{
+    guint64 count = 0;
+
+    if (G_LIKELY(self)) {
+        DBusLogTrigramQuery* query = filter ? dbus_log_trigram_query_new(
+            filter->substrings, filter->regex) : NULL;
+        guint32 bitmap[DBUSLOG_STORE_CHUNK_WORDS];
+        guint c;
+
+        for (c = 0; c < self->chunks->len; c++) {
+            DBusLogStoreChunk* chunk = g_ptr_array_index(self->chunks, c);
+
+            if (dbus_log_store_chunk_match(chunk, filter, query, bitmap)) {
+                guint i;
+
+                for (i = 0; i < (chunk->count + 31) / 32; i++) {
+                    guint32 word = bitmap[i];
+
+                    while (word) {
+                        word &= word - 1;
+                        count++;
+                    }
+                }
+            }
+        }
+        dbus_log_trigram_query_free(query);
+    }
+    return count;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_trigram.h"
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+dbus_log_trigram_query_collect(
+    GArray* trigrams,
+    const char* text,
+    gsize length)
+{
+    const guchar* ptr = (const guchar*)text;
+    gsize i;
+
+    for (i = 0; i + DBUSLOG_TRIGRAM_SIZE <= length; i++) {
+        const guint32 t = DBUSLOG_TRIGRAM(ptr + i);
+
+        g_array_append_vals(trigrams, &t, 1);
+    }
+}
+
+static
+gint
+dbus_log_trigram_query_compare(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const guint32 t1 = *(const guint32*)a;
+    const guint32 t2 = *(const guint32*)b;
+
+    return (t1 < t2) ? -1 : (t1 > t2) ? 1 : 0;
+}
+
+/* Sorts trigrams and removes the duplicates */
+static
+GArray*
+dbus_log_trigram_query_unique(
+    GArray* trigrams)
+{
+    guint32* t = (guint32*)trigrams->data;
+    guint i, n = 0;
+
+    g_array_sort(trigrams, dbus_log_trigram_query_compare);
+    for (i = 0; i < trigrams->len; i++) {
+        if (!n || t[n - 1] != t[i]) {
+            t[n++] = t[i];
+        }
+    }
+    return g_array_set_size(trigrams, n);
+}
+
+static
+void
+dbus_log_trigram_query_flush(
+    GArray* trigrams,
+    GString* run)
+{
+    dbus_log_trigram_query_collect(trigrams, run->str, run->len);
+    g_string_truncate(run, 0);
+}
+
+/*
+ * The last character of the run turned out to be optional. Unless the
+ * regex is compiled with G_REGEX_RAW, the quantifier applies to the
+ * whole UTF-8 sequence, not just to its last byte.
+ */
+static
+void
+dbus_log_trigram_query_optional(
+    GArray* trigrams,
+    GString* run,
+    gboolean raw)
+{
+    if (run->len) {
+        gsize len = run->len - 1;
+
+        if (!raw) {
+            while (len && (((guchar)run->str[len]) & 0xc0) == 0x80) {
+                len--;
+            }
+        }
+        g_string_truncate(run, len);
+    }
+    dbus_log_trigram_query_flush(trigrams, run);
+}
+
+/*
+ * Collects the trigrams of the literal runs which any matching text must
+ * contain. This isn't a regex parser, it only needs to be conservative.
+ * Alternation, inline options and the exotic escapes give up right away.
+ * The contents of groups and character classes are ignored, the literals
+ * around them are still used. The character followed by an optional
+ * quantifier ends the run without becoming a part of it.
+ */
+static
+gboolean
+dbus_log_trigram_query_regex(
+    GArray* trigrams,
+    GRegex* regex)
+{
+    const char* p = g_regex_get_pattern(regex);
+    const GRegexCompileFlags flags = g_regex_get_compile_flags(regex);
+    const gboolean raw = (flags & G_REGEX_RAW) != 0;
+    GString* run = g_string_new(NULL);
+    gboolean ok = TRUE;
+    guint depth = 0;
+
+    if (flags & (G_REGEX_CASELESS | G_REGEX_EXTENDED)) {
+        ok = FALSE;
+    }
+    while (ok && *p) {
+        const char c = *p++;
+
+        switch (c) {
+        case '|':
+            ok = FALSE;
+            break;
+        case '(':
+            if (*p == '?') {
+                ok = FALSE;
+            }
+            depth++;
+            dbus_log_trigram_query_flush(trigrams, run);
+            break;
+        case ')':
+            if (depth) {
+                depth--;
+            }
+            break;
+        case '[':
+            /* A closing bracket right after the opening one is literal */
+            if (*p == '^') {
+                p++;
+            }
+            if (*p == ']') {
+                p++;
+            }
+            while (*p && *p != ']') {
+                if (*p++ == '\\' && *p) {
+                    p++;
+                }
+            }
+            if (*p) {
+                p++;
+            }
+            dbus_log_trigram_query_flush(trigrams, run);
+            break;
+        case '{':
+            while (*p && *p != '}') {
+                p++;
+            }
+            if (*p) {
+                p++;
+            }
+            dbus_log_trigram_query_optional(trigrams, run, raw);
+            break;
+        case '*':
+        case '?':
+            dbus_log_trigram_query_optional(trigrams, run, raw);
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            dbus_log_trigram_query_flush(trigrams, run);
+            break;
+        case '\\':
+            if (!*p) {
+                ok = FALSE;
+            } else if (g_ascii_isalnum(*p)) {
+                /* Character types and assertions */
+                if (strchr("dDwWsSbBAzZ", *p)) {
+                    dbus_log_trigram_query_flush(trigrams, run);
+                    p++;
+                } else {
+                    ok = FALSE;
+                }
+            } else if (!depth) {
+                g_string_append_c(run, *p++);
+            } else {
+                p++;
+            }
+            break;
+        default:
+            if (!depth) {
+                g_string_append_c(run, c);
+            }
+            break;
+        }
+    }
+    if (ok) {
+        dbus_log_trigram_query_flush(trigrams, run);
+    }
+    g_string_free(run, TRUE);
+    return ok;
+}
+
+static
+void
+dbus_log_trigram_query_free_alternative(
+    gpointer trigrams)
+{
+    g_array_free(trigrams, TRUE);
+}
+
+static
+gboolean
+dbus_log_trigram_query_add(
+    DBusLogTrigramQuery* self,
+    GArray* trigrams)
+{
+    if (self->alternatives) {
+        if (trigrams->len) {
+            g_ptr_array_add(self->alternatives,
+                dbus_log_trigram_query_unique(trigrams));
+            return TRUE;
+        }
+
+        /* This one matches too much, the index won't help */
+        g_ptr_array_free(self->alternatives, TRUE);
+        self->alternatives = NULL;
+    }
+    g_array_free(trigrams, TRUE);
+    return FALSE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogTrigramQuery*
+dbus_log_trigram_query_new(
+    const GStrV* substrings,
+    GRegex* regex)
+{
+    if ((substrings && substrings[0]) || regex) {
+        DBusLogTrigramQuery* self = g_slice_new0(DBusLogTrigramQuery);
+
+        self->alternatives = g_ptr_array_new_with_free_func(
+            dbus_log_trigram_query_free_alternative);
+        if (substrings) {
+            const GStrV* ptr;
+
+            self->substrings = g_strdupv((char**)substrings);
+            for (ptr = substrings; *ptr; ptr++) {
+                GArray* trigrams = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+                dbus_log_trigram_query_collect(trigrams, *ptr, strlen(*ptr));
+                dbus_log_trigram_query_add(self, trigrams);
+            }
+        }
+        if (regex) {
+            GArray* trigrams = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+            self->regex = g_regex_ref(regex);
+            if (!dbus_log_trigram_query_regex(trigrams, regex)) {
+                g_array_set_size(trigrams, 0);
+            }
+            dbus_log_trigram_query_add(self, trigrams);
+        }
+        return self;
+    }
+    return NULL;
+}
+
+void
+dbus_log_trigram_query_free(
+    DBusLogTrigramQuery* self)
+{
+    if (G_LIKELY(self)) {
+        if (self->alternatives) {
+            g_ptr_array_free(self->alternatives, TRUE);
+        }
+        if (self->regex) {
+            g_regex_unref(self->regex);
+        }
+        g_strfreev(self->substrings);
+        g_slice_free(DBusLogTrigramQuery, self);
+    }
+}
+
+gboolean
+dbus_log_trigram_query_match(
+    DBusLogTrigramQuery* self,
+    const char* text,
+    gsize length)
+{
+    if (G_LIKELY(self) && G_LIKELY(text)) {
+        if (self->substrings) {
+            const GStrV* ptr;
+
+            for (ptr = self->substrings; *ptr; ptr++) {
+                if (g_strstr_len(text, length, *ptr)) {
+                    return TRUE;
+                }
+            }
+        }
+        if (self->regex) {
+            return g_regex_match_full(self->regex, text, length, 0, 0,
+                NULL, NULL);
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
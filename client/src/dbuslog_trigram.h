@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_TRIGRAM_H
+#define DBUSLOG_TRIGRAM_H
+
+#include "dbuslog_client_types.h"
+
+#include <gutil_types.h>
+
+/*
+ * Trigram is three consecutive bytes of the message text packed into
+ * a 24-bit number. Trigram indices map trigrams to the lists of places
+ * (rows, blocks) where they occur. A message can only contain the
+ * substring if it contains all trigrams of the substring, so the
+ * intersection of their lists gives the candidates which then have
+ * to be matched for real.
+ */
+#define DBUSLOG_TRIGRAM_SIZE (3)
+#define DBUSLOG_TRIGRAM(ptr) (((guint32)(ptr)[0] << 16) | \
+    ((guint32)(ptr)[1] << 8) | (ptr)[2])
+
+/*
+ * Substrings and the regular expression are alternatives, i.e. the
+ * text matches if it contains any of the substrings or matches the
+ * regular expression. Each alternative which can be narrowed down by
+ * the index has a sorted array of distinct trigrams in alternatives.
+ * If any of them can't, alternatives is NULL and the index is useless.
+ */
+typedef struct dbus_log_trigram_query {
+    GStrV* substrings;
+    GRegex* regex;
+    GPtrArray* alternatives;
+} DBusLogTrigramQuery;
+
+/* Returns NULL if there's nothing to filter */
+DBusLogTrigramQuery*
+dbus_log_trigram_query_new(
+    const GStrV* substrings,
+    GRegex* regex);
+
+void
+dbus_log_trigram_query_free(
+    DBusLogTrigramQuery* query);
+
+gboolean
+dbus_log_trigram_query_match(
+    DBusLogTrigramQuery* query,
+    const char* text,
+    gsize length);
+
+#endif /* DBUSLOG_TRIGRAM_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -44,6 +44,7 @@ typedef struct dbus_log_category {
     gulong flags;
     guint32 id;
     DBUSLOG_LEVEL level;
+    gint max_level; /* Since 1.0.23, maintained by the server (atomic) */
 } DBusLogCategory;
 
 DBusLogCategory*
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_FORMAT_H
+#define DBUSLOG_FORMAT_H
+
+/* Since 1.0.23 */
+
+#include "dbuslog_protocol.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Registered printf-style format string. The producer serializes the
+ * arguments (see PROTOCOL file for the encoding) and the consumer turns
+ * them back into text. Formats which can't be serialized (positional
+ * arguments, %n, %m, long double and such) have can_pack set to FALSE,
+ * messages using those get formatted by the producer as usual.
+ */
+typedef struct dbus_log_format {
+    const char* format;
+    guint32 id;
+    gboolean can_pack;
+} DBusLogFormat;
+
+DBusLogFormat*
+dbus_log_format_new(
+    const char* format,
+    guint32 id);
+
+DBusLogFormat*
+dbus_log_format_ref(
+    DBusLogFormat* format);
+
+void
+dbus_log_format_unref(
+    DBusLogFormat* format);
+
+void
+dbus_log_format_free(
+    gpointer format);
+
+void*
+dbus_log_format_pack(
+    DBusLogFormat* format,
+    va_list args,
+    gsize* size);
+
+/* Same thing in two steps, for those who manage the memory themselves */
+gsize
+dbus_log_format_pack_size(
+    DBusLogFormat* format,
+    va_list args);
+
+void
+dbus_log_format_pack_into(
+    DBusLogFormat* format,
+    va_list args,
+    void* buf);
+
+char*
+dbus_log_format_unpack(
+    DBusLogFormat* format,
+    const void* data,
+    gsize size,
+    gsize* length);
+
+/* Appends the text to the string, leaves it untouched on failure */
+gboolean
+dbus_log_format_unpack_append(
+    DBusLogFormat* format,
+    const void* data,
+    gsize size,
+    GString* out);
+
+G_END_DECLS
+
+#endif /* DBUSLOG_FORMAT_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -33,7 +33,7 @@
 #ifndef DBUSLOG_MESSAGE_H
 #define DBUSLOG_MESSAGE_H
 
-#include "dbuslog_protocol.h"
+#include "dbuslog_format.h"
 
 #include <glib.h>
 
@@ -52,11 +52,22 @@ DBusLogMessage*
 dbus_log_message_new(
     const char* str);
 
+/* If str is NULL, the caller is expected to fill in the text */
+DBusLogMessage*
+dbus_log_message_new_len(
+    const char* str,
+    gsize length); /* Since 1.0.23 */
+
 DBusLogMessage*
 dbus_log_message_new_va(
     const char* format,
     va_list args);
 
+DBusLogMessage*
+dbus_log_message_new_format(
+    DBusLogFormat* format,
+    va_list args); /* Since 1.0.23 */
+
 DBusLogMessage*
 dbus_log_message_ref(
     DBusLogMessage* message);
@@ -65,6 +76,39 @@ void
 dbus_log_message_unref(
     DBusLogMessage* message);
 
+/*
+ * Messages created by dbus_log_message_new_format() carry serialized
+ * arguments instead of the text, the string field remains NULL until
+ * dbus_log_message_text() is called. The text is formatted once and
+ * cached, that must happen on a single thread. Since 1.0.23
+ */
+DBusLogFormat*
+dbus_log_message_format(
+    DBusLogMessage* message);
+
+const void*
+dbus_log_message_args(
+    DBusLogMessage* message,
+    gsize* size);
+
+const char*
+dbus_log_message_text(
+    DBusLogMessage* message);
+
+/*
+ * Link to the next message, for whoever keeps the messages in a list.
+ * A message can only be in one such list at a time. The link doesn't
+ * hold a reference. Since 1.0.23
+ */
+DBusLogMessage*
+dbus_log_message_next(
+    DBusLogMessage* message);
+
+void
+dbus_log_message_set_next(
+    DBusLogMessage* message,
+    DBusLogMessage* next);
+
 G_END_DECLS
 
 #endif /* DBUSLOG_MESSAGE_H */
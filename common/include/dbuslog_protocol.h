@@ -41,6 +41,10 @@
  *        0: Ping (no payload)
  *        1: Message (>= 17 bytes)
  *        2: Bye (no payload and no more data to follow)
+ *        3: Format (>= 4 bytes)
+ *        4: Binary message (>= 21 bytes)
+ *        5: Message batch (>= 12 bytes)
+ *        6: Dropped messages report (>= 16 bytes)
  */
 
 #define DBUSLOG_PACKET_HEADER_SIZE      (5)
@@ -51,6 +55,10 @@ typedef enum dbus_log_packet_type {
     DBUSLOG_PACKET_TYPE_PING,
     DBUSLOG_PACKET_TYPE_MESSAGE,
     DBUSLOG_PACKET_TYPE_BYE,
+    DBUSLOG_PACKET_TYPE_FORMAT,
+    DBUSLOG_PACKET_TYPE_BINARY_MESSAGE,
+    DBUSLOG_PACKET_TYPE_MESSAGE_BATCH,
+    DBUSLOG_PACKET_TYPE_DROPPED,
     DBUSLOG_PACKET_TYPE_COUNT
 } DBUSLOG_PACKET_TYPE;
 
@@ -70,9 +78,131 @@ typedef enum dbus_log_packet_type {
 #define DBUSLOG_MESSAGE_LEVEL_OFFSET        (DBUSLOG_PACKET_HEADER_SIZE + 16)
 
 #define DBUSLOG_MESSAGE_PREFIX_SIZE         (17)
+
+/*
+ * Format payload [type 3]
+ *
+ * 0..3   Format id
+ * 4...   UTF-8 encoded printf-style format (not including NULL terminator)
+ *
+ * Only sent to the clients which have requested binary messages.
+ * Format is sent once, before the first binary message referring to it.
+ */
+
+#define DBUSLOG_FORMAT_ID_OFFSET            (DBUSLOG_PACKET_HEADER_SIZE + 0)
+#define DBUSLOG_FORMAT_PREFIX_SIZE          (4)
+
+/*
+ * Binary message payload [type 4]
+ *
+ * 0..16  Same as in the text message
+ * 17..20 Format id
+ * 21...  Serialized arguments (see PROTOCOL file)
+ */
+
+#define DBUSLOG_BINARY_MESSAGE_FORMAT_OFFSET (DBUSLOG_PACKET_HEADER_SIZE + 17)
+#define DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE  (21)
+
+/*
+ * Message batch payload [type 5]
+ *
+ * 0..7   Base timestamp
+ * 8..11  Index of the first message
+ * 12...  Messages with consecutive indices, each one encoded as:
+ *
+ *        varint  Timestamp delta (zigzag encoded, relative to the
+ *                previous message, or to the base for the first one)
+ *        varint  Log category id
+ *        1 byte  Log level
+ *        varint  Length of the string
+ *        ...     UTF-8 encoded string (not including NULL terminator)
+ *
+ * Varints are unsigned LEB128, 7 bits per byte, least significant first.
+ */
+
+#define DBUSLOG_MESSAGE_BATCH_TIMESTAMP_OFFSET (DBUSLOG_PACKET_HEADER_SIZE + 0)
+#define DBUSLOG_MESSAGE_BATCH_INDEX_OFFSET  (DBUSLOG_PACKET_HEADER_SIZE + 8)
+#define DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE   (12)
+
+/*
+ * Dropped messages report [type 6]
+ *
+ * 0..3   Number of messages dropped since the previous report
+ * 4..11  Their total size in bytes (text or serialized arguments)
+ * 12..15 Number of categories
+ * 16...  For each category, 4 bytes category id followed by 4 bytes
+ *        number of messages dropped in that category
+ *
+ * Only sent to the clients which have asked for it. Messages logged
+ * without a category have category id zero.
+ */
+
+#define DBUSLOG_DROPPED_COUNT_OFFSET        (DBUSLOG_PACKET_HEADER_SIZE + 0)
+#define DBUSLOG_DROPPED_BYTES_OFFSET        (DBUSLOG_PACKET_HEADER_SIZE + 4)
+#define DBUSLOG_DROPPED_CATEGORIES_OFFSET   (DBUSLOG_PACKET_HEADER_SIZE + 12)
+#define DBUSLOG_DROPPED_PREFIX_SIZE         (16)
+#define DBUSLOG_DROPPED_ENTRY_SIZE          (8)
+
 #define DBUSLOG_PACKET_MAX_FIXED_PART (\
     DBUSLOG_PACKET_HEADER_SIZE + \
-    DBUSLOG_MESSAGE_PREFIX_SIZE)
+    DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE)
+
+/*
+ * Shared memory ring [LogOpenShm]
+ *
+ * 0..3     Magic (DBUSLOG_SHM_MAGIC)
+ * 4..7     Size of the data area (power of 2)
+ * 64..67   Write position (updated by the server)
+ * 68..71   Non-zero if the server is waiting for space
+ * 128..131 Read position (updated by the client)
+ * 132..135 Non-zero if the client is waiting for data
+ * 65536... Data area, the same stream of packets as written to the pipe
+ *
+ * Unlike the packets, these fields are in native byte order. Positions
+ * are free running 32-bit counters, the offset in the data area is the
+ * position modulo the size.
+ */
+
+#define DBUSLOG_SHM_MAGIC                   (0x474f4c44) /* "DLOG" */
+#define DBUSLOG_SHM_MAGIC_OFFSET            (0)
+#define DBUSLOG_SHM_SIZE_OFFSET             (4)
+#define DBUSLOG_SHM_WRITE_POS_OFFSET        (64)
+#define DBUSLOG_SHM_WRITER_WAITING_OFFSET   (68)
+#define DBUSLOG_SHM_READ_POS_OFFSET         (128)
+#define DBUSLOG_SHM_READER_WAITING_OFFSET   (132)
+#define DBUSLOG_SHM_DATA_OFFSET             (0x10000)
+
+#define DBUSLOG_SHM_MIN_SIZE                (0x10000)
+#define DBUSLOG_SHM_MAX_SIZE                (0x4000000)
+#define DBUSLOG_SHM_DEFAULT_SIZE            (0x100000)
+
+/* LogOpen2, LogOpen3 and LogOpenShm flags */
+#define DBUSLOG_OPEN_FLAG_BINARY                    (0x01)
+#define DBUSLOG_OPEN_FLAG_HISTORY_SINCE             (0x02) /* LogOpen3 */
+#define DBUSLOG_OPEN_FLAG_BATCH                     (0x04)
+#define DBUSLOG_OPEN_FLAG_DROP_REPORT               (0x08)
+
+/*
+ * What happens to a new message when the client's queue is full
+ * (SetOverflowPolicy). Blocking delays the delivery of new messages
+ * to all clients, it never blocks the callers producing them. It's
+ * bounded, if the client doesn't make room in time, the oldest messages
+ * get dropped until the queue is drained.
+ */
+typedef enum dbus_log_overflow {
+    DBUSLOG_OVERFLOW_DROP_OLDEST,
+    DBUSLOG_OVERFLOW_DROP_NEWEST,
+    DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL,
+    DBUSLOG_OVERFLOW_BLOCK,
+    DBUSLOG_OVERFLOW_COUNT
+} DBUSLOG_OVERFLOW;
+
+/* GetStatistics keys */
+#define DBUSLOG_STATS_PIPE_SIZE             "PipeSize"
+#define DBUSLOG_STATS_MAX_PIPE_SIZE         "MaxPipeSize"
+#define DBUSLOG_STATS_PIPE_RESIZE_COUNT     "PipeResizeCount"
+#define DBUSLOG_STATS_DROPPED_COUNT         "DroppedCount"
+#define DBUSLOG_STATS_DROPPED_BYTES         "DroppedBytes"
 
 typedef enum dbus_log_level {
     DBUSLOG_LEVEL_UNDEFINED,
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_SHM_H
+#define DBUSLOG_SHM_H
+
+/* Since 1.0.23 */
+
+#include "dbuslog_protocol.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Single producer, single consumer ring in a memfd shared between the
+ * server and the client (see PROTOCOL file for the layout). The data
+ * area is mapped twice back to back, so that any chunk of up to the
+ * ring size is contiguous in memory regardless of where it starts.
+ *
+ * Each side tells the other one that it needs a wakeup by setting its
+ * waiting flag. The wakeup itself is delivered through eventfd by the
+ * user of this API.
+ */
+typedef struct dbus_log_shm DBusLogShm;
+
+/* Creates a new memfd, the caller owns the returned descriptor */
+DBusLogShm*
+dbus_log_shm_new(
+    gsize size,
+    int* fd);
+
+/* Maps the existing one, doesn't take the ownership of the descriptor */
+DBusLogShm*
+dbus_log_shm_map(
+    int fd);
+
+void
+dbus_log_shm_free(
+    DBusLogShm* shm);
+
+gsize
+dbus_log_shm_size(
+    DBusLogShm* shm);
+
+/* Writer side */
+
+/* Copies as much as fits, the data remains invisible until commit */
+gsize
+dbus_log_shm_write(
+    DBusLogShm* shm,
+    const void* data,
+    gsize size);
+
+/* Returns TRUE if the reader needs to be woken up */
+gboolean
+dbus_log_shm_commit(
+    DBusLogShm* shm);
+
+/* Returns FALSE if there's already some space and no need to wait */
+gboolean
+dbus_log_shm_wait_space(
+    DBusLogShm* shm);
+
+/* Reader side */
+
+/* Returns pointer to the unread data, clears the waiting flag */
+const void*
+dbus_log_shm_peek(
+    DBusLogShm* shm,
+    gsize* size);
+
+/* Returns TRUE if the writer needs to be woken up */
+gboolean
+dbus_log_shm_consume(
+    DBusLogShm* shm,
+    gsize size);
+
+/* Returns FALSE if there's already some data and no need to wait */
+gboolean
+dbus_log_shm_wait_data(
+    DBusLogShm* shm);
+
+G_END_DECLS
+
+#endif /* DBUSLOG_SHM_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
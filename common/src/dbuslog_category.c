@@ -59,6 +59,7 @@ dbus_log_category_new(
     DBusLogCategory* cat = &priv->pub;
     priv->ref_count = 1;
     cat->level = DBUSLOG_LEVEL_UNDEFINED;
+    cat->max_level = DBUSLOG_LEVEL_UNDEFINED;
     cat->name = priv->name = g_strdup(name);
     cat->id = id;
     return cat;
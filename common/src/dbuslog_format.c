@@ -0,0 +1,732 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_format.h"
+
+#include <gutil_macros.h>
+#include <gutil_log.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum dbus_log_format_arg {
+    DBUSLOG_FORMAT_ARG_NONE,    /* %% */
+    DBUSLOG_FORMAT_ARG_INT,     /* int, 4 bytes */
+    DBUSLOG_FORMAT_ARG_INT64,   /* long, long long, size_t etc, 8 bytes */
+    DBUSLOG_FORMAT_ARG_DOUBLE,  /* double, 8 bytes */
+    DBUSLOG_FORMAT_ARG_STRING,  /* 4 bytes length followed by the data */
+    DBUSLOG_FORMAT_ARG_POINTER  /* pointer, 8 bytes */
+} DBUSLOG_FORMAT_ARG;
+
+typedef enum dbus_log_format_lmod {
+    DBUSLOG_FORMAT_LMOD_NONE,
+    DBUSLOG_FORMAT_LMOD_HH,
+    DBUSLOG_FORMAT_LMOD_H,
+    DBUSLOG_FORMAT_LMOD_L,
+    DBUSLOG_FORMAT_LMOD_LL,
+    DBUSLOG_FORMAT_LMOD_Z,
+    DBUSLOG_FORMAT_LMOD_J,
+    DBUSLOG_FORMAT_LMOD_T
+} DBUSLOG_FORMAT_LMOD;
+
+typedef struct dbus_log_format_spec {
+    guint text_start;           /* Literal text preceding the conversion */
+    guint text_len;
+    char* spec;                 /* Normalized conversion spec */
+    DBUSLOG_FORMAT_ARG arg;
+    DBUSLOG_FORMAT_LMOD lmod;
+    gboolean is_signed;
+    gboolean star_precision;
+    guint stars;                /* Number of '*' (0, 1 or 2) */
+    int precision;              /* Explicit precision or -1 */
+} DBusLogFormatSpec;
+
+typedef struct dbus_log_format_priv {
+    DBusLogFormat pub;
+    gint ref_count;
+    char* format;
+    DBusLogFormatSpec* specs;
+    guint count;
+    guint tail;                 /* Start of the trailing literal text */
+} DBusLogFormatPriv;
+
+#define DBUSLOG_FORMAT_NULL_STRING (0xffffffff)
+
+static
+inline
+DBusLogFormatPriv*
+dbus_log_format_cast(
+    DBusLogFormat* format)
+{
+    return G_CAST(format, DBusLogFormatPriv, pub);
+}
+
+/*==========================================================================*
+ * Parsing
+ *==========================================================================*/
+
+static
+const char*
+dbus_log_format_skip_digits(
+    const char* ptr)
+{
+    while (g_ascii_isdigit(*ptr)) ptr++;
+    return ptr;
+}
+
+/* Returns NULL if the conversion can't be packed */
+static
+const char*
+dbus_log_format_parse_spec(
+    const char* start,
+    DBusLogFormatSpec* spec)
+{
+    const char* ptr = start + 1;
+    const char* lmod_start;
+    const char* modifier = "";
+
+    spec->precision = -1;
+    if (*ptr == '%') {
+        spec->arg = DBUSLOG_FORMAT_ARG_NONE;
+        return ptr + 1;
+    }
+
+    /* Flags */
+    while (*ptr && strchr("-+ #0'", *ptr)) ptr++;
+
+    /* Field width */
+    if (*ptr == '*') {
+        spec->stars++;
+        ptr++;
+    }
+    if (*dbus_log_format_skip_digits(ptr) == '$') {
+        /* Positional arguments are not supported */
+        return NULL;
+    }
+    ptr = dbus_log_format_skip_digits(ptr);
+
+    /* Precision */
+    if (*ptr == '.') {
+        ptr++;
+        if (*ptr == '*') {
+            spec->stars++;
+            spec->star_precision = TRUE;
+            ptr++;
+            if (*dbus_log_format_skip_digits(ptr) == '$') {
+                return NULL;
+            }
+        } else {
+            spec->precision = atoi(ptr);
+            ptr = dbus_log_format_skip_digits(ptr);
+        }
+    }
+
+    /* Length modifier */
+    lmod_start = ptr;
+    switch (*ptr) {
+    case 'h':
+        if (ptr[1] == 'h') {
+            spec->lmod = DBUSLOG_FORMAT_LMOD_HH;
+            ptr += 2;
+        } else {
+            spec->lmod = DBUSLOG_FORMAT_LMOD_H;
+            ptr++;
+        }
+        break;
+    case 'l':
+        if (ptr[1] == 'l') {
+            spec->lmod = DBUSLOG_FORMAT_LMOD_LL;
+            ptr += 2;
+        } else {
+            spec->lmod = DBUSLOG_FORMAT_LMOD_L;
+            ptr++;
+        }
+        break;
+    case 'z':
+        spec->lmod = DBUSLOG_FORMAT_LMOD_Z;
+        ptr++;
+        break;
+    case 'j':
+        spec->lmod = DBUSLOG_FORMAT_LMOD_J;
+        ptr++;
+        break;
+    case 't':
+        spec->lmod = DBUSLOG_FORMAT_LMOD_T;
+        ptr++;
+        break;
+    }
+
+    /* Conversion */
+    switch (*ptr) {
+    case 'd':
+    case 'i':
+        spec->is_signed = TRUE;
+        /* fallthrough */
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        switch (spec->lmod) {
+        case DBUSLOG_FORMAT_LMOD_NONE:
+            spec->arg = DBUSLOG_FORMAT_ARG_INT;
+            break;
+        case DBUSLOG_FORMAT_LMOD_HH:
+            spec->arg = DBUSLOG_FORMAT_ARG_INT;
+            modifier = "hh";
+            break;
+        case DBUSLOG_FORMAT_LMOD_H:
+            spec->arg = DBUSLOG_FORMAT_ARG_INT;
+            modifier = "h";
+            break;
+        default:
+            spec->arg = DBUSLOG_FORMAT_ARG_INT64;
+            modifier = G_GINT64_MODIFIER;
+            break;
+        }
+        break;
+    case 'c':
+        if (spec->lmod != DBUSLOG_FORMAT_LMOD_NONE) return NULL;
+        spec->arg = DBUSLOG_FORMAT_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        /* %lf is the same as %f */
+        if (spec->lmod != DBUSLOG_FORMAT_LMOD_NONE &&
+            spec->lmod != DBUSLOG_FORMAT_LMOD_L) return NULL;
+        spec->arg = DBUSLOG_FORMAT_ARG_DOUBLE;
+        break;
+    case 's':
+        if (spec->lmod != DBUSLOG_FORMAT_LMOD_NONE) return NULL;
+        spec->arg = DBUSLOG_FORMAT_ARG_STRING;
+        break;
+    case 'p':
+        if (spec->lmod != DBUSLOG_FORMAT_LMOD_NONE) return NULL;
+        spec->arg = DBUSLOG_FORMAT_ARG_POINTER;
+        break;
+    default:
+        /* %n, %m, long double, wide characters and other oddities */
+        return NULL;
+    }
+
+    spec->spec = g_strdup_printf("%%%.*s%s%c", (int)(lmod_start - start - 1),
+        start + 1, modifier, *ptr);
+    return ptr + 1;
+}
+
+static
+gboolean
+dbus_log_format_parse(
+    DBusLogFormatPriv* priv)
+{
+    const char* format = priv->format;
+    const char* text = format;
+    const char* ptr = format;
+    GArray* specs = g_array_new(FALSE, TRUE, sizeof(DBusLogFormatSpec));
+
+    while ((ptr = strchr(ptr, '%')) != NULL) {
+        DBusLogFormatSpec spec;
+
+        memset(&spec, 0, sizeof(spec));
+        spec.text_start = text - format;
+        spec.text_len = ptr - text;
+        ptr = dbus_log_format_parse_spec(ptr, &spec);
+        if (ptr) {
+            g_array_append_val(specs, spec);
+            text = ptr;
+        } else {
+            guint i;
+
+            for (i = 0; i < specs->len; i++) {
+                g_free(g_array_index(specs, DBusLogFormatSpec, i).spec);
+            }
+            g_array_free(specs, TRUE);
+            return FALSE;
+        }
+    }
+
+    priv->tail = text - format;
+    priv->count = specs->len;
+    priv->specs = (DBusLogFormatSpec*)g_array_free(specs, FALSE);
+    return TRUE;
+}
+
+/*==========================================================================*
+ * Packing
+ *==========================================================================*/
+
+static
+inline
+void
+dbus_log_format_put_uint32(
+    guchar* ptr,
+    guint32 data)
+{
+    *ptr++ = data & 0xff;
+    *ptr++ = (data >> 8) & 0xff;
+    *ptr++ = (data >> 16) & 0xff;
+    *ptr = (data >> 24) & 0xff;
+}
+
+static
+inline
+void
+dbus_log_format_put_uint64(
+    guchar* ptr,
+    guint64 data)
+{
+    dbus_log_format_put_uint32(ptr, (guint32)data);
+    dbus_log_format_put_uint32(ptr + 4, (guint32)(data >> 32));
+}
+
+static
+inline
+guint32
+dbus_log_format_get_uint32(
+    const guchar* ptr)
+{
+    return ((guint32)(ptr[3]) << 24) |
+        ((guint32)(ptr[2]) << 16) |
+        ((guint32)(ptr[1]) << 8) |
+        ptr[0];
+}
+
+static
+inline
+guint64
+dbus_log_format_get_uint64(
+    const guchar* ptr)
+{
+    return ((guint64)dbus_log_format_get_uint32(ptr)) |
+        (((guint64)dbus_log_format_get_uint32(ptr + 4)) << 32);
+}
+
+/*
+ * Walks the argument list. If out is NULL, only calculates the size.
+ * It's called twice for each message, with separate copies of va_list.
+ */
+static
+gsize
+dbus_log_format_walk(
+    DBusLogFormatPriv* priv,
+    va_list args,
+    guchar* out)
+{
+    gsize size = 0;
+    guint i;
+
+    for (i = 0; i < priv->count; i++) {
+        const DBusLogFormatSpec* spec = priv->specs + i;
+        int precision = spec->precision;
+        guint k;
+
+        for (k = 0; k < spec->stars; k++) {
+            const int value = va_arg(args, int);
+
+            if (spec->star_precision && k == spec->stars - 1) {
+                precision = value;
+            }
+            if (out) {
+                dbus_log_format_put_uint32(out + size, value);
+            }
+            size += 4;
+        }
+
+        switch (spec->arg) {
+        case DBUSLOG_FORMAT_ARG_NONE:
+            break;
+        case DBUSLOG_FORMAT_ARG_INT:
+            {
+                const int value = va_arg(args, int);
+
+                if (out) {
+                    dbus_log_format_put_uint32(out + size, value);
+                }
+                size += 4;
+            }
+            break;
+        case DBUSLOG_FORMAT_ARG_INT64:
+            {
+                guint64 value;
+
+                switch (spec->lmod) {
+                case DBUSLOG_FORMAT_LMOD_L:
+                    value = spec->is_signed ?
+                        (guint64)(gint64)va_arg(args, long) :
+                        (guint64)va_arg(args, unsigned long);
+                    break;
+                case DBUSLOG_FORMAT_LMOD_Z:
+                    value = spec->is_signed ?
+                        (guint64)(gint64)va_arg(args, gssize) :
+                        (guint64)va_arg(args, gsize);
+                    break;
+                case DBUSLOG_FORMAT_LMOD_J:
+                    value = spec->is_signed ?
+                        (guint64)(gint64)va_arg(args, intmax_t) :
+                        (guint64)va_arg(args, uintmax_t);
+                    break;
+                case DBUSLOG_FORMAT_LMOD_T:
+                    value = spec->is_signed ?
+                        (guint64)(gint64)va_arg(args, ptrdiff_t) :
+                        (guint64)(gsize)va_arg(args, ptrdiff_t);
+                    break;
+                default:
+                    value = spec->is_signed ?
+                        (guint64)(gint64)va_arg(args, long long) :
+                        (guint64)va_arg(args, unsigned long long);
+                    break;
+                }
+                if (out) {
+                    dbus_log_format_put_uint64(out + size, value);
+                }
+                size += 8;
+            }
+            break;
+        case DBUSLOG_FORMAT_ARG_DOUBLE:
+            {
+                union { double d; guint64 u; } value;
+
+                value.d = va_arg(args, double);
+                if (out) {
+                    dbus_log_format_put_uint64(out + size, value.u);
+                }
+                size += 8;
+            }
+            break;
+        case DBUSLOG_FORMAT_ARG_STRING:
+            {
+                const char* str = va_arg(args, const char*);
+
+                if (str) {
+                    /* The string doesn't have to be NULL-terminated
+                     * if the precision is specified */
+                    const gsize len = (precision >= 0) ?
+                        strnlen(str, precision) : strlen(str);
+
+                    if (out) {
+                        dbus_log_format_put_uint32(out + size, len);
+                        memcpy(out + size + 4, str, len);
+                    }
+                    size += 4 + len;
+                } else {
+                    if (out) {
+                        dbus_log_format_put_uint32(out + size,
+                            DBUSLOG_FORMAT_NULL_STRING);
+                    }
+                    size += 4;
+                }
+            }
+            break;
+        case DBUSLOG_FORMAT_ARG_POINTER:
+            {
+                const gsize value = GPOINTER_TO_SIZE(va_arg(args, void*));
+
+                if (out) {
+                    dbus_log_format_put_uint64(out + size, value);
+                }
+                size += 8;
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+/*==========================================================================*
+ * Unpacking
+ *==========================================================================*/
+
+#define dbus_log_format_append(out,spec,stars,value) \
+    switch ((spec)->stars) { \
+    case 2: \
+        g_string_append_printf(out, (spec)->spec, stars[0], stars[1], value); \
+        break; \
+    case 1: \
+        g_string_append_printf(out, (spec)->spec, stars[0], value); \
+        break; \
+    default: \
+        g_string_append_printf(out, (spec)->spec, value); \
+        break; \
+    }
+
+static
+gboolean
+dbus_log_format_append_spec(
+    GString* out,
+    const DBusLogFormatSpec* spec,
+    const guchar** data,
+    const guchar* end)
+{
+    const guchar* ptr = *data;
+    int stars[2];
+    guint k;
+
+    for (k = 0; k < spec->stars; k++) {
+        if (ptr + 4 > end) return FALSE;
+        stars[k] = (gint32)dbus_log_format_get_uint32(ptr);
+        ptr += 4;
+    }
+
+    switch (spec->arg) {
+    case DBUSLOG_FORMAT_ARG_NONE:
+        g_string_append_c(out, '%');
+        break;
+    case DBUSLOG_FORMAT_ARG_INT:
+        if (ptr + 4 > end) return FALSE;
+        dbus_log_format_append(out, spec, stars,
+            (int)dbus_log_format_get_uint32(ptr));
+        ptr += 4;
+        break;
+    case DBUSLOG_FORMAT_ARG_INT64:
+        if (ptr + 8 > end) return FALSE;
+        dbus_log_format_append(out, spec, stars,
+            dbus_log_format_get_uint64(ptr));
+        ptr += 8;
+        break;
+    case DBUSLOG_FORMAT_ARG_DOUBLE:
+        if (ptr + 8 > end) return FALSE;
+        {
+            union { double d; guint64 u; } value;
+
+            value.u = dbus_log_format_get_uint64(ptr);
+            dbus_log_format_append(out, spec, stars, value.d);
+        }
+        ptr += 8;
+        break;
+    case DBUSLOG_FORMAT_ARG_STRING:
+        if (ptr + 4 > end) return FALSE;
+        {
+            const guint32 len = dbus_log_format_get_uint32(ptr);
+
+            ptr += 4;
+            if (len == DBUSLOG_FORMAT_NULL_STRING) {
+                dbus_log_format_append(out, spec, stars, (char*)NULL);
+            } else if (len > (gsize)(end - ptr)) {
+                return FALSE;
+            } else {
+                char* str = g_strndup((const char*)ptr, len);
+
+                dbus_log_format_append(out, spec, stars, str);
+                g_free(str);
+                ptr += len;
+            }
+        }
+        break;
+    case DBUSLOG_FORMAT_ARG_POINTER:
+        if (ptr + 8 > end) return FALSE;
+        dbus_log_format_append(out, spec, stars,
+            GSIZE_TO_POINTER((gsize)dbus_log_format_get_uint64(ptr)));
+        ptr += 8;
+        break;
+    }
+
+    *data = ptr;
+    return TRUE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogFormat*
+dbus_log_format_new(
+    const char* format,
+    guint32 id)
+{
+    DBusLogFormatPriv* priv = g_slice_new0(DBusLogFormatPriv);
+    DBusLogFormat* fmt = &priv->pub;
+
+    priv->ref_count = 1;
+    fmt->format = priv->format = g_strdup(format ? format : "");
+    fmt->id = id;
+    fmt->can_pack = dbus_log_format_parse(priv);
+    return fmt;
+}
+
+static
+void
+dbus_log_format_finalize(
+    DBusLogFormatPriv* priv)
+{
+    guint i;
+
+    for (i = 0; i < priv->count; i++) {
+        g_free(priv->specs[i].spec);
+    }
+    g_free(priv->specs);
+    g_free(priv->format);
+    g_slice_free(DBusLogFormatPriv, priv);
+}
+
+DBusLogFormat*
+dbus_log_format_ref(
+    DBusLogFormat* fmt)
+{
+    if (G_LIKELY(fmt)) {
+        DBusLogFormatPriv* priv = dbus_log_format_cast(fmt);
+        GASSERT(priv->ref_count > 0);
+        g_atomic_int_inc(&priv->ref_count);
+    }
+    return fmt;
+}
+
+void
+dbus_log_format_unref(
+    DBusLogFormat* fmt)
+{
+    if (G_LIKELY(fmt)) {
+        DBusLogFormatPriv* priv = dbus_log_format_cast(fmt);
+        GASSERT(priv->ref_count > 0);
+        if (g_atomic_int_dec_and_test(&priv->ref_count)) {
+            dbus_log_format_finalize(priv);
+        }
+    }
+}
+
+void
+dbus_log_format_free(
+    gpointer fmt)
+{
+    dbus_log_format_unref(fmt);
+}
+
+gsize
+dbus_log_format_pack_size(
+    DBusLogFormat* fmt,
+    va_list args)
+{
+    if (G_LIKELY(fmt) && G_LIKELY(fmt->can_pack)) {
+        gsize size;
+        va_list va;
+
+        va_copy(va, args);
+        size = dbus_log_format_walk(dbus_log_format_cast(fmt), va, NULL);
+        va_end(va);
+        return size;
+    }
+    return 0;
+}
+
+void
+dbus_log_format_pack_into(
+    DBusLogFormat* fmt,
+    va_list args,
+    void* buf)
+{
+    if (G_LIKELY(fmt) && G_LIKELY(fmt->can_pack) && G_LIKELY(buf)) {
+        va_list va;
+
+        va_copy(va, args);
+        dbus_log_format_walk(dbus_log_format_cast(fmt), va, buf);
+        va_end(va);
+    }
+}
+
+void*
+dbus_log_format_pack(
+    DBusLogFormat* fmt,
+    va_list args,
+    gsize* size)
+{
+    const gsize n = dbus_log_format_pack_size(fmt, args);
+    void* data = NULL;
+
+    if (n) {
+        data = g_malloc(n);
+        dbus_log_format_pack_into(fmt, args, data);
+    }
+    if (size) *size = n;
+    return data;
+}
+
+gboolean
+dbus_log_format_unpack_append(
+    DBusLogFormat* fmt,
+    const void* data,
+    gsize size,
+    GString* out)
+{
+    if (G_LIKELY(fmt) && G_LIKELY(fmt->can_pack) && G_LIKELY(out)) {
+        DBusLogFormatPriv* priv = dbus_log_format_cast(fmt);
+        const guchar* ptr = data;
+        const guchar* end = ptr + size;
+        const gsize start = out->len;
+        guint i;
+
+        for (i = 0; i < priv->count; i++) {
+            const DBusLogFormatSpec* spec = priv->specs + i;
+
+            g_string_append_len(out, priv->format + spec->text_start,
+                spec->text_len);
+            if (!dbus_log_format_append_spec(out, spec, &ptr, end)) {
+                GDEBUG("Malformed arguments for \"%s\"", priv->format);
+                g_string_truncate(out, start);
+                return FALSE;
+            }
+        }
+        g_string_append(out, priv->format + priv->tail);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+char*
+dbus_log_format_unpack(
+    DBusLogFormat* fmt,
+    const void* data,
+    gsize size,
+    gsize* length)
+{
+    if (G_LIKELY(fmt) && G_LIKELY(fmt->can_pack)) {
+        GString* out = g_string_sized_new(strlen(fmt->format) + size);
+
+        if (dbus_log_format_unpack_append(fmt, data, size, out)) {
+            if (length) *length = out->len;
+            return g_string_free(out, FALSE);
+        }
+        g_string_free(out, TRUE);
+    }
+    return NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
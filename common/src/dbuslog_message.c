@@ -37,10 +37,59 @@
 
 #include <glib/gprintf.h>
 
-typedef struct dbus_log_message_priv {
+/*
+ * The message header and the data (the text or the serialized arguments)
+ * are allocated as a single block. Blocks of the common sizes are not
+ * freed but recycled through the per-size-class free lists, so that in
+ * the steady state messages are created and destroyed without touching
+ * the heap. Each free list is limited to DBUSLOG_MESSAGE_POOL_BYTES.
+ *
+ * The free lists are lock-free stacks. Blocks are pushed one by one but
+ * only ever taken off as a whole, into the cache of the allocating thread
+ * which then hands them out one by one. Taking the whole list can't be
+ * fooled by the same block being popped and pushed back in between (the
+ * ABA problem) the way popping a single block could. The cache goes back
+ * to the free lists when the thread exits.
+ */
+#define DBUSLOG_MESSAGE_MIN_DATA_SHIFT  (6)     /* 64 bytes */
+#define DBUSLOG_MESSAGE_SIZE_CLASSES    (6)     /* Up to 2048 bytes */
+#define DBUSLOG_MESSAGE_POOL_BYTES      (0x10000)
+#define DBUSLOG_MESSAGE_NO_SIZE_CLASS   DBUSLOG_MESSAGE_SIZE_CLASSES
+#define DBUSLOG_MESSAGE_CLASS_SIZE(c)   \
+    (1 << ((c) + DBUSLOG_MESSAGE_MIN_DATA_SHIFT))
+
+/* Messages shorter than that are formatted on stack and then copied */
+#define DBUSLOG_MESSAGE_STACK_BUF       (256)
+
+typedef struct dbus_log_message_priv DBusLogMessagePriv;
+struct dbus_log_message_priv {
     DBusLogMessage pub;
+    DBusLogMessagePriv* next;   /* Free list or dbus_log_message_next */
     gint ref_count;
-} DBusLogMessagePriv;
+    guint size_class;
+    DBusLogFormat* format;
+    gsize args_size;
+};
+
+#define DBUSLOG_MESSAGE_DATA(priv) ((char*)((priv) + 1))
+
+typedef struct dbus_log_message_pool {
+    DBusLogMessagePriv* free;
+    gint count;
+} DBusLogMessagePool;
+
+typedef struct dbus_log_message_cache {
+    DBusLogMessagePriv* free[DBUSLOG_MESSAGE_SIZE_CLASSES];
+} DBusLogMessageCache;
+
+static
+void
+dbus_log_message_cache_free(
+    gpointer data);
+
+static DBusLogMessagePool dbus_log_message_pool[DBUSLOG_MESSAGE_SIZE_CLASSES];
+static GPrivate dbus_log_message_cache =
+    G_PRIVATE_INIT(dbus_log_message_cache_free);
 
 static
 inline
@@ -51,26 +100,162 @@ dbus_log_message_cast(
     return G_CAST(msg, DBusLogMessagePriv, pub);
 }
 
+static
+guint
+dbus_log_message_size_class(
+    gsize size)
+{
+    guint c;
+    for (c = 0; c < DBUSLOG_MESSAGE_SIZE_CLASSES; c++) {
+        if (size <= DBUSLOG_MESSAGE_CLASS_SIZE(c)) {
+            break;
+        }
+    }
+    return c;
+}
+
+/* Returns the block to the free list, unless the list is full */
+static
+void
+dbus_log_message_push(
+    DBusLogMessagePriv* priv)
+{
+    DBusLogMessagePool* pool = dbus_log_message_pool + priv->size_class;
+    const gint max = DBUSLOG_MESSAGE_POOL_BYTES /
+        DBUSLOG_MESSAGE_CLASS_SIZE(priv->size_class);
+
+    if (g_atomic_int_add(&pool->count, 1) < max) {
+        DBusLogMessagePriv* head;
+
+        do {
+            head = g_atomic_pointer_get(&pool->free);
+            priv->next = head;
+        } while (!g_atomic_pointer_compare_and_exchange(&pool->free,
+            head, priv));
+    } else {
+        g_atomic_int_add(&pool->count, -1);
+        g_free(priv);
+    }
+}
+
+/* Takes the whole free list, returns NULL if it's empty */
 static
 DBusLogMessagePriv*
-dbus_log_message_alloc()
+dbus_log_message_take_all(
+    DBusLogMessagePool* pool)
 {
-    DBusLogMessagePriv* priv = g_slice_new0(DBusLogMessagePriv);
+    DBusLogMessagePriv* list;
+
+    do {
+        list = g_atomic_pointer_get(&pool->free);
+    } while (list && !g_atomic_pointer_compare_and_exchange(&pool->free,
+        list, NULL));
+
+    if (list) {
+        DBusLogMessagePriv* priv;
+        gint n = 0;
+
+        for (priv = list; priv; priv = priv->next) {
+            n++;
+        }
+        g_atomic_int_add(&pool->count, -n);
+    }
+    return list;
+}
+
+static
+void
+dbus_log_message_cache_free(
+    gpointer data)
+{
+    DBusLogMessageCache* cache = data;
+    guint c;
+
+    for (c = 0; c < DBUSLOG_MESSAGE_SIZE_CLASSES; c++) {
+        DBusLogMessagePriv* priv = cache->free[c];
+
+        while (priv) {
+            DBusLogMessagePriv* next = priv->next;
+
+            dbus_log_message_push(priv);
+            priv = next;
+        }
+    }
+    g_free(cache);
+}
+
+/* Allocates a message with room for at least size bytes of data */
+static
+DBusLogMessagePriv*
+dbus_log_message_alloc(
+    gsize size)
+{
+    const guint c = dbus_log_message_size_class(size);
+    DBusLogMessagePriv* priv = NULL;
+
+    if (c < DBUSLOG_MESSAGE_SIZE_CLASSES) {
+        DBusLogMessageCache* cache = g_private_get(&dbus_log_message_cache);
+
+        if (!cache) {
+            cache = g_new0(DBusLogMessageCache, 1);
+            g_private_set(&dbus_log_message_cache, cache);
+        }
+        if (!cache->free[c]) {
+            cache->free[c] = dbus_log_message_take_all(
+                dbus_log_message_pool + c);
+        }
+        priv = cache->free[c];
+        if (priv) {
+            cache->free[c] = priv->next;
+        } else {
+            priv = g_malloc(sizeof(DBusLogMessagePriv) +
+                DBUSLOG_MESSAGE_CLASS_SIZE(c));
+        }
+    } else {
+        priv = g_malloc(sizeof(DBusLogMessagePriv) + size);
+    }
+    memset(priv, 0, sizeof(*priv));
     priv->ref_count = 1;
+    priv->size_class = c;
     return priv;
 }
 
+static
+void
+dbus_log_message_free(
+    DBusLogMessagePriv* priv)
+{
+    if (priv->size_class < DBUSLOG_MESSAGE_SIZE_CLASSES) {
+        dbus_log_message_push(priv);
+    } else {
+        g_free(priv);
+    }
+}
+
 DBusLogMessage*
 dbus_log_message_new(
     const char* str)
 {
-    DBusLogMessagePriv* priv = dbus_log_message_alloc();
+    if (str) {
+        return dbus_log_message_new_len(str, strlen(str));
+    } else {
+        return &dbus_log_message_alloc(0)->pub;
+    }
+}
+
+DBusLogMessage*
+dbus_log_message_new_len(
+    const char* str,
+    gsize length)
+{
+    DBusLogMessagePriv* priv = dbus_log_message_alloc(length + 1);
     DBusLogMessage* msg = &priv->pub;
+    msg->length = length;
+    msg->string = DBUSLOG_MESSAGE_DATA(priv);
     if (str) {
-        msg->length = strlen(str);
-        msg->string = g_new(char, msg->length + 1);
-        memcpy(msg->string, str, msg->length + 1);
+        memcpy(msg->string, str, length);
     }
+    msg->string[length] = 0;
     return msg;
 }
 
@@ -79,19 +264,56 @@ dbus_log_message_new_va(
     const char* format,
     va_list args)
 {
-    DBusLogMessagePriv* priv = dbus_log_message_alloc();
-    DBusLogMessage* msg = &priv->pub;
-    msg->length = g_vasprintf(&msg->string, format, args);
+    DBusLogMessage* msg;
+    char buf[DBUSLOG_MESSAGE_STACK_BUF];
+    va_list va;
+    int len;
+
+    /* Most messages are short enough to avoid formatting them twice */
+    va_copy(va, args);
+    len = g_vsnprintf(buf, sizeof(buf), format, va);
+    va_end(va);
+    if (len < 0) {
+        msg = dbus_log_message_new_len(NULL, 0);
+    } else if (len < (int)sizeof(buf)) {
+        msg = dbus_log_message_new_len(buf, len);
+    } else {
+        msg = dbus_log_message_new_len(NULL, len);
+        va_copy(va, args);
+        g_vsnprintf(msg->string, len + 1, format, va);
+        va_end(va);
+    }
     return msg;
 }
 
+DBusLogMessage*
+dbus_log_message_new_format(
+    DBusLogFormat* format,
+    va_list args)
+{
+    if (format->can_pack) {
+        /* Text gets formatted later, if anyone needs it */
+        const gsize size = dbus_log_format_pack_size(format, args);
+        DBusLogMessagePriv* priv = dbus_log_message_alloc(size);
+        priv->format = dbus_log_format_ref(format);
+        priv->args_size = size;
+        dbus_log_format_pack_into(format, args, DBUSLOG_MESSAGE_DATA(priv));
+        return &priv->pub;
+    } else {
+        return dbus_log_message_new_va(format->format, args);
+    }
+}
+
 static
 void
 dbus_log_message_finalize(
     DBusLogMessagePriv* priv)
 {
-    g_free(priv->pub.string);
-    g_slice_free(DBusLogMessagePriv, priv);
+    if (priv->pub.string != DBUSLOG_MESSAGE_DATA(priv)) {
+        g_free(priv->pub.string);
+    }
+    dbus_log_format_unref(priv->format);
+    dbus_log_message_free(priv);
 }
 
 DBusLogMessage*
@@ -119,6 +341,71 @@ dbus_log_message_unref(
     }
 }
 
+DBusLogFormat*
+dbus_log_message_format(
+    DBusLogMessage* msg)
+{
+    return G_LIKELY(msg) ? dbus_log_message_cast(msg)->format : NULL;
+}
+
+const void*
+dbus_log_message_args(
+    DBusLogMessage* msg,
+    gsize* size)
+{
+    if (G_LIKELY(msg)) {
+        DBusLogMessagePriv* priv = dbus_log_message_cast(msg);
+        if (priv->format) {
+            if (size) *size = priv->args_size;
+            return DBUSLOG_MESSAGE_DATA(priv);
+        }
+    }
+    if (size) *size = 0;
+    return NULL;
+}
+
+const char*
+dbus_log_message_text(
+    DBusLogMessage* msg)
+{
+    if (G_LIKELY(msg)) {
+        DBusLogMessagePriv* priv = dbus_log_message_cast(msg);
+        if (!msg->string && priv->format) {
+            msg->string = dbus_log_format_unpack(priv->format,
+                DBUSLOG_MESSAGE_DATA(priv), priv->args_size, &msg->length);
+            if (!msg->string) {
+                /* Shouldn't happen, we have packed it ourselves */
+                msg->length = strlen(priv->format->format);
+                msg->string = g_strdup(priv->format->format);
+            }
+        }
+        return msg->string;
+    }
+    return NULL;
+}
+
+DBusLogMessage*
+dbus_log_message_next(
+    DBusLogMessage* msg)
+{
+    if (G_LIKELY(msg)) {
+        DBusLogMessagePriv* next = dbus_log_message_cast(msg)->next;
+        return next ? &next->pub : NULL;
+    }
+    return NULL;
+}
+
+void
+dbus_log_message_set_next(
+    DBusLogMessage* msg,
+    DBusLogMessage* next)
+{
+    if (G_LIKELY(msg)) {
+        dbus_log_message_cast(msg)->next = next ?
+            dbus_log_message_cast(next) : NULL;
+    }
+}
+
 /*
  * Local Variables:
  * mode: C
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_shm.h"
+
+#include <gutil_log.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef MFD_CLOEXEC
+#  define MFD_CLOEXEC (0x0001U)
+#endif
+
+struct dbus_log_shm {
+    guchar* map;
+    gsize map_size;
+    guchar* data;
+    guint32 size;
+    guint32 pos;        /* Our own position (read or write) */
+    guint32 pending;    /* Written but not yet committed */
+    gboolean waiting;   /* Our own waiting flag is set */
+};
+
+#define DBUSLOG_SHM_FIELD(shm,offset) ((gint*)((shm)->map + (offset)))
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+int
+dbus_log_shm_memfd(
+    void)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, "dbuslog", MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static
+guint32
+dbus_log_shm_normalize_size(
+    gsize size)
+{
+    guint32 result = DBUSLOG_SHM_MIN_SIZE;
+
+    /* Power of 2 is also a multiple of the page size */
+    while (result < size && result < DBUSLOG_SHM_MAX_SIZE) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static
+DBusLogShm*
+dbus_log_shm_map_size(
+    int fd,
+    guint32 size)
+{
+    /* Reserve the address space, then map the data area twice */
+    const gsize total = DBUSLOG_SHM_DATA_OFFSET + 2 * (gsize)size;
+    guchar* map = mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+
+    if (map != MAP_FAILED) {
+        guchar* data = map + DBUSLOG_SHM_DATA_OFFSET;
+
+        if (mmap(map, DBUSLOG_SHM_DATA_OFFSET + size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+            mmap(data + size, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, DBUSLOG_SHM_DATA_OFFSET) !=
+            MAP_FAILED) {
+            DBusLogShm* shm = g_slice_new0(DBusLogShm);
+
+            shm->map = map;
+            shm->map_size = total;
+            shm->data = data;
+            shm->size = size;
+            return shm;
+        }
+        GWARN("Failed to map shared memory: %s", strerror(errno));
+        munmap(map, total);
+    } else {
+        GWARN("Failed to reserve address space: %s", strerror(errno));
+    }
+    return NULL;
+}
+
+inline static
+guint32
+dbus_log_shm_get(
+    DBusLogShm* shm,
+    guint offset)
+{
+    return (guint32)g_atomic_int_get(DBUSLOG_SHM_FIELD(shm, offset));
+}
+
+/* Sets our own waiting flag */
+static
+void
+dbus_log_shm_wait(
+    DBusLogShm* shm,
+    guint flag_offset)
+{
+    if (!shm->waiting) {
+        /* Full barrier, the other side's position is loaded after that */
+        shm->waiting = TRUE;
+        g_atomic_int_compare_and_exchange(DBUSLOG_SHM_FIELD(shm,
+            flag_offset), 0, 1);
+    }
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogShm*
+dbus_log_shm_new(
+    gsize size,
+    int* fd_out)
+{
+    const int fd = dbus_log_shm_memfd();
+
+    if (fd >= 0) {
+        const guint32 ring_size = dbus_log_shm_normalize_size(size);
+        DBusLogShm* shm;
+
+        if (ftruncate(fd, DBUSLOG_SHM_DATA_OFFSET + ring_size) == 0 &&
+            (shm = dbus_log_shm_map_size(fd, ring_size)) != NULL) {
+            *DBUSLOG_SHM_FIELD(shm, DBUSLOG_SHM_MAGIC_OFFSET) =
+                DBUSLOG_SHM_MAGIC;
+            *DBUSLOG_SHM_FIELD(shm, DBUSLOG_SHM_SIZE_OFFSET) = ring_size;
+            *fd_out = fd;
+            return shm;
+        }
+        close(fd);
+    } else {
+        GWARN("Failed to create memfd: %s", strerror(errno));
+    }
+    return NULL;
+}
+
+DBusLogShm*
+dbus_log_shm_map(
+    int fd)
+{
+    guint32 header[2];
+    struct stat st;
+
+    if (pread(fd, header, sizeof(header), 0) == sizeof(header) &&
+        fstat(fd, &st) == 0) {
+        const guint32 size = header[1];
+
+        if (header[0] == DBUSLOG_SHM_MAGIC &&
+            size >= DBUSLOG_SHM_MIN_SIZE && size <= DBUSLOG_SHM_MAX_SIZE &&
+            !(size & (size - 1)) &&
+            st.st_size >= (off_t)(DBUSLOG_SHM_DATA_OFFSET + size)) {
+            DBusLogShm* shm = dbus_log_shm_map_size(fd, size);
+
+            if (shm) {
+                shm->pos = dbus_log_shm_get(shm, DBUSLOG_SHM_READ_POS_OFFSET);
+                return shm;
+            }
+        } else {
+            GWARN("Invalid shared memory header");
+        }
+    } else {
+        GWARN("Failed to read shared memory header: %s", strerror(errno));
+    }
+    return NULL;
+}
+
+void
+dbus_log_shm_free(
+    DBusLogShm* shm)
+{
+    if (G_LIKELY(shm)) {
+        munmap(shm->map, shm->map_size);
+        g_slice_free(DBusLogShm, shm);
+    }
+}
+
+gsize
+dbus_log_shm_size(
+    DBusLogShm* shm)
+{
+    return G_LIKELY(shm) ? shm->size : 0;
+}
+
+gsize
+dbus_log_shm_write(
+    DBusLogShm* shm,
+    const void* data,
+    gsize size)
+{
+    const guint32 pos = shm->pos + shm->pending;
+    const guint32 used = pos - dbus_log_shm_get(shm,
+        DBUSLOG_SHM_READ_POS_OFFSET);
+    const gsize n = MIN(size, shm->size - used);
+
+    if (shm->waiting) {
+        shm->waiting = FALSE;
+        g_atomic_int_set(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_WRITER_WAITING_OFFSET), 0);
+    }
+    /* The second mapping takes care of the wraparound */
+    memcpy(shm->data + (pos & (shm->size - 1)), data, n);
+    shm->pending += n;
+    return n;
+}
+
+gboolean
+dbus_log_shm_commit(
+    DBusLogShm* shm)
+{
+    if (shm->pending) {
+        /* Full barrier, the reader's flag is loaded after that */
+        g_atomic_int_add(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_WRITE_POS_OFFSET), shm->pending);
+        shm->pos += shm->pending;
+        shm->pending = 0;
+        return g_atomic_int_get(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_READER_WAITING_OFFSET)) != 0;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_shm_wait_space(
+    DBusLogShm* shm)
+{
+    dbus_log_shm_wait(shm, DBUSLOG_SHM_WRITER_WAITING_OFFSET);
+    return (shm->pos + shm->pending - dbus_log_shm_get(shm,
+        DBUSLOG_SHM_READ_POS_OFFSET)) >= shm->size;
+}
+
+const void*
+dbus_log_shm_peek(
+    DBusLogShm* shm,
+    gsize* size)
+{
+    if (shm->waiting) {
+        shm->waiting = FALSE;
+        g_atomic_int_set(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_READER_WAITING_OFFSET), 0);
+    }
+    *size = dbus_log_shm_get(shm, DBUSLOG_SHM_WRITE_POS_OFFSET) - shm->pos;
+    return shm->data + (shm->pos & (shm->size - 1));
+}
+
+gboolean
+dbus_log_shm_consume(
+    DBusLogShm* shm,
+    gsize size)
+{
+    if (size) {
+        /* Full barrier, the writer's flag is loaded after that */
+        g_atomic_int_add(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_READ_POS_OFFSET), size);
+        shm->pos += size;
+        return g_atomic_int_get(DBUSLOG_SHM_FIELD(shm,
+            DBUSLOG_SHM_WRITER_WAITING_OFFSET)) != 0;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_shm_wait_data(
+    DBusLogShm* shm)
+{
+    dbus_log_shm_wait(shm, DBUSLOG_SHM_READER_WAITING_OFFSET);
+    return dbus_log_shm_get(shm, DBUSLOG_SHM_WRITE_POS_OFFSET) == shm->pos;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -40,6 +40,10 @@ make DESTDIR=%{buildroot} LIBDIR=%{_libdir} -C server install-dev
 
 #############################################################################
 
+# ABI change in 1.0.23: DBusLogCategory has grown the max_level field.
+# The structure is always allocated by the library, so the programs built
+# against the older headers keep working. The ones using DBUSLOG_ENABLED()
+# read the new field and must require libdbuslogserver >= 1.0.23.
 %package -n libdbuslogserver-common-devel
 Summary: Common development files
 
@@ -34,6 +34,8 @@
 #define DBUSLOG_SERVER_H
 
 #include "dbuslog_server_types.h"
+#include "dbuslog_category.h"
+#include "dbuslog_format.h"
 #include "dbuslog_protocol.h"
 
 G_BEGIN_DECLS
@@ -92,18 +94,86 @@ dbus_log_server_set_default_level(
     DBusLogServer* server,
     DBUSLOG_LEVEL level);
 
+/*
+ * By default, nothing is logged while no clients are connected.
+ * With keep_history set to TRUE, the messages are stored in the
+ * backlog even if no one is listening, and the clients can ask
+ * for them when they connect (LogOpen3). Since 1.0.23
+ */
+void
+dbus_log_server_set_keep_history(
+    DBusLogServer* server,
+    gboolean keep_history);
+
+/*
+ * Capacity of the pipes created for new clients and the limit up to
+ * which a pipe grows if its client can't keep up with the traffic.
+ * Clients may resize their pipes within the same limit. Zero size
+ * means the system default. Since 1.0.23
+ */
+void
+dbus_log_server_set_pipe_size(
+    DBusLogServer* server,
+    guint size,
+    guint max_size);
+
+/*
+ * What happens when a client can't keep up and its queue (as long as
+ * the backlog) is full. Applies to the clients connecting after this
+ * call, each client can change it for itself. The default is to drop
+ * the oldest messages. Since 1.0.23
+ */
+gboolean
+dbus_log_server_set_overflow_policy(
+    DBusLogServer* server,
+    DBUSLOG_OVERFLOW overflow);
+
+/* The clock used to timestamp the messages. Since 1.0.23 */
+gboolean
+dbus_log_server_set_clock(
+    DBusLogServer* server,
+    DBUSLOG_CLOCK clock);
+
 gboolean
 dbus_log_server_set_category_level(
     DBusLogServer* server,
     const char* name,
     DBUSLOG_LEVEL level); /* Since 1.0.19 */
 
-void
+/*
+ * The category handle returned by dbus_log_server_add_category() can
+ * be passed to dbus_log_server_log_cat() and dbus_log_server_logv_cat()
+ * to avoid looking up the category by name. The handle remains valid
+ * until the category is removed. The caller doesn't own the reference,
+ * if the handle needs to stay valid longer than that, it has to be
+ * referenced with dbus_log_category_ref(). Messages logged to a removed
+ * category are dropped.
+ */
+DBusLogCategory*
 dbus_log_server_add_category(
     DBusLogServer* server,
     const char* name,
     DBUSLOG_LEVEL level,
-    gulong flags);
+    gulong flags); /* Returns the handle since 1.0.23 */
+
+/*
+ * Checks whether a message of the given level would be logged to the
+ * category, by looking at the effective level cached in the handle.
+ * This allows to skip evaluating expensive arguments:
+ *
+ *   if (DBUSLOG_ENABLED(cat, DBUSLOG_LEVEL_VERBOSE)) {
+ *       dbus_log_server_log_cat(server, DBUSLOG_LEVEL_VERBOSE, cat,
+ *           hexdump(data, len));
+ *   }
+ *
+ * Nothing is enabled while no clients are connected, unless the server
+ * has been asked to keep the history. NULL handle (no category) is
+ * always considered enabled, the logging call decides then. The cat
+ * argument is evaluated more than once. The macro may be used on any
+ * thread. Since 1.0.23
+ */
+#define DBUSLOG_ENABLED(cat,level) (!(cat) || \
+    (gint)(level) <= g_atomic_int_get(&(cat)->max_level))
 
 gboolean
 dbus_log_server_remove_category(
@@ -129,6 +199,51 @@ dbus_log_server_logv(
     const char* format,
     va_list args);
 
+gboolean
+dbus_log_server_log_cat(
+    DBusLogServer* server,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* message); /* Since 1.0.23 */
+
+gboolean
+dbus_log_server_logv_cat(
+    DBusLogServer* server,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* format,
+    va_list args); /* Since 1.0.23 */
+
+/*
+ * Deferred formatting. The format string is registered once and
+ * the returned handle stays valid for the lifetime of the server.
+ * Messages logged with dbus_log_server_log_format() only have their
+ * arguments serialized by the calling thread, the text is produced
+ * by the clients (or by the server's main thread for the clients
+ * which can't do it). Formats which can't be handled that way (see
+ * DBusLogFormat) are formatted by the caller. Since 1.0.23
+ */
+DBusLogFormat*
+dbus_log_server_add_format(
+    DBusLogServer* server,
+    const char* format);
+
+gboolean
+dbus_log_server_log_format(
+    DBusLogServer* server,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    DBusLogFormat* format,
+    ...);
+
+gboolean
+dbus_log_server_logv_format(
+    DBusLogServer* server,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    DBusLogFormat* format,
+    va_list args);
+
 /* Signals */
 
 gulong
@@ -37,6 +37,20 @@
 
 #define DBUSLOG_SERVER_LOG_MODULE dbuslog_server_log
 
+/*
+ * Where the message timestamps come from. DBUSLOG_CLOCK_REALTIME_COARSE
+ * is only as precise as the kernel tick. DBUSLOG_CLOCK_MONOTONIC adds
+ * the monotonic time to the realtime base, which is periodically
+ * re-synced, so it takes a while to follow a change of the system
+ * time. Since 1.0.23
+ */
+typedef enum dbus_log_clock {
+    DBUSLOG_CLOCK_REALTIME,     /* Default */
+    DBUSLOG_CLOCK_REALTIME_COARSE,
+    DBUSLOG_CLOCK_MONOTONIC,
+    DBUSLOG_CLOCK_COUNT
+} DBUSLOG_CLOCK;
+
 #endif /* DBUSLOG_SERVER_TYPES_H */
 
 /*
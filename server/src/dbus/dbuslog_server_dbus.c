@@ -309,6 +309,10 @@ dbus_log_server_error(
         type = DBUS_ERROR_INVALID_ARGS;
         message = "Invalid argument(s)";
         break;
+    case -ENOENT:
+        type = DBUS_ERROR_FAILED;
+        message = "Log is not open";
+        break;
     default:
         type = DBUS_ERROR_FAILED;
         message = "Internal error";
@@ -365,12 +369,14 @@ dbus_log_server_dbus_handle_set_category_level(
 
 static
 DBusMessage*
-dbus_log_server_dbus_handle_log_open(
+dbus_log_server_dbus_open(
     DBusLogServerDbus* self,
-    DBusMessage* msg)
+    DBusMessage* msg,
+    guint flags,
+    guint history)
 {
     int fd = dbus_log_server_call_log_open(&self->server,
-        dbus_message_get_sender(msg));
+        dbus_message_get_sender(msg), flags, history);
     if (fd >= 0) {
         DBusMessageIter it;
         const dbus_uint32_t cookie = DBUSLOG_LOG_COOKIE;
@@ -384,6 +390,76 @@ dbus_log_server_dbus_handle_log_open(
     }
 }
 
+static
+DBusMessage*
+dbus_log_server_dbus_handle_log_open(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    return dbus_log_server_dbus_open(self, msg, 0, 0);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_log_open2(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    DBusMessageIter it;
+    dbus_uint32_t flags;
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &flags);
+    return dbus_log_server_dbus_open(self, msg, flags, 0);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_log_open3(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    DBusMessageIter it;
+    dbus_uint32_t flags, history;
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &flags);
+    dbus_message_iter_next(&it);
+    dbus_message_iter_get_basic(&it, &history);
+    return dbus_log_server_dbus_open(self, msg, flags, history);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_log_open_shm(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    DBusMessageIter it;
+    dbus_uint32_t flags, history, size;
+    int err, fds[3];
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &flags);
+    dbus_message_iter_next(&it);
+    dbus_message_iter_get_basic(&it, &history);
+    dbus_message_iter_next(&it);
+    dbus_message_iter_get_basic(&it, &size);
+    err = dbus_log_server_call_log_open_shm(&self->server,
+        dbus_message_get_sender(msg), flags, history, size, fds);
+    if (!err) {
+        int i;
+        const dbus_uint32_t cookie = DBUSLOG_LOG_COOKIE;
+        DBusMessage* reply = dbus_message_new_method_return(msg);
+        /* The descriptors get duplicated */
+        dbus_message_iter_init_append(reply, &it);
+        for (i=0; i<3; i++) {
+            dbus_message_iter_append_basic(&it, DBUS_TYPE_UNIX_FD, fds + i);
+        }
+        dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &cookie);
+        return reply;
+    } else {
+        return dbus_log_server_error(msg, err);
+    }
+}
+
 static
 DBusMessage*
 dbus_log_server_dbus_handle_log_close(
@@ -494,6 +570,203 @@ dbus_log_server_dbus_handle_set_backlog(
     return dbus_log_server_return(msg, err);
 }
 
+static
+DBusMessage*
+dbus_log_server_dbus_handle_set_pipe_size(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err = -EINVAL;
+    dbus_uint32_t cookie, size;
+    if (dbus_message_get_args(msg, NULL,
+        DBUS_TYPE_UINT32, &cookie,
+        DBUS_TYPE_UINT32, &size,
+        DBUS_TYPE_INVALID)) {
+        err = dbus_log_server_call_set_pipe_size(&self->server,
+            dbus_message_get_sender(msg), cookie, size);
+    }
+    return dbus_log_server_return(msg, err);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_set_overflow_policy(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err = -EINVAL;
+    dbus_uint32_t cookie, policy;
+    if (dbus_message_get_args(msg, NULL,
+        DBUS_TYPE_UINT32, &cookie,
+        DBUS_TYPE_UINT32, &policy,
+        DBUS_TYPE_INVALID)) {
+        err = dbus_log_server_call_set_overflow(&self->server,
+            dbus_message_get_sender(msg), cookie, policy);
+    }
+    return dbus_log_server_return(msg, err);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_session_set_level(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err = -EINVAL;
+    dbus_uint32_t cookie;
+    dbus_int32_t level;
+    if (dbus_message_get_args(msg, NULL,
+        DBUS_TYPE_UINT32, &cookie,
+        DBUS_TYPE_INT32, &level,
+        DBUS_TYPE_INVALID)) {
+        err = dbus_log_server_call_session_set_level(&self->server,
+            dbus_message_get_sender(msg), cookie, level);
+    }
+    return dbus_log_server_return(msg, err);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_session_set_category_level(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err = -EINVAL;
+    dbus_uint32_t cookie;
+    const char* name = NULL;
+    dbus_int32_t level;
+    if (dbus_message_get_args(msg, NULL,
+        DBUS_TYPE_UINT32, &cookie,
+        DBUS_TYPE_STRING, &name,
+        DBUS_TYPE_INT32, &level,
+        DBUS_TYPE_INVALID)) {
+        err = dbus_log_server_call_session_set_category_level(&self->server,
+            dbus_message_get_sender(msg), cookie, name, level);
+    }
+    return dbus_log_server_return(msg, err);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_session_set_categories(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err;
+    dbus_uint32_t cookie;
+    GStrV* names = NULL;
+    DBusMessageIter it, array;
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &cookie);
+    dbus_message_iter_next(&it);
+    dbus_message_iter_recurse(&it, &array);
+    while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING) {
+        const char* name = NULL;
+        dbus_message_iter_get_basic(&array, &name);
+        names = gutil_strv_add(names, name);
+        dbus_message_iter_next(&array);
+    }
+    err = dbus_log_server_call_session_set_categories(&self->server,
+        dbus_message_get_sender(msg), cookie, names);
+    g_strfreev(names);
+    return dbus_log_server_return(msg, err);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_session_set_content_filter(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    int err;
+    dbus_uint32_t cookie;
+    const char* regex = NULL;
+    GStrV* substrings = NULL;
+    DBusMessageIter it, array;
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &cookie);
+    dbus_message_iter_next(&it);
+    dbus_message_iter_recurse(&it, &array);
+    while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING) {
+        const char* str = NULL;
+        dbus_message_iter_get_basic(&array, &str);
+        substrings = gutil_strv_add(substrings, str);
+        dbus_message_iter_next(&array);
+    }
+    dbus_message_iter_next(&it);
+    dbus_message_iter_get_basic(&it, &regex);
+    err = dbus_log_server_call_session_set_content_filter(&self->server,
+        dbus_message_get_sender(msg), cookie, substrings, regex);
+    g_strfreev(substrings);
+    return dbus_log_server_return(msg, err);
+}
+
+static
+void
+dbus_log_server_dbus_append_stat(
+    DBusMessageIter* dict,
+    const char* key,
+    int type,
+    const void* value)
+{
+    const char signature[2] = { (char)type, 0 };
+    DBusMessageIter entry, variant;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+        &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+        signature, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+static
+DBusMessage*
+dbus_log_server_dbus_handle_get_statistics(
+    DBusLogServerDbus* self,
+    DBusMessage* msg)
+{
+    DBusLogSenderStats stats;
+    DBusMessageIter it;
+    dbus_uint32_t cookie;
+    int err;
+    dbus_message_iter_init(msg, &it);
+    dbus_message_iter_get_basic(&it, &cookie);
+    err = dbus_log_server_call_get_stats(&self->server,
+        dbus_message_get_sender(msg), cookie, &stats);
+    if (!err) {
+        DBusMessage* reply = dbus_message_new_method_return(msg);
+        DBusMessageIter dict;
+        const dbus_uint32_t pipe_size = stats.pipe_size;
+        const dbus_uint32_t max_pipe_size = stats.max_pipe_size;
+        const dbus_uint32_t pipe_resize_count = stats.pipe_resize_count;
+        const dbus_uint64_t dropped_count = stats.dropped_count;
+        const dbus_uint64_t dropped_bytes = stats.dropped_bytes;
+        dbus_message_iter_init_append(reply, &it);
+        dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY,
+            DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+            DBUS_TYPE_STRING_AS_STRING
+            DBUS_TYPE_VARIANT_AS_STRING
+            DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dict);
+        dbus_log_server_dbus_append_stat(&dict, DBUSLOG_STATS_PIPE_SIZE,
+            DBUS_TYPE_UINT32, &pipe_size);
+        dbus_log_server_dbus_append_stat(&dict, DBUSLOG_STATS_MAX_PIPE_SIZE,
+            DBUS_TYPE_UINT32, &max_pipe_size);
+        dbus_log_server_dbus_append_stat(&dict,
+            DBUSLOG_STATS_PIPE_RESIZE_COUNT, DBUS_TYPE_UINT32,
+            &pipe_resize_count);
+        dbus_log_server_dbus_append_stat(&dict,
+            DBUSLOG_STATS_DROPPED_COUNT, DBUS_TYPE_UINT64, &dropped_count);
+        dbus_log_server_dbus_append_stat(&dict,
+            DBUSLOG_STATS_DROPPED_BYTES, DBUS_TYPE_UINT64, &dropped_bytes);
+        dbus_message_iter_close_container(&it, &dict);
+        return reply;
+    } else {
+        return dbus_log_server_error(msg, err);
+    }
+}
+
 static
 void
 dbus_log_server_dbus_emit_default_level_changed(
@@ -676,6 +949,36 @@ dbus_log_server_dbus_filter(
                 },{
                     "SetBacklog", "i",
                     dbus_log_server_dbus_handle_set_backlog
+                },{
+                    "LogOpen2", "u",
+                    dbus_log_server_dbus_handle_log_open2
+                },{
+                    "LogOpen3", "uu",
+                    dbus_log_server_dbus_handle_log_open3
+                },{
+                    "LogOpenShm", "uuu",
+                    dbus_log_server_dbus_handle_log_open_shm
+                },{
+                    "SetPipeSize", "uu",
+                    dbus_log_server_dbus_handle_set_pipe_size
+                },{
+                    "GetStatistics", "u",
+                    dbus_log_server_dbus_handle_get_statistics
+                },{
+                    "SetOverflowPolicy", "uu",
+                    dbus_log_server_dbus_handle_set_overflow_policy
+                },{
+                    "SessionSetLevel", "ui",
+                    dbus_log_server_dbus_handle_session_set_level
+                },{
+                    "SessionSetCategoryLevel", "usi",
+                    dbus_log_server_dbus_handle_session_set_category_level
+                },{
+                    "SessionSetCategories", "uas",
+                    dbus_log_server_dbus_handle_session_set_categories
+                },{
+                    "SessionSetContentFilter", "uass",
+                    dbus_log_server_dbus_handle_session_set_content_filter
                 }
             };
             guint i;
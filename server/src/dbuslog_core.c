@@ -37,6 +37,8 @@
 #include <gutil_idlepool.h>
 #include <gutil_misc.h>
 
+#include <time.h>
+
 /* Log module (don't forward our own log) */
 GLogModule GLOG_MODULE_NAME = {
     "dbuslog",          /* name      */
@@ -48,17 +50,66 @@ GLogModule GLOG_MODULE_NAME = {
     0                   /* reserved2 */
 };
 
+/*
+ * Messages produced by arbitrary threads are pushed to a lock-free
+ * singly linked list (in LIFO order) and then handed over to the
+ * senders by the thread owning the main context. While any of the
+ * senders is blocked (DBUSLOG_OVERFLOW_BLOCK), the messages are held
+ * back in the pending list. The messages are linked to each other
+ * (see dbus_log_message_next), so queueing doesn't allocate anything.
+ */
+
+/*
+ * With DBUSLOG_CLOCK_MONOTONIC, the realtime base is re-synced by the
+ * thread owning the context. It writes the slot which isn't in use and
+ * then flips the slot index, so that the producers never see a half
+ * written base.
+ */
+#define DBUSLOG_CORE_CLOCK_SYNC_INTERVAL (10 * G_USEC_PER_SEC)
+
+/*
+ * Producers only look at the atomic levels. The categories table is
+ * only modified by the thread owning the context, under the writer
+ * lock. The producers look up the names under the reader lock (which
+ * doesn't make them wait for each other) and take a reference to the
+ * category they found. The top level is the most verbose level enabled
+ * by default or for any category, anything above it is thrown away
+ * without looking up the category.
+ */
+
 /* Object definition */
 struct dbus_log_core {
     GObject object;
     guint backlog;
     GUtilIdlePool* pool;
+    GMainContext* context;
+    DBusLogMessage* queue;
+    DBusLogMessage* pending;
+    DBusLogMessage* pending_last;
+    guint drain_id;
+    DBusLogHistory* history;
     GPtrArray* senders;
     GHashTable* categories;
+    GRWLock categories_lock;
+    GHashTable* formats;
     GHashTable* sender_signal_ids;
     guint last_cid;
+    guint32 last_fid;
     guint next_msg_index;
+    gboolean keep_history;
     DBUSLOG_LEVEL default_level;
+    gint max_level;
+    gint top_level;
+    gint clock;
+    gint clock_slot;
+    gint64 clock_base[2];
+    gint64 clock_synced;
+};
+
+enum dbus_log_core_sender_signal {
+    SENDER_SIGNAL_CLOSED,
+    SENDER_SIGNAL_UNBLOCKED,
+    SENDER_SIGNAL_COUNT
 };
 
 typedef GObjectClass DBusLogCoreClass;
@@ -108,6 +159,147 @@ dbus_log_core_sender_closed(
     dbus_log_core_remove_sender(DBUSLOG_CORE(user_data), sender);
 }
 
+static
+void
+dbus_log_core_drain(
+    DBusLogCore* self);
+
+static
+gboolean
+dbus_log_core_drain_pending(
+    gpointer user_data)
+{
+    DBusLogCore* self = DBUSLOG_CORE(user_data);
+
+    self->drain_id = 0;
+    dbus_log_core_drain(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+dbus_log_core_sender_unblocked(
+    DBusLogSender* sender,
+    gpointer user_data)
+{
+    DBusLogCore* self = DBUSLOG_CORE(user_data);
+
+    /* Not from here, the sender may be in the middle of something */
+    if (self->pending) {
+        const guint id = self->drain_id;
+
+        self->drain_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+            dbus_log_core_drain_pending, dbus_log_core_ref(self),
+            g_object_unref);
+        if (id) {
+            g_source_remove(id);
+        }
+    }
+}
+
+static
+void
+dbus_log_core_free_category(
+    gpointer data)
+{
+    DBusLogCategory* cat = data;
+
+    /* Stale handles must not let anything through */
+    cat->flags &= ~DBUSLOG_CATEGORY_FLAG_ENABLED;
+    g_atomic_int_set(&cat->max_level, DBUSLOG_LEVEL_UNDEFINED);
+    dbus_log_category_unref(cat);
+}
+
+static
+inline
+gboolean
+dbus_log_core_active(
+    DBusLogCore* self)
+{
+    return self->senders->len || self->keep_history;
+}
+
+static
+void
+dbus_log_core_update_category_level(
+    DBusLogCore* self,
+    DBusLogCategory* cat)
+{
+    gint max_level;
+
+    if (!dbus_log_core_active(self) ||
+        !(cat->flags & DBUSLOG_CATEGORY_FLAG_ENABLED)) {
+        max_level = DBUSLOG_LEVEL_UNDEFINED;
+    } else if (cat->level > DBUSLOG_LEVEL_UNDEFINED) {
+        /* Category has non-default log level */
+        max_level = cat->level;
+    } else {
+        max_level = self->max_level;
+    }
+
+    /* This is what DBUSLOG_ENABLED() looks at */
+    g_atomic_int_set(&cat->max_level, max_level);
+}
+
+static
+void
+dbus_log_core_update_top_level(
+    DBusLogCore* self)
+{
+    GHashTableIter it;
+    gpointer value;
+    gint top_level = self->max_level;
+
+    g_hash_table_iter_init(&it, self->categories);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        DBusLogCategory* cat = value;
+
+        top_level = MAX(top_level, cat->max_level);
+    }
+    g_atomic_int_set(&self->top_level, top_level);
+}
+
+static
+void
+dbus_log_core_category_level_changed(
+    DBusLogCore* self,
+    DBusLogCategory* cat)
+{
+    dbus_log_core_update_category_level(self, cat);
+    dbus_log_core_update_top_level(self);
+}
+
+static
+void
+dbus_log_core_update_levels(
+    DBusLogCore* self)
+{
+    GHashTableIter it;
+    gpointer value;
+
+    g_atomic_int_set(&self->max_level, !dbus_log_core_active(self) ?
+        DBUSLOG_LEVEL_UNDEFINED :
+        (self->default_level <= DBUSLOG_LEVEL_UNDEFINED) ?
+        (DBUSLOG_LEVEL_COUNT - 1) : self->default_level);
+
+    g_hash_table_iter_init(&it, self->categories);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        dbus_log_core_update_category_level(self, value);
+    }
+    dbus_log_core_update_top_level(self);
+}
+
+static
+void
+dbus_log_core_clear_categories(
+    DBusLogCore* self)
+{
+    g_rw_lock_writer_lock(&self->categories_lock);
+    g_hash_table_remove_all(self->categories);
+    g_rw_lock_writer_unlock(&self->categories_lock);
+    dbus_log_core_update_top_level(self);
+}
+
 static
 void
 dbus_log_core_emit_signal(
@@ -130,6 +322,7 @@ dbus_log_core_new(
 {
     DBusLogCore* self = g_object_new(DBUSLOG_CORE_TYPE, NULL);
     self->backlog = dbus_log_sender_normalize_backlog(backlog);
+    self->history = dbus_log_history_new(self->backlog);
     return self;
 }
 
@@ -154,48 +347,70 @@ dbus_log_core_unref(
     }
 }
 
+static
 DBusLogSender*
-dbus_log_core_new_sender(
+dbus_log_core_add_sender(
     DBusLogCore* self,
-    const char* name)
+    DBusLogSender* sender)
 {
-    DBusLogSender* sender = NULL;
-    if (G_LIKELY(self)) {
-        sender = dbus_log_sender_new(name, self->backlog);
-        if (sender) {
-            /*
-             * Replace the complete array in case if this function is
-             * indirectly invoked by dbus_log_core_logv.
-             */
-            guint i;
-            gulong signal_id;
-            GPtrArray* old = self->senders;
-            GPtrArray* new_array = g_ptr_array_new_full(old->len + 1,
-                dbus_log_core_free_sender);
-
-            /* Copy the old ones */
-            for (i=0; i<self->senders->len; i++) {
-                g_ptr_array_add(new_array,
-                    dbus_log_sender_ref(g_ptr_array_index(old, i)));
-            }
-
-            /* Add the new one */
-            g_ptr_array_add(new_array, dbus_log_sender_ref(sender));
+    if (sender) {
+        /*
+         * Replace the complete array in case if this function is
+         * indirectly invoked by dbus_log_core_logv.
+         */
+        guint i;
+        gulong* ids = g_new(gulong, SENDER_SIGNAL_COUNT);
+        GPtrArray* old = self->senders;
+        GPtrArray* new_array = g_ptr_array_new_full(old->len + 1,
+            dbus_log_core_free_sender);
 
-            /* Register for close notifications */
-            signal_id = dbus_log_sender_add_closed_handler(sender,
-                dbus_log_core_sender_closed, self);
-            g_hash_table_replace(self->sender_signal_ids, sender,
-                (gpointer)signal_id);
+        /* Copy the old ones */
+        for (i=0; i<self->senders->len; i++) {
+            g_ptr_array_add(new_array,
+                dbus_log_sender_ref(g_ptr_array_index(old, i)));
+        }
 
-            /* Swap the arrays */
-            self->senders = new_array;
-            g_ptr_array_unref(old);
+        /* Add the new one */
+        g_ptr_array_add(new_array, dbus_log_sender_ref(sender));
+        dbus_log_sender_set_queue_size(sender, self->backlog);
+
+        /* Register for notifications */
+        ids[SENDER_SIGNAL_CLOSED] = dbus_log_sender_add_closed_handler(sender,
+            dbus_log_core_sender_closed, self);
+        ids[SENDER_SIGNAL_UNBLOCKED] =
+            dbus_log_sender_add_unblocked_handler(sender,
+                dbus_log_core_sender_unblocked, self);
+        g_hash_table_replace(self->sender_signal_ids, sender, ids);
+
+        /* Swap the arrays */
+        self->senders = new_array;
+        g_ptr_array_unref(old);
+        if (new_array->len == 1) {
+            dbus_log_core_update_levels(self);
         }
     }
     return sender;
 }
 
+DBusLogSender*
+dbus_log_core_new_sender(
+    DBusLogCore* self,
+    const char* name)
+{
+    return G_LIKELY(self) ? dbus_log_core_add_sender(self,
+        dbus_log_sender_new_shared(name, self->history)) : NULL;
+}
+
+DBusLogSender*
+dbus_log_core_new_shm_sender(
+    DBusLogCore* self,
+    const char* name,
+    gsize size)
+{
+    return G_LIKELY(self) ? dbus_log_core_add_sender(self,
+        dbus_log_sender_new_shm(name, self->history, size)) : NULL;
+}
+
 gboolean
 dbus_log_core_remove_sender(
     DBusLogCore* self,
@@ -234,14 +449,20 @@ dbus_log_core_remove_sender(
                     dbus_log_sender_ref(g_ptr_array_index(old, i)));
             }
 
-            /* Unregister the handler */
-            dbus_log_sender_remove_handler(sender, (gulong)
-                g_hash_table_lookup(self->sender_signal_ids, sender));
+            /* Unregister the handlers */
+            dbus_log_sender_remove_handlers(sender, g_hash_table_lookup(
+                self->sender_signal_ids, sender), SENDER_SIGNAL_COUNT);
             GVERIFY(g_hash_table_remove(self->sender_signal_ids, sender));
 
             /* Swap the arrays */
             self->senders = new_array;
             g_ptr_array_unref(old);
+            if (!new_array->len) {
+                dbus_log_core_update_levels(self);
+            }
+
+            /* It may have been the one holding the messages back */
+            dbus_log_core_sender_unblocked(sender, self);
             removed = TRUE;
         }
     }
@@ -265,6 +486,7 @@ dbus_log_core_set_default_level(
         G_LIKELY(level < DBUSLOG_LEVEL_COUNT)) {
         if (self->default_level != level) {
             self->default_level = level;
+            dbus_log_core_update_levels(self);
             g_signal_emit(self, dbus_log_core_signals[SIGNAL_DEFAULT_LEVEL], 0);
         }
         return TRUE;
@@ -291,15 +513,78 @@ dbus_log_core_set_backlog(
             guint i;
 
             self->backlog = backlog;
-            for (i = 0; i < senders->len; i++) {
-                dbus_log_sender_set_backlog(g_ptr_array_index(senders, i),
-                    backlog);
+            dbus_log_history_set_max_size(self->history, backlog);
+            for (i=0; i<senders->len; i++) {
+                dbus_log_sender_set_queue_size(senders->pdata[i], backlog);
             }
             g_signal_emit(self, dbus_log_core_signals[SIGNAL_BACKLOG], 0);
         }
     }
 }
 
+void
+dbus_log_core_set_keep_history(
+    DBusLogCore* self,
+    gboolean keep_history)
+{
+    if (G_LIKELY(self)) {
+        keep_history = (keep_history != FALSE);
+        if (self->keep_history != keep_history) {
+            self->keep_history = keep_history;
+            dbus_log_core_update_levels(self);
+        }
+    }
+}
+
+static
+void
+dbus_log_core_clock_sync(
+    DBusLogCore* self)
+{
+    const gint slot = !g_atomic_int_get(&self->clock_slot);
+    const gint64 now = g_get_real_time();
+
+    self->clock_base[slot] = now - g_get_monotonic_time();
+    self->clock_synced = now;
+    g_atomic_int_set(&self->clock_slot, slot);
+}
+
+gboolean
+dbus_log_core_set_clock(
+    DBusLogCore* self,
+    DBUSLOG_CLOCK clock)
+{
+    if (G_LIKELY(self) && (guint)clock < DBUSLOG_CLOCK_COUNT) {
+        if (clock == DBUSLOG_CLOCK_MONOTONIC) {
+            dbus_log_core_clock_sync(self);
+        }
+        g_atomic_int_set(&self->clock, clock);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+dbus_log_core_replay(
+    DBusLogCore* self,
+    DBusLogSender* sender,
+    guint flags,
+    guint32 history)
+{
+    if (G_LIKELY(self) && G_LIKELY(sender)) {
+        DBusLogHistory* h = self->history;
+        guint64 cursor;
+
+        if (flags & DBUSLOG_OPEN_FLAG_HISTORY_SINCE) {
+            cursor = dbus_log_history_find(h, history);
+        } else {
+            cursor = dbus_log_history_end(h) -
+                MIN(history, (guint)dbus_log_history_size(h));
+        }
+        dbus_log_sender_rewind(sender, cursor);
+    }
+}
+
 DBusLogCategory*
 dbus_log_core_new_category(
     DBusLogCore* self,
@@ -322,7 +607,11 @@ dbus_log_core_new_category(
             if (flags & DBUSLOG_CATEGORY_FLAG_ENABLED) {
                 cat->flags |= DBUSLOG_CATEGORY_FLAG_ENABLED_BY_DEFAULT;
             }
+            dbus_log_core_update_category_level(self, cat);
+            g_rw_lock_writer_lock(&self->categories_lock);
             g_hash_table_replace(self->categories, (void*)cat->name, cat);
+            g_rw_lock_writer_unlock(&self->categories_lock);
+            dbus_log_core_update_top_level(self);
             dbus_log_core_emit_signal(self, cat, SIGNAL_CATEGORY_ADDED);
         }
         dbus_log_category_ref(cat);
@@ -391,7 +680,10 @@ dbus_log_core_remove_category(
         if (cat) {
             removed = TRUE;
             dbus_log_category_ref(cat);
+            g_rw_lock_writer_lock(&self->categories_lock);
             GVERIFY(g_hash_table_remove(self->categories, name));
+            g_rw_lock_writer_unlock(&self->categories_lock);
+            dbus_log_core_update_top_level(self);
             dbus_log_core_emit_signal(self, cat, SIGNAL_CATEGORY_REMOVED);
             dbus_log_category_unref(cat);
         }
@@ -410,14 +702,14 @@ dbus_log_core_remove_all_categories(
                 SIGNAL_CATEGORY_REMOVED], 0, FALSE)) {
                 GPtrArray* cats = dbus_log_core_get_categories(self);
                 g_ptr_array_ref(cats);
-                g_hash_table_remove_all(self->categories);
+                dbus_log_core_clear_categories(self);
                 for (i=0; i<cats->len; i++) {
                     dbus_log_core_emit_signal(self, g_ptr_array_index(cats, i),
                         SIGNAL_CATEGORY_REMOVED);
                 }
                 g_ptr_array_unref(cats);
             } else {
-                g_hash_table_remove_all(self->categories);
+                dbus_log_core_clear_categories(self);
             }
         }
     }
@@ -445,6 +737,7 @@ dbus_log_core_set_category_enabled(
                 }
             }
             if (changed) {
+                dbus_log_core_category_level_changed(self, cat);
                 dbus_log_category_ref(cat);
                 g_signal_emit(self, dbus_log_core_signals[
                     SIGNAL_CATEGORY_FLAGS], 0,
@@ -468,6 +761,7 @@ dbus_log_core_set_category_level(
         if (cat) {
             if (cat->level != level) {
                 cat->level = level;
+                dbus_log_core_category_level_changed(self, cat);
                 dbus_log_core_emit_signal(self, cat, SIGNAL_CATEGORY_LEVEL);
             }
             return TRUE;
@@ -476,6 +770,150 @@ dbus_log_core_set_category_level(
     return FALSE;
 }
 
+static
+void
+dbus_log_core_free_messages(
+    DBusLogMessage* msg)
+{
+    while (msg) {
+        DBusLogMessage* next = dbus_log_message_next(msg);
+        dbus_log_message_unref(msg);
+        msg = next;
+    }
+}
+
+static
+gboolean
+dbus_log_core_blocked(
+    GPtrArray* senders)
+{
+    guint i;
+
+    for (i=0; i<senders->len; i++) {
+        if (dbus_log_sender_blocked(g_ptr_array_index(senders, i))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static
+void
+dbus_log_core_drain(
+    DBusLogCore* self)
+{
+    DBusLogMessage* msg;
+    DBusLogMessage* list = NULL;
+    DBusLogMessage* last = NULL;
+
+    /* Detach the whole list with a single atomic operation */
+    do {
+        msg = g_atomic_pointer_get(&self->queue);
+    } while (!g_atomic_pointer_compare_and_exchange(&self->queue,
+        msg, NULL));
+
+    /* Restore the original order */
+    while (msg) {
+        DBusLogMessage* next = dbus_log_message_next(msg);
+        dbus_log_message_set_next(msg, list);
+        list = msg;
+        if (!last) last = msg;
+        msg = next;
+    }
+
+    /* What's been held back goes first */
+    if (list) {
+        if (self->pending) {
+            dbus_log_message_set_next(self->pending_last, list);
+        } else {
+            self->pending = list;
+        }
+        self->pending_last = last;
+    }
+
+    /* Messages get their indices in the order they are handed over */
+    if (self->pending) {
+        GPtrArray* senders = g_ptr_array_ref(self->senders);
+        guint i;
+
+        /* The messages tell the time, no need to read the clock */
+        if (g_atomic_int_get(&self->clock) == DBUSLOG_CLOCK_MONOTONIC &&
+            (self->pending->timestamp - self->clock_synced) >=
+            DBUSLOG_CORE_CLOCK_SYNC_INTERVAL) {
+            dbus_log_core_clock_sync(self);
+        }
+
+        while (self->pending && !dbus_log_core_blocked(senders)) {
+            msg = self->pending;
+            self->pending = dbus_log_message_next(msg);
+            dbus_log_message_set_next(msg, NULL);
+            msg->index = self->next_msg_index++;
+
+            /* Each message is stored once, senders keep the position */
+            for (i=0; i<senders->len; i++) {
+                dbus_log_sender_reserve(g_ptr_array_index(senders, i));
+            }
+            dbus_log_history_put(self->history, msg);
+            dbus_log_message_unref(msg);
+            for (i=0; i<senders->len; i++) {
+                dbus_log_sender_pull(g_ptr_array_index(senders, i));
+            }
+        }
+
+        if (self->pending) {
+            /* Try again when the blocking times out, if not earlier */
+            if (!self->drain_id) {
+                self->drain_id = g_timeout_add_full(G_PRIORITY_DEFAULT,
+                    DBUSLOG_SENDER_BLOCK_TIMEOUT_MS,
+                    dbus_log_core_drain_pending, dbus_log_core_ref(self),
+                    g_object_unref);
+            }
+        } else {
+            self->pending_last = NULL;
+        }
+
+        /* And start writing */
+        for (i=0; i<senders->len; i++) {
+            dbus_log_sender_notify(g_ptr_array_index(senders, i));
+        }
+        g_ptr_array_unref(senders);
+    }
+}
+
+static
+gboolean
+dbus_log_core_drain_in_context(
+    gpointer user_data)
+{
+    dbus_log_core_drain(DBUSLOG_CORE(user_data));
+    return G_SOURCE_REMOVE;
+}
+
+static
+gint64
+dbus_log_core_timestamp(
+    DBusLogCore* self)
+{
+    switch (g_atomic_int_get(&self->clock)) {
+    case DBUSLOG_CLOCK_REALTIME_COARSE:
+#ifdef CLOCK_REALTIME_COARSE
+        {
+            struct timespec ts;
+
+            if (!clock_gettime(CLOCK_REALTIME_COARSE, &ts)) {
+                return ((gint64)ts.tv_sec) * G_USEC_PER_SEC +
+                    ts.tv_nsec / 1000;
+            }
+        }
+#endif
+        break;
+    case DBUSLOG_CLOCK_MONOTONIC:
+        return g_get_monotonic_time() +
+            self->clock_base[g_atomic_int_get(&self->clock_slot)];
+    }
+    return g_get_real_time();
+}
+
 static
 void
 dbus_log_core_send(
@@ -483,21 +921,52 @@ dbus_log_core_send(
     DBusLogCategory* category,
     DBusLogMessage* message)
 {
-    guint i;
-    GPtrArray* senders = g_ptr_array_ref(self->senders);
-
-    message->timestamp = g_get_real_time();
-    message->index = self->next_msg_index++;
+    DBusLogMessage* head;
 
+    message->timestamp = dbus_log_core_timestamp(self);
     if (category) {
         message->category = category->id;
     }
 
-    for (i=0; i<senders->len; i++) {
-        dbus_log_sender_send(g_ptr_array_index(senders, i), message);
+    dbus_log_message_ref(message);
+    do {
+        head = g_atomic_pointer_get(&self->queue);
+        dbus_log_message_set_next(message, head);
+    } while (!g_atomic_pointer_compare_and_exchange(&self->queue,
+        head, message));
+
+    /*
+     * Only the producer which has found the queue empty needs to wake
+     * up the main context. When called on the thread owning the context,
+     * the queue gets drained right away. Other threads never drain it,
+     * even if nobody owns the context at the moment.
+     */
+    if (!head) {
+        if (g_main_context_is_owner(self->context)) {
+            dbus_log_core_drain(self);
+        } else {
+            GSource* source = g_idle_source_new();
+
+            g_source_set_priority(source, G_PRIORITY_DEFAULT);
+            g_source_set_callback(source, dbus_log_core_drain_in_context,
+                dbus_log_core_ref(self), g_object_unref);
+            g_source_attach(source, self->context);
+            g_source_unref(source);
+        }
     }
+}
 
-    g_ptr_array_unref(senders);
+static
+inline
+gboolean
+dbus_log_core_should_log_cat(
+    DBusLogCore* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* cat)
+{
+    return G_LIKELY(self) && (gint)level <= (cat ?
+        g_atomic_int_get(&cat->max_level) :
+        g_atomic_int_get(&self->max_level));
 }
 
 static
@@ -508,29 +977,22 @@ dbus_log_core_should_log(
     const char* cname,
     DBusLogCategory** cat)
 {
-    if (G_LIKELY(self) && self->senders->len) {
-        gboolean send = (self->default_level <= DBUSLOG_LEVEL_UNDEFINED) ||
-            (level <= self->default_level);
+    /* May be invoked on any thread, returns a reference to the category */
+    if (G_LIKELY(self) && (gint)level <= g_atomic_int_get(&self->top_level)) {
         if (cname) {
-            *cat = g_hash_table_lookup(self->categories, cname);
-            if (*cat) {
-                if ((*cat)->flags & DBUSLOG_CATEGORY_FLAG_ENABLED) {
-                    if ((*cat)->level > DBUSLOG_LEVEL_UNDEFINED) {
-                        /* Category has non-default log level */
-                        send = (level <= (*cat)->level);
-                    }
-                } else {
-                    /* Category is disabled */
-                    send = FALSE;
-                }
-            }
+            g_rw_lock_reader_lock(&self->categories_lock);
+            *cat = dbus_log_category_ref(g_hash_table_lookup(self->categories,
+                cname));
+            g_rw_lock_reader_unlock(&self->categories_lock);
         } else {
             *cat = NULL;
         }
-        return send;
-    } else {
-        return FALSE;
+        if (dbus_log_core_should_log_cat(self, level, *cat)) {
+            return TRUE;
+        }
+        dbus_log_category_unref(*cat);
     }
+    return FALSE;
 }
 
 gboolean
@@ -546,6 +1008,7 @@ dbus_log_core_log(
         msg->level = level;
         dbus_log_core_send(self, cat, msg);
         dbus_log_message_unref(msg);
+        dbus_log_category_unref(cat);
         return TRUE;
     }
     return FALSE;
@@ -565,6 +1028,79 @@ dbus_log_core_logv(
         msg->level = level;
         dbus_log_core_send(self, cat, msg);
         dbus_log_message_unref(msg);
+        dbus_log_category_unref(cat);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_core_log_cat(
+    DBusLogCore* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* cat,
+    const char* message)
+{
+    if (dbus_log_core_should_log_cat(self, level, cat)) {
+        DBusLogMessage* msg = dbus_log_message_new(message);
+        msg->level = level;
+        dbus_log_core_send(self, cat, msg);
+        dbus_log_message_unref(msg);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_core_logv_cat(
+    DBusLogCore* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* cat,
+    const char* format,
+    va_list args)
+{
+    if (dbus_log_core_should_log_cat(self, level, cat)) {
+        DBusLogMessage* msg = dbus_log_message_new_va(format, args);
+        msg->level = level;
+        dbus_log_core_send(self, cat, msg);
+        dbus_log_message_unref(msg);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+DBusLogFormat*
+dbus_log_core_new_format(
+    DBusLogCore* self,
+    const char* format)
+{
+    DBusLogFormat* fmt = NULL;
+    if (G_LIKELY(self) && G_LIKELY(format)) {
+        fmt = g_hash_table_lookup(self->formats, format);
+        if (!fmt) {
+            /* Formats are never removed, the ids are never reused */
+            fmt = dbus_log_format_new(format, ++self->last_fid);
+            g_hash_table_replace(self->formats, (void*)fmt->format, fmt);
+        }
+        dbus_log_format_ref(fmt);
+    }
+    return fmt;
+}
+
+gboolean
+dbus_log_core_logv_format(
+    DBusLogCore* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* cat,
+    DBusLogFormat* format,
+    va_list args)
+{
+    if (G_LIKELY(format) && dbus_log_core_should_log_cat(self, level, cat)) {
+        /* Only the arguments get serialized here */
+        DBusLogMessage* msg = dbus_log_message_new_format(format, args);
+        msg->level = level;
+        dbus_log_core_send(self, cat, msg);
+        dbus_log_message_unref(msg);
         return TRUE;
     }
     return FALSE;
@@ -662,12 +1198,18 @@ dbus_log_core_init(
     DBusLogCore* self)
 {
     self->default_level = DBUSLOG_LEVEL_INFO;
+    self->max_level = DBUSLOG_LEVEL_UNDEFINED;
+    self->top_level = DBUSLOG_LEVEL_UNDEFINED;
+    self->context = g_main_context_default();
     self->pool = gutil_idle_pool_new();
     self->senders = g_ptr_array_new_with_free_func(dbus_log_core_free_sender);
     self->categories = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
-        dbus_log_category_free);
+        dbus_log_core_free_category);
+    g_rw_lock_init(&self->categories_lock);
+    self->formats = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+        dbus_log_format_free);
     self->sender_signal_ids = g_hash_table_new_full(g_direct_hash,
-        g_direct_equal, NULL, NULL);
+        g_direct_equal, NULL, g_free);
 }
 
 /**
@@ -688,13 +1230,13 @@ dbus_log_core_dispose(
      */
     for (i=0; i<self->senders->len; i++) {
         DBusLogSender* sender = g_ptr_array_index(self->senders, i);
-        dbus_log_sender_remove_handler(sender, (gulong)
-            g_hash_table_lookup(self->sender_signal_ids, sender));
+        dbus_log_sender_remove_handlers(sender, g_hash_table_lookup(
+            self->sender_signal_ids, sender), SENDER_SIGNAL_COUNT);
         GVERIFY(g_hash_table_remove(self->sender_signal_ids, sender));
     }
     GASSERT(!g_hash_table_size(self->sender_signal_ids));
     g_ptr_array_set_size(self->senders, 0);
-    g_hash_table_remove_all(self->categories);
+    dbus_log_core_clear_categories(self);
     gutil_idle_pool_drain(self->pool);
     G_OBJECT_CLASS(PARENT_CLASS)->dispose(object);
 }
@@ -708,8 +1250,13 @@ dbus_log_core_finalize(
     GObject* object)
 {
     DBusLogCore* self = DBUSLOG_CORE(object);
+    dbus_log_core_free_messages(self->queue);
+    dbus_log_core_free_messages(self->pending);
     g_ptr_array_unref(self->senders);
+    dbus_log_history_unref(self->history);
     g_hash_table_destroy(self->categories);
+    g_rw_lock_clear(&self->categories_lock);
+    g_hash_table_destroy(self->formats);
     g_hash_table_destroy(self->sender_signal_ids);
     gutil_idle_pool_unref(self->pool);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
@@ -35,6 +35,7 @@
 
 #include "dbuslog_server_types.h"
 #include "dbuslog_category.h"
+#include "dbuslog_format.h"
 #include "dbuslog_sender.h"
 
 typedef struct dbus_log_core DBusLogCore;
@@ -77,6 +78,13 @@ dbus_log_core_new_sender(
     DBusLogCore* core,
     const char* name);
 
+/* Same as above but using the shared memory ring of the given size */
+DBusLogSender*
+dbus_log_core_new_shm_sender(
+    DBusLogCore* core,
+    const char* name,
+    gsize size);
+
 gboolean
 dbus_log_core_remove_sender(
     DBusLogCore* core,
@@ -100,6 +108,34 @@ dbus_log_core_set_backlog(
     DBusLogCore* core,
     int backlog);
 
+/*
+ * Normally, nothing is logged while there are no senders. With
+ * keep_history set, messages are stored in the history (up to the
+ * backlog size) even when no one is listening, so that they can be
+ * replayed to the clients connecting later.
+ */
+void
+dbus_log_core_set_keep_history(
+    DBusLogCore* core,
+    gboolean keep_history);
+
+gboolean
+dbus_log_core_set_clock(
+    DBusLogCore* core,
+    DBUSLOG_CLOCK clock);
+
+/*
+ * Makes the sender start with the messages from the history. With
+ * DBUSLOG_OPEN_FLAG_HISTORY_SINCE flag, history is the index of the
+ * first message, otherwise it's the number of the most recent messages.
+ */
+void
+dbus_log_core_replay(
+    DBusLogCore* core,
+    DBusLogSender* sender,
+    guint flags,
+    guint32 history);
+
 DBusLogCategory*
 dbus_log_core_new_category(
     DBusLogCore* core,
@@ -157,6 +193,34 @@ dbus_log_core_logv(
     const char* format,
     va_list args);
 
+gboolean
+dbus_log_core_log_cat(
+    DBusLogCore* core,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* message);
+
+gboolean
+dbus_log_core_logv_cat(
+    DBusLogCore* core,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* format,
+    va_list args);
+
+DBusLogFormat*
+dbus_log_core_new_format(
+    DBusLogCore* core,
+    const char* format);
+
+gboolean
+dbus_log_core_logv_format(
+    DBusLogCore* core,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    DBusLogFormat* format,
+    va_list args);
+
 /* Signals */
 
 gulong
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_history.h"
+#include "dbuslog_server_log.h"
+
+#include <gutil_ring.h>
+
+struct dbus_log_history {
+    gint ref_count;
+    GUtilRing* ring;
+    guint64 start;
+    GSList* cursors;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+dbus_log_history_free_func(
+    gpointer data)
+{
+    dbus_log_message_unref(data);
+}
+
+static
+void
+dbus_log_history_drop(
+    DBusLogHistory* self,
+    int count)
+{
+    self->start += gutil_ring_drop(self->ring, count);
+}
+
+static
+void
+dbus_log_history_trim(
+    DBusLogHistory* self)
+{
+    guint64 min = dbus_log_history_end(self);
+    GSList* l;
+
+    for (l = self->cursors; l; l = l->next) {
+        const guint64* cursor = l->data;
+        if (min > *cursor) {
+            min = *cursor;
+        }
+    }
+    if (min > self->start) {
+        dbus_log_history_drop(self, (int)(min - self->start));
+    }
+}
+
+static
+void
+dbus_log_history_finalize(
+    DBusLogHistory* self)
+{
+    GASSERT(!self->cursors);
+    g_slist_free(self->cursors);
+    gutil_ring_unref(self->ring);
+    g_slice_free(DBusLogHistory, self);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogHistory*
+dbus_log_history_new(
+    int max_size)
+{
+    DBusLogHistory* self = g_slice_new0(DBusLogHistory);
+    self->ref_count = 1;
+    self->ring = gutil_ring_new_full(0, max_size, dbus_log_history_free_func);
+    return self;
+}
+
+DBusLogHistory*
+dbus_log_history_ref(
+    DBusLogHistory* self)
+{
+    if (G_LIKELY(self)) {
+        GASSERT(self->ref_count > 0);
+        g_atomic_int_inc(&self->ref_count);
+    }
+    return self;
+}
+
+void
+dbus_log_history_unref(
+    DBusLogHistory* self)
+{
+    if (G_LIKELY(self)) {
+        GASSERT(self->ref_count > 0);
+        if (g_atomic_int_dec_and_test(&self->ref_count)) {
+            dbus_log_history_finalize(self);
+        }
+    }
+}
+
+void
+dbus_log_history_set_max_size(
+    DBusLogHistory* self,
+    int max_size)
+{
+    if (G_LIKELY(self)) {
+        if (max_size != GUTIL_RING_UNLIMITED_SIZE) {
+            const int size = gutil_ring_size(self->ring);
+
+            /* Drop the oldest messages if they no longer fit */
+            if (size > max_size) {
+                dbus_log_history_drop(self, size - max_size);
+            }
+        }
+        gutil_ring_set_max_size(self->ring, max_size);
+    }
+}
+
+int
+dbus_log_history_size(
+    DBusLogHistory* self)
+{
+    return G_LIKELY(self) ? gutil_ring_size(self->ring) : 0;
+}
+
+guint64
+dbus_log_history_start(
+    DBusLogHistory* self)
+{
+    return G_LIKELY(self) ? self->start : 0;
+}
+
+guint64
+dbus_log_history_end(
+    DBusLogHistory* self)
+{
+    return G_LIKELY(self) ? (self->start + gutil_ring_size(self->ring)) : 0;
+}
+
+guint64
+dbus_log_history_find(
+    DBusLogHistory* self,
+    guint32 index)
+{
+    if (G_LIKELY(self)) {
+        int lo = 0, hi = gutil_ring_size(self->ring);
+
+        /* Message indices are increasing */
+        while (lo < hi) {
+            const int mid = lo + (hi - lo)/2;
+            DBusLogMessage* msg = gutil_ring_data_at(self->ring, mid);
+
+            if ((gint32)(msg->index - index) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return self->start + lo;
+    }
+    return 0;
+}
+
+gboolean
+dbus_log_history_full(
+    DBusLogHistory* self)
+{
+    return G_LIKELY(self) &&
+        gutil_ring_max_size(self->ring) != GUTIL_RING_UNLIMITED_SIZE &&
+        !gutil_ring_can_put(self->ring, 1);
+}
+
+void
+dbus_log_history_put(
+    DBusLogHistory* self,
+    DBusLogMessage* msg)
+{
+    if (G_LIKELY(self) && G_LIKELY(msg)) {
+        if (gutil_ring_max_size(self->ring) == GUTIL_RING_UNLIMITED_SIZE) {
+            dbus_log_history_trim(self);
+        } else if (!gutil_ring_can_put(self->ring, 1)) {
+            /* Overwrite the oldest one */
+            dbus_log_history_drop(self, 1);
+        }
+        if (gutil_ring_put(self->ring, msg)) {
+            dbus_log_message_ref(msg);
+        } else {
+            /* Zero max size, the message goes nowhere */
+            self->start++;
+        }
+    }
+}
+
+DBusLogMessage*
+dbus_log_history_at(
+    DBusLogHistory* self,
+    guint64 pos)
+{
+    return (G_LIKELY(self) && pos >= self->start &&
+        pos < dbus_log_history_end(self)) ?
+        gutil_ring_data_at(self->ring, (int)(pos - self->start)) : NULL;
+}
+
+void
+dbus_log_history_add_cursor(
+    DBusLogHistory* self,
+    const guint64* cursor)
+{
+    if (G_LIKELY(self) && G_LIKELY(cursor)) {
+        self->cursors = g_slist_prepend(self->cursors, (gpointer)cursor);
+    }
+}
+
+void
+dbus_log_history_remove_cursor(
+    DBusLogHistory* self,
+    const guint64* cursor)
+{
+    if (G_LIKELY(self) && G_LIKELY(cursor)) {
+        self->cursors = g_slist_remove(self->cursors, cursor);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
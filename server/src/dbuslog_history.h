@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_HISTORY_H
+#define DBUSLOG_HISTORY_H
+
+#include "dbuslog_server_types.h"
+#include "dbuslog_message.h"
+
+/*
+ * The history is shared by all senders. Each message is stored once
+ * and gets a sequence number, the senders only keep the sequence number
+ * of the next message they need to send (the cursor). Must only be
+ * accessed by the thread owning the main context.
+ */
+typedef struct dbus_log_history DBusLogHistory;
+
+DBusLogHistory*
+dbus_log_history_new(
+    int max_size);
+
+DBusLogHistory*
+dbus_log_history_ref(
+    DBusLogHistory* history);
+
+void
+dbus_log_history_unref(
+    DBusLogHistory* history);
+
+void
+dbus_log_history_set_max_size(
+    DBusLogHistory* history,
+    int max_size);
+
+int
+dbus_log_history_size(
+    DBusLogHistory* history);
+
+/* Sequence number of the oldest message still in the history */
+guint64
+dbus_log_history_start(
+    DBusLogHistory* history);
+
+/* Sequence number which will be assigned to the next message */
+guint64
+dbus_log_history_end(
+    DBusLogHistory* history);
+
+/*
+ * Sequence number of the first message with the index equal or greater
+ * than the given one (index wraparound is taken into account). Returns
+ * the end of the history if there's no such message.
+ */
+guint64
+dbus_log_history_find(
+    DBusLogHistory* history,
+    guint32 index);
+
+/* TRUE if the next message is going to push the oldest one out */
+gboolean
+dbus_log_history_full(
+    DBusLogHistory* history);
+
+void
+dbus_log_history_put(
+    DBusLogHistory* history,
+    DBusLogMessage* message);
+
+/*
+ * Returns the message with the given sequence number without adding
+ * a reference, or NULL if it's not (or no longer) in the history.
+ */
+DBusLogMessage*
+dbus_log_history_at(
+    DBusLogHistory* history,
+    guint64 pos);
+
+/*
+ * If the size is unlimited, the messages which all registered cursors
+ * have already passed are dropped.
+ */
+void
+dbus_log_history_add_cursor(
+    DBusLogHistory* history,
+    const guint64* cursor);
+
+void
+dbus_log_history_remove_cursor(
+    DBusLogHistory* history,
+    const guint64* cursor);
+
+#endif /* DBUSLOG_HISTORY_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
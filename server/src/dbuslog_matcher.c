@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_matcher.h"
+
+#include <string.h>
+
+/*
+ * Substrings are matched with the Aho-Corasick automaton, turned into
+ * a complete DFA (256 transitions per state) so that the matching is
+ * one table lookup per byte. The number of states doesn't exceed the
+ * total length of the substrings plus one, the root state is zero.
+ */
+#define DBUSLOG_MATCHER_ALPHABET (256)
+
+struct dbus_log_matcher {
+    guint32* next;
+    guchar* output;
+    guint n_states;
+    gboolean match_all;
+    GRegex* regex;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+dbus_log_matcher_build(
+    DBusLogMatcher* self,
+    const GStrV* substrings)
+{
+    const GStrV* ptr;
+    guint max_states = 1, n = 1, head = 0, tail = 0;
+    guint32* fail;
+    guint32* queue;
+    guint c;
+
+    for (ptr = substrings; *ptr; ptr++) {
+        max_states += strlen(*ptr);
+    }
+
+    /* While building the trie, zero means no transition */
+    self->next = g_new0(guint32, max_states * DBUSLOG_MATCHER_ALPHABET);
+    self->output = g_new0(guchar, max_states);
+    for (ptr = substrings; *ptr; ptr++) {
+        const guchar* s = (const guchar*)*ptr;
+        guint32 state = 0;
+
+        if (!*s) {
+            /* Empty substring matches anything */
+            self->match_all = TRUE;
+        }
+        for (; *s; s++) {
+            guint32* t = self->next + state * DBUSLOG_MATCHER_ALPHABET + *s;
+
+            if (!*t) {
+                *t = n++;
+            }
+            state = *t;
+        }
+        self->output[state] = TRUE;
+    }
+
+    /* Breadth-first pass fills in the failure transitions */
+    fail = g_new0(guint32, n);
+    queue = g_new(guint32, n);
+    for (c = 0; c < DBUSLOG_MATCHER_ALPHABET; c++) {
+        const guint32 child = self->next[c];
+
+        if (child) {
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        const guint32 state = queue[head++];
+        guint32* t = self->next + state * DBUSLOG_MATCHER_ALPHABET;
+        const guint32* f = self->next + fail[state] * DBUSLOG_MATCHER_ALPHABET;
+
+        for (c = 0; c < DBUSLOG_MATCHER_ALPHABET; c++) {
+            if (t[c]) {
+                fail[t[c]] = f[c];
+                self->output[t[c]] |= self->output[f[c]];
+                queue[tail++] = t[c];
+            } else {
+                t[c] = f[c];
+            }
+        }
+    }
+    self->n_states = n;
+    g_free(queue);
+    g_free(fail);
+}
+
+static
+gboolean
+dbus_log_matcher_check_limits(
+    const GStrV* substrings,
+    const char* regex,
+    GError** error)
+{
+    if (substrings) {
+        const GStrV* ptr;
+        gsize total = 0;
+
+        for (ptr = substrings; *ptr; ptr++) {
+            total += strlen(*ptr);
+            if ((ptr - substrings) >= DBUSLOG_MATCHER_MAX_SUBSTRINGS ||
+                total > DBUSLOG_MATCHER_MAX_TOTAL_LENGTH) {
+                g_set_error(error, DBUSLOG_MATCHER_ERROR, 0,
+                    "Too many substrings (max %u, %u bytes in total)",
+                    DBUSLOG_MATCHER_MAX_SUBSTRINGS,
+                    DBUSLOG_MATCHER_MAX_TOTAL_LENGTH);
+                return FALSE;
+            }
+        }
+    }
+    if (regex && strlen(regex) > DBUSLOG_MATCHER_MAX_REGEX_LENGTH) {
+        g_set_error(error, DBUSLOG_MATCHER_ERROR, 0,
+            "Regex is too long (max %u bytes)",
+            DBUSLOG_MATCHER_MAX_REGEX_LENGTH);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+G_DEFINE_QUARK(dbus-log-matcher-error-quark, dbus_log_matcher_error)
+
+DBusLogMatcher*
+dbus_log_matcher_new(
+    const GStrV* substrings,
+    const char* regex,
+    GError** error)
+{
+    const gboolean have_substrings = substrings && substrings[0];
+    GRegex* re = NULL;
+
+    if (!dbus_log_matcher_check_limits(substrings, regex, error)) {
+        return NULL;
+    }
+    if (regex && regex[0]) {
+        /* Log messages aren't necessarily valid UTF-8 */
+        re = g_regex_new(regex, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, error);
+        if (!re) {
+            return NULL;
+        }
+    }
+    if (have_substrings || re) {
+        DBusLogMatcher* self = g_slice_new0(DBusLogMatcher);
+
+        self->regex = re;
+        if (have_substrings) {
+            dbus_log_matcher_build(self, substrings);
+        }
+        return self;
+    }
+    return NULL;
+}
+
+void
+dbus_log_matcher_free(
+    DBusLogMatcher* self)
+{
+    if (G_LIKELY(self)) {
+        if (self->regex) {
+            g_regex_unref(self->regex);
+        }
+        g_free(self->next);
+        g_free(self->output);
+        g_slice_free(DBusLogMatcher, self);
+    }
+}
+
+gboolean
+dbus_log_matcher_match(
+    DBusLogMatcher* self,
+    const char* text,
+    gsize length)
+{
+    if (G_LIKELY(self) && G_LIKELY(text)) {
+        if (self->match_all) {
+            return TRUE;
+        }
+        if (self->n_states) {
+            const guchar* ptr = (const guchar*)text;
+            const guchar* end = ptr + length;
+            guint32 state = 0;
+
+            while (ptr < end) {
+                state = self->next[state * DBUSLOG_MATCHER_ALPHABET + *ptr++];
+                if (self->output[state]) {
+                    return TRUE;
+                }
+            }
+        }
+        if (self->regex) {
+            return g_regex_match_full(self->regex, text, length, 0, 0,
+                NULL, NULL);
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DBUSLOG_MATCHER_H
+#define DBUSLOG_MATCHER_H
+
+#include "dbuslog_server_types.h"
+
+#include <gutil_types.h>
+
+/*
+ * Content filter. Matches the text containing any of the substrings
+ * or matching the regular expression (like grep -e ... -e ...). All
+ * substrings are searched for in a single pass.
+ */
+typedef struct dbus_log_matcher DBusLogMatcher;
+
+/*
+ * The filters come from the clients. The limits keep the size of the
+ * automaton (256 transitions per byte of substrings) and the cost of
+ * compiling the regex in check.
+ */
+#define DBUSLOG_MATCHER_MAX_SUBSTRINGS (64)
+#define DBUSLOG_MATCHER_MAX_TOTAL_LENGTH (512)
+#define DBUSLOG_MATCHER_MAX_REGEX_LENGTH (256)
+
+#define DBUSLOG_MATCHER_ERROR (dbus_log_matcher_error_quark())
+
+GQuark
+dbus_log_matcher_error_quark(
+    void)
+    G_GNUC_INTERNAL;
+
+/*
+ * Returns NULL if there's nothing to match. If the regex is invalid or
+ * the limits are exceeded, also sets the error.
+ */
+DBusLogMatcher*
+dbus_log_matcher_new(
+    const GStrV* substrings,
+    const char* regex,
+    GError** error);
+
+void
+dbus_log_matcher_free(
+    DBusLogMatcher* matcher);
+
+gboolean
+dbus_log_matcher_match(
+    DBusLogMatcher* matcher,
+    const char* text,
+    gsize length);
+
+#endif /* DBUSLOG_MATCHER_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -36,28 +36,150 @@
 #include "dbuslog_protocol.h"
 #include "dbuslog_server_log.h"
 
+#include <gutil_misc.h>
 #include <gutil_ring.h>
 
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
+#ifndef F_SETPIPE_SZ
+#  define F_SETPIPE_SZ (1031)
+#  define F_GETPIPE_SZ (1032)
+#endif
+
 #define DBUSLOG_SENDER_DEFAULT_BACKLOG (1000)
 
+/*
+ * If the pipe keeps getting full before the queue is drained, its
+ * capacity gets doubled (up to max_pipe_size) instead of waiting.
+ */
+#define DBUSLOG_SENDER_PIPE_GROW_THRESHOLD (4)
+
+/*
+ * Messages are stored once, in the (normally shared) history. Senders
+ * don't queue them, each one keeps track of its own position in the
+ * history (the cursor). The messages between the cursor and the tail
+ * (the end of the history as of the last dbus_log_sender_pull) are the
+ * ones waiting to be sent. Once the sender is closed, the tail stops
+ * moving and only the messages before it get flushed.
+ *
+ * The number of waiting messages is limited per sender and the overflow
+ * policy decides which ones get dropped when there are too many. None
+ * of them can be removed from the history, so instead of dropping the
+ * oldest ones the cursor jumps over them. The newest ones are skipped
+ * by keeping the list of gaps and the least severe ones by remembering
+ * the range of positions shed at each level. Either way, the messages
+ * are accounted for as dropped at the time when the decision is made.
+ * Under DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL, once more than half of the
+ * queue is taken, the most severe messages (DBUSLOG_SENDER_URGENT_LEVEL
+ * and above) are sent ahead of the less severe ones waiting in front of
+ * them. Positions sent out of order are added to the gaps, so that the
+ * cursor steps over them later. The client sees the indices going back
+ * but doesn't count that as lost messages.
+ *
+ * A session can't hold on to the messages longer than the history does,
+ * a message which is about to be pushed out of the history is dropped
+ * right before it's gone (see dbus_log_sender_reserve).
+ *
+ * Each session may also narrow down what it receives, by category, by
+ * level and by content. Messages which don't pass the session's filter
+ * are skipped when the cursor gets to them (and aren't counted as
+ * dropped). Content filter needs the text, so those messages get
+ * formatted here.
+ *
+ * DBUSLOG_OVERFLOW_BLOCK doesn't drop anything while the sender says
+ * it's blocked (dbus_log_sender_blocked). The core then holds the new
+ * messages back instead of adding them to the history, which delays
+ * all senders but doesn't stall the main loop (the producers are not
+ * slowed down either). If the client doesn't make room in time, the
+ * sender stops blocking and drops the oldest messages until its queue
+ * is drained.
+ *
+ * Packets are written in batches, with a single writev() call per batch
+ * (unless the pipe gets full). A batch is limited by the number of
+ * packets and by the default pipe capacity. Each packet takes up to two
+ * I/O vectors, one for the fixed part and one for the data.
+ */
+#define DBUSLOG_SENDER_MAX_PACKETS (32)
+#define DBUSLOG_SENDER_MAX_BATCH_SIZE (0x10000)
+
+/*
+ * If the client understands message batch packets, short text messages
+ * are copied into a buffer, many of them per packet. Longer ones are
+ * still sent as individual packets, straight from the message.
+ */
+#define DBUSLOG_SENDER_MAX_BATCHED_LENGTH (0x100)
+#define DBUSLOG_SENDER_MAX_VARINT_SIZE (10)
+#define DBUSLOG_SENDER_MAX_BATCH_ENTRY_SIZE \
+    (3 * DBUSLOG_SENDER_MAX_VARINT_SIZE + 1)
+
+#define DBUSLOG_SENDER_URGENT_LEVEL DBUSLOG_LEVEL_ERROR
+
+/* Positions dropped by DBUSLOG_OVERFLOW_DROP_NEWEST or sent ahead */
+typedef struct dbus_log_sender_gap {
+    guint64 start;
+    guint64 end;
+} DBusLogSenderGap;
+
+typedef struct dbus_log_sender_packet {
+    guchar header[DBUSLOG_PACKET_MAX_FIXED_PART];
+    DBusLogMessage* message; /* Keeps the data alive */
+} DBusLogSenderPacket;
+
 /* Object definition */
 struct dbus_log_sender_priv {
     gboolean done;
     gboolean bye;
     char* name;
     GIOChannel* io;
+    DBusLogShm* shm;
+    int datafd;
     guint write_watch_id;
-    GUtilRing* buffer;
-    guchar packet[DBUSLOG_PACKET_MAX_FIXED_PART];
-    guint packet_size;
-    guint packet_fixed_part;
-    guint packet_written;
-    DBusLogMessage* current_message;
-    GMainContext* context;
-    GMutex mutex;
+    DBusLogHistory* history;
+    guint64 cursor;
+    guint64 tail;
+    guint queued;
+    guint queued_level[DBUSLOG_LEVEL_COUNT];
+    guint skipped;
+    guint64 shed_start[DBUSLOG_LEVEL_COUNT];
+    guint64 shed_end[DBUSLOG_LEVEL_COUNT];
+    GArray* gaps;
+    guint64 urgent_scan;
+    int queue_size;
+    DBUSLOG_OVERFLOW overflow;
+    gboolean overflow_timed_out;
+    gint64 block_deadline;
+    DBUSLOG_LEVEL filter_level;
+    GHashTable* filter_levels;
+    GHashTable* filter_categories;
+    DBusLogMatcher* matcher;
+    guint flags;
+    GHashTable* formats_sent;
+    DBusLogSenderPacket packet[DBUSLOG_SENDER_MAX_PACKETS];
+    struct iovec iov[2 * DBUSLOG_SENDER_MAX_PACKETS];
+    guint packet_count;
+    guint iov_count;
+    guint iov_written;
+    gsize batch_size;
+    guchar* batch_buf;
+    gsize batch_used;
+    struct iovec* batch_iov;
+    guchar* batch_header;
+    guint32 batch_next_index;
+    guint64 batch_last_timestamp;
+    guint pipe_size;
+    guint max_pipe_size;
+    guint pipe_resize_count;
+    guint pipe_full_count;
+    guint64 dropped_count;
+    guint64 dropped_bytes;
+    guint32 report_count;
+    guint64 report_bytes;
+    GHashTable* report_categories;
+    guchar* report_data;
 };
 
 typedef GObjectClass DBusLogSenderClass;
@@ -69,118 +191,971 @@ G_DEFINE_TYPE(DBusLogSender, dbus_log_sender, G_TYPE_OBJECT)
 
 enum dbus_log_sender_signal {
     DBUSLOG_SENDER_SIGNAL_CLOSED,
+    DBUSLOG_SENDER_SIGNAL_UNBLOCKED,
     DBUSLOG_SENDER_SIGNAL_COUNT
 };
 
-#define DBUSLOG_SENDER_SIGNAL_CLOSED_NAME   "dbuslog-sender-closed"
+#define DBUSLOG_SENDER_SIGNAL_CLOSED_NAME     "dbuslog-sender-closed"
+#define DBUSLOG_SENDER_SIGNAL_UNBLOCKED_NAME  "dbuslog-sender-unblocked"
 
 static guint dbus_log_sender_signals[DBUSLOG_SENDER_SIGNAL_COUNT] = { 0 };
 
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gboolean
+dbus_log_sender_pending(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    return priv->queued > 0 || priv->report_count > 0;
+}
+
+static
+gboolean
+dbus_log_sender_queue_full(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    return priv->queue_size >= 0 && priv->queued >= (guint)priv->queue_size;
+}
+
+static
+int
+dbus_log_sender_level(
+    const DBusLogMessage* msg)
+{
+    return (msg->level < DBUSLOG_LEVEL_COUNT) ? msg->level :
+        (DBUSLOG_LEVEL_COUNT - 1);
+}
+
+/* Returns TRUE if the message at this position has already been dropped */
+static
+gboolean
+dbus_log_sender_skipped(
+    DBusLogSender* self,
+    guint64 pos,
+    int level)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    GArray* gaps = priv->gaps;
+    guint i;
+
+    if (pos >= priv->shed_start[level] && pos < priv->shed_end[level]) {
+        return TRUE;
+    }
+
+    /* The gaps are sorted, those behind the cursor are no longer needed */
+    while (gaps->len > 0 &&
+        g_array_index(gaps, DBusLogSenderGap, 0).end <= priv->cursor) {
+        g_array_remove_index(gaps, 0);
+    }
+    for (i = 0; i < gaps->len; i++) {
+        const DBusLogSenderGap* gap =
+            &g_array_index(gaps, DBusLogSenderGap, i);
+
+        if (pos < gap->start) {
+            break;
+        } else if (pos < gap->end) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Marks the position as accounted for, keeping the gaps sorted */
 static
 void
-dbus_log_sender_prepare_bye(
-    DBusLogSender* self);
+dbus_log_sender_add_gap(
+    DBusLogSender* self,
+    guint64 pos)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    GArray* gaps = priv->gaps;
+    DBusLogSenderGap* prev = NULL;
+    DBusLogSenderGap* next = NULL;
+    guint i;
+
+    /* Usually it's the last one */
+    for (i = gaps->len; i > 0; i--) {
+        DBusLogSenderGap* gap = &g_array_index(gaps, DBusLogSenderGap, i - 1);
+
+        if (gap->end <= pos) {
+            prev = gap;
+            break;
+        }
+        next = gap;
+    }
+
+    priv->skipped++;
+    if (prev && prev->end == pos) {
+        prev->end++;
+        if (next && next->start == prev->end) {
+            prev->end = next->end;
+            g_array_remove_index(gaps, i);
+        }
+    } else if (next && next->start == pos + 1) {
+        next->start--;
+    } else {
+        DBusLogSenderGap gap;
+
+        gap.start = pos;
+        gap.end = pos + 1;
+        g_array_insert_val(gaps, i, gap);
+    }
+}
 
 static
 void
-dbus_log_sender_prepare_current_message(
-    DBusLogSender* self);
+dbus_log_sender_unqueue(
+    DBusLogSender* self,
+    int level)
+{
+    DBusLogSenderPriv* priv = self->priv;
 
+    priv->queued--;
+    priv->queued_level[level]--;
+}
+
+/* Counts the messages between the cursor and the tail from scratch */
 static
 void
-dbus_log_sender_schedule_write(
-    DBusLogSender* self);
+dbus_log_sender_recount(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    guint64 pos;
 
-/*==========================================================================*
- * Implementation
- *==========================================================================*/
+    priv->queued = priv->skipped = 0;
+    memset(priv->queued_level, 0, sizeof(priv->queued_level));
+    for (pos = priv->cursor; pos < priv->tail; pos++) {
+        const int level = dbus_log_sender_level(dbus_log_history_at(
+            priv->history, pos));
+
+        if (dbus_log_sender_skipped(self, pos, level)) {
+            priv->skipped++;
+        } else {
+            priv->queued++;
+            priv->queued_level[level]++;
+        }
+    }
+}
+
+static
+gsize
+dbus_log_sender_message_size(
+    DBusLogMessage* msg)
+{
+    if (msg->string) {
+        return msg->length;
+    } else {
+        /* Formatting is deferred, what would be sent is the arguments */
+        gsize size = 0;
+
+        dbus_log_message_args(msg, &size);
+        return size;
+    }
+}
 
 static
 gboolean
-dbus_log_sender_write(
+dbus_log_sender_filter(
+    DBusLogSender* self,
+    DBusLogMessage* msg)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    gpointer key = GUINT_TO_POINTER(msg->category);
+    DBUSLOG_LEVEL level;
+
+    /* Uncategorized messages can't be filtered out by category */
+    if (priv->filter_categories && msg->category &&
+        !g_hash_table_contains(priv->filter_categories, key)) {
+        return FALSE;
+    }
+    level = GPOINTER_TO_INT(g_hash_table_lookup(priv->filter_levels, key));
+    if (level == DBUSLOG_LEVEL_UNDEFINED) {
+        level = priv->filter_level;
+    }
+    if (level != DBUSLOG_LEVEL_UNDEFINED && msg->level > level) {
+        return FALSE;
+    }
+    return !priv->matcher || dbus_log_matcher_match(priv->matcher,
+        dbus_log_message_text(msg), msg->length);
+}
+
+/* Accounts for the message, unless the session isn't interested anyway */
+static
+void
+dbus_log_sender_drop(
+    DBusLogSender* self,
+    DBusLogMessage* msg)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (dbus_log_sender_filter(self, msg)) {
+        const gsize size = dbus_log_sender_message_size(msg);
+
+        priv->dropped_count++;
+        priv->dropped_bytes += size;
+        if (priv->flags & DBUSLOG_OPEN_FLAG_DROP_REPORT) {
+            gpointer key = GUINT_TO_POINTER(msg->category);
+            const guint count = GPOINTER_TO_UINT(g_hash_table_lookup(
+                priv->report_categories, key));
+
+            priv->report_count++;
+            priv->report_bytes += size;
+            g_hash_table_insert(priv->report_categories, key,
+                GUINT_TO_POINTER(count + 1));
+        }
+    }
+}
+
+/* Accounts for the messages which have fallen out of the history */
+static
+void
+dbus_log_sender_check_lost(
     DBusLogSender* self)
 {
     DBusLogSenderPriv* priv = self->priv;
-    GError* error = NULL;
+    const guint64 start = dbus_log_history_start(priv->history);
 
-    if (priv->packet_written < priv->packet_size) {
-        gsize bytes_written;
+    if (priv->cursor < start) {
+        /* These are gone, no way to tell what they were */
+        guint64 lost = priv->queued;
 
-        /* Fixed part */
-        if (priv->packet_written < priv->packet_fixed_part) {
-            bytes_written = 0;
-            g_io_channel_write_chars(priv->io,
-                (void*)(priv->packet + priv->packet_written),
-                priv->packet_fixed_part - priv->packet_written,
-                &bytes_written, &error);
-            if (error) {
-                GDEBUG("%s write failed: %s", priv->name, error->message);
-                g_error_free(error);
-                priv->write_watch_id = 0;
-                dbus_log_sender_shutdown(self, FALSE);
-                return FALSE;
-            }
-            priv->packet_written += bytes_written;
-            if (priv->packet_written < priv->packet_fixed_part) {
-                /* Will have to wait */
+        if (priv->tail < start && !priv->done) {
+            lost += start - priv->tail;
+            priv->tail = start;
+        }
+        priv->cursor = MIN(start, priv->tail);
+        dbus_log_sender_recount(self);
+        lost -= priv->queued;
+        priv->dropped_count += lost;
+        if (priv->flags & DBUSLOG_OPEN_FLAG_DROP_REPORT) {
+            priv->report_count += (guint32)lost;
+        }
+    }
+}
+
+static
+gboolean
+dbus_log_sender_urgent_pending(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    int level;
+
+    if (priv->overflow == DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL &&
+        priv->queue_size >= 0 && priv->queued > (guint)priv->queue_size / 2) {
+        for (level = DBUSLOG_LEVEL_ALWAYS;
+             level <= DBUSLOG_SENDER_URGENT_LEVEL; level++) {
+            if (priv->queued_level[level]) {
                 return TRUE;
             }
         }
+    }
+    return FALSE;
+}
 
-        /* Message data */
-        if (priv->packet_written < priv->packet_size) {
-            GASSERT(priv->current_message);
-            bytes_written = 0;
-            g_io_channel_write_chars(priv->io, priv->current_message->string +
-                (priv->packet_written - priv->packet_fixed_part),
-                priv->packet_size - priv->packet_written,
-                &bytes_written, &error);
-            if (error) {
-                GDEBUG("%s write failed: %s", priv->name, error->message);
-                g_error_free(error);
-                priv->write_watch_id = 0;
-                dbus_log_sender_shutdown(self, FALSE);
-                return FALSE;
+/* Picks a severe message ahead of the cursor, if the queue is filling up */
+static
+DBusLogMessage*
+dbus_log_sender_dequeue_urgent(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    guint64 pos = MAX(priv->urgent_scan, priv->cursor);
+
+    /* Nothing before urgent_scan is worth another look */
+    for (; pos < priv->tail && dbus_log_sender_urgent_pending(self); pos++) {
+        DBusLogMessage* msg = dbus_log_history_at(priv->history, pos);
+        const int level = dbus_log_sender_level(msg);
+
+        if (level != DBUSLOG_LEVEL_UNDEFINED &&
+            level <= DBUSLOG_SENDER_URGENT_LEVEL &&
+            !dbus_log_sender_skipped(self, pos, level)) {
+            if (pos == priv->cursor) {
+                /* It's next in line anyway */
+                break;
             }
-            priv->packet_written += bytes_written;
-            if (priv->packet_written < priv->packet_size) {
-                /* Will have to wait */
-                return TRUE;
+            dbus_log_sender_add_gap(self, pos);
+            dbus_log_sender_unqueue(self, level);
+            if (dbus_log_sender_filter(self, msg)) {
+                priv->urgent_scan = pos + 1;
+                return dbus_log_message_ref(msg);
             }
         }
     }
+    priv->urgent_scan = pos;
+    return NULL;
+}
 
-    /* The entire packet has been sent, pick the next one */
+/* Returns the reference to the next message to send, NULL if none */
+static
+DBusLogMessage*
+dbus_log_sender_dequeue(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    DBusLogMessage* urgent;
 
-    /* Lock */
-    g_mutex_lock(&priv->mutex);
-    dbus_log_message_unref(priv->current_message);
-    priv->current_message = gutil_ring_get(priv->buffer);
-    priv->packet_written = priv->packet_size = priv->packet_fixed_part = 0;
-    if (priv->current_message) {
-        dbus_log_sender_prepare_current_message(self);
-        g_mutex_unlock(&priv->mutex);
-        /* Unlock */
-        dbus_log_sender_schedule_write(self);
+    dbus_log_sender_check_lost(self);
+    urgent = dbus_log_sender_dequeue_urgent(self);
+    if (urgent) {
+        return urgent;
+    }
+    while (priv->cursor < priv->tail) {
+        const guint64 pos = priv->cursor;
+        DBusLogMessage* msg = dbus_log_history_at(priv->history, pos);
+        const int level = dbus_log_sender_level(msg);
+        const gboolean skipped = dbus_log_sender_skipped(self, pos, level);
+
+        priv->cursor++;
+        if (skipped) {
+            /* Has already been accounted for */
+            priv->skipped--;
+        } else {
+            dbus_log_sender_unqueue(self, level);
+            if (dbus_log_sender_filter(self, msg)) {
+                return dbus_log_message_ref(msg);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Moves the cursor forward, returns FALSE if there's nothing to drop */
+static
+gboolean
+dbus_log_sender_drop_oldest(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (priv->cursor < priv->tail) {
+        const guint64 pos = priv->cursor;
+        DBusLogMessage* msg = dbus_log_history_at(priv->history, pos);
+        const int level = dbus_log_sender_level(msg);
+
+        if (dbus_log_sender_skipped(self, pos, level)) {
+            priv->skipped--;
+        } else {
+            dbus_log_sender_unqueue(self, level);
+            dbus_log_sender_drop(self, msg);
+        }
+        priv->cursor++;
         return TRUE;
-    } else if (priv->bye) {
-        dbus_log_sender_prepare_bye(self);
-        g_mutex_unlock(&priv->mutex);
-        /* Unlock */
-        dbus_log_sender_schedule_write(self);
+    }
+    return FALSE;
+}
+
+/* The message at this position is the last one pulled from the history */
+static
+void
+dbus_log_sender_drop_newest(
+    DBusLogSender* self,
+    guint64 pos,
+    DBusLogMessage* msg)
+{
+    dbus_log_sender_add_gap(self, pos);
+    dbus_log_sender_unqueue(self, dbus_log_sender_level(msg));
+    dbus_log_sender_drop(self, msg);
+}
+
+/* Drops the oldest one of the least severe messages */
+static
+void
+dbus_log_sender_drop_lowest_level(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    int level = DBUSLOG_LEVEL_COUNT - 1;
+    guint64 pos;
+
+    while (level > 0 && !priv->queued_level[level]) {
+        level--;
+    }
+
+    /*
+     * All messages of this level between the cursor and the end of
+     * the shed range have already been dropped, the range is extended
+     * to the next one.
+     */
+    for (pos = MAX(priv->cursor, priv->shed_end[level]);
+         pos < priv->tail; pos++) {
+        DBusLogMessage* msg = dbus_log_history_at(priv->history, pos);
+
+        if (dbus_log_sender_level(msg) == level &&
+            !dbus_log_sender_skipped(self, pos, level)) {
+            if (priv->shed_end[level] <= priv->cursor) {
+                priv->shed_start[level] = pos;
+            }
+            priv->shed_end[level] = pos + 1;
+            priv->skipped++;
+            dbus_log_sender_unqueue(self, level);
+            dbus_log_sender_drop(self, msg);
+            break;
+        }
+    }
+}
+
+static
+void
+dbus_log_sender_overflow(
+    DBusLogSender* self,
+    guint64 pos,
+    DBusLogMessage* msg)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    switch (priv->overflow) {
+    case DBUSLOG_OVERFLOW_DROP_NEWEST:
+        dbus_log_sender_drop_newest(self, pos, msg);
+        break;
+    case DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL:
+        dbus_log_sender_drop_lowest_level(self);
+        break;
+    default:
+        /*
+         * DBUSLOG_OVERFLOW_BLOCK gets here if the sender has stopped
+         * blocking (or if whoever adds messages to the history doesn't
+         * check dbus_log_sender_blocked).
+         */
+        while (priv->queued > (guint)priv->queue_size &&
+            dbus_log_sender_drop_oldest(self));
+        break;
+    }
+}
+
+static
+void
+dbus_log_sender_unblock(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (priv->block_deadline) {
+        priv->block_deadline = 0;
+        g_signal_emit(self, dbus_log_sender_signals
+            [DBUSLOG_SENDER_SIGNAL_UNBLOCKED], 0);
+    }
+}
+
+inline static
+void
+dbus_log_sender_put_uint32(
+    guchar* ptr,
+    guint32 data)
+{
+    *ptr++ = data & 0xff;
+    *ptr++ = (data >> 8) & 0xff;
+    *ptr++ = (data >> 16) & 0xff;
+    *ptr = (data >> 24) & 0xff;
+}
+
+inline static
+void
+dbus_log_sender_put_uint64(
+    guchar* ptr,
+    guint64 data)
+{
+    dbus_log_sender_put_uint32(ptr, (guint32)(data));
+    dbus_log_sender_put_uint32(ptr + 4, (guint32)(data >> 32));
+}
+
+static
+void
+dbus_log_sender_release_batch(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    while (priv->packet_count > 0) {
+        DBusLogSenderPacket* packet = priv->packet + (--priv->packet_count);
+
+        dbus_log_message_unref(packet->message);
+        packet->message = NULL;
+    }
+    priv->iov_count = priv->iov_written = 0;
+    priv->batch_size = priv->batch_used = 0;
+    priv->batch_iov = NULL;
+    priv->batch_header = NULL;
+    g_free(priv->report_data);
+    priv->report_data = NULL;
+}
+
+inline static
+guchar*
+dbus_log_sender_put_varint(
+    guchar* ptr,
+    guint64 data)
+{
+    while (data >= 0x80) {
+        *ptr++ = (guchar)(data | 0x80);
+        data >>= 7;
+    }
+    *ptr++ = (guchar)data;
+    return ptr;
+}
+
+static
+void
+dbus_log_sender_close_message_batch(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (priv->batch_iov) {
+        dbus_log_sender_put_uint32(priv->batch_header +
+            DBUSLOG_PACKET_SIZE_OFFSET, priv->batch_iov->iov_len -
+            DBUSLOG_PACKET_HEADER_SIZE);
+        priv->batch_iov = NULL;
+        priv->batch_header = NULL;
+    }
+}
+
+/* Returns FALSE if the message has to be sent in its own packet */
+static
+gboolean
+dbus_log_sender_add_batched_message(
+    DBusLogSender* self,
+    DBusLogMessage* msg,
+    const char* text)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    gsize needed = DBUSLOG_SENDER_MAX_BATCH_ENTRY_SIZE + msg->length;
+    gint64 delta;
+    guchar* start;
+    guchar* ptr;
+
+    if (msg->length > DBUSLOG_SENDER_MAX_BATCHED_LENGTH) {
+        return FALSE;
+    }
+
+    if (priv->batch_iov && msg->index != priv->batch_next_index) {
+        /* Indices have to be consecutive */
+        dbus_log_sender_close_message_batch(self);
+    }
+    if (!priv->batch_iov) {
+        needed += DBUSLOG_PACKET_HEADER_SIZE +
+            DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE;
+    }
+    if (priv->batch_used + needed > DBUSLOG_SENDER_MAX_BATCH_SIZE) {
+        dbus_log_sender_close_message_batch(self);
+        return FALSE;
+    }
+
+    if (!priv->batch_buf) {
+        priv->batch_buf = g_malloc(DBUSLOG_SENDER_MAX_BATCH_SIZE);
+    }
+    if (!priv->batch_iov) {
+        /* Start a new packet, the size is filled in when it's complete */
+        struct iovec* iov = priv->iov + (priv->iov_count++);
+        guchar* header = priv->batch_buf + priv->batch_used;
+
+        GASSERT(priv->packet_count < DBUSLOG_SENDER_MAX_PACKETS);
+        priv->packet[priv->packet_count++].message = NULL;
+        header[DBUSLOG_PACKET_TYPE_OFFSET] =
+            DBUSLOG_PACKET_TYPE_MESSAGE_BATCH;
+        dbus_log_sender_put_uint64(header +
+            DBUSLOG_MESSAGE_BATCH_TIMESTAMP_OFFSET, msg->timestamp);
+        dbus_log_sender_put_uint32(header +
+            DBUSLOG_MESSAGE_BATCH_INDEX_OFFSET, msg->index);
+        iov->iov_base = header;
+        iov->iov_len = DBUSLOG_PACKET_HEADER_SIZE +
+            DBUSLOG_MESSAGE_BATCH_PREFIX_SIZE;
+        priv->batch_iov = iov;
+        priv->batch_header = header;
+        priv->batch_last_timestamp = msg->timestamp;
+        priv->batch_used += iov->iov_len;
+        priv->batch_size += iov->iov_len;
+    }
+
+    /* Timestamps don't have to be monotonic, the delta is zigzag encoded */
+    delta = (gint64)(msg->timestamp - priv->batch_last_timestamp);
+    start = ptr = priv->batch_buf + priv->batch_used;
+    ptr = dbus_log_sender_put_varint(ptr,
+        ((guint64)delta << 1) ^ (guint64)(delta >> 63));
+    ptr = dbus_log_sender_put_varint(ptr, msg->category);
+    *ptr++ = msg->level;
+    ptr = dbus_log_sender_put_varint(ptr, msg->length);
+    memcpy(ptr, text, msg->length);
+    ptr += msg->length;
+
+    priv->batch_iov->iov_len += ptr - start;
+    priv->batch_used += ptr - start;
+    priv->batch_size += ptr - start;
+    priv->batch_next_index = msg->index + 1;
+    priv->batch_last_timestamp = msg->timestamp;
+    return TRUE;
+}
+
+/* Returns TRUE if the whole batch has been written (or there was none) */
+static
+gboolean
+dbus_log_sender_batch_done(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (priv->iov_written == priv->iov_count) {
+        dbus_log_sender_release_batch(self);
         return TRUE;
+    }
+    return FALSE;
+}
+
+/* Returns the packet buffer, offsets are the same as in the protocol */
+static
+guchar*
+dbus_log_sender_add_packet(
+    DBusLogSender* self,
+    DBUSLOG_PACKET_TYPE type,
+    guint prefix_size,
+    const void* data,
+    gsize data_size,
+    DBusLogMessage* msg)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    DBusLogSenderPacket* packet;
+    struct iovec* iov;
+    const gsize payload = prefix_size + data_size;
+
+    /* Keep the packets in order */
+    dbus_log_sender_close_message_batch(self);
+    packet = priv->packet + (priv->packet_count++);
+    iov = priv->iov + priv->iov_count;
+    GASSERT(priv->packet_count <= DBUSLOG_SENDER_MAX_PACKETS);
+    GASSERT(prefix_size + DBUSLOG_PACKET_HEADER_SIZE <=
+        sizeof(packet->header));
+    packet->message = dbus_log_message_ref(msg);
+    dbus_log_sender_put_uint32(packet->header + DBUSLOG_PACKET_SIZE_OFFSET,
+        payload);
+    packet->header[DBUSLOG_PACKET_TYPE_OFFSET] = type;
+
+    iov->iov_base = packet->header;
+    iov->iov_len = DBUSLOG_PACKET_HEADER_SIZE + prefix_size;
+    priv->iov_count++;
+    if (data_size) {
+        iov++;
+        iov->iov_base = (void*)data;
+        iov->iov_len = data_size;
+        priv->iov_count++;
+    }
+    priv->batch_size += DBUSLOG_PACKET_HEADER_SIZE + payload;
+    return packet->header;
+}
+
+static
+void
+dbus_log_sender_add_bye(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    GASSERT(priv->done);
+    GASSERT(!dbus_log_sender_pending(self));
+
+    priv->bye = FALSE;
+    dbus_log_sender_add_packet(self, DBUSLOG_PACKET_TYPE_BYE, 0, NULL, 0,
+        NULL);
+}
+
+static
+void
+dbus_log_sender_add_message(
+    DBusLogSender* self,
+    DBusLogMessage* msg)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    DBusLogFormat* fmt = (priv->flags & DBUSLOG_OPEN_FLAG_BINARY) ?
+        dbus_log_message_format(msg) : NULL;
+    guchar* header;
+
+    if (fmt) {
+        gsize size;
+        const void* args = dbus_log_message_args(msg, &size);
+
+        if (!g_hash_table_contains(priv->formats_sent,
+            GUINT_TO_POINTER(fmt->id))) {
+            /* The client needs to see the format first */
+            g_hash_table_add(priv->formats_sent, GUINT_TO_POINTER(fmt->id));
+            header = dbus_log_sender_add_packet(self,
+                DBUSLOG_PACKET_TYPE_FORMAT, DBUSLOG_FORMAT_PREFIX_SIZE,
+                fmt->format, strlen(fmt->format), msg);
+            dbus_log_sender_put_uint32(header + DBUSLOG_FORMAT_ID_OFFSET,
+                fmt->id);
+        }
+
+        header = dbus_log_sender_add_packet(self,
+            DBUSLOG_PACKET_TYPE_BINARY_MESSAGE,
+            DBUSLOG_BINARY_MESSAGE_PREFIX_SIZE, args, size, msg);
+        dbus_log_sender_put_uint32(header +
+            DBUSLOG_BINARY_MESSAGE_FORMAT_OFFSET, fmt->id);
     } else {
-        g_mutex_unlock(&priv->mutex);
-        /* Unlock */
-        priv->write_watch_id = 0;
-        if (priv->done) {
-            GVERBOSE("%s done", priv->name);
-            dbus_log_sender_shutdown(self, TRUE);
+        /* Formats the message if necessary */
+        const char* text = dbus_log_message_text(msg);
+
+        if ((priv->flags & DBUSLOG_OPEN_FLAG_BATCH) &&
+            dbus_log_sender_add_batched_message(self, msg, text)) {
+            return;
+        }
+        header = dbus_log_sender_add_packet(self,
+            DBUSLOG_PACKET_TYPE_MESSAGE, DBUSLOG_MESSAGE_PREFIX_SIZE,
+            text, msg->length, msg);
+    }
+    dbus_log_sender_put_uint64(header + DBUSLOG_MESSAGE_TIMESTAMP_OFFSET,
+        msg->timestamp);
+    dbus_log_sender_put_uint32(header + DBUSLOG_MESSAGE_INDEX_OFFSET,
+        msg->index);
+    dbus_log_sender_put_uint32(header + DBUSLOG_MESSAGE_CATEGORY_OFFSET,
+        msg->category);
+    header[DBUSLOG_MESSAGE_LEVEL_OFFSET] = msg->level;
+}
+
+static
+void
+dbus_log_sender_add_report(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    const guint n = g_hash_table_size(priv->report_categories);
+    const gsize size = n * DBUSLOG_DROPPED_ENTRY_SIZE;
+    guchar* header;
+
+    GASSERT(!priv->report_data);
+    if (n) {
+        GHashTableIter it;
+        gpointer key, value;
+        guchar* ptr = priv->report_data = g_malloc(size);
+
+        g_hash_table_iter_init(&it, priv->report_categories);
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            dbus_log_sender_put_uint32(ptr, GPOINTER_TO_UINT(key));
+            dbus_log_sender_put_uint32(ptr + 4, GPOINTER_TO_UINT(value));
+            ptr += DBUSLOG_DROPPED_ENTRY_SIZE;
+        }
+        g_hash_table_remove_all(priv->report_categories);
+    }
+
+    header = dbus_log_sender_add_packet(self, DBUSLOG_PACKET_TYPE_DROPPED,
+        DBUSLOG_DROPPED_PREFIX_SIZE, priv->report_data, size, NULL);
+    dbus_log_sender_put_uint32(header + DBUSLOG_DROPPED_COUNT_OFFSET,
+        priv->report_count);
+    dbus_log_sender_put_uint64(header + DBUSLOG_DROPPED_BYTES_OFFSET,
+        priv->report_bytes);
+    dbus_log_sender_put_uint32(header + DBUSLOG_DROPPED_CATEGORIES_OFFSET, n);
+    priv->report_count = 0;
+    priv->report_bytes = 0;
+}
+
+/* Starts the next batch, returns FALSE if there's nothing to send */
+static
+gboolean
+dbus_log_sender_fill_batch(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    /* The report goes first, the client may want to know right away */
+    if (priv->report_count) {
+        dbus_log_sender_add_report(self);
+    }
+
+    /* A message may need two packets (format and the message itself) */
+    while (priv->packet_count + 2 <= DBUSLOG_SENDER_MAX_PACKETS &&
+        priv->batch_size < DBUSLOG_SENDER_MAX_BATCH_SIZE) {
+        DBusLogMessage* msg = dbus_log_sender_dequeue(self);
+
+        if (msg) {
+            dbus_log_sender_add_message(self, msg);
+            dbus_log_message_unref(msg);
         } else {
-            GVERBOSE("%s queue empty", priv->name);
+            if (priv->bye) {
+                dbus_log_sender_add_bye(self);
+            }
+            break;
+        }
+    }
+    dbus_log_sender_close_message_batch(self);
+    return priv->iov_written < priv->iov_count;
+}
+
+static
+void
+dbus_log_sender_advance(
+    DBusLogSender* self,
+    gsize bytes_written)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    while (bytes_written > 0) {
+        struct iovec* iov = priv->iov + priv->iov_written;
+
+        GASSERT(priv->iov_written < priv->iov_count);
+        if (bytes_written >= iov->iov_len) {
+            bytes_written -= iov->iov_len;
+            priv->iov_written++;
+        } else {
+            /* Partial write, continue from there next time */
+            iov->iov_base = (char*)iov->iov_base + bytes_written;
+            iov->iov_len -= bytes_written;
+            bytes_written = 0;
+        }
+    }
+}
+
+static
+void
+dbus_log_sender_close_fd(
+    int* fd)
+{
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/* Copies the data into the shared memory ring, same semantics as writev */
+static
+gssize
+dbus_log_sender_shm_writev(
+    DBusLogSender* self,
+    const struct iovec* iov,
+    int count)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    gssize written = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const gsize n = dbus_log_shm_write(priv->shm, iov[i].iov_base,
+            iov[i].iov_len);
+
+        written += n;
+        if (n < iov[i].iov_len) {
+            break;
+        }
+    }
+    if (dbus_log_shm_commit(priv->shm)) {
+        eventfd_write(priv->datafd, 1);
+    }
+    if (written > 0) {
+        return written;
+    } else {
+        errno = EAGAIN;
+        return -1;
+    }
+}
+
+/* Returns zero on success, negative error code on failure */
+static
+int
+dbus_log_sender_resize_pipe(
+    DBusLogSender* self,
+    guint size)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    const int ret = fcntl(g_io_channel_unix_get_fd(priv->io),
+        F_SETPIPE_SZ, size);
+
+    if (ret >= 0) {
+        GDEBUG("%s pipe size %u -> %d", priv->name, priv->pipe_size, ret);
+        priv->pipe_size = ret;
+        priv->pipe_resize_count++;
+        if (priv->max_pipe_size < priv->pipe_size) {
+            priv->max_pipe_size = priv->pipe_size;
+        }
+        return 0;
+    } else {
+        const int err = errno;
+
+        GDEBUG("%s can't resize pipe to %u: %s", priv->name, size,
+            strerror(err));
+        return -err;
+    }
+}
+
+/* Returns TRUE if the other side has to make room for more data */
+static
+gboolean
+dbus_log_sender_must_wait(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+
+    if (priv->shm) {
+        /* The reader may have already consumed something */
+        return dbus_log_shm_wait_space(priv->shm);
+    } else if (++priv->pipe_full_count >= DBUSLOG_SENDER_PIPE_GROW_THRESHOLD &&
+        priv->pipe_size < priv->max_pipe_size) {
+        priv->pipe_full_count = 0;
+        if (!dbus_log_sender_resize_pipe(self, MIN(priv->pipe_size * 2,
+            priv->max_pipe_size))) {
+            /* There's more room in the pipe now */
+            return FALSE;
+        }
+        /* Don't try again */
+        priv->max_pipe_size = priv->pipe_size;
+    }
+    return TRUE;
+}
+
+/* Returns TRUE if there's something left to write */
+static
+gboolean
+dbus_log_sender_write(
+    DBusLogSender* self)
+{
+    DBusLogSenderPriv* priv = self->priv;
+    const int fd = g_io_channel_unix_get_fd(priv->io);
+
+    while (!dbus_log_sender_batch_done(self) ||
+        dbus_log_sender_fill_batch(self)) {
+        const ssize_t written = priv->shm ?
+            dbus_log_sender_shm_writev(self, priv->iov + priv->iov_written,
+                priv->iov_count - priv->iov_written) :
+            writev(fd, priv->iov + priv->iov_written,
+                priv->iov_count - priv->iov_written);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (dbus_log_sender_must_wait(self)) {
+                    /* Will have to wait */
+                    return TRUE;
+                }
+                continue;
+            } else {
+                GDEBUG("%s write failed: %s", priv->name, strerror(errno));
+                priv->write_watch_id = 0;
+                dbus_log_sender_shutdown(self, FALSE);
+                return FALSE;
+            }
+        }
+        dbus_log_sender_advance(self, written);
+        if (priv->iov_written < priv->iov_count &&
+            dbus_log_sender_must_wait(self)) {
+            /* The pipe is full, will have to wait */
+            return TRUE;
         }
-        return FALSE;
     }
+
+    priv->write_watch_id = 0;
+    priv->pipe_full_count = 0;
+    priv->overflow_timed_out = FALSE;
+    if (priv->done) {
+        GVERBOSE("%s done", priv->name);
+        dbus_log_sender_shutdown(self, TRUE);
+    } else {
+        GVERBOSE("%s queue empty", priv->name);
+    }
+    return FALSE;
 }
 
 static
@@ -194,13 +1169,23 @@ dbus_log_sender_write_callback(
     DBusLogSenderPriv* priv = self->priv;
     gboolean disposition;
     dbus_log_sender_ref(self);
-    if (condition & G_IO_OUT) {
+    if (condition & (G_IO_OUT | G_IO_IN)) {
+        if (priv->shm) {
+            eventfd_t value;
+
+            /* The reader has made some room */
+            eventfd_read(g_io_channel_unix_get_fd(source), &value);
+        }
         if (dbus_log_sender_write(self)) {
             disposition = G_SOURCE_CONTINUE;
         } else {
             GASSERT(!priv->write_watch_id);
             disposition = G_SOURCE_REMOVE;
         }
+        if (!dbus_log_sender_queue_full(self)) {
+            /* The core may have been holding the messages back */
+            dbus_log_sender_unblock(self);
+        }
     } else {
         priv->write_watch_id = 0;
         dbus_log_sender_shutdown(self, FALSE);
@@ -221,179 +1206,321 @@ dbus_log_sender_schedule_write(
             /* Something was left to write */
             GVERBOSE("%s scheduling write", priv->name);
             priv->write_watch_id = g_io_add_watch(priv->io,
-                G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+                (priv->shm ? G_IO_IN : G_IO_OUT) |
+                G_IO_ERR | G_IO_HUP | G_IO_NVAL,
                 dbus_log_sender_write_callback, self);
         }
     }
 }
 
 static
-gboolean
-dbus_log_sender_schedule_write_in_context(
-    gpointer user_data)
+DBusLogSender*
+dbus_log_sender_create(
+    const char* name,
+    DBusLogHistory* history,
+    int fd)
 {
-    dbus_log_sender_schedule_write(DBUSLOG_SENDER(user_data));
-    return G_SOURCE_REMOVE;
+    DBusLogSender* self = g_object_new(DBUSLOG_SENDER_TYPE, NULL);
+    DBusLogSenderPriv* priv = self->priv;
+
+    /* Only the messages logged from now on will be sent */
+    priv->history = dbus_log_history_ref(history);
+    priv->cursor = priv->tail = dbus_log_history_end(history);
+    dbus_log_history_add_cursor(history, &priv->cursor);
+    priv->queue_size = DBUSLOG_SENDER_DEFAULT_BACKLOG;
+    self->name = priv->name = g_strdup(name);
+    priv->io = g_io_channel_unix_new(fd);
+    if (priv->io) {
+        g_io_channel_set_flags(priv->io, G_IO_FLAG_NONBLOCK, NULL);
+        g_io_channel_set_encoding(priv->io, NULL, NULL);
+        g_io_channel_set_buffered(priv->io, FALSE);
+        g_io_channel_set_close_on_unref(priv->io, TRUE);
+        return self;
+    } else {
+        dbus_log_sender_unref(self);
+        return NULL;
+    }
 }
 
-inline static
-void
-dbus_log_sender_put_uint32(
-    DBusLogSender* self,
-    guint offset,
-    guint32 data)
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+DBusLogSender*
+dbus_log_sender_new(
+    const char* name,
+    int backlog)
 {
-    guchar* ptr = self->priv->packet + offset;
-    *ptr++ = data & 0xff;
-    *ptr++ = (data >> 8) & 0xff;
-    *ptr++ = (data >> 16) & 0xff;
-    *ptr = (data >> 24) & 0xff;
+    DBusLogHistory* history = dbus_log_history_new(
+        dbus_log_sender_normalize_backlog(backlog));
+    DBusLogSender* self = dbus_log_sender_new_shared(name, history);
+
+    dbus_log_sender_set_queue_size(self, backlog);
+    dbus_log_history_unref(history);
+    return self;
+}
+
+DBusLogSender*
+dbus_log_sender_new_shared(
+    const char* name,
+    DBusLogHistory* history)
+{
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        GERR("Can't create pipe: %s", strerror(errno));
+    } else {
+        DBusLogSender* self = dbus_log_sender_create(name, history,
+            pipefd[1]);
+        if (self) {
+            DBusLogSenderPriv* priv = self->priv;
+            const int size = fcntl(pipefd[1], F_GETPIPE_SZ);
+
+            /* Zero means that the pipe can't be resized */
+            if (size > 0) {
+                priv->pipe_size = size;
+                priv->max_pipe_size = MAX(priv->pipe_size,
+                    DBUSLOG_SENDER_DEFAULT_MAX_PIPE_SIZE);
+            }
+            self->readfd = pipefd[0];
+            return self;
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    return NULL;
+}
+
+DBusLogSender*
+dbus_log_sender_new_shm(
+    const char* name,
+    DBusLogHistory* history,
+    gsize size)
+{
+    int shmfd;
+    DBusLogShm* shm = dbus_log_shm_new(size, &shmfd);
+
+    if (shm) {
+        /* One eventfd per direction, each side keeps its own copy */
+        const int datafd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        const int spacefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if (datafd >= 0 && spacefd >= 0) {
+            DBusLogSender* self = dbus_log_sender_create(name, history,
+                spacefd);
+
+            if (self) {
+                DBusLogSenderPriv* priv = self->priv;
+
+                priv->shm = shm;
+                priv->datafd = datafd;
+                self->shmfd = shmfd;
+                self->datafd = dup(datafd);
+                self->spacefd = dup(spacefd);
+                return self;
+            }
+        } else {
+            GERR("Can't create eventfd: %s", strerror(errno));
+        }
+        if (datafd >= 0) close(datafd);
+        if (spacefd >= 0) close(spacefd);
+        dbus_log_shm_free(shm);
+        close(shmfd);
+    }
+    return NULL;
+}
+
+DBusLogSender*
+dbus_log_sender_ref(
+    DBusLogSender* self)
+{
+    if (G_LIKELY(self)) {
+        g_object_ref(DBUSLOG_SENDER(self));
+        return self;
+    } else {
+        return NULL;
+    }
 }
 
-inline static
 void
-dbus_log_sender_put_uint64(
-    DBusLogSender* self,
-    guint offset,
-    guint64 data)
+dbus_log_sender_unref(
+    DBusLogSender* self)
 {
-    dbus_log_sender_put_uint32(self, offset, (guint32)(data));
-    dbus_log_sender_put_uint32(self, offset + 4, (guint32)(data >> 32));
+    if (G_LIKELY(self)) {
+        g_object_unref(DBUSLOG_SENDER(self));
+    }
 }
 
-static
 void
-dbus_log_sender_fill_header(
+dbus_log_sender_set_flags(
     DBusLogSender* self,
-    guint payload,
-    DBUSLOG_PACKET_TYPE type)
+    guint flags)
 {
-    DBusLogSenderPriv* priv = self->priv;
-    dbus_log_sender_put_uint32(self, DBUSLOG_PACKET_SIZE_OFFSET, payload);
-    priv->packet[DBUSLOG_PACKET_TYPE_OFFSET] = type;
-    priv->packet_size = DBUSLOG_PACKET_HEADER_SIZE + payload;
-    priv->packet_written = 0;
-    priv->packet_fixed_part = MIN(sizeof(priv->packet), priv->packet_size);
+    if (G_LIKELY(self)) {
+        self->priv->flags = flags;
+    }
 }
 
-static
 void
-dbus_log_sender_prepare_bye(
-    DBusLogSender* self)
+dbus_log_sender_rewind(
+    DBusLogSender* self,
+    guint64 cursor)
 {
-    DBusLogSenderPriv* priv = self->priv;
-
-    GASSERT(priv->done);
-    GASSERT(!priv->current_message);
-    GASSERT(!gutil_ring_size(priv->buffer));
-    GASSERT(priv->packet_size == priv->packet_written);
+    if (G_LIKELY(self)) {
+        DBusLogSenderPriv* priv = self->priv;
 
-    priv->bye = FALSE;
-    dbus_log_sender_fill_header(self, 0, DBUSLOG_PACKET_TYPE_BYE);
+        if (!priv->done && cursor < priv->cursor) {
+            /* Whatever has been dropped gets another chance */
+            memset(priv->shed_start, 0, sizeof(priv->shed_start));
+            memset(priv->shed_end, 0, sizeof(priv->shed_end));
+            g_array_set_size(priv->gaps, 0);
+            priv->urgent_scan = 0;
+            priv->cursor = MAX(cursor, dbus_log_history_start(priv->history));
+            dbus_log_sender_recount(self);
+            dbus_log_sender_notify(self);
+        }
+    }
 }
 
-static
 void
-dbus_log_sender_prepare_current_message(
-    DBusLogSender* self)
+dbus_log_sender_set_queue_size(
+    DBusLogSender* self,
+    int size)
 {
-    DBusLogSenderPriv* priv = self->priv;
-    DBusLogMessage* msg = priv->current_message;
+    if (G_LIKELY(self)) {
+        self->priv->queue_size = dbus_log_sender_normalize_backlog(size);
+    }
+}
 
-    GASSERT(priv->packet_size == priv->packet_written);
-    GASSERT(priv->current_message);
+void
+dbus_log_sender_set_overflow(
+    DBusLogSender* self,
+    DBUSLOG_OVERFLOW overflow)
+{
+    if (G_LIKELY(self)) {
+        DBusLogSenderPriv* priv = self->priv;
 
-    dbus_log_sender_fill_header(self,
-        DBUSLOG_MESSAGE_PREFIX_SIZE + msg->length,
-        DBUSLOG_PACKET_TYPE_MESSAGE);
-    dbus_log_sender_put_uint64(self,
-        DBUSLOG_MESSAGE_TIMESTAMP_OFFSET,
-        msg->timestamp);
-    dbus_log_sender_put_uint32(self,
-        DBUSLOG_MESSAGE_INDEX_OFFSET,
-        msg->index);
-    dbus_log_sender_put_uint32(self,
-        DBUSLOG_MESSAGE_CATEGORY_OFFSET,
-        msg->category);
-    priv->packet[DBUSLOG_MESSAGE_LEVEL_OFFSET] = msg->level;
+        priv->overflow = overflow;
+        priv->overflow_timed_out = FALSE;
+        dbus_log_sender_unblock(self);
+    }
 }
 
-static
 void
-dbus_log_sender_buffer_free_func(
-    gpointer data)
+dbus_log_sender_set_level(
+    DBusLogSender* self,
+    DBUSLOG_LEVEL level)
 {
-    dbus_log_message_unref(data);
+    if (G_LIKELY(self)) {
+        self->priv->filter_level = level;
+    }
 }
 
-/*==========================================================================*
- * API
- *==========================================================================*/
-
-DBusLogSender*
-dbus_log_sender_new(
-    const char* name,
-    int backlog)
+void
+dbus_log_sender_set_category_level(
+    DBusLogSender* self,
+    guint32 category,
+    DBUSLOG_LEVEL level)
 {
-    int pipefd[2];
-    if (pipe(pipefd) < 0) {
-        GERR("Can't create pipe: %s", strerror(errno));
-    } else {
-        DBusLogSender* self = g_object_new(DBUSLOG_SENDER_TYPE, NULL);
+    if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
-        int writefd = pipefd[1];
-        self->readfd = pipefd[0];
-        priv->buffer = gutil_ring_new_full(0,
-            dbus_log_sender_normalize_backlog(backlog),
-            dbus_log_sender_buffer_free_func);
-        self->name = priv->name = g_strdup(name);
-        priv->io = g_io_channel_unix_new(writefd);
-        if (priv->io) {
-            g_io_channel_set_flags(priv->io, G_IO_FLAG_NONBLOCK, NULL);
-            g_io_channel_set_encoding(priv->io, NULL, NULL);
-            g_io_channel_set_buffered(priv->io, FALSE);
-            g_io_channel_set_close_on_unref(priv->io, TRUE);
-            return self;
+        gpointer key = GUINT_TO_POINTER(category);
+
+        if (level == DBUSLOG_LEVEL_UNDEFINED) {
+            g_hash_table_remove(priv->filter_levels, key);
         } else {
-            dbus_log_sender_unref(self);
+            g_hash_table_insert(priv->filter_levels, key,
+                GINT_TO_POINTER(level));
         }
-        close(pipefd[0]);
-        close(pipefd[1]);
     }
-    return NULL;
 }
 
-DBusLogSender*
-dbus_log_sender_ref(
-    DBusLogSender* self)
+void
+dbus_log_sender_set_categories(
+    DBusLogSender* self,
+    const guint32* categories,
+    guint count)
 {
     if (G_LIKELY(self)) {
-        g_object_ref(DBUSLOG_SENDER(self));
-        return self;
+        DBusLogSenderPriv* priv = self->priv;
+
+        if (priv->filter_categories) {
+            g_hash_table_destroy(priv->filter_categories);
+            priv->filter_categories = NULL;
+        }
+        if (categories) {
+            guint i;
+
+            priv->filter_categories = g_hash_table_new(g_direct_hash,
+                g_direct_equal);
+            for (i = 0; i < count; i++) {
+                g_hash_table_add(priv->filter_categories,
+                    GUINT_TO_POINTER(categories[i]));
+            }
+        }
+    }
+}
+
+void
+dbus_log_sender_set_content_filter(
+    DBusLogSender* self,
+    DBusLogMatcher* matcher)
+{
+    if (G_LIKELY(self)) {
+        DBusLogSenderPriv* priv = self->priv;
+
+        dbus_log_matcher_free(priv->matcher);
+        priv->matcher = matcher;
     } else {
-        return NULL;
+        dbus_log_matcher_free(matcher);
+    }
+}
+
+int
+dbus_log_sender_set_pipe_size(
+    DBusLogSender* self,
+    guint size)
+{
+    if (G_LIKELY(self)) {
+        DBusLogSenderPriv* priv = self->priv;
+
+        if (priv->io && priv->pipe_size && size) {
+            const int err = dbus_log_sender_resize_pipe(self, size);
+
+            return err ? err : (int)priv->pipe_size;
+        }
     }
+    return -EINVAL;
 }
 
 void
-dbus_log_sender_unref(
-    DBusLogSender* self)
+dbus_log_sender_set_max_pipe_size(
+    DBusLogSender* self,
+    guint max_size)
 {
     if (G_LIKELY(self)) {
-        g_object_unref(DBUSLOG_SENDER(self));
+        DBusLogSenderPriv* priv = self->priv;
+
+        if (priv->pipe_size) {
+            priv->max_pipe_size = MAX(priv->pipe_size, max_size);
+        }
     }
 }
 
 void
-dbus_log_sender_set_backlog(
+dbus_log_sender_get_stats(
     DBusLogSender* self,
-    int backlog)
+    DBusLogSenderStats* stats)
 {
     if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
 
-        gutil_ring_set_max_size(priv->buffer,
-            dbus_log_sender_normalize_backlog(backlog));
+        stats->pipe_size = priv->pipe_size;
+        stats->max_pipe_size = priv->max_pipe_size;
+        stats->pipe_resize_count = priv->pipe_resize_count;
+        stats->dropped_count = priv->dropped_count;
+        stats->dropped_bytes = priv->dropped_bytes;
+    } else {
+        memset(stats, 0, sizeof(*stats));
     }
 }
 
@@ -404,10 +1531,11 @@ dbus_log_sender_ping(
     if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
         /* Only ping if we have nothing pending */
-        if (!priv->done && !priv->current_message &&
-            !gutil_ring_size(priv->buffer)) {
-            GASSERT(priv->packet_size == priv->packet_written);
-            dbus_log_sender_fill_header(self, 0, DBUSLOG_PACKET_TYPE_PING);
+        dbus_log_sender_pull(self);
+        if (!priv->done && dbus_log_sender_batch_done(self) &&
+            !dbus_log_sender_pending(self)) {
+            dbus_log_sender_add_packet(self, DBUSLOG_PACKET_TYPE_PING, 0,
+                NULL, 0, NULL);
             dbus_log_sender_schedule_write(self);
             return TRUE;
         }
@@ -420,36 +1548,87 @@ dbus_log_sender_send(
     DBusLogSender* self,
     DBusLogMessage* msg)
 {
-    if (G_LIKELY(self) && G_LIKELY(msg)) {
+    if (G_LIKELY(self) && G_LIKELY(msg) && !self->priv->done) {
+        dbus_log_sender_reserve(self);
+        dbus_log_history_put(self->priv->history, msg);
+        dbus_log_sender_notify(self);
+    }
+}
+
+void
+dbus_log_sender_reserve(
+    DBusLogSender* self)
+{
+    if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
-        /* Lock */
-        g_mutex_lock(&priv->mutex);
-        if (!priv->done) {
-            if (priv->packet_size == priv->packet_written) {
-                GASSERT(!priv->current_message);
-                priv->current_message = dbus_log_message_ref(msg);
-                dbus_log_sender_prepare_current_message(self);
-                g_mutex_unlock(&priv->mutex);
-                /* Unlock */
-                g_main_context_invoke_full(priv->context, G_PRIORITY_DEFAULT,
-                    dbus_log_sender_schedule_write_in_context,
-                    dbus_log_sender_ref(self), g_object_unref);
-                return;
-            } else {
-                /* Queue the message */
-                if (!gutil_ring_can_put(priv->buffer, 1)) {
-                    /* Buffer is full, drop the last half */
-                    GDEBUG("%s queue full", priv->name);
-                    gutil_ring_drop_last(priv->buffer,
-                        gutil_ring_size(priv->buffer)/2);
-                }
-                if (gutil_ring_put(priv->buffer, msg)) {
-                    dbus_log_message_ref(msg);
-                }
+
+        dbus_log_sender_check_lost(self);
+        if (dbus_log_history_full(priv->history) &&
+            priv->cursor == dbus_log_history_start(priv->history)) {
+            /* Account for it while it's still there */
+            dbus_log_sender_drop_oldest(self);
+        }
+    }
+}
+
+void
+dbus_log_sender_pull(
+    DBusLogSender* self)
+{
+    if (G_LIKELY(self) && !self->priv->done) {
+        DBusLogSenderPriv* priv = self->priv;
+        const guint64 end = dbus_log_history_end(priv->history);
+
+        dbus_log_sender_check_lost(self);
+        while (priv->tail < end) {
+            const guint64 pos = priv->tail++;
+            DBusLogMessage* msg = dbus_log_history_at(priv->history, pos);
+            const gboolean full = dbus_log_sender_queue_full(self);
+
+            priv->queued++;
+            priv->queued_level[dbus_log_sender_level(msg)]++;
+            if (full) {
+                dbus_log_sender_overflow(self, pos, msg);
+            }
+        }
+    }
+}
+
+gboolean
+dbus_log_sender_blocked(
+    DBusLogSender* self)
+{
+    if (G_LIKELY(self)) {
+        DBusLogSenderPriv* priv = self->priv;
+
+        if (priv->overflow == DBUSLOG_OVERFLOW_BLOCK && priv->io &&
+            !priv->done && !priv->overflow_timed_out &&
+            dbus_log_sender_queue_full(self)) {
+            const gint64 now = g_get_monotonic_time();
+
+            if (!priv->block_deadline) {
+                priv->block_deadline = now +
+                    DBUSLOG_SENDER_BLOCK_TIMEOUT_MS * G_TIME_SPAN_MILLISECOND;
+            }
+            if (now < priv->block_deadline) {
+                return TRUE;
             }
+
+            /* Don't block again until the queue is drained */
+            GDEBUG("%s is not reading", priv->name);
+            priv->overflow_timed_out = TRUE;
         }
-        g_mutex_unlock(&priv->mutex);
-        /* Unlock */
+    }
+    return FALSE;
+}
+
+void
+dbus_log_sender_notify(
+    DBusLogSender* self)
+{
+    if (G_LIKELY(self) && !self->priv->done) {
+        dbus_log_sender_pull(self);
+        dbus_log_sender_schedule_write(self);
     }
 }
 
@@ -461,24 +1640,16 @@ dbus_log_sender_close(
     if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
         if (!priv->done) {
-            /* Lock */
-            g_mutex_lock(&priv->mutex);
-            /* Non-main threads are not supposed to change the 'done'
-             * flag, they only check it. This function is supposed to
-             * be called by the main thread. Therefore, there's no need
-             * to re-check the flag under mutex. */
+            /* Nothing logged after this point is going to be sent */
+            dbus_log_sender_pull(self);
             priv->done = TRUE;
-            if (priv->packet_size == priv->packet_written &&
-                !gutil_ring_size(priv->buffer)) {
-                dbus_log_sender_prepare_bye(self);
-                g_mutex_unlock(&priv->mutex);
-                /* Unlock */
+            if (dbus_log_sender_batch_done(self) &&
+                !dbus_log_sender_pending(self)) {
+                dbus_log_sender_add_bye(self);
                 dbus_log_sender_schedule_write(self);
             } else {
                 /* Will send it after flushing pending messages */
                 priv->bye = TRUE;
-                g_mutex_unlock(&priv->mutex);
-                /* Unlock */
             }
         }
     }
@@ -491,12 +1662,21 @@ dbus_log_sender_shutdown(
 {
     if (G_LIKELY(self)) {
         DBusLogSenderPriv* priv = self->priv;
-        priv->packet_size = priv->packet_written = 0;
+
+        dbus_log_sender_release_batch(self);
         priv->done = TRUE;
         priv->bye = FALSE;
-        if (self->readfd >= 0) {
-            close(self->readfd);
-            self->readfd = -1;
+        dbus_log_history_remove_cursor(priv->history, &priv->cursor);
+        priv->queued = priv->skipped = 0;
+        priv->cursor = priv->tail;
+        dbus_log_sender_close_fd(&self->readfd);
+        dbus_log_sender_close_fd(&self->shmfd);
+        dbus_log_sender_close_fd(&self->datafd);
+        dbus_log_sender_close_fd(&self->spacefd);
+        dbus_log_sender_close_fd(&priv->datafd);
+        if (priv->shm) {
+            dbus_log_shm_free(priv->shm);
+            priv->shm = NULL;
         }
         if (priv->write_watch_id) {
             g_source_remove(priv->write_watch_id);
@@ -506,6 +1686,7 @@ dbus_log_sender_shutdown(
             g_io_channel_shutdown(priv->io, flush, NULL);
             g_io_channel_unref(priv->io);
             priv->io = NULL;
+            dbus_log_sender_unblock(self);
             g_signal_emit(self, dbus_log_sender_signals
                 [DBUSLOG_SENDER_SIGNAL_CLOSED], 0);
         }
@@ -522,6 +1703,16 @@ dbus_log_sender_add_closed_handler(
         DBUSLOG_SENDER_SIGNAL_CLOSED_NAME, G_CALLBACK(fn), user_data) : 0;
 }
 
+gulong
+dbus_log_sender_add_unblocked_handler(
+    DBusLogSender* self,
+    DBusLogSenderFunc fn,
+    gpointer user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(fn)) ? g_signal_connect(self,
+        DBUSLOG_SENDER_SIGNAL_UNBLOCKED_NAME, G_CALLBACK(fn), user_data) : 0;
+}
+
 void
 dbus_log_sender_remove_handler(
     DBusLogSender* self,
@@ -532,6 +1723,15 @@ dbus_log_sender_remove_handler(
     }
 }
 
+void
+dbus_log_sender_remove_handlers(
+    DBusLogSender* self,
+    gulong* ids,
+    guint count)
+{
+    gutil_disconnect_handlers(self, ids, count);
+}
+
 int
 dbus_log_sender_normalize_backlog(
     int backlog)
@@ -555,10 +1755,14 @@ dbus_log_sender_init(
 {
     DBusLogSenderPriv* priv = G_TYPE_INSTANCE_GET_PRIVATE(self,
         DBUSLOG_SENDER_TYPE, DBusLogSenderPriv);
-    g_mutex_init(&priv->mutex);
-    priv->context = g_main_context_default();
+    priv->formats_sent = g_hash_table_new(g_direct_hash, g_direct_equal);
+    priv->report_categories = g_hash_table_new(g_direct_hash,
+        g_direct_equal);
+    priv->filter_levels = g_hash_table_new(g_direct_hash, g_direct_equal);
+    priv->gaps = g_array_new(FALSE, FALSE, sizeof(DBusLogSenderGap));
     self->priv = priv;
-    self->readfd = -1;
+    self->readfd = self->shmfd = self->datafd = self->spacefd = -1;
+    priv->datafd = -1;
 }
 
 /**
@@ -570,10 +1774,7 @@ void
 dbus_log_sender_dispose(
     GObject* object)
 {
-    DBusLogSender* self = DBUSLOG_SENDER(object);
-    DBusLogSenderPriv* priv = self->priv;
-    dbus_log_sender_shutdown(self, FALSE);
-    gutil_ring_clear(priv->buffer);
+    dbus_log_sender_shutdown(DBUSLOG_SENDER(object), FALSE);
     G_OBJECT_CLASS(PARENT_CLASS)->dispose(object);
 }
 
@@ -587,9 +1788,18 @@ dbus_log_sender_finalize(
 {
     DBusLogSender* self = DBUSLOG_SENDER(object);
     DBusLogSenderPriv* priv = self->priv;
-    dbus_log_message_unref(priv->current_message);
-    gutil_ring_unref(priv->buffer);
-    g_mutex_clear(&priv->mutex);
+
+    dbus_log_sender_release_batch(self);
+    dbus_log_history_unref(priv->history);
+    g_array_free(priv->gaps, TRUE);
+    g_free(priv->batch_buf);
+    g_hash_table_destroy(priv->formats_sent);
+    g_hash_table_destroy(priv->report_categories);
+    g_hash_table_destroy(priv->filter_levels);
+    dbus_log_matcher_free(priv->matcher);
+    if (priv->filter_categories) {
+        g_hash_table_destroy(priv->filter_categories);
+    }
     g_free(priv->name);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
@@ -611,6 +1821,10 @@ dbus_log_sender_class_init(
         g_signal_new(DBUSLOG_SENDER_SIGNAL_CLOSED_NAME, class_type,
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
             G_TYPE_NONE, 0);
+    dbus_log_sender_signals[DBUSLOG_SENDER_SIGNAL_UNBLOCKED] =
+        g_signal_new(DBUSLOG_SENDER_SIGNAL_UNBLOCKED_NAME, class_type,
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
+            G_TYPE_NONE, 0);
 
     /*
      * There seems to be no way to stop write() from generating
@@ -34,7 +34,10 @@
 #define DBUSLOG_SENDER_H
 
 #include "dbuslog_server_types.h"
+#include "dbuslog_history.h"
+#include "dbuslog_matcher.h"
 #include "dbuslog_message.h"
+#include "dbuslog_shm.h"
 
 #include <glib-object.h>
 
@@ -45,8 +48,27 @@ typedef struct dbus_log_sender {
     DBusLogSenderPriv* priv;
     const char* name;
     int readfd;
+    /* Client side of the shared memory transport */
+    int shmfd;
+    int datafd;     /* Signaled by the sender when data is available */
+    int spacefd;    /* Signaled by the client when space is available */
 } DBusLogSender;
 
+/* Pipe sizes are zero for shared memory senders */
+typedef struct dbus_log_sender_stats {
+    guint pipe_size;
+    guint max_pipe_size;
+    guint pipe_resize_count;
+    guint64 dropped_count;
+    guint64 dropped_bytes;
+} DBusLogSenderStats;
+
+/* The pipe grows on its own up to this size, unless told otherwise */
+#define DBUSLOG_SENDER_DEFAULT_MAX_PIPE_SIZE (0x100000)
+
+/* How long DBUSLOG_OVERFLOW_BLOCK may hold the messages back */
+#define DBUSLOG_SENDER_BLOCK_TIMEOUT_MS (100)
+
 typedef
 void
 (*DBusLogSenderFunc)(
@@ -66,20 +88,132 @@ void
 dbus_log_sender_unref(
     DBusLogSender* sender);
 
+/* The sender reads the messages from the shared history */
+DBusLogSender*
+dbus_log_sender_new_shared(
+    const char* name,
+    DBusLogHistory* history);
+
+/* Writes into the shared memory ring rather than into the pipe */
+DBusLogSender*
+dbus_log_sender_new_shm(
+    const char* name,
+    DBusLogHistory* history,
+    gsize size);
+
+/* DBUSLOG_OPEN_FLAG_* */
 void
-dbus_log_sender_set_backlog(
+dbus_log_sender_set_flags(
     DBusLogSender* sender,
-    int backlog);
+    guint flags);
+
+/*
+ * Moves the sender back to the given position in the history. The
+ * messages dropped by the overflow policy may then be sent after all.
+ */
+void
+dbus_log_sender_rewind(
+    DBusLogSender* sender,
+    guint64 cursor);
+
+/*
+ * Maximum number of messages waiting to be sent, negative means
+ * unlimited. The history limits it too, regardless of this value.
+ */
+void
+dbus_log_sender_set_queue_size(
+    DBusLogSender* sender,
+    int size);
+
+void
+dbus_log_sender_set_overflow(
+    DBusLogSender* sender,
+    DBUSLOG_OVERFLOW overflow);
+
+/*
+ * Per-session filter, applied when the messages get sent. Level
+ * DBUSLOG_LEVEL_UNDEFINED means no limit (or, for a category, that the
+ * session's level applies). NULL categories lets all categories through.
+ */
+void
+dbus_log_sender_set_level(
+    DBusLogSender* sender,
+    DBUSLOG_LEVEL level);
+
+void
+dbus_log_sender_set_category_level(
+    DBusLogSender* sender,
+    guint32 category,
+    DBUSLOG_LEVEL level);
+
+void
+dbus_log_sender_set_categories(
+    DBusLogSender* sender,
+    const guint32* categories,
+    guint count);
+
+/* Takes ownership of the matcher, NULL removes the content filter */
+void
+dbus_log_sender_set_content_filter(
+    DBusLogSender* sender,
+    DBusLogMatcher* matcher);
+
+/* Returns the actual size of the pipe or a negative error code */
+int
+dbus_log_sender_set_pipe_size(
+    DBusLogSender* sender,
+    guint size);
+
+/* Limits the automatic growth of the pipe */
+void
+dbus_log_sender_set_max_pipe_size(
+    DBusLogSender* sender,
+    guint max_size);
+
+void
+dbus_log_sender_get_stats(
+    DBusLogSender* sender,
+    DBusLogSenderStats* stats);
 
 gboolean
 dbus_log_sender_ping(
     DBusLogSender* sender);
 
+/* Adds the message to the history and notifies the sender */
 void
 dbus_log_sender_send(
     DBusLogSender* sender,
     DBusLogMessage* message);
 
+/*
+ * Must be called before adding a message to the history. If the oldest
+ * message is about to be pushed out and the sender hasn't got to it
+ * yet, it gets dropped (and accounted for) here.
+ */
+void
+dbus_log_sender_reserve(
+    DBusLogSender* sender);
+
+/* Picks up the messages added to the history since the last call */
+void
+dbus_log_sender_pull(
+    DBusLogSender* sender);
+
+/* Same as dbus_log_sender_pull() but also starts writing them */
+void
+dbus_log_sender_notify(
+    DBusLogSender* sender);
+
+/*
+ * TRUE if the sender wants no more messages to be added to the history
+ * for the time being (DBUSLOG_OVERFLOW_BLOCK). It stops blocking after
+ * DBUSLOG_SENDER_BLOCK_TIMEOUT_MS, and emits the unblocked signal if
+ * the client makes room before that.
+ */
+gboolean
+dbus_log_sender_blocked(
+    DBusLogSender* sender);
+
 void
 dbus_log_sender_close(
     DBusLogSender* sender,
@@ -96,11 +230,23 @@ dbus_log_sender_add_closed_handler(
     DBusLogSenderFunc fn,
     gpointer user_data);
 
+gulong
+dbus_log_sender_add_unblocked_handler(
+    DBusLogSender* sender,
+    DBusLogSenderFunc fn,
+    gpointer user_data);
+
 void
 dbus_log_sender_remove_handler(
     DBusLogSender* sender,
     gulong id);
 
+void
+dbus_log_sender_remove_handlers(
+    DBusLogSender* sender,
+    gulong* ids,
+    guint count);
+
 int
 dbus_log_sender_normalize_backlog(
     int backlog);
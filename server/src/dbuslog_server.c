@@ -54,6 +54,7 @@ typedef struct dbus_log_server_peer {
     gulong watch_id;
     DBusLogSender* sender;
     DBusLogServer* server;
+    char** categories;
 } DBusLogServerPeer;
 
 struct dbus_log_server_priv {
@@ -61,6 +62,9 @@ struct dbus_log_server_priv {
     DA_BUS bus;
     DAPolicy* policy;
     GHashTable* peers;
+    guint pipe_size;
+    guint max_pipe_size;
+    DBUSLOG_OVERFLOW overflow;
     gulong core_signal_id[DBUSLOG_CORE_SIGNAL_COUNT];
 };
 
@@ -91,7 +95,9 @@ typedef enum dbuslog_action {
     DBUSLOG_ACTION_LOG_OPEN,
     DBUSLOG_ACTION_CATEGORY_ENABLE,
     DBUSLOG_ACTION_CATEGORY_DISABLE,
-    DBUSLOG_ACTION_SET_BACKLOG
+    DBUSLOG_ACTION_SET_BACKLOG,
+    DBUSLOG_ACTION_SESSION_FILTER,
+    DBUSLOG_ACTION_SESSION_BLOCK
 } DBUSLOG_ACTION;
 
 static const DA_ACTION dbus_log_server_policy_actions[] = {
@@ -101,6 +107,8 @@ static const DA_ACTION dbus_log_server_policy_actions[] = {
     { "CategoryEnable", DBUSLOG_ACTION_CATEGORY_ENABLE, 0 },
     { "CategoryDisable", DBUSLOG_ACTION_CATEGORY_DISABLE, 0 },
     { "SetBacklog", DBUSLOG_ACTION_SET_BACKLOG, 0 },
+    { "SessionFilter", DBUSLOG_ACTION_SESSION_FILTER, 0 },
+    { "SessionBlock", DBUSLOG_ACTION_SESSION_BLOCK, 0 },
     { NULL }
 };
 
@@ -124,9 +132,36 @@ dbus_log_server_peer_destroy(
     }
     dbus_log_sender_close(peer->sender, TRUE);
     dbus_log_sender_unref(peer->sender);
+    g_strfreev(peer->categories);
     g_slice_free(DBusLogServerPeer, peer);
 }
 
+static
+void
+dbus_log_server_peer_update_categories(
+    DBusLogServerPeer* peer)
+{
+    if (peer->categories) {
+        /* Categories which don't exist (yet) let nothing through */
+        DBusLogCore* core = peer->server->core;
+        guint32* ids = g_new(guint32, gutil_strv_length(peer->categories));
+        guint count = 0;
+        char** ptr;
+
+        for (ptr = peer->categories; *ptr; ptr++) {
+            DBusLogCategory* cat = dbus_log_core_find_category(core, *ptr);
+
+            if (cat) {
+                ids[count++] = cat->id;
+            }
+        }
+        dbus_log_sender_set_categories(peer->sender, ids, count);
+        g_free(ids);
+    } else {
+        dbus_log_sender_set_categories(peer->sender, NULL, 0);
+    }
+}
+
 static
 void
 dbus_log_server_backlog_changed(
@@ -163,6 +198,18 @@ dbus_log_server_category_added(
     gpointer user_data)
 {
     DBusLogServer* self = DBUSLOG_SERVER(user_data);
+    GHashTableIter it;
+    gpointer value;
+
+    /* Session filters refer to the categories by name */
+    g_hash_table_iter_init(&it, self->priv->peers);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        DBusLogServerPeer* peer = value;
+
+        if (gutil_strv_contains(peer->categories, category->name)) {
+            dbus_log_server_peer_update_categories(peer);
+        }
+    }
     if (self->started) {
         DBUSLOG_SERVER_GET_CLASS(self)->emit_category_added(self,
             category->name, category->id, category->flags);
@@ -241,6 +288,18 @@ dbus_log_server_access_allowed(
         DA_ACCESS_DENY) == DA_ACCESS_ALLOW;
 }
 
+static
+DBusLogServerPeer*
+dbus_log_server_session(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie)
+{
+    /* There's one session per peer and they all have the same cookie */
+    return (cookie == DBUSLOG_LOG_COOKIE) ?
+        g_hash_table_lookup(self->priv->peers, name) : NULL;
+}
+
 /*==========================================================================*
  * D-Bus method helpers
  *==========================================================================*/
@@ -277,31 +336,77 @@ dbus_log_server_call_set_category_level(
     }
 }
 
+static
+void
+dbus_log_server_add_peer(
+    DBusLogServer* self,
+    DBusLogSender* sender,
+    guint flags,
+    guint history)
+{
+    DBusLogServerPriv* priv = self->priv;
+    DBusLogServerPeer* peer = g_slice_new0(DBusLogServerPeer);
+    DBusLogServerClass* klass = DBUSLOG_SERVER_GET_CLASS(self);
+    dbus_log_sender_set_flags(sender, flags);
+    dbus_log_sender_set_overflow(sender, priv->overflow);
+    peer->sender = sender;
+    peer->server = self;
+    if (klass->watch_name) {
+        peer->watch_id = klass->watch_name(self, sender->name);
+    }
+    g_hash_table_replace(priv->peers, (gpointer)sender->name, peer);
+    dbus_log_core_replay(self->core, sender, flags, history);
+}
+
 int
 dbus_log_server_call_log_open(
     DBusLogServer* self,
-    const char* name)
+    const char* name,
+    guint flags,
+    guint history)
 {
     if (!dbus_log_server_access_allowed(self, name, DBUSLOG_ACTION_LOG_OPEN)) {
         return -EACCES;
     } else {
+        DBusLogServerPriv* priv = self->priv;
         DBusLogSender* sender = dbus_log_core_new_sender(self->core, name);
         if (sender) {
-            DBusLogServerPriv* priv = self->priv;
-            DBusLogServerPeer* peer = g_slice_new0(DBusLogServerPeer);
-            DBusLogServerClass* klass = DBUSLOG_SERVER_GET_CLASS(self);
-            peer->sender = sender;
-            peer->server = self;
-            if (klass->watch_name) {
-                peer->watch_id = klass->watch_name(self, name);
+            if (priv->pipe_size) {
+                dbus_log_sender_set_pipe_size(sender, priv->pipe_size);
             }
-            g_hash_table_replace(priv->peers, (gpointer)sender->name, peer);
+            dbus_log_sender_set_max_pipe_size(sender, priv->max_pipe_size);
+            dbus_log_server_add_peer(self, sender, flags, history);
             return sender->readfd;
         }
         return -EIO;
     }
 }
 
+int
+dbus_log_server_call_log_open_shm(
+    DBusLogServer* self,
+    const char* name,
+    guint flags,
+    guint history,
+    guint size,
+    int* fds)
+{
+    if (!dbus_log_server_access_allowed(self, name, DBUSLOG_ACTION_LOG_OPEN)) {
+        return -EACCES;
+    } else {
+        DBusLogSender* sender = dbus_log_core_new_shm_sender(self->core,
+            name, size ? size : DBUSLOG_SHM_DEFAULT_SIZE);
+        if (sender) {
+            dbus_log_server_add_peer(self, sender, flags, history);
+            fds[0] = sender->shmfd;
+            fds[1] = sender->datafd;
+            fds[2] = sender->spacefd;
+            return 0;
+        }
+        return -EIO;
+    }
+}
+
 void
 dbus_log_server_call_log_close(
     DBusLogServer* self,
@@ -313,6 +418,165 @@ dbus_log_server_call_log_close(
     g_hash_table_remove(priv->peers, name);
 }
 
+int
+dbus_log_server_call_set_pipe_size(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    guint size)
+{
+    DBusLogServerPriv* priv = self->priv;
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else {
+        const int ret = dbus_log_sender_set_pipe_size(peer->sender,
+            MIN(size, priv->max_pipe_size));
+        return (ret < 0) ? ret : 0;
+    }
+}
+
+int
+dbus_log_server_call_set_overflow(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    guint overflow)
+{
+    DBusLogServerPeer* peer;
+
+    /* Blocking delays all sessions, not just this one */
+    if (overflow == DBUSLOG_OVERFLOW_BLOCK &&
+        !dbus_log_server_access_allowed(self, name,
+        DBUSLOG_ACTION_SESSION_BLOCK)) {
+        return -EACCES;
+    }
+    peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else if (overflow >= DBUSLOG_OVERFLOW_COUNT) {
+        return -EINVAL;
+    } else {
+        dbus_log_sender_set_overflow(peer->sender, overflow);
+        return 0;
+    }
+}
+
+int
+dbus_log_server_call_session_set_level(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    int level)
+{
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else if (!dbus_log_server_access_allowed(self, name,
+        DBUSLOG_ACTION_SESSION_FILTER)) {
+        return -EACCES;
+    } else if (level < DBUSLOG_LEVEL_UNDEFINED ||
+        level >= DBUSLOG_LEVEL_COUNT) {
+        return -EINVAL;
+    } else {
+        dbus_log_sender_set_level(peer->sender, level);
+        return 0;
+    }
+}
+
+int
+dbus_log_server_call_session_set_category_level(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    const char* category,
+    int level)
+{
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    DBusLogCategory* cat = dbus_log_core_find_category(self->core, category);
+    if (!peer) {
+        return -ENOENT;
+    } else if (!dbus_log_server_access_allowed(self, name,
+        DBUSLOG_ACTION_SESSION_FILTER)) {
+        return -EACCES;
+    } else if (!cat || level < DBUSLOG_LEVEL_UNDEFINED ||
+        level >= DBUSLOG_LEVEL_COUNT) {
+        return -EINVAL;
+    } else {
+        dbus_log_sender_set_category_level(peer->sender, cat->id, level);
+        return 0;
+    }
+}
+
+int
+dbus_log_server_call_session_set_categories(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    const GStrV* names)
+{
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else if (!dbus_log_server_access_allowed(self, name,
+        DBUSLOG_ACTION_SESSION_FILTER)) {
+        return -EACCES;
+    } else {
+        /* Empty list removes the filter */
+        g_strfreev(peer->categories);
+        peer->categories = (names && names[0]) ?
+            g_strdupv((char**)names) : NULL;
+        dbus_log_server_peer_update_categories(peer);
+        return 0;
+    }
+}
+
+int
+dbus_log_server_call_session_set_content_filter(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    const GStrV* substrings,
+    const char* regex)
+{
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else if (!dbus_log_server_access_allowed(self, name,
+        DBUSLOG_ACTION_SESSION_FILTER)) {
+        return -EACCES;
+    } else {
+        GError* error = NULL;
+        DBusLogMatcher* matcher = dbus_log_matcher_new(substrings, regex,
+            &error);
+
+        if (error) {
+            GWARN("%s", error->message);
+            g_error_free(error);
+            return -EINVAL;
+        }
+        /* NULL matcher (nothing to match) removes the filter */
+        dbus_log_sender_set_content_filter(peer->sender, matcher);
+        return 0;
+    }
+}
+
+int
+dbus_log_server_call_get_stats(
+    DBusLogServer* self,
+    const char* name,
+    guint cookie,
+    DBusLogSenderStats* stats)
+{
+    DBusLogServerPeer* peer = dbus_log_server_session(self, name, cookie);
+    if (!peer) {
+        return -ENOENT;
+    } else {
+        dbus_log_sender_get_stats(peer->sender, stats);
+        return 0;
+    }
+}
+
 int
 dbus_log_server_call_set_names_enabled(
     DBusLogServer* self,
@@ -502,6 +766,50 @@ dbus_log_server_set_default_level(
     return G_LIKELY(self) && dbus_log_core_set_default_level(self->core, level);
 }
 
+void
+dbus_log_server_set_keep_history(
+    DBusLogServer* self,
+    gboolean keep_history) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        dbus_log_core_set_keep_history(self->core, keep_history);
+    }
+}
+
+void
+dbus_log_server_set_pipe_size(
+    DBusLogServer* self,
+    guint size,
+    guint max_size) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        DBusLogServerPriv* priv = self->priv;
+        priv->pipe_size = size;
+        priv->max_pipe_size = MAX(size, max_size);
+    }
+}
+
+gboolean
+dbus_log_server_set_overflow_policy(
+    DBusLogServer* self,
+    DBUSLOG_OVERFLOW overflow) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self) && (guint)overflow < DBUSLOG_OVERFLOW_COUNT) {
+        DBusLogServerPriv* priv = self->priv;
+        priv->overflow = overflow;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean
+dbus_log_server_set_clock(
+    DBusLogServer* self,
+    DBUSLOG_CLOCK clock) /* Since 1.0.23 */
+{
+    return G_LIKELY(self) && dbus_log_core_set_clock(self->core, clock);
+}
+
 gboolean
 dbus_log_server_set_category_level(
     DBusLogServer* self,
@@ -512,7 +820,7 @@ dbus_log_server_set_category_level(
         dbus_log_core_set_category_level(self->core, name, level);
 }
 
-void
+DBusLogCategory*
 dbus_log_server_add_category(
     DBusLogServer* self,
     const char* name,
@@ -520,9 +828,14 @@ dbus_log_server_add_category(
     gulong flags)
 {
     if (G_LIKELY(self)) {
-        dbus_log_category_unref(dbus_log_core_new_category(self->core,
-            name, level, flags));
+        DBusLogCategory* cat = dbus_log_core_new_category(self->core,
+            name, level, flags);
+
+        /* The core keeps its own reference */
+        dbus_log_category_unref(cat);
+        return cat;
     }
+    return NULL;
 }
 
 gboolean
@@ -572,6 +885,84 @@ dbus_log_server_logv(
     return TRUE;
 }
 
+gboolean
+dbus_log_server_log_cat(
+    DBusLogServer* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* message) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        return dbus_log_core_log_cat(self->core, level, category, message);
+    }
+    return TRUE;
+}
+
+gboolean
+dbus_log_server_logv_cat(
+    DBusLogServer* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    const char* format,
+    va_list args) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        return dbus_log_core_logv_cat(self->core, level, category,
+            format, args);
+    }
+    return TRUE;
+}
+
+DBusLogFormat*
+dbus_log_server_add_format(
+    DBusLogServer* self,
+    const char* format) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        DBusLogFormat* fmt = dbus_log_core_new_format(self->core, format);
+
+        /* The core keeps its own reference */
+        dbus_log_format_unref(fmt);
+        return fmt;
+    }
+    return NULL;
+}
+
+gboolean
+dbus_log_server_log_format(
+    DBusLogServer* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    DBusLogFormat* format,
+    ...) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        gboolean ok;
+        va_list args;
+        va_start(args, format);
+        ok = dbus_log_core_logv_format(self->core, level, category,
+            format, args);
+        va_end(args);
+        return ok;
+    }
+    return TRUE;
+}
+
+gboolean
+dbus_log_server_logv_format(
+    DBusLogServer* self,
+    DBUSLOG_LEVEL level,
+    DBusLogCategory* category,
+    DBusLogFormat* format,
+    va_list args) /* Since 1.0.23 */
+{
+    if (G_LIKELY(self)) {
+        return dbus_log_core_logv_format(self->core, level, category,
+            format, args);
+    }
+    return TRUE;
+}
+
 gulong
 dbus_log_server_add_category_enabled_handler(
     DBusLogServer* self,
@@ -655,6 +1046,19 @@ dbus_log_server_steal_readfd(
     return FALSE;
 }
 
+void
+dbus_log_server_steal_shm_fds(
+    DBusLogServer* self,
+    const char* name)
+{
+    DBusLogServerPriv* priv = self->priv;
+    DBusLogServerPeer* peer = g_hash_table_lookup(priv->peers, name);
+    if (peer) {
+        DBusLogSender* sender = peer->sender;
+        sender->shmfd = sender->datafd = sender->spacefd = -1;
+    }
+}
+
 void
 dbus_log_server_peer_vanished(
     DBusLogServer* self,
@@ -679,6 +1083,7 @@ dbus_log_server_init(
     DBusLogServerPriv* priv = G_TYPE_INSTANCE_GET_PRIVATE(self,
         DBUSLOG_SERVER_TYPE, DBusLogServerPriv);
     self->priv = priv;
+    priv->max_pipe_size = DBUSLOG_SENDER_DEFAULT_MAX_PIPE_SIZE;
     priv->peers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
         dbus_log_server_peer_destroy);
     priv->policy = da_policy_new_full(dbus_log_server_default_policy,
@@ -38,7 +38,7 @@
 
 #include <gutil_strv.h>
 
-#define DBUSLOG_INTERFACE_VERSION (2)
+#define DBUSLOG_INTERFACE_VERSION (9)
 #define DBUSLOG_LOG_COOKIE (1)
 
 typedef struct dbus_log_server_priv DBusLogServerPriv;
@@ -125,6 +125,12 @@ dbus_log_server_steal_readfd(
     int fd)
     G_GNUC_INTERNAL;
 
+void
+dbus_log_server_steal_shm_fds(
+    DBusLogServer* server,
+    const char* peer)
+    G_GNUC_INTERNAL;
+
 void
 dbus_log_server_peer_vanished(
     DBusLogServer* self,
@@ -149,7 +155,20 @@ dbus_log_server_call_set_category_level(
 int
 dbus_log_server_call_log_open(
     DBusLogServer* server,
-    const char* peer)
+    const char* peer,
+    guint flags,
+    guint history)
+    G_GNUC_INTERNAL;
+
+/* On success, fills fds with shm, data and space descriptors */
+int
+dbus_log_server_call_log_open_shm(
+    DBusLogServer* server,
+    const char* peer,
+    guint flags,
+    guint history,
+    guint size,
+    int* fds)
     G_GNUC_INTERNAL;
 
 void
@@ -159,6 +178,64 @@ dbus_log_server_call_log_close(
     guint cookie)
     G_GNUC_INTERNAL;
 
+int
+dbus_log_server_call_set_pipe_size(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    guint size)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_set_overflow(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    guint overflow)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_session_set_level(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    int level)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_session_set_category_level(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    const char* category,
+    int level)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_session_set_categories(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    const GStrV* names)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_session_set_content_filter(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    const GStrV* substrings,
+    const char* regex)
+    G_GNUC_INTERNAL;
+
+int
+dbus_log_server_call_get_stats(
+    DBusLogServer* server,
+    const char* peer,
+    guint cookie,
+    DBusLogSenderStats* stats)
+    G_GNUC_INTERNAL;
+
 int
 dbus_log_server_call_set_names_enabled(
     DBusLogServer* server,
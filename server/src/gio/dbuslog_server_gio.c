@@ -55,6 +55,16 @@ enum dbus_log_skeleton_method {
     DBUSLOG_METHOD_DISABLE_PATTERN,
     DBUSLOG_METHOD_GET_ALL2,
     DBUSLOG_METHOD_SET_BACKLOG,
+    DBUSLOG_METHOD_OPEN2,
+    DBUSLOG_METHOD_OPEN3,
+    DBUSLOG_METHOD_OPEN_SHM,
+    DBUSLOG_METHOD_SET_PIPE_SIZE,
+    DBUSLOG_METHOD_GET_STATISTICS,
+    DBUSLOG_METHOD_SET_OVERFLOW_POLICY,
+    DBUSLOG_METHOD_SESSION_SET_LEVEL,
+    DBUSLOG_METHOD_SESSION_SET_CATEGORY_LEVEL,
+    DBUSLOG_METHOD_SESSION_SET_CATEGORIES,
+    DBUSLOG_METHOD_SESSION_SET_CONTENT_FILTER,
     DBUSLOG_METHOD_COUNT
 };
 
@@ -282,6 +292,10 @@ dbus_log_server_return_error(
         code = G_DBUS_ERROR_INVALID_ARGS;
         message = "Invalid argument(s)";
         break;
+    case -ENOENT:
+        code = G_DBUS_ERROR_FAILED;
+        message = "Log is not open";
+        break;
     default:
         code = G_DBUS_ERROR_FAILED;
         message = "Internal error";
@@ -391,31 +405,114 @@ dbus_log_server_handle_set_category_level(
 }
 
 static
-gboolean
-dbus_log_server_handle_open(
+void
+dbus_log_server_gio_open(
+    DBusLogServerGio* self,
     OrgNemomobileLogger* proxy,
     GDBusMethodInvocation* call,
-    GUnixFDList* fdlist,
-    DBusLogServerGio* self)
+    guint flags,
+    guint history,
+    void (*complete)(
+        OrgNemomobileLogger* proxy,
+        GDBusMethodInvocation* call,
+        GUnixFDList* fdl,
+        GVariant* fd,
+        guint cookie))
 {
     int err = -EFAULT;
     GASSERT(self->bus);
     if (self->bus) {
         DBusLogServer* server = &self->server;
         const char* name = g_dbus_method_invocation_get_sender(call);
-        const gint fd = dbus_log_server_call_log_open(server, name);
+        const gint fd = dbus_log_server_call_log_open(server, name,
+            flags, history);
         if (fd >= 0) {
             /* GUnixFDList takes ownership of the descriptor */
             GUnixFDList* fdl = g_unix_fd_list_new_from_array(&fd, 1);
-            org_nemomobile_logger_complete_log_open(proxy, call, fdl,
-                g_variant_new_handle(0), DBUSLOG_LOG_COOKIE);
+            complete(proxy, call, fdl, g_variant_new_handle(0),
+                DBUSLOG_LOG_COOKIE);
             dbus_log_server_steal_readfd(server, name, fd);
             g_object_unref(fdl);
-            return TRUE;
+            return;
         }
         err = fd;
     }
     dbus_log_server_return_error(call, err);
+}
+
+static
+gboolean
+dbus_log_server_handle_open(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    GUnixFDList* fdlist,
+    DBusLogServerGio* self)
+{
+    dbus_log_server_gio_open(self, proxy, call, 0, 0,
+        org_nemomobile_logger_complete_log_open);
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_open2(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    GUnixFDList* fdlist,
+    guint flags,
+    DBusLogServerGio* self)
+{
+    dbus_log_server_gio_open(self, proxy, call, flags, 0,
+        org_nemomobile_logger_complete_log_open2);
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_open3(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    GUnixFDList* fdlist,
+    guint flags,
+    guint history,
+    DBusLogServerGio* self)
+{
+    dbus_log_server_gio_open(self, proxy, call, flags, history,
+        org_nemomobile_logger_complete_log_open3);
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_open_shm(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    GUnixFDList* fdlist,
+    guint flags,
+    guint history,
+    guint size,
+    DBusLogServerGio* self)
+{
+    int err = -EFAULT;
+    GASSERT(self->bus);
+    if (self->bus) {
+        DBusLogServer* server = &self->server;
+        const char* name = g_dbus_method_invocation_get_sender(call);
+        int fds[3];
+        err = dbus_log_server_call_log_open_shm(server, name, flags,
+            history, size, fds);
+        if (!err) {
+            /* GUnixFDList takes ownership of the descriptors */
+            GUnixFDList* fdl = g_unix_fd_list_new_from_array(fds, 3);
+            dbus_log_server_steal_shm_fds(server, name);
+            org_nemomobile_logger_complete_log_open_shm(proxy, call, fdl,
+                g_variant_new_handle(0), g_variant_new_handle(1),
+                g_variant_new_handle(2), DBUSLOG_LOG_COOKIE);
+            g_object_unref(fdl);
+            return TRUE;
+        }
+    }
+    dbus_log_server_return_error(call, err);
     return TRUE;
 }
 
@@ -523,6 +620,160 @@ dbus_log_server_handle_set_backlog(
     return TRUE;
 }
 
+static
+gboolean
+dbus_log_server_handle_set_pipe_size(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    guint size,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_set_pipe_size(&self->server,
+        g_dbus_method_invocation_get_sender(call), cookie, size);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_set_pipe_size(proxy, call);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_get_statistics(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    DBusLogServerGio* self)
+{
+    DBusLogSenderStats stats;
+    const int err = dbus_log_server_call_get_stats(&self->server,
+        g_dbus_method_invocation_get_sender(call), cookie, &stats);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add(&builder, "{sv}", DBUSLOG_STATS_PIPE_SIZE,
+            g_variant_new_uint32(stats.pipe_size));
+        g_variant_builder_add(&builder, "{sv}", DBUSLOG_STATS_MAX_PIPE_SIZE,
+            g_variant_new_uint32(stats.max_pipe_size));
+        g_variant_builder_add(&builder, "{sv}",
+            DBUSLOG_STATS_PIPE_RESIZE_COUNT,
+            g_variant_new_uint32(stats.pipe_resize_count));
+        g_variant_builder_add(&builder, "{sv}", DBUSLOG_STATS_DROPPED_COUNT,
+            g_variant_new_uint64(stats.dropped_count));
+        g_variant_builder_add(&builder, "{sv}", DBUSLOG_STATS_DROPPED_BYTES,
+            g_variant_new_uint64(stats.dropped_bytes));
+        org_nemomobile_logger_complete_get_statistics(proxy, call,
+            g_variant_builder_end(&builder));
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_set_overflow_policy(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    guint policy,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_set_overflow(&self->server,
+        g_dbus_method_invocation_get_sender(call), cookie, policy);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_set_overflow_policy(proxy, call);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_session_set_level(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    gint level,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_session_set_level(&self->server,
+        g_dbus_method_invocation_get_sender(call), cookie, level);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_session_set_level(proxy, call);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_session_set_category_level(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    const char* name,
+    gint level,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_session_set_category_level(
+        &self->server, g_dbus_method_invocation_get_sender(call), cookie,
+        name, level);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_session_set_category_level(proxy,
+            call);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_session_set_categories(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    const GStrV* names,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_session_set_categories(
+        &self->server, g_dbus_method_invocation_get_sender(call), cookie,
+        names);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_session_set_categories(proxy, call);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_log_server_handle_session_set_content_filter(
+    OrgNemomobileLogger* proxy,
+    GDBusMethodInvocation* call,
+    guint cookie,
+    const GStrV* substrings,
+    const char* regex,
+    DBusLogServerGio* self)
+{
+    const int err = dbus_log_server_call_session_set_content_filter(
+        &self->server, g_dbus_method_invocation_get_sender(call), cookie,
+        substrings, regex);
+    if (err) {
+        dbus_log_server_return_error(call, err);
+    } else {
+        org_nemomobile_logger_complete_session_set_content_filter(proxy,
+            call);
+    }
+    return TRUE;
+}
+
 /*==========================================================================*
  * API
  *==========================================================================*/
@@ -576,6 +827,36 @@ dbus_log_server_new(
     self->iface_method_id[DBUSLOG_METHOD_SET_BACKLOG] =
         g_signal_connect(self->iface, "handle-set-backlog",
         G_CALLBACK(dbus_log_server_handle_set_backlog), self);
+    self->iface_method_id[DBUSLOG_METHOD_OPEN2] =
+        g_signal_connect(self->iface, "handle-log-open2",
+        G_CALLBACK(dbus_log_server_handle_open2), self);
+    self->iface_method_id[DBUSLOG_METHOD_OPEN3] =
+        g_signal_connect(self->iface, "handle-log-open3",
+        G_CALLBACK(dbus_log_server_handle_open3), self);
+    self->iface_method_id[DBUSLOG_METHOD_OPEN_SHM] =
+        g_signal_connect(self->iface, "handle-log-open-shm",
+        G_CALLBACK(dbus_log_server_handle_open_shm), self);
+    self->iface_method_id[DBUSLOG_METHOD_SET_PIPE_SIZE] =
+        g_signal_connect(self->iface, "handle-set-pipe-size",
+        G_CALLBACK(dbus_log_server_handle_set_pipe_size), self);
+    self->iface_method_id[DBUSLOG_METHOD_GET_STATISTICS] =
+        g_signal_connect(self->iface, "handle-get-statistics",
+        G_CALLBACK(dbus_log_server_handle_get_statistics), self);
+    self->iface_method_id[DBUSLOG_METHOD_SET_OVERFLOW_POLICY] =
+        g_signal_connect(self->iface, "handle-set-overflow-policy",
+        G_CALLBACK(dbus_log_server_handle_set_overflow_policy), self);
+    self->iface_method_id[DBUSLOG_METHOD_SESSION_SET_LEVEL] =
+        g_signal_connect(self->iface, "handle-session-set-level",
+        G_CALLBACK(dbus_log_server_handle_session_set_level), self);
+    self->iface_method_id[DBUSLOG_METHOD_SESSION_SET_CATEGORY_LEVEL] =
+        g_signal_connect(self->iface, "handle-session-set-category-level",
+        G_CALLBACK(dbus_log_server_handle_session_set_category_level), self);
+    self->iface_method_id[DBUSLOG_METHOD_SESSION_SET_CATEGORIES] =
+        g_signal_connect(self->iface, "handle-session-set-categories",
+        G_CALLBACK(dbus_log_server_handle_session_set_categories), self);
+    self->iface_method_id[DBUSLOG_METHOD_SESSION_SET_CONTENT_FILTER] =
+        g_signal_connect(self->iface, "handle-session-set-content-filter",
+        G_CALLBACK(dbus_log_server_handle_session_set_content_filter), self);
 
     /* And start watching the requested name */
     if (service) {
@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_capture.h"
+#include "dbuslog_client_log.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+GLOG_MODULE_DEFINE("test_capture");
+
+#define TEST_CATEGORY_A (1)
+#define TEST_CATEGORY_B (2)
+
+static
+char*
+test_capture_tmp_file(
+    void)
+{
+    char* path = NULL;
+    int fd = g_file_open_tmp("test_capture_XXXXXX", &path, NULL);
+
+    g_assert(fd >= 0);
+    close(fd);
+    return path;
+}
+
+static
+void
+test_capture_write(
+    DBusLogCaptureWriter* writer,
+    DBusLogCategory* category,
+    guint32 index,
+    gint64 timestamp)
+{
+    char* text = g_strdup_printf("Message %u", index);
+    DBusLogMessage* msg = dbus_log_message_new(text);
+
+    msg->index = index;
+    msg->timestamp = timestamp;
+    msg->category = category ? category->id : 0;
+    msg->level = DBUSLOG_LEVEL_INFO;
+    g_assert(dbus_log_capture_writer_write(writer, category, msg));
+    dbus_log_message_unref(msg);
+    g_free(text);
+}
+
+static
+void
+test_capture_check(
+    DBusLogMessage* msg,
+    guint32 index)
+{
+    char* text = g_strdup_printf("Message %u", index);
+
+    g_assert(msg);
+    g_assert_cmpuint(msg->index, == ,index);
+    g_assert_cmpuint(msg->level, == ,DBUSLOG_LEVEL_INFO);
+    g_assert_cmpuint(msg->length, == ,strlen(text));
+    g_assert_cmpstr(msg->string, == ,text);
+    dbus_log_message_unref(msg);
+    g_free(text);
+}
+
+/* Writes count messages from category A, then count from category B */
+static
+char*
+test_capture_file_full(
+    guint count,
+    gboolean index_text)
+{
+    char* path = test_capture_tmp_file();
+    DBusLogCaptureWriter* writer = dbus_log_capture_writer_new(path);
+    DBusLogCategory* a = dbus_log_category_new("a", TEST_CATEGORY_A);
+    DBusLogCategory* b = dbus_log_category_new("b", TEST_CATEGORY_B);
+    guint i;
+
+    g_assert(writer);
+    if (index_text) {
+        g_assert(dbus_log_capture_writer_index_text(writer));
+    }
+    for (i = 0; i < count; i++) {
+        test_capture_write(writer, a, i, 1000 * i);
+    }
+    for (i = count; i < 2 * count; i++) {
+        test_capture_write(writer, b, i, 1000 * i);
+    }
+    dbus_log_capture_writer_close(writer);
+    dbus_log_category_unref(a);
+    dbus_log_category_unref(b);
+    return path;
+}
+
+static
+char*
+test_capture_file(
+    guint count)
+{
+    return test_capture_file_full(count, FALSE);
+}
+
+/*==========================================================================*
+ * Null
+ *==========================================================================*/
+
+static
+void
+test_null(
+    void)
+{
+    /* Public interfaces are NULL tolerant */
+    g_assert(!dbus_log_capture_writer_index_text(NULL));
+    g_assert(!dbus_log_capture_writer_write(NULL, NULL, NULL));
+    g_assert(!dbus_log_capture_reader_category(NULL, 0));
+    g_assert(!dbus_log_capture_reader_find_category(NULL, NULL));
+    g_assert(!dbus_log_capture_reader_next(NULL, NULL));
+    dbus_log_capture_writer_close(NULL);
+    dbus_log_capture_reader_free(NULL);
+    dbus_log_capture_reader_seek_time(NULL, 0);
+    dbus_log_capture_reader_set_category(NULL, 0);
+    g_assert(!dbus_log_capture_reader_set_content_filter(NULL, NULL, NULL,
+        NULL));
+    g_assert(!dbus_log_capture_reader_new("/nonexistent/file"));
+}
+
+/*==========================================================================*
+ * Basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    char* path = test_capture_tmp_file();
+    DBusLogCaptureWriter* writer = dbus_log_capture_writer_new(path);
+    DBusLogCaptureReader* reader;
+    DBusLogCategory* a = dbus_log_category_new("a", TEST_CATEGORY_A);
+    DBusLogCategory* cat;
+    DBusLogMessage* msg;
+
+    a->flags = DBUSLOG_CATEGORY_FLAG_HIDE_NAME;
+    test_capture_write(writer, a, 1, 1000);
+    test_capture_write(writer, NULL, 2, 2000);
+    dbus_log_capture_writer_close(writer);
+    dbus_log_category_unref(a);
+
+    reader = dbus_log_capture_reader_new(path);
+    g_assert(reader);
+    cat = dbus_log_capture_reader_find_category(reader, "a");
+    g_assert(cat);
+    g_assert_cmpuint(cat->id, == ,TEST_CATEGORY_A);
+    g_assert_cmpuint(cat->flags, == ,DBUSLOG_CATEGORY_FLAG_HIDE_NAME);
+    g_assert(dbus_log_capture_reader_category(reader, TEST_CATEGORY_A) == cat);
+    g_assert(!dbus_log_capture_reader_find_category(reader, "b"));
+
+    msg = dbus_log_capture_reader_next(reader, &cat);
+    g_assert(cat);
+    g_assert_cmpstr(cat->name, == ,"a");
+    g_assert_cmpint(msg->timestamp, == ,1000);
+    test_capture_check(msg, 1);
+    msg = dbus_log_capture_reader_next(reader, &cat);
+    g_assert(!cat);
+    g_assert_cmpint(msg->timestamp, == ,2000);
+    test_capture_check(msg, 2);
+    g_assert(!dbus_log_capture_reader_next(reader, &cat));
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+
+    dbus_log_capture_reader_free(reader);
+    unlink(path);
+    g_free(path);
+}
+
+/*==========================================================================*
+ * Seek
+ *==========================================================================*/
+
+static
+void
+test_seek(
+    void)
+{
+    const guint n = 2500; /* Several blocks per category */
+    char* path = test_capture_file(n);
+    DBusLogCaptureReader* reader = dbus_log_capture_reader_new(path);
+    guint i;
+
+    g_assert(reader);
+    dbus_log_capture_reader_seek_time(reader, 1000 * (n + 10));
+    for (i = n + 10; i < 2 * n; i++) {
+        test_capture_check(dbus_log_capture_reader_next(reader, NULL), i);
+    }
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+
+    /* Seeking rewinds the reader */
+    dbus_log_capture_reader_seek_time(reader, 500);
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 1);
+
+    dbus_log_capture_reader_free(reader);
+    unlink(path);
+    g_free(path);
+}
+
+/*==========================================================================*
+ * Category
+ *==========================================================================*/
+
+static
+void
+test_category(
+    void)
+{
+    const guint n = 2500;
+    char* path = test_capture_file(n);
+    DBusLogCaptureReader* reader = dbus_log_capture_reader_new(path);
+    DBusLogCategory* cat;
+    guint i;
+
+    g_assert(reader);
+    dbus_log_capture_reader_set_category(reader, TEST_CATEGORY_A);
+    for (i = 0; i < n; i++) {
+        test_capture_check(dbus_log_capture_reader_next(reader, &cat), i);
+        g_assert_cmpuint(cat->id, == ,TEST_CATEGORY_A);
+    }
+    g_assert(!dbus_log_capture_reader_next(reader, &cat));
+    g_assert(!cat);
+
+    /* Both filters at once */
+    dbus_log_capture_reader_set_category(reader, TEST_CATEGORY_B);
+    dbus_log_capture_reader_seek_time(reader, 1000 * (2 * n - 1));
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 2 * n - 1);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+
+    dbus_log_capture_reader_free(reader);
+    unlink(path);
+    g_free(path);
+}
+
+/*==========================================================================*
+ * NoIndex
+ *==========================================================================*/
+
+static
+void
+test_no_index(
+    void)
+{
+    const guint n = 1500;
+    char* path = test_capture_file(n);
+    DBusLogCaptureReader* reader;
+    struct stat st;
+    guint i;
+
+    /* Damage the trailer, the reader has to scan the file */
+    g_assert(!stat(path, &st));
+    g_assert(!truncate(path, st.st_size - 3));
+    reader = dbus_log_capture_reader_new(path);
+    g_assert(reader);
+    g_assert(dbus_log_capture_reader_find_category(reader, "b"));
+    for (i = 0; i < 2 * n; i++) {
+        test_capture_check(dbus_log_capture_reader_next(reader, NULL), i);
+    }
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_free(reader);
+
+    /*
+     * Leave the header, category "a", one complete message and
+     * a piece of the second one.
+     */
+    g_assert(!truncate(path, 16 +
+        DBUSLOG_PACKET_HEADER_SIZE + 8 + strlen("a") +
+        DBUSLOG_PACKET_HEADER_SIZE + DBUSLOG_MESSAGE_PREFIX_SIZE +
+        strlen("Message 0") + 3));
+    reader = dbus_log_capture_reader_new(path);
+    g_assert(reader);
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 0);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_free(reader);
+
+    /* Not a capture file at all */
+    g_assert(!truncate(path, 3));
+    g_assert(!dbus_log_capture_reader_new(path));
+
+    unlink(path);
+    g_free(path);
+}
+
+/*==========================================================================*
+ * Corrupt
+ *==========================================================================*/
+
+static
+void
+test_corrupt(
+    void)
+{
+    static const guchar huge[] = { 0xff, 0xff, 0xff, 0xff };
+    char* path = test_capture_file(10);
+    DBusLogCaptureReader* reader;
+    int fd;
+
+    /* The second message claims to be way longer than its block */
+    fd = open(path, O_WRONLY);
+    g_assert(fd >= 0);
+    g_assert(pwrite(fd, huge, sizeof(huge), 16 +
+        DBUSLOG_PACKET_HEADER_SIZE + 8 + strlen("a") +
+        DBUSLOG_PACKET_HEADER_SIZE + DBUSLOG_MESSAGE_PREFIX_SIZE +
+        strlen("Message 0") + DBUSLOG_PACKET_SIZE_OFFSET) ==
+        sizeof(huge));
+    close(fd);
+
+    reader = dbus_log_capture_reader_new(path);
+    g_assert(reader);
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 0);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_free(reader);
+
+    unlink(path);
+    g_free(path);
+}
+
+/*==========================================================================*
+ * Text
+ *==========================================================================*/
+
+static
+void
+test_text_check(
+    const char* path)
+{
+    static const char* substrings[] = { "Message 1234", "Message 4321", NULL };
+    DBusLogCaptureReader* reader = dbus_log_capture_reader_new(path);
+    GError* error = NULL;
+    guint i;
+
+    g_assert(reader);
+
+    /* Substrings */
+    g_assert(dbus_log_capture_reader_set_content_filter(reader,
+        (const GStrV*)substrings, NULL, NULL));
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 1234);
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 4321);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+
+    /* Regular expression, combined with the category */
+    g_assert(dbus_log_capture_reader_set_content_filter(reader, NULL,
+        "^Message 49[0-9]9$", NULL));
+    for (i = 4909; i < 5000; i += 10) {
+        test_capture_check(dbus_log_capture_reader_next(reader, NULL), i);
+    }
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_set_category(reader, TEST_CATEGORY_A);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_set_category(reader, 0);
+
+    /* Nothing like that, short ones don't narrow anything down */
+    g_assert(dbus_log_capture_reader_set_content_filter(reader, NULL,
+        "Massage", NULL));
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    g_assert(dbus_log_capture_reader_set_content_filter(reader, NULL,
+        "e 7$", NULL));
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 7);
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+
+    /* Invalid regex leaves the filter alone */
+    g_assert(!dbus_log_capture_reader_set_content_filter(reader, NULL,
+        "(", &error));
+    g_assert(error);
+    g_error_free(error);
+    dbus_log_capture_reader_seek_time(reader, 0);
+    test_capture_check(dbus_log_capture_reader_next(reader, NULL), 7);
+
+    /* Remove the filter */
+    g_assert(dbus_log_capture_reader_set_content_filter(reader, NULL, NULL,
+        NULL));
+    for (i = 0; i < 5000; i++) {
+        test_capture_check(dbus_log_capture_reader_next(reader, NULL), i);
+    }
+    g_assert(!dbus_log_capture_reader_next(reader, NULL));
+    dbus_log_capture_reader_free(reader);
+}
+
+static
+void
+test_text(
+    void)
+{
+    /* Same results with and without the index */
+    char* path = test_capture_file_full(2500, TRUE);
+    char* path2 = test_capture_file(2500);
+    DBusLogCaptureWriter* writer;
+
+    test_text_check(path);
+    test_text_check(path2);
+
+    /* Too late to start indexing */
+    writer = dbus_log_capture_writer_new(path2);
+    test_capture_write(writer, NULL, 0, 0);
+    g_assert(!dbus_log_capture_writer_index_text(writer));
+    dbus_log_capture_writer_close(writer);
+
+    unlink(path);
+    unlink(path2);
+    g_free(path);
+    g_free(path2);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/capture/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("null"), test_null);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("seek"), test_seek);
+    g_test_add_func(TEST_("category"), test_category);
+    g_test_add_func(TEST_("no_index"), test_no_index);
+    g_test_add_func(TEST_("corrupt"), test_corrupt);
+    g_test_add_func(TEST_("text"), test_text);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_format.h"
+
+#include <gutil_log.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+static
+char*
+test_format_roundtrip(
+    DBusLogFormat* fmt,
+    ...)
+{
+    va_list va;
+    gsize size = 0;
+    gsize length = 0;
+    void* data;
+    char* text;
+
+    va_start(va, fmt);
+    data = dbus_log_format_pack(fmt, va, &size);
+    va_end(va);
+    text = dbus_log_format_unpack(fmt, data, size, &length);
+    g_assert(text);
+    g_assert_cmpuint(strlen(text), == ,length);
+    g_free(data);
+    return text;
+}
+
+static
+void*
+test_format_pack(
+    DBusLogFormat* fmt,
+    gsize* size,
+    ...)
+{
+    va_list va;
+    void* data;
+
+    va_start(va, size);
+    data = dbus_log_format_pack(fmt, va, size);
+    va_end(va);
+    return data;
+}
+
+#define test_format_check(expected,format,args...) do { \
+    DBusLogFormat* fmt = dbus_log_format_new(format, 1); \
+    char* text; \
+    g_assert(fmt->can_pack); \
+    text = test_format_roundtrip(fmt, ##args); \
+    g_assert_cmpstr(text, == ,expected); \
+    g_free(text); \
+    dbus_log_format_unref(fmt); \
+} while (0)
+
+/*==========================================================================*
+ * basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    DBusLogFormat* fmt = dbus_log_format_new(NULL, 1);
+    gsize size = 1;
+
+    g_assert(fmt->can_pack);
+    g_assert_cmpstr(fmt->format, == ,"");
+    g_assert_cmpuint(fmt->id, == ,1);
+    g_assert(dbus_log_format_ref(fmt) == fmt);
+    dbus_log_format_unref(fmt);
+    dbus_log_format_free(fmt);
+
+    /* NULL resistance */
+    g_assert(!dbus_log_format_ref(NULL));
+    dbus_log_format_unref(NULL);
+    g_assert(!dbus_log_format_unpack(NULL, NULL, 0, NULL));
+    g_assert(!dbus_log_format_unpack_append(NULL, NULL, 0, NULL));
+
+    /* No arguments - no data */
+    test_format_check("", "");
+    test_format_check("text", "text");
+    test_format_check("100%", "100%%");
+    fmt = dbus_log_format_new("text", 2);
+    g_assert(!test_format_pack(fmt, &size));
+    g_assert_cmpuint(size, == ,0);
+    dbus_log_format_unref(fmt);
+}
+
+/*==========================================================================*
+ * int
+ *==========================================================================*/
+
+static
+void
+test_int(
+    void)
+{
+    test_format_check("-5 7 4000000000 ff FF 10", "%d %i %u %x %X %o",
+        -5, 7, 4000000000u, 255, 255, 8);
+    test_format_check("44 4464", "%hhd %hd", 300, 70000);
+    test_format_check("-1234567890123 18446744073709551615",
+        "%lld %llu", -1234567890123LL, 18446744073709551615ULL);
+    test_format_check("-1 4294967295", "%ld %lu", -1L, 0xffffffffUL);
+    test_format_check("42 -42 -1 -3", "%zu %zd %jd %td",
+        (size_t)42, (gssize)-42, (intmax_t)-1, (ptrdiff_t)-3);
+    test_format_check("[   42] [42   ] [00042] [+42]", "[%5d] [%-5d] "
+        "[%05d] [%+d]", 42, 42, 42, 42);
+    test_format_check("[    42] [  0042]", "[%*d] [%*.*d]", 6, 42, 6, 4, 42);
+    test_format_check("ok", "%c%c", 'o', 'k');
+}
+
+/*==========================================================================*
+ * double
+ *==========================================================================*/
+
+static
+void
+test_double(
+    void)
+{
+    test_format_check(" 3.14|1.000000e+10|0.5|2.500000",
+        "%5.2f|%-8e|%g|%lf", 3.14159, 1e10, 0.5, 2.5);
+    test_format_check("     2.000", "%*.*f", 10, 3, 2.0);
+}
+
+/*==========================================================================*
+ * string
+ *==========================================================================*/
+
+static
+void
+test_string(
+    void)
+{
+    static const char not_terminated[] = { 'a', 'b', 'c' };
+
+    test_format_check("[abc] [    r] [l    ]", "[%s] [%5s] [%-5s]",
+        "abc", "r", "l");
+    test_format_check("(null)", "%s", (char*)NULL);
+
+    /* Precision limits the amount of data being read */
+    test_format_check("tru", "%.3s", "truncate");
+    test_format_check("ab", "%.*s", 2, not_terminated);
+}
+
+/*==========================================================================*
+ * pointer
+ *==========================================================================*/
+
+static
+void
+test_pointer(
+    void)
+{
+    char* expected = g_strdup_printf("%p", &test_pointer);
+
+    test_format_check(expected, "%p", &test_pointer);
+    g_free(expected);
+}
+
+/*==========================================================================*
+ * unsupported
+ *==========================================================================*/
+
+static
+void
+test_unsupported(
+    void)
+{
+    static const char* formats[] = {
+        "%n", "%m", "%Lf", "%ls", "%lc", "%1$d", "%*1$d", "%.*1$d",
+        "%S", "%C", "%q", "%"
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(formats); i++) {
+        DBusLogFormat* fmt = dbus_log_format_new(formats[i], i + 1);
+        gsize size = 1;
+
+        g_assert(!fmt->can_pack);
+        g_assert(!test_format_pack(fmt, &size));
+        g_assert_cmpuint(size, == ,0);
+        g_assert(!dbus_log_format_unpack(fmt, NULL, 0, NULL));
+        dbus_log_format_unref(fmt);
+    }
+}
+
+/*==========================================================================*
+ * malformed
+ *==========================================================================*/
+
+static
+void
+test_malformed(
+    void)
+{
+    static const guchar data[] = {
+        0x01, 0x00, 0x00, 0x00,
+        0x05, 0x00, 0x00, 0x00, 'a', 'b'
+    };
+    DBusLogFormat* fmt = dbus_log_format_new("%d %s", 1);
+    DBusLogFormat* fmt2 = dbus_log_format_new("%lld%f%p", 2);
+    DBusLogFormat* fmt3 = dbus_log_format_new("%d", 3);
+    GString* buf = g_string_new("x");
+    char* text;
+
+    /* String is too short */
+    g_assert(!dbus_log_format_unpack(fmt, data, sizeof(data), NULL));
+    g_assert(!dbus_log_format_unpack(fmt, data, 6, NULL));
+    g_assert(!dbus_log_format_unpack(fmt, data, 2, NULL));
+    g_assert(!dbus_log_format_unpack(fmt2, data, 4, NULL));
+    g_assert(!dbus_log_format_unpack(fmt2, data, 8, NULL));
+
+    /* Nothing is appended on failure */
+    g_assert(!dbus_log_format_unpack_append(fmt, data, sizeof(data), buf));
+    g_assert_cmpstr(buf->str, == ,"x");
+
+    /* Extra data is ignored */
+    text = dbus_log_format_unpack(fmt3, data, sizeof(data), NULL);
+    g_assert_cmpstr(text, == ,"1");
+    g_free(text);
+    g_assert(dbus_log_format_unpack_append(fmt3, data, sizeof(data), buf));
+    g_assert_cmpstr(buf->str, == ,"x1");
+    g_string_free(buf, TRUE);
+
+    dbus_log_format_unref(fmt);
+    dbus_log_format_unref(fmt2);
+    dbus_log_format_unref(fmt3);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/format/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("int"), test_int);
+    g_test_add_func(TEST_("double"), test_double);
+    g_test_add_func(TEST_("string"), test_string);
+    g_test_add_func(TEST_("pointer"), test_pointer);
+    g_test_add_func(TEST_("unsupported"), test_unsupported);
+    g_test_add_func(TEST_("malformed"), test_malformed);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -32,6 +32,7 @@
 
 #include "dbuslog_core.h"
 #include "dbuslog_receiver.h"
+#include "dbuslog_reader.h"
 #include "dbuslog_protocol.h"
 #include "gutil_log.h"
 
@@ -72,6 +73,57 @@ test_sendv(
     va_end(va);
 }
 
+static
+DBusLogMessage*
+test_message_new(
+    const char* format,
+    ...) G_GNUC_PRINTF(1,2);
+
+static
+DBusLogMessage*
+test_message_new(
+    const char* format,
+    ...)
+{
+    DBusLogMessage* msg;
+    va_list va;
+    va_start(va, format);
+    msg = dbus_log_message_new_va(format, va);
+    va_end(va);
+    return msg;
+}
+
+static
+void
+test_message_sizes(
+    void)
+{
+    /* Cover the stack buffer, the pooled and the large allocations */
+    static const gsize sizes[] = { 0, 10, 255, 256, 1000, 2048, 5000 };
+    guint i, k;
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        char* str = g_strnfill(sizes[i], 'x');
+        for (k = 0; k < 2; k++) {
+            DBusLogMessage* m1 = dbus_log_message_new(str);
+            DBusLogMessage* m2 = dbus_log_message_new_len(NULL, sizes[i]);
+            DBusLogMessage* m3 = test_message_new("%s", str);
+
+            memset(m2->string, 'x', sizes[i]);
+            g_assert(m1->length == sizes[i]);
+            g_assert(m2->length == sizes[i]);
+            g_assert(m3->length == sizes[i]);
+            g_assert(!strcmp(m1->string, str));
+            g_assert(!strcmp(m2->string, str));
+            g_assert(!strcmp(m3->string, str));
+            dbus_log_message_unref(m1);
+            dbus_log_message_unref(m2);
+            dbus_log_message_unref(m3);
+        }
+        g_free(str);
+    }
+}
+
 #define test_send(core,level,category,message) \
     dbus_log_core_log(core, level, category, message)
 
@@ -258,6 +310,7 @@ test_basic(GMainLoop* loop)
     dbus_log_core_remove_handler(core, 0);
     dbus_log_message_ref(NULL);
     dbus_log_message_unref(NULL);
+    test_message_sizes();
     dbus_log_sender_ref(NULL);
     dbus_log_sender_unref(NULL);
     dbus_log_sender_ping(NULL);
@@ -469,6 +522,11 @@ test_cat(GMainLoop* loop)
     dbus_log_core_set_category_enabled(core, "Disabled", FALSE);
     dbus_log_core_set_category_enabled(core, "Non-existent", TRUE);
 
+    /* Effective levels */
+    g_assert_cmpint(test.enabled->max_level, == ,DBUSLOG_LEVEL_INFO);
+    g_assert_cmpint(test.verbose->max_level, == ,DBUSLOG_LEVEL_VERBOSE);
+    g_assert_cmpint(disabled->max_level, == ,DBUSLOG_LEVEL_UNDEFINED);
+
     id[0] = dbus_log_receiver_add_message_handler(test.receiver,
         test_cat_message_received, &test);
     id[1] = dbus_log_receiver_add_closed_handler(test.receiver,
@@ -478,6 +536,12 @@ test_cat(GMainLoop* loop)
     test_send(core, DBUSLOG_LEVEL_INFO, "Enabled", "Test message (enabled)");
     test_send(core, DBUSLOG_LEVEL_VERBOSE, "Verbose", "Test message (verbose)");
     test_sendv(core, DBUSLOG_LEVEL_INFO, "Disabled", "Test message (disabled)");
+    g_assert(!dbus_log_core_log_cat(core, DBUSLOG_LEVEL_INFO, disabled,
+        "Test message (disabled)"));
+    g_assert(!dbus_log_core_log_cat(core, DBUSLOG_LEVEL_VERBOSE, test.enabled,
+        "Dropped message"));
+    g_assert(dbus_log_core_log_cat(core, DBUSLOG_LEVEL_INFO, test.enabled,
+        "Test message (enabled)"));
     test_sendv(core, DBUSLOG_LEVEL_INFO, "Non-existent", "Test message (stop)");
     test_send(core, DBUSLOG_LEVEL_INFO, "Non-existent", "Missed message");
     test_send(core, DBUSLOG_LEVEL_VERBOSE, "Enabled", "Dropped message");
@@ -486,7 +550,7 @@ test_cat(GMainLoop* loop)
 
     g_main_loop_run(loop);
 
-    g_assert_cmpint(test.msg_count, == ,3);
+    g_assert_cmpint(test.msg_count, == ,4);
     cat = dbus_log_core_new_category(core, "Enabled", DBUSLOG_LEVEL_UNDEFINED,
         DBUSLOG_CATEGORY_FLAG_ENABLED);
 
@@ -504,6 +568,7 @@ test_cat(GMainLoop* loop)
     g_assert(dbus_log_core_find_categories(core, disabled->name)->len == 1);
     g_assert(dbus_log_core_remove_category(core, test.enabled->name));
     g_assert(!dbus_log_core_remove_category(core, "Non-existent"));
+    g_assert(!(test.enabled->flags & DBUSLOG_CATEGORY_FLAG_ENABLED));
 
     /* Setting category log level */
     g_assert(!dbus_log_core_set_category_level(core, "Non-existent",
@@ -765,22 +830,2095 @@ test_skip(GMainLoop* loop)
 }
 
 /*==========================================================================*
- * Common
+ * Threads
  *==========================================================================*/
 
-static const TestDesc all_tests[] = {
-    {
-        "Basic",
-        test_basic
-    },{
-        "Categories",
-        test_cat
-    },{
-        "Queue",
-        test_queue
-    },{
-        "Skip",
-        test_skip
+#define TEST_THREADS_COUNT (4)
+#define TEST_THREADS_MESSAGES (100)
+
+typedef struct _test_threads {
+    GMainLoop* loop;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    int received;
+    int received_ok;
+    int skipped;
+    int ret;
+} TestThreads;
+
+static
+gpointer
+test_threads_proc(
+    gpointer user_data)
+{
+    TestThreads* test = user_data;
+    int i;
+    for (i=0; i<TEST_THREADS_MESSAGES; i++) {
+        test_sendv(test->core, DBUSLOG_LEVEL_INFO, NULL, "%p %d",
+            g_thread_self(), i);
+    }
+    return NULL;
+}
+
+static
+void
+test_threads_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestThreads* test = user_data;
+    if (msg->index == (guint32)test->received) {
+        test->received_ok++;
+    } else {
+        GERR("Unexpected index %u", msg->index);
+    }
+    test->received++;
+    if (test->received == TEST_THREADS_COUNT * TEST_THREADS_MESSAGES) {
+        dbus_log_sender_close(test->sender, TRUE);
+    }
+}
+
+static
+void
+test_threads_message_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestThreads* test = user_data;
+    GERR("%u message(s) skipped", count);
+    test->skipped += count;
+}
+
+static
+void
+test_threads_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestThreads* test = user_data;
+    GDEBUG("Closed");
+    if (!test->skipped && test->received == test->received_ok &&
+        test->received == TEST_THREADS_COUNT * TEST_THREADS_MESSAGES) {
+        test->ret = RET_OK;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_threads(GMainLoop* loop)
+{
+    TestThreads test;
+    DBusLogReceiver* receiver;
+    GThread* threads[TEST_THREADS_COUNT];
+    gulong id[3];
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_ERR;
+    test.loop = loop;
+    test.core = dbus_log_core_new(-1);
+    test.sender = dbus_log_core_new_sender(test.core, "Test");
+    receiver = dbus_log_receiver_new(dup(test.sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_threads_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_threads_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_threads_receiver_closed, &test);
+
+    for (i=0; i<G_N_ELEMENTS(threads); i++) {
+        threads[i] = g_thread_new("test", test_threads_proc, &test);
+    }
+
+    g_main_loop_run(loop);
+
+    for (i=0; i<G_N_ELEMENTS(threads); i++) {
+        g_thread_join(threads[i]);
+    }
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(test.sender);
+    dbus_log_core_unref(test.core);
+
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Format
+ *==========================================================================*/
+
+typedef struct _test_format {
+    GMainLoop* loop;
+    DBusLogSender* sender[2];
+    int received[2];
+    int received_ok[2];
+    int closed;
+} TestFormat;
+
+static const char* test_format_msg [] = {
+    "answer=42",
+    "3.14% (null)",
+    "answer=-1",
+    "positional"
+};
+
+static
+void
+test_format_check(
+    TestFormat* test,
+    int i,
+    DBusLogMessage* msg)
+{
+    GDEBUG("[%d] %s", i, msg->string);
+    if (test->received[i] < G_N_ELEMENTS(test_format_msg)) {
+        if (!g_strcmp0(msg->string, test_format_msg[test->received[i]]) &&
+            msg->length == strlen(msg->string)) {
+            test->received_ok[i]++;
+        } else {
+            GERR("Expected \"%s\", got \"%s\"",
+                test_format_msg[test->received[i]], msg->string);
+        }
+    }
+    test->received[i]++;
+    if (test->received[i] == G_N_ELEMENTS(test_format_msg)) {
+        dbus_log_sender_close(test->sender[i], TRUE);
+    }
+}
+
+static
+void
+test_format_message_received0(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    test_format_check(user_data, 0, msg);
+}
+
+static
+void
+test_format_message_received1(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    test_format_check(user_data, 1, msg);
+}
+
+static
+void
+test_format_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestFormat* test = user_data;
+    GDEBUG("Closed");
+    if (++test->closed == G_N_ELEMENTS(test->sender)) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_format_send(
+    DBusLogCore* core,
+    DBusLogFormat* format,
+    ...)
+{
+    va_list va;
+    va_start(va, format);
+    dbus_log_core_logv_format(core, DBUSLOG_LEVEL_INFO, NULL, format, va);
+    va_end(va);
+}
+
+static
+int
+test_format(GMainLoop* loop)
+{
+    TestFormat test;
+    DBusLogCore* core;
+    DBusLogFormat* fmt1;
+    DBusLogFormat* fmt2;
+    DBusLogFormat* fmt3;
+    DBusLogReceiver* receiver[2];
+    gulong id[2][2];
+    guint i;
+    int ret = RET_ERR;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = loop;
+    core = dbus_log_core_new(0);
+
+    /* The first one gets binary messages, the second one gets text */
+    for (i=0; i<G_N_ELEMENTS(receiver); i++) {
+        test.sender[i] = dbus_log_core_new_sender(core, "Test");
+        receiver[i] = dbus_log_receiver_new(dup(test.sender[i]->readfd),
+            TRUE);
+        id[i][0] = dbus_log_receiver_add_message_handler(receiver[i], i ?
+            test_format_message_received1 : test_format_message_received0,
+            &test);
+        id[i][1] = dbus_log_receiver_add_closed_handler(receiver[i],
+            test_format_receiver_closed, &test);
+    }
+    dbus_log_sender_set_flags(test.sender[0], DBUSLOG_OPEN_FLAG_BINARY);
+
+    fmt1 = dbus_log_core_new_format(core, "%s=%d");
+    fmt2 = dbus_log_core_new_format(core, "%.2f%% %s");
+    fmt3 = dbus_log_core_new_format(core, "%1$s");
+    g_assert(fmt1->can_pack);
+    g_assert(fmt2->can_pack);
+    g_assert(!fmt3->can_pack);
+    g_assert(fmt1->id != fmt2->id);
+
+    /* Same string - same format */
+    g_assert(dbus_log_core_new_format(core, "%s=%d") == fmt1);
+    dbus_log_format_unref(fmt1);
+    g_assert(!dbus_log_core_new_format(core, NULL));
+    g_assert(!dbus_log_core_new_format(NULL, "%s"));
+
+    test_format_send(core, fmt1, "answer", 42);
+    test_format_send(core, fmt2, 3.14159, NULL);
+    test_format_send(core, fmt1, "answer", -1);
+    test_format_send(core, fmt3, "positional");
+
+    g_main_loop_run(loop);
+
+    if (test.received_ok[0] == G_N_ELEMENTS(test_format_msg) &&
+        test.received_ok[1] == G_N_ELEMENTS(test_format_msg)) {
+        ret = RET_OK;
+    }
+
+    for (i=0; i<G_N_ELEMENTS(receiver); i++) {
+        dbus_log_receiver_remove_handlers(receiver[i], id[i],
+            G_N_ELEMENTS(id[i]));
+        dbus_log_receiver_unref(receiver[i]);
+        dbus_log_sender_unref(test.sender[i]);
+    }
+    dbus_log_format_unref(fmt1);
+    dbus_log_format_unref(fmt2);
+    dbus_log_format_unref(fmt3);
+    dbus_log_core_unref(core);
+    return ret;
+}
+
+/*==========================================================================*
+ * History
+ *==========================================================================*/
+
+typedef struct _test_history {
+    GMainLoop* loop;
+    GString* received[2];
+    int closed;
+} TestHistory;
+
+static
+void
+test_history_message_received(
+    TestHistory* test,
+    int i,
+    DBusLogMessage* msg)
+{
+    GDEBUG("[%d] %s", i, msg->string);
+    g_string_append(test->received[i], msg->string);
+}
+
+static
+void
+test_history_message_received0(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    test_history_message_received(user_data, 0, msg);
+}
+
+static
+void
+test_history_message_received1(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    test_history_message_received(user_data, 1, msg);
+}
+
+static
+void
+test_history_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestHistory* test = user_data;
+    GDEBUG("Closed");
+    if (++test->closed == G_N_ELEMENTS(test->received)) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+int
+test_history(GMainLoop* loop)
+{
+    TestHistory test;
+    DBusLogCore* core;
+    DBusLogSender* sender[2];
+    DBusLogReceiver* receiver[2];
+    gulong id[2][2];
+    guint i;
+    int ret = RET_ERR;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = loop;
+    core = dbus_log_core_new(3);
+
+    /* The second sender only gets what's been logged after it's created */
+    for (i=0; i<G_N_ELEMENTS(sender); i++) {
+        sender[i] = dbus_log_core_new_sender(core, "Test");
+        receiver[i] = dbus_log_receiver_new(dup(sender[i]->readfd), TRUE);
+        test.received[i] = g_string_new(NULL);
+        id[i][0] = dbus_log_receiver_add_message_handler(receiver[i], i ?
+            test_history_message_received1 : test_history_message_received0,
+            &test);
+        id[i][1] = dbus_log_receiver_add_closed_handler(receiver[i],
+            test_history_receiver_closed, &test);
+        test_send(core, DBUSLOG_LEVEL_INFO, NULL, i ? "c" : "a");
+        test_send(core, DBUSLOG_LEVEL_INFO, NULL, i ? "d" : "b");
+    }
+
+    /* Shrinking the backlog doesn't affect what's already been sent */
+    dbus_log_core_set_backlog(core, 1);
+    g_assert_cmpint(dbus_log_core_backlog(core), == ,1);
+    for (i=0; i<G_N_ELEMENTS(sender); i++) {
+        dbus_log_sender_close(sender[i], TRUE);
+    }
+
+    /* Logged after the senders were closed, won't be sent */
+    test_send(core, DBUSLOG_LEVEL_INFO, NULL, "e");
+
+    g_main_loop_run(loop);
+
+    if (!strcmp(test.received[0]->str, "abcd") &&
+        !strcmp(test.received[1]->str, "cd")) {
+        ret = RET_OK;
+    }
+
+    for (i=0; i<G_N_ELEMENTS(receiver); i++) {
+        dbus_log_receiver_remove_handlers(receiver[i], id[i],
+            G_N_ELEMENTS(id[i]));
+        dbus_log_receiver_unref(receiver[i]);
+        dbus_log_sender_unref(sender[i]);
+        g_string_free(test.received[i], TRUE);
+    }
+    dbus_log_core_unref(core);
+    return ret;
+}
+
+/*==========================================================================*
+ * Replay
+ *==========================================================================*/
+
+static
+int
+test_replay(GMainLoop* loop)
+{
+    TestHistory test;
+    DBusLogCore* core;
+    DBusLogSender* sender[2];
+    DBusLogReceiver* receiver[2];
+    gulong id[2][2];
+    guint i;
+    int ret = RET_ERR;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = loop;
+    core = dbus_log_core_new(3);
+
+    /* Nothing gets logged without senders by default */
+    g_assert(!test_send(core, DBUSLOG_LEVEL_INFO, NULL, "-"));
+    dbus_log_core_set_keep_history(NULL, TRUE);
+    dbus_log_core_set_keep_history(core, TRUE);
+    dbus_log_core_set_keep_history(core, TRUE);
+    g_assert(test_send(core, DBUSLOG_LEVEL_INFO, NULL, "a"));
+    g_assert(test_send(core, DBUSLOG_LEVEL_INFO, NULL, "b"));
+    g_assert(test_send(core, DBUSLOG_LEVEL_INFO, NULL, "c"));
+    g_assert(test_send(core, DBUSLOG_LEVEL_INFO, NULL, "d"));
+
+    /* The first one asks for 2 last messages, the second one for
+     * everything since index 0 (which has already been dropped) */
+    for (i=0; i<G_N_ELEMENTS(sender); i++) {
+        sender[i] = dbus_log_core_new_sender(core, "Test");
+        receiver[i] = dbus_log_receiver_new(dup(sender[i]->readfd), TRUE);
+        test.received[i] = g_string_new(NULL);
+        id[i][0] = dbus_log_receiver_add_message_handler(receiver[i], i ?
+            test_history_message_received1 : test_history_message_received0,
+            &test);
+        id[i][1] = dbus_log_receiver_add_closed_handler(receiver[i],
+            test_history_receiver_closed, &test);
+    }
+    dbus_log_core_replay(NULL, sender[0], 0, 0);
+    dbus_log_core_replay(core, NULL, 0, 0);
+    dbus_log_core_replay(core, sender[0], 0, 2);
+    dbus_log_core_replay(core, sender[1], DBUSLOG_OPEN_FLAG_HISTORY_SINCE, 0);
+    g_assert(test_send(core, DBUSLOG_LEVEL_INFO, NULL, "e"));
+    for (i=0; i<G_N_ELEMENTS(sender); i++) {
+        dbus_log_sender_close(sender[i], TRUE);
+    }
+
+    g_main_loop_run(loop);
+
+    if (!strcmp(test.received[0]->str, "cde") &&
+        !strcmp(test.received[1]->str, "bcde")) {
+        ret = RET_OK;
+    }
+
+    for (i=0; i<G_N_ELEMENTS(receiver); i++) {
+        dbus_log_receiver_remove_handlers(receiver[i], id[i],
+            G_N_ELEMENTS(id[i]));
+        dbus_log_receiver_unref(receiver[i]);
+        dbus_log_sender_unref(sender[i]);
+        g_string_free(test.received[i], TRUE);
+    }
+    dbus_log_core_unref(core);
+    return ret;
+}
+
+/*==========================================================================*
+ * Batch
+ *==========================================================================*/
+
+#define TEST_BATCH_COUNT (500)
+#define TEST_BATCH_MAX_LEN (3000)
+#define TEST_BATCH_HUGE_LEN (100000) /* Larger than the smallest ring */
+
+typedef struct _test_batch {
+    GMainLoop* loop;
+    int received;
+    int ret;
+} TestBatch;
+
+static
+gsize
+test_batch_len(
+    int i)
+{
+    return ((i % 100) == 99) ? TEST_BATCH_HUGE_LEN :
+        ((i * 37) % TEST_BATCH_MAX_LEN);
+}
+
+static
+void
+test_batch_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestBatch* test = user_data;
+    const gsize len = test_batch_len(test->received);
+    const char c = 'a' + (test->received % 26);
+    gsize i;
+
+    if (msg->length != len || msg->level != DBUSLOG_LEVEL_INFO) {
+        GERR("Unexpected message %d", test->received);
+        test->ret = RET_ERR;
+    } else {
+        for (i=0; i<len && msg->string[i] == c; i++);
+        if (i < len) {
+            GERR("Message %d is corrupted", test->received);
+            test->ret = RET_ERR;
+        }
+    }
+    test->received++;
+}
+
+static
+void
+test_batch_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestBatch* test = user_data;
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT && test->received == TEST_BATCH_COUNT) {
+        test->ret = RET_OK;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_batch_run(
+    GMainLoop* loop,
+    guint flags,
+    gboolean shm)
+{
+    TestBatch test;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    char* buf = g_malloc(TEST_BATCH_HUGE_LEN + 1);
+    gulong id[2];
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(-1);
+    if (shm) {
+        /* Zero gets rounded up to the minimum size */
+        sender = dbus_log_core_new_shm_sender(core, "Test", 0);
+        receiver = dbus_log_receiver_new_shm(dup(sender->shmfd),
+            dup(sender->datafd), dup(sender->spacefd));
+    } else {
+        sender = dbus_log_core_new_sender(core, "Test");
+        receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    }
+    dbus_log_sender_set_flags(sender, flags);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_batch_message_received, &test);
+    id[1] = dbus_log_receiver_add_closed_handler(receiver,
+        test_batch_receiver_closed, &test);
+
+    /* Way more than fits into the pipe, of all sizes */
+    for (i=0; i<TEST_BATCH_COUNT; i++) {
+        const gsize len = test_batch_len(i);
+
+        memset(buf, 'a' + (i % 26), len);
+        buf[len] = 0;
+        test_send(core, DBUSLOG_LEVEL_INFO, NULL, buf);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_core_unref(core);
+    g_free(buf);
+    return test.ret;
+}
+
+static
+int
+test_batch(GMainLoop* loop)
+{
+    return test_batch_run(loop, 0, FALSE);
+}
+
+static
+int
+test_message_batch(GMainLoop* loop)
+{
+    /* Short messages get packed together, long ones don't */
+    return test_batch_run(loop, DBUSLOG_OPEN_FLAG_BATCH, FALSE);
+}
+
+static
+int
+test_shm(GMainLoop* loop)
+{
+    return test_batch_run(loop, DBUSLOG_OPEN_FLAG_BATCH, TRUE);
+}
+
+/*==========================================================================*
+ * Pause
+ *==========================================================================*/
+
+#define TEST_PAUSE_COUNT (10)
+
+typedef struct _test_pause {
+    GMainLoop* loop;
+    int received;
+    int ret;
+} TestPause;
+
+static
+gboolean
+test_pause_resume(
+    gpointer receiver)
+{
+    dbus_log_receiver_resume(receiver);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+test_pause_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestPause* test = user_data;
+    char* expected = g_strdup_printf("%d", test->received++);
+
+    if (strcmp(msg->string, expected)) {
+        GERR("Unexpected message \"%s\"", msg->string);
+        test->ret = RET_ERR;
+    }
+    g_free(expected);
+
+    /* The rest of the buffered packets has to wait */
+    dbus_log_receiver_pause(receiver);
+    g_idle_add(test_pause_resume, receiver);
+}
+
+static
+void
+test_pause_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestPause* test = user_data;
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT && test->received == TEST_PAUSE_COUNT) {
+        test->ret = RET_OK;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_pause(GMainLoop* loop)
+{
+    TestPause test;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    gulong id[2];
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(0);
+    sender = dbus_log_core_new_sender(core, "Test");
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_pause_message_received, &test);
+    id[1] = dbus_log_receiver_add_closed_handler(receiver,
+        test_pause_receiver_closed, &test);
+
+    /* All of these get read at once */
+    for (i=0; i<TEST_PAUSE_COUNT; i++) {
+        test_sendv(core, DBUSLOG_LEVEL_INFO, NULL, "%d", i);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_core_unref(core);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * PipeSize
+ *==========================================================================*/
+
+#define TEST_PIPE_MAX_SIZE (0x40000)
+
+static
+int
+test_pipe_size(GMainLoop* loop)
+{
+    TestBatch test;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    char* buf = g_malloc(TEST_BATCH_HUGE_LEN + 1);
+    guint initial_size;
+    gulong id[2];
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(-1);
+    sender = dbus_log_core_new_sender(core, "Test");
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_batch_message_received, &test);
+    id[1] = dbus_log_receiver_add_closed_handler(receiver,
+        test_batch_receiver_closed, &test);
+
+    /* Shrink the pipe, it has to grow back */
+    dbus_log_sender_get_stats(sender, &stats);
+    initial_size = stats.pipe_size / 2;
+    if (dbus_log_sender_set_pipe_size(sender, initial_size) < 0) {
+        GERR("Failed to resize the pipe");
+        test.ret = RET_ERR;
+    }
+    dbus_log_sender_set_max_pipe_size(sender, TEST_PIPE_MAX_SIZE);
+
+    for (i=0; i<TEST_BATCH_COUNT; i++) {
+        const gsize len = test_batch_len(i);
+
+        memset(buf, 'a' + (i % 26), len);
+        buf[len] = 0;
+        test_send(core, DBUSLOG_LEVEL_INFO, NULL, buf);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_sender_get_stats(sender, &stats);
+    GDEBUG("Pipe size %u, resized %u time(s)", stats.pipe_size,
+        stats.pipe_resize_count);
+    if (stats.pipe_size <= initial_size ||
+        stats.pipe_size > TEST_PIPE_MAX_SIZE ||
+        stats.pipe_resize_count < 2) {
+        GERR("Pipe didn't grow as expected");
+        test.ret = RET_ERR;
+    }
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_core_unref(core);
+    g_free(buf);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Overflow
+ *==========================================================================*/
+
+/*
+ * The history has to be larger than the queue, otherwise the oldest
+ * messages get pushed out of it regardless of the overflow policy.
+ */
+#define TEST_OVERFLOW_QUEUE_SIZE (4)
+#define TEST_OVERFLOW_HISTORY_SIZE (16)
+#define TEST_OVERFLOW_CAT_INFO (1)
+#define TEST_OVERFLOW_CAT_ERROR (2)
+#define TEST_OVERFLOW_CAT_VERBOSE (3)
+
+typedef struct _test_overflow {
+    GMainLoop* loop;
+    guint32 expected_index;
+    int received;
+    int reports;
+    int ret;
+} TestOverflow;
+
+static
+void
+test_overflow_send(
+    DBusLogSender* sender,
+    guint32 index,
+    DBUSLOG_LEVEL level,
+    guint32 category)
+{
+    char* text = g_strdup_printf("%u", index);
+    DBusLogMessage* msg = dbus_log_message_new(text);
+
+    msg->index = index;
+    msg->level = level;
+    msg->category = category;
+    dbus_log_sender_send(sender, msg);
+    dbus_log_message_unref(msg);
+    g_free(text);
+}
+
+static
+void
+test_overflow_dropped(
+    DBusLogReceiver* receiver,
+    const DBusLogDropReport* report,
+    gpointer user_data)
+{
+    TestOverflow* test = user_data;
+    guint i, info = 0, verbose = 0;
+
+    GDEBUG("%u message(s) dropped", report->count);
+    for (i = 0; i < report->n_categories; i++) {
+        const DBusLogDropCount* dc = report->categories + i;
+
+        if (dc->category == TEST_OVERFLOW_CAT_INFO) {
+            info = dc->count;
+        } else if (dc->category == TEST_OVERFLOW_CAT_VERBOSE) {
+            verbose = dc->count;
+        } else {
+            GERR("Unexpected category %u", dc->category);
+            test->ret = RET_ERR;
+        }
+    }
+    /* Two INFO dropped for ERROR, two VERBOSE and one newest INFO */
+    if (report->count != 5 || report->bytes != 5 ||
+        info != 3 || verbose != 2 || test->received) {
+        GERR("Unexpected drop report");
+        test->ret = RET_ERR;
+    }
+    test->reports++;
+}
+
+static
+void
+test_overflow_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestOverflow* test = user_data;
+
+    GDEBUG("%s", msg->string);
+    if (msg->index != test->expected_index) {
+        GERR("Unexpected message %u", msg->index);
+        test->ret = RET_ERR;
+    }
+    test->expected_index++;
+    test->received++;
+}
+
+static
+void
+test_overflow_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestOverflow* test = user_data;
+
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT) {
+        test->ret = (test->reports == 1 &&
+            test->received == TEST_OVERFLOW_QUEUE_SIZE) ? RET_OK : RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_overflow(GMainLoop* loop)
+{
+    TestOverflow test;
+    DBusLogHistory* history;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    gulong id[3];
+    guint32 i = 0;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    history = dbus_log_history_new(TEST_OVERFLOW_HISTORY_SIZE);
+    sender = dbus_log_sender_new_shared("Test", history);
+    dbus_log_sender_set_queue_size(sender, TEST_OVERFLOW_QUEUE_SIZE);
+    dbus_log_sender_set_flags(sender, DBUSLOG_OPEN_FLAG_DROP_REPORT);
+    dbus_log_sender_set_overflow(sender, DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL);
+    dbus_log_sender_set_max_pipe_size(sender, 0);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_overflow_message_received, &test);
+    id[1] = dbus_log_receiver_add_dropped_handler(receiver,
+        test_overflow_dropped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_overflow_receiver_closed, &test);
+
+    /* Fill the pipe so that everything stays in the queue */
+    while (dbus_log_sender_ping(sender));
+
+    /* 0..3 fill the queue, ERRORs push out 0 and 1 */
+    for (; i < TEST_OVERFLOW_QUEUE_SIZE; i++) {
+        test_overflow_send(sender, i, DBUSLOG_LEVEL_INFO,
+            TEST_OVERFLOW_CAT_INFO);
+    }
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_ERROR,
+        TEST_OVERFLOW_CAT_ERROR);
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_ERROR,
+        TEST_OVERFLOW_CAT_ERROR);
+
+    /* These are less severe than anything in the queue */
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_VERBOSE,
+        TEST_OVERFLOW_CAT_VERBOSE);
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_VERBOSE,
+        TEST_OVERFLOW_CAT_VERBOSE);
+
+    /* And this one doesn't get in regardless of its level */
+    dbus_log_sender_set_overflow(sender, DBUSLOG_OVERFLOW_DROP_NEWEST);
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_INFO,
+        TEST_OVERFLOW_CAT_INFO);
+
+    dbus_log_sender_get_stats(sender, &stats);
+    if (stats.dropped_count != 5 || stats.dropped_bytes != 5) {
+        GERR("Unexpected drop count %u", (guint)stats.dropped_count);
+        test.ret = RET_ERR;
+    }
+
+    test.expected_index = 2;
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_history_unref(history);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Shed
+ *==========================================================================*/
+
+typedef struct _test_shed {
+    GMainLoop* loop;
+    guint32 received[TEST_OVERFLOW_QUEUE_SIZE];
+    int count;
+    int skipped;
+    int ret;
+} TestShed;
+
+static
+void
+test_shed_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestShed* test = user_data;
+
+    GDEBUG("%s", msg->string);
+    if (test->count < TEST_OVERFLOW_QUEUE_SIZE) {
+        test->received[test->count] = msg->index;
+    }
+    test->count++;
+}
+
+static
+void
+test_shed_message_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestShed* test = user_data;
+
+    GDEBUG("%u message(s) skipped", count);
+    test->skipped += count;
+}
+
+static
+void
+test_shed_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestShed* test = user_data;
+    /* The oldest DEBUG ones make room, the order is preserved */
+    static const guint32 expected[TEST_OVERFLOW_QUEUE_SIZE] = {
+        0, 4, 5, 6
+    };
+
+    GDEBUG("Closed");
+    if (test->count == TEST_OVERFLOW_QUEUE_SIZE && test->skipped == 3 &&
+        !memcmp(test->received, expected, sizeof(expected))) {
+        test->ret = RET_OK;
+    } else {
+        test->ret = RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_shed(GMainLoop* loop)
+{
+    TestShed test;
+    DBusLogHistory* history;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    gulong id[3];
+    guint32 i = 0;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    history = dbus_log_history_new(TEST_OVERFLOW_HISTORY_SIZE);
+    sender = dbus_log_sender_new_shared("Test", history);
+    dbus_log_sender_set_queue_size(sender, TEST_OVERFLOW_QUEUE_SIZE);
+    dbus_log_sender_set_overflow(sender, DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL);
+    dbus_log_sender_set_max_pipe_size(sender, 0);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_shed_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_shed_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_shed_receiver_closed, &test);
+
+    /* Fill the pipe so that everything stays in the queue */
+    while (dbus_log_sender_ping(sender));
+
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_ERROR, 0);
+    for (; i < TEST_OVERFLOW_QUEUE_SIZE; i++) {
+        test_overflow_send(sender, i, DBUSLOG_LEVEL_DEBUG, 0);
+    }
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_ERROR, 0);
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_DEBUG, 0);
+    test_overflow_send(sender, i++, DBUSLOG_LEVEL_ERROR, 0);
+
+    dbus_log_sender_get_stats(sender, &stats);
+    if (stats.dropped_count != 3) {
+        GERR("Unexpected drop count %u", (guint)stats.dropped_count);
+        test.ret = RET_ERR;
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_history_unref(history);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Backwards
+ *==========================================================================*/
+
+typedef struct _test_backwards {
+    GMainLoop* loop;
+    int received;
+    int skipped;
+    int ret;
+} TestBackwards;
+
+static
+void
+test_backwards_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestBackwards* test = user_data;
+
+    GDEBUG("%s", msg->string);
+    test->received++;
+}
+
+static
+void
+test_backwards_message_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestBackwards* test = user_data;
+
+    GDEBUG("%u message(s) skipped", count);
+    test->skipped += count;
+}
+
+static
+void
+test_backwards_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestBackwards* test = user_data;
+
+    GDEBUG("Closed");
+    test->ret = (test->received == 6 && test->skipped == 3) ?
+        RET_OK : RET_ERR;
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_backwards(GMainLoop* loop)
+{
+    TestBackwards test;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    gulong id[3];
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    sender = dbus_log_sender_new("Test", -1);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_backwards_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_backwards_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_backwards_receiver_closed, &test);
+
+    /*
+     * 2, 5 and 6 are skipped. When 2 arrives late, it's neither counted
+     * again nor makes 4 look like a skip.
+     */
+    test_overflow_send(sender, 0, DBUSLOG_LEVEL_INFO, 0);
+    test_overflow_send(sender, 1, DBUSLOG_LEVEL_INFO, 0);
+    test_overflow_send(sender, 3, DBUSLOG_LEVEL_INFO, 0);
+    test_overflow_send(sender, 2, DBUSLOG_LEVEL_INFO, 0);
+    test_overflow_send(sender, 4, DBUSLOG_LEVEL_INFO, 0);
+    test_overflow_send(sender, 7, DBUSLOG_LEVEL_INFO, 0);
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Urgent
+ *==========================================================================*/
+
+static
+void
+test_urgent_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestShed* test = user_data;
+    /* ERROR overtakes DEBUG messages queued before it */
+    static const guint32 expected[TEST_OVERFLOW_QUEUE_SIZE] = {
+        3, 0, 1, 2
+    };
+
+    GDEBUG("Closed");
+    if (test->count == TEST_OVERFLOW_QUEUE_SIZE && !test->skipped &&
+        !memcmp(test->received, expected, sizeof(expected))) {
+        test->ret = RET_OK;
+    } else {
+        test->ret = RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_urgent(GMainLoop* loop)
+{
+    TestShed test;
+    DBusLogHistory* history;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    gulong id[3];
+    guint32 i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    history = dbus_log_history_new(TEST_OVERFLOW_HISTORY_SIZE);
+    sender = dbus_log_sender_new_shared("Test", history);
+    dbus_log_sender_set_queue_size(sender, TEST_OVERFLOW_QUEUE_SIZE);
+    dbus_log_sender_set_overflow(sender, DBUSLOG_OVERFLOW_DROP_LOWEST_LEVEL);
+    dbus_log_sender_set_max_pipe_size(sender, 0);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_shed_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_shed_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_urgent_receiver_closed, &test);
+
+    /* Fill the pipe so that everything stays in the queue */
+    while (dbus_log_sender_ping(sender));
+
+    for (i = 0; i < TEST_OVERFLOW_QUEUE_SIZE - 1; i++) {
+        test_overflow_send(sender, i, DBUSLOG_LEVEL_DEBUG, 0);
+    }
+    test_overflow_send(sender, i, DBUSLOG_LEVEL_ERROR, 0);
+
+    dbus_log_sender_get_stats(sender, &stats);
+    if (stats.dropped_count) {
+        GERR("Unexpected drop count %u", (guint)stats.dropped_count);
+        test.ret = RET_ERR;
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_history_unref(history);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Block
+ *==========================================================================*/
+
+#define TEST_BLOCK_COUNT (3 * TEST_OVERFLOW_QUEUE_SIZE)
+
+typedef struct _test_block {
+    GMainLoop* loop;
+    DBusLogSender* sender;
+    int received;
+    int skipped;
+    int ret;
+} TestBlock;
+
+static
+void
+test_block_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestBlock* test = user_data;
+
+    GDEBUG("%s", msg->string);
+    if (++test->received == TEST_BLOCK_COUNT) {
+        dbus_log_sender_close(test->sender, TRUE);
+    }
+}
+
+static
+void
+test_block_message_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestBlock* test = user_data;
+
+    GDEBUG("%u message(s) skipped", count);
+    test->skipped += count;
+}
+
+static
+void
+test_block_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestBlock* test = user_data;
+
+    GDEBUG("Closed");
+    test->ret = (test->received == TEST_BLOCK_COUNT && !test->skipped) ?
+        RET_OK : RET_ERR;
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_block(GMainLoop* loop)
+{
+    TestBlock test;
+    DBusLogCore* core;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    gulong id[3];
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(TEST_OVERFLOW_QUEUE_SIZE);
+    test.sender = dbus_log_core_new_sender(core, "Test");
+    dbus_log_sender_set_overflow(test.sender, DBUSLOG_OVERFLOW_BLOCK);
+    dbus_log_sender_set_max_pipe_size(test.sender, 0);
+    receiver = dbus_log_receiver_new(dup(test.sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_block_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_block_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_block_receiver_closed, &test);
+
+    /* Fill the pipe so that the messages can't be written */
+    while (dbus_log_sender_ping(test.sender));
+
+    /*
+     * Three times more than fits into the queue (and the history). The
+     * main loop isn't running, so nothing is being read yet. Blocking
+     * doesn't stall the caller, the core holds the rest back until the
+     * client makes room and nothing gets dropped.
+     */
+    for (i = 0; i < TEST_BLOCK_COUNT; i++) {
+        test_sendv(core, DBUSLOG_LEVEL_INFO, NULL, "%d", i);
+    }
+    g_assert(dbus_log_sender_blocked(test.sender));
+
+    g_main_loop_run(loop);
+
+    dbus_log_sender_get_stats(test.sender, &stats);
+    if (stats.dropped_count) {
+        GERR("Unexpected drop count %u", (guint)stats.dropped_count);
+        test.ret = RET_ERR;
+    }
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(test.sender);
+    dbus_log_core_unref(core);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Filter
+ *==========================================================================*/
+
+typedef struct _test_filter {
+    GMainLoop* loop;
+    int received;
+    int ret;
+} TestFilter;
+
+static const guint32 test_filter_expected[] = { 0, 2, 5 };
+
+static
+void
+test_filter_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestFilter* test = user_data;
+
+    GDEBUG("%s", msg->string);
+    if (test->received >= G_N_ELEMENTS(test_filter_expected) ||
+        test_filter_expected[test->received] != msg->index) {
+        GERR("Unexpected message %u", msg->index);
+        test->ret = RET_ERR;
+    }
+    test->received++;
+}
+
+static
+void
+test_filter_message_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestFilter* test = user_data;
+
+    GERR("%u message(s) skipped", count);
+    test->ret = RET_ERR;
+}
+
+static
+void
+test_filter_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestFilter* test = user_data;
+
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT) {
+        test->ret = (test->received == G_N_ELEMENTS(test_filter_expected)) ?
+            RET_OK : RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_filter(GMainLoop* loop)
+{
+    static const guint32 cats[] = { 1, 2 };
+    TestFilter test;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    DBusLogSenderStats stats;
+    gulong id[3];
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    sender = dbus_log_sender_new("Test", -1);
+    dbus_log_sender_set_level(sender, DBUSLOG_LEVEL_INFO);
+    dbus_log_sender_set_category_level(sender, 2, DBUSLOG_LEVEL_VERBOSE);
+    dbus_log_sender_set_categories(sender, cats, G_N_ELEMENTS(cats));
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    dbus_log_receiver_set_filtered(receiver, TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_filter_message_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_filter_message_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_filter_receiver_closed, &test);
+
+    test_overflow_send(sender, 0, DBUSLOG_LEVEL_INFO, 1);
+    test_overflow_send(sender, 1, DBUSLOG_LEVEL_DEBUG, 1);  /* Level */
+    test_overflow_send(sender, 2, DBUSLOG_LEVEL_DEBUG, 2);
+    test_overflow_send(sender, 3, DBUSLOG_LEVEL_ERROR, 3);  /* Category */
+    test_overflow_send(sender, 4, DBUSLOG_LEVEL_DEBUG, 0);  /* Level */
+    test_overflow_send(sender, 5, DBUSLOG_LEVEL_ERROR, 0);
+    dbus_log_sender_close(sender, TRUE);
+
+    /* Filtered messages are not dropped ones */
+    dbus_log_sender_get_stats(sender, &stats);
+    if (stats.dropped_count) {
+        GERR("Filtered messages counted as dropped");
+        test.ret = RET_ERR;
+    }
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Grep
+ *==========================================================================*/
+
+/* Messages 0, 2 and 5 match, same indices as in the Filter test */
+static const char* test_grep_msg [] = {
+    "ushers",           /* "she" ends inside "hers" */
+    "his",
+    "conn 42 closed",   /* Regex */
+    "conn 4x closed",
+    "",
+    "xyzhe"             /* At the very end */
+};
+
+static
+int
+test_grep(GMainLoop* loop)
+{
+    static const char* substrings[] = { "he", "she", "hers", NULL };
+    DBusLogMatcher* matcher;
+    TestFilter test;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    GError* error = NULL;
+    char** many;
+    char* long_regex;
+    gulong id[2];
+    guint i;
+
+    /* Invalid regex */
+    matcher = dbus_log_matcher_new(NULL, "(", &error);
+    if (matcher || !error) {
+        GERR("Invalid regex accepted");
+        dbus_log_matcher_free(matcher);
+        return RET_ERR;
+    }
+    g_error_free(error);
+
+    /* Nothing to match */
+    if (dbus_log_matcher_new(NULL, "", NULL)) {
+        GERR("Empty matcher created");
+        return RET_ERR;
+    }
+
+    /* Limits */
+    many = g_new0(char*, DBUSLOG_MATCHER_MAX_SUBSTRINGS + 2);
+    for (i = 0; i <= DBUSLOG_MATCHER_MAX_SUBSTRINGS; i++) {
+        many[i] = g_strdup("x");
+    }
+    long_regex = g_strnfill(DBUSLOG_MATCHER_MAX_REGEX_LENGTH + 1, 'x');
+    matcher = dbus_log_matcher_new((const GStrV*)many, NULL, &error);
+    if (!matcher && error) {
+        g_clear_error(&error);
+        matcher = dbus_log_matcher_new(NULL, long_regex, &error);
+    }
+    g_strfreev(many);
+    g_free(long_regex);
+    if (matcher || !error) {
+        GERR("Limits not enforced");
+        dbus_log_matcher_free(matcher);
+        return RET_ERR;
+    }
+    g_error_free(error);
+    error = NULL;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    sender = dbus_log_sender_new("Test", -1);
+    dbus_log_sender_set_content_filter(sender, dbus_log_matcher_new(
+        (const GStrV*)substrings, "^conn [0-9]+ ", NULL));
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_filter_message_received, &test);
+    id[1] = dbus_log_receiver_add_closed_handler(receiver,
+        test_filter_receiver_closed, &test);
+
+    for (i = 0; i < G_N_ELEMENTS(test_grep_msg); i++) {
+        DBusLogMessage* msg = dbus_log_message_new(test_grep_msg[i]);
+
+        msg->index = i;
+        dbus_log_sender_send(sender, msg);
+        dbus_log_message_unref(msg);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Clock
+ *==========================================================================*/
+
+typedef struct _test_clock {
+    GMainLoop* loop;
+    gint64 since;
+    gint64 until;
+    int received;
+    int ret;
+} TestClock;
+
+static
+void
+test_clock_message_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage* msg,
+    gpointer user_data)
+{
+    TestClock* test = user_data;
+
+    GDEBUG("%s %" G_GINT64_FORMAT, msg->string, msg->timestamp);
+    /* The coarse clock lags behind by up to a tick */
+    if (msg->timestamp < (test->since - G_USEC_PER_SEC) ||
+        msg->timestamp > (test->until + G_USEC_PER_SEC)) {
+        GERR("Unexpected timestamp %" G_GINT64_FORMAT, msg->timestamp);
+        test->ret = RET_ERR;
+    }
+    test->received++;
+}
+
+static
+void
+test_clock_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestClock* test = user_data;
+
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT) {
+        test->ret = (test->received == DBUSLOG_CLOCK_COUNT) ?
+            RET_OK : RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_clock(GMainLoop* loop)
+{
+    TestClock test;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    gulong id[2];
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(DBUSLOG_CLOCK_COUNT);
+    sender = dbus_log_core_new_sender(core, "Test");
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_message_handler(receiver,
+        test_clock_message_received, &test);
+    id[1] = dbus_log_receiver_add_closed_handler(receiver,
+        test_clock_receiver_closed, &test);
+
+    if (dbus_log_core_set_clock(core, DBUSLOG_CLOCK_COUNT)) {
+        GERR("Invalid clock accepted");
+        test.ret = RET_ERR;
+    }
+
+    /* One message per clock */
+    test.since = g_get_real_time();
+    for (i = 0; i < DBUSLOG_CLOCK_COUNT; i++) {
+        dbus_log_core_set_clock(core, i);
+        test_sendv(core, DBUSLOG_LEVEL_INFO, NULL, "%u", i);
+    }
+    test.until = g_get_real_time();
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    dbus_log_core_unref(core);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Messages
+ *==========================================================================*/
+
+typedef struct _test_messages {
+    GMainLoop* loop;
+    int received;
+    int batches;
+    int ret;
+} TestMessages;
+
+static const guint32 test_messages_expected[] = { 0, 1, 2, 4, 5 };
+
+static
+void
+test_messages_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage** msgs,
+    guint count,
+    gpointer user_data)
+{
+    TestMessages* test = user_data;
+    guint i;
+
+    GDEBUG("%u message(s)", count);
+    if (!count) {
+        test->ret = RET_ERR;
+    }
+    for (i = 0; i < count; i++) {
+        if (test->received >= G_N_ELEMENTS(test_messages_expected) ||
+            test_messages_expected[test->received] != msgs[i]->index) {
+            GERR("Unexpected message %u", msgs[i]->index);
+            test->ret = RET_ERR;
+        }
+        test->received++;
+    }
+    test->batches++;
+}
+
+static
+void
+test_messages_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestMessages* test = user_data;
+
+    /* Whatever precedes the gap must have been delivered */
+    GDEBUG("Skipped %u", count);
+    if (count != 1 || test->received != 3) {
+        GERR("Unexpected skip");
+        test->ret = RET_ERR;
+    }
+}
+
+static
+void
+test_messages_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestMessages* test = user_data;
+
+    GDEBUG("Closed after %d batch(es)", test->batches);
+    if (test->ret == RET_TIMEOUT) {
+        test->ret = (test->received == G_N_ELEMENTS(test_messages_expected)) ?
+            RET_OK : RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_messages(GMainLoop* loop)
+{
+    TestMessages test;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    gulong id[3];
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    sender = dbus_log_sender_new("Test", -1);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_messages_handler(receiver,
+        test_messages_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_messages_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_messages_receiver_closed, &test);
+
+    for (i = 0; i < G_N_ELEMENTS(test_messages_expected); i++) {
+        test_overflow_send(sender, test_messages_expected[i],
+            DBUSLOG_LEVEL_INFO, 0);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Thread
+ *==========================================================================*/
+
+typedef struct _test_thread {
+    GMainLoop* loop;
+    GThread* main_thread;
+    int received;
+    int resumed;
+    int ret;
+} TestThread;
+
+static
+gboolean
+test_thread_resume(
+    gpointer receiver)
+{
+    dbus_log_receiver_resume(receiver);
+    dbus_log_receiver_unref(receiver);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+test_thread_received(
+    DBusLogReceiver* receiver,
+    DBusLogMessage** msgs,
+    guint count,
+    gpointer user_data)
+{
+    TestThread* test = user_data;
+    guint i;
+
+    GDEBUG("%u message(s)", count);
+    if (g_thread_self() != test->main_thread) {
+        GERR("Messages delivered on a wrong thread");
+        test->ret = RET_ERR;
+    }
+    for (i = 0; i < count; i++) {
+        if (test->received >= G_N_ELEMENTS(test_messages_expected) ||
+            test_messages_expected[test->received] != msgs[i]->index) {
+            GERR("Unexpected message %u", msgs[i]->index);
+            test->ret = RET_ERR;
+        }
+        test->received++;
+    }
+
+    /* Pausing must hold the rest back */
+    if (!test->resumed++) {
+        dbus_log_receiver_pause(receiver);
+        g_idle_add(test_thread_resume, dbus_log_receiver_ref(receiver));
+    }
+}
+
+static
+void
+test_thread_skipped(
+    DBusLogReceiver* receiver,
+    guint count,
+    gpointer user_data)
+{
+    TestThread* test = user_data;
+
+    GDEBUG("Skipped %u", count);
+    if (g_thread_self() != test->main_thread || count != 1 ||
+        test->received != 3) {
+        GERR("Unexpected skip");
+        test->ret = RET_ERR;
+    }
+}
+
+static
+void
+test_thread_receiver_closed(
+    DBusLogReceiver* receiver,
+    gpointer user_data)
+{
+    TestThread* test = user_data;
+
+    GDEBUG("Closed");
+    if (test->ret == RET_TIMEOUT) {
+        test->ret = (test->received == G_N_ELEMENTS(test_messages_expected)) ?
+            RET_OK : RET_ERR;
+    }
+    g_main_loop_quit(test->loop);
+}
+
+static
+int
+test_thread(GMainLoop* loop)
+{
+    TestThread test;
+    DBusLogSender* sender;
+    DBusLogReceiver* receiver;
+    gulong id[3];
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    test.main_thread = g_thread_self();
+    sender = dbus_log_sender_new("Test", -1);
+    receiver = dbus_log_receiver_new(dup(sender->readfd), TRUE);
+    id[0] = dbus_log_receiver_add_messages_handler(receiver,
+        test_thread_received, &test);
+    id[1] = dbus_log_receiver_add_skip_handler(receiver,
+        test_thread_skipped, &test);
+    id[2] = dbus_log_receiver_add_closed_handler(receiver,
+        test_thread_receiver_closed, &test);
+    if (!dbus_log_receiver_start_thread(receiver) ||
+        dbus_log_receiver_start_thread(receiver)) {
+        test.ret = RET_ERR;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(test_messages_expected); i++) {
+        test_overflow_send(sender, test_messages_expected[i],
+            DBUSLOG_LEVEL_INFO, 0);
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    if (test.ret == RET_TIMEOUT) {
+        g_main_loop_run(loop);
+    }
+
+    dbus_log_receiver_remove_handlers(receiver, id, G_N_ELEMENTS(id));
+    dbus_log_receiver_unref(receiver);
+    dbus_log_sender_unref(sender);
+    return test.ret;
+}
+
+/*==========================================================================*
+ * Reader
+ *==========================================================================*/
+
+#define TEST_READER_MAX_BATCH (7)
+
+typedef struct _test_reader {
+    GMainLoop* loop;
+    DBusLogReader* reader;
+    guint watch_id;
+    int received;
+    int ret;
+} TestReader;
+
+static
+gboolean
+test_reader_check(
+    TestReader* test,
+    const DBusLogReaderMessage* msg)
+{
+    const gsize len = test_batch_len(test->received);
+    const char c = 'a' + (test->received % 26);
+    gsize i;
+
+    if (msg->length != len || msg->level != DBUSLOG_LEVEL_INFO ||
+        msg->index != (guint32)test->received) {
+        GERR("Unexpected message %d", test->received);
+        return FALSE;
+    }
+    for (i=0; i<len && msg->text[i] == c; i++);
+    if (i < len) {
+        GERR("Message %d is corrupted", test->received);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static
+gboolean
+test_reader_readable(
+    GIOChannel* source,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    TestReader* test = user_data;
+    DBusLogReaderMessage msgs[TEST_READER_MAX_BATCH];
+    int i, n;
+
+    /* Drain it */
+    while ((n = dbus_log_reader_next_batch(test->reader, msgs,
+        G_N_ELEMENTS(msgs))) > 0) {
+        for (i = 0; i < n; i++) {
+            if (!test_reader_check(test, msgs + i)) {
+                test->ret = RET_ERR;
+            }
+            test->received++;
+        }
+    }
+
+    if (n < 0) {
+        GDEBUG("End of stream");
+        if (test->ret == RET_TIMEOUT) {
+            test->ret = (test->received == TEST_BATCH_COUNT &&
+                !dbus_log_reader_skipped(test->reader) &&
+                !dbus_log_reader_dropped(test->reader)) ? RET_OK : RET_ERR;
+        }
+        test->watch_id = 0;
+        g_main_loop_quit(test->loop);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static
+int
+test_reader_run(
+    GMainLoop* loop,
+    gboolean binary)
+{
+    TestReader test;
+    DBusLogCore* core;
+    DBusLogSender* sender;
+    DBusLogFormat* fmt;
+    GIOChannel* io;
+    char* buf = g_malloc(TEST_BATCH_HUGE_LEN + 1);
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.ret = RET_TIMEOUT;
+    test.loop = loop;
+    core = dbus_log_core_new(-1);
+    sender = dbus_log_core_new_sender(core, "Test");
+    dbus_log_sender_set_flags(sender, DBUSLOG_OPEN_FLAG_BATCH |
+        (binary ? DBUSLOG_OPEN_FLAG_BINARY : 0));
+    fmt = dbus_log_core_new_format(core, "%s");
+    test.reader = dbus_log_reader_new(dup(sender->readfd), TRUE);
+    io = g_io_channel_unix_new(dbus_log_reader_fd(test.reader));
+    test.watch_id = g_io_add_watch(io, G_IO_IN | G_IO_ERR | G_IO_HUP,
+        test_reader_readable, &test);
+
+    /* Batches get split between the calls */
+    for (i=0; i<TEST_BATCH_COUNT; i++) {
+        const gsize len = test_batch_len(i);
+
+        memset(buf, 'a' + (i % 26), len);
+        buf[len] = 0;
+        if (binary) {
+            /* Huge messages make the text arena grow mid-batch */
+            test_format_send(core, fmt, buf);
+        } else {
+            test_send(core, DBUSLOG_LEVEL_INFO, NULL, buf);
+        }
+    }
+    dbus_log_sender_close(sender, TRUE);
+
+    g_main_loop_run(loop);
+
+    if (test.watch_id) {
+        g_source_remove(test.watch_id);
+    }
+    g_io_channel_unref(io);
+    dbus_log_reader_free(test.reader);
+    dbus_log_sender_unref(sender);
+    dbus_log_format_unref(fmt);
+    dbus_log_core_unref(core);
+    g_free(buf);
+    return test.ret;
+}
+
+static
+int
+test_reader(GMainLoop* loop)
+{
+    return test_reader_run(loop, FALSE);
+}
+
+static
+int
+test_reader_binary(GMainLoop* loop)
+{
+    return test_reader_run(loop, TRUE);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+static const TestDesc all_tests[] = {
+    {
+        "Basic",
+        test_basic
+    },{
+        "Categories",
+        test_cat
+    },{
+        "Queue",
+        test_queue
+    },{
+        "Skip",
+        test_skip
+    },{
+        "Threads",
+        test_threads
+    },{
+        "Format",
+        test_format
+    },{
+        "History",
+        test_history
+    },{
+        "Replay",
+        test_replay
+    },{
+        "Batch",
+        test_batch
+    },{
+        "MessageBatch",
+        test_message_batch
+    },{
+        "Shm",
+        test_shm
+    },{
+        "Pause",
+        test_pause
+    },{
+        "PipeSize",
+        test_pipe_size
+    },{
+        "Overflow",
+        test_overflow
+    },{
+        "Shed",
+        test_shed
+    },{
+        "Backwards",
+        test_backwards
+    },{
+        "Urgent",
+        test_urgent
+    },{
+        "Block",
+        test_block
+    },{
+        "Filter",
+        test_filter
+    },{
+        "Grep",
+        test_grep
+    },{
+        "Clock",
+        test_clock
+    },{
+        "Messages",
+        test_messages
+    },{
+        "Thread",
+        test_thread
+    },{
+        "Reader",
+        test_reader
+    },{
+        "ReaderBinary",
+        test_reader_binary
     }
 };
 
@@ -820,7 +2958,10 @@ test_run_once(
         run.timeout_id = g_timeout_add_seconds(TEST_TIMEOUT, test_timer, &run);
     }
 
+    /* Messages logged on this thread are handed over to senders inline */
+    g_main_context_acquire(NULL);
     ret = desc->run(run.loop);
+    g_main_context_release(NULL);
 
     if (run.timeout_occured) {
         ret = RET_TIMEOUT;
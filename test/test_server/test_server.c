@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_server_p.h"
+
+#include <errno.h>
+
+/* No such peer, so there are no credentials to grant anything */
+#define TEST_PEER ":0.0"
+
+static
+DBusLogServer*
+test_server_new(
+    void)
+{
+    DBusLogServer* server = g_object_new(DBUSLOG_SERVER_TYPE, NULL);
+
+    dbus_log_server_initialize(server, DBUSLOG_BUS_SYSTEM, "/");
+    return server;
+}
+
+/*==========================================================================*
+ * overflow
+ *==========================================================================*/
+
+static
+void
+test_overflow(
+    void)
+{
+    DBusLogServer* server = test_server_new();
+
+    /* Blocking requires a permission */
+    g_assert_cmpint(dbus_log_server_call_set_overflow(server, TEST_PEER,
+        DBUSLOG_LOG_COOKIE, DBUSLOG_OVERFLOW_BLOCK), == ,-EACCES);
+
+    /* Other policies don't, there's just no such session */
+    g_assert_cmpint(dbus_log_server_call_set_overflow(server, TEST_PEER,
+        DBUSLOG_LOG_COOKIE, DBUSLOG_OVERFLOW_DROP_NEWEST), == ,-ENOENT);
+    dbus_log_server_unref(server);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/server/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("overflow"), test_overflow);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
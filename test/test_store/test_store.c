@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dbuslog_store.h"
+#include "dbuslog_client_log.h"
+
+GLOG_MODULE_DEFINE("test_store");
+
+#define TEST_CATEGORY_COUNT (3)
+#define TEST_LEVEL_COUNT (6)
+
+/* Category is index % 3, level goes from CRITICAL to VERBOSE */
+static
+void
+test_store_add(
+    DBusLogStore* store,
+    guint32 index)
+{
+    char* text = g_strdup_printf("Message %u", index);
+    DBusLogMessage* msg = dbus_log_message_new(text);
+
+    msg->index = index;
+    msg->timestamp = 1000 * index;
+    msg->category = index % TEST_CATEGORY_COUNT;
+    msg->level = DBUSLOG_LEVEL_CRITICAL + (index % TEST_LEVEL_COUNT);
+    g_assert(dbus_log_store_add(store, msg));
+    dbus_log_message_unref(msg);
+    g_free(text);
+}
+
+static
+void
+test_store_check(
+    DBusLogStore* store,
+    guint64 row,
+    guint32 index)
+{
+    char* text = g_strdup_printf("Message %u", index);
+    DBusLogStoreEntry entry;
+
+    g_assert(dbus_log_store_get(store, row, &entry));
+    g_assert_cmpuint(entry.index, == ,index);
+    g_assert_cmpint(entry.timestamp, == ,1000 * index);
+    g_assert_cmpuint(entry.category, == ,index % TEST_CATEGORY_COUNT);
+    g_assert_cmpuint(entry.level, == ,DBUSLOG_LEVEL_CRITICAL +
+        (index % TEST_LEVEL_COUNT));
+    g_assert_cmpuint(entry.length, == ,strlen(text));
+    g_assert_cmpstr(entry.text, == ,text);
+    g_free(text);
+}
+
+/*==========================================================================*
+ * Null
+ *==========================================================================*/
+
+static
+void
+test_null(
+    void)
+{
+    /* Public interfaces are NULL tolerant */
+    DBusLogStore* store = dbus_log_store_new(0);
+
+    g_assert(!dbus_log_store_add(NULL, NULL));
+    g_assert(!dbus_log_store_add(store, NULL));
+    g_assert(!dbus_log_store_get(NULL, 0, NULL));
+    g_assert(!dbus_log_store_get(store, 0, NULL));
+    g_assert(!dbus_log_store_select(NULL, NULL, 0, NULL, 0));
+    g_assert(!dbus_log_store_select(store, NULL, 0, NULL, 1));
+    g_assert(!dbus_log_store_count(NULL, NULL));
+    g_assert(!dbus_log_store_count(store, NULL));
+    g_assert(!dbus_log_store_first(NULL));
+    g_assert(!dbus_log_store_end(NULL));
+    dbus_log_store_index_text(NULL, TRUE);
+    dbus_log_store_clear(NULL);
+    dbus_log_store_free(NULL);
+    dbus_log_store_free(store);
+}
+
+/*==========================================================================*
+ * Basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    const guint count = 10000;
+    DBusLogStore* store = dbus_log_store_new(0);
+    DBusLogStoreEntry entry;
+    guint64 rows[4];
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        test_store_add(store, i);
+    }
+    g_assert_cmpuint(dbus_log_store_first(store), == ,0);
+    g_assert_cmpuint(dbus_log_store_end(store), == ,count);
+    g_assert_cmpuint(dbus_log_store_count(store, NULL), == ,count);
+    for (i = 0; i < count; i++) {
+        test_store_check(store, i, i);
+    }
+    g_assert(!dbus_log_store_get(store, count, &entry));
+
+    /* Select without a filter */
+    g_assert_cmpuint(dbus_log_store_select(store, NULL, count - 2,
+        rows, G_N_ELEMENTS(rows)), == ,2);
+    g_assert_cmpuint(rows[0], == ,count - 2);
+    g_assert_cmpuint(rows[1], == ,count - 1);
+    g_assert(!dbus_log_store_select(store, NULL, count, rows, 1));
+
+    /* Empty message */
+    dbus_log_store_clear(store);
+    g_assert_cmpuint(dbus_log_store_end(store), == ,0);
+    g_assert_cmpuint(dbus_log_store_count(store, NULL), == ,0);
+    {
+        DBusLogMessage* msg = dbus_log_message_new(NULL);
+
+        g_assert(dbus_log_store_add(store, msg));
+        dbus_log_message_unref(msg);
+    }
+    g_assert(dbus_log_store_get(store, 0, &entry));
+    g_assert_cmpuint(entry.length, == ,0);
+    g_assert_cmpstr(entry.text, == ,"");
+    dbus_log_store_free(store);
+}
+
+/*==========================================================================*
+ * Filter
+ *==========================================================================*/
+
+static
+void
+test_filter(
+    void)
+{
+    const guint count = 10000;
+    const guint32 categories[] = { 1, 42 };
+    DBusLogStore* store = dbus_log_store_new(0);
+    DBusLogStoreFilter filter;
+    guint64* rows = g_new(guint64, count);
+    guint i, n;
+
+    for (i = 0; i < count; i++) {
+        test_store_add(store, i);
+    }
+
+    /* Category */
+    memset(&filter, 0, sizeof(filter));
+    filter.categories = categories;
+    filter.n_categories = G_N_ELEMENTS(categories);
+    n = dbus_log_store_select(store, &filter, 0, rows, count);
+    g_assert_cmpuint(n, == ,count / TEST_CATEGORY_COUNT);
+    g_assert_cmpuint(dbus_log_store_count(store, &filter), == ,n);
+    for (i = 0; i < n; i++) {
+        g_assert_cmpuint(rows[i] % TEST_CATEGORY_COUNT, == ,1);
+        g_assert(!i || rows[i] > rows[i - 1]);
+        test_store_check(store, rows[i], rows[i]);
+    }
+
+    /* Starting from the middle */
+    g_assert_cmpuint(dbus_log_store_select(store, &filter, 5000, rows, 2),
+        == ,2);
+    g_assert_cmpuint(rows[0], == ,5002);
+    g_assert_cmpuint(rows[1], == ,5005);
+
+    /* Category and level, i.e. CRITICAL and ERROR from category 1 */
+    filter.max_level = DBUSLOG_LEVEL_ERROR;
+    n = dbus_log_store_select(store, &filter, 0, rows, count);
+    g_assert_cmpuint(n, == ,dbus_log_store_count(store, &filter));
+    g_assert_cmpuint(n, == ,(count + 4) / TEST_LEVEL_COUNT);
+    for (i = 0; i < n; i++) {
+        g_assert_cmpuint(rows[i] % TEST_LEVEL_COUNT, == ,1);
+    }
+
+    /* Level only, across the chunk boundary */
+    filter.n_categories = 0;
+    g_assert_cmpuint(dbus_log_store_select(store, &filter, 4093, rows, 3),
+        == ,3);
+    g_assert_cmpuint(rows[0], == ,4093);
+    g_assert_cmpuint(rows[1], == ,4098);
+    g_assert_cmpuint(rows[2], == ,4099);
+
+    /* Nothing matches */
+    filter.categories = categories + 1;
+    filter.n_categories = 1;
+    g_assert(!dbus_log_store_select(store, &filter, 0, rows, count));
+    g_assert(!dbus_log_store_count(store, &filter));
+
+    g_free(rows);
+    dbus_log_store_free(store);
+}
+
+/*==========================================================================*
+ * Limit
+ *==========================================================================*/
+
+static
+void
+test_limit(
+    void)
+{
+    const guint limit = 5000;
+    const guint count = 20000;
+    DBusLogStore* store = dbus_log_store_new(limit);
+    guint64 first, end, row;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        test_store_add(store, i);
+    }
+
+    /* Old messages are dropped, but at least limit of them remain */
+    first = dbus_log_store_first(store);
+    end = dbus_log_store_end(store);
+    g_assert_cmpuint(end, == ,count);
+    g_assert_cmpuint(first, > ,0);
+    g_assert_cmpuint(end - first, >= ,limit);
+    g_assert_cmpuint(dbus_log_store_count(store, NULL), == ,end - first);
+    g_assert(!dbus_log_store_get(store, first - 1, NULL));
+    test_store_check(store, first, first);
+    test_store_check(store, end - 1, end - 1);
+
+    /* Selection starts at the first remaining row */
+    g_assert_cmpuint(dbus_log_store_select(store, NULL, 0, &row, 1), == ,1);
+    g_assert_cmpuint(row, == ,first);
+    dbus_log_store_free(store);
+}
+
+/*==========================================================================*
+ * Text
+ *==========================================================================*/
+
+static
+void
+test_text_check(
+    DBusLogStore* store)
+{
+    static const char* substrings[] = { "Message 1234", "Message 4321", NULL };
+    const guint32 category = 1;
+    DBusLogStoreFilter filter;
+    guint64 rows[16];
+    guint i;
+
+    /* Substrings */
+    memset(&filter, 0, sizeof(filter));
+    filter.substrings = (const GStrV*)substrings;
+    g_assert_cmpuint(dbus_log_store_select(store, &filter, 0, rows,
+        G_N_ELEMENTS(rows)), == ,2);
+    g_assert_cmpuint(rows[0], == ,1234);
+    g_assert_cmpuint(rows[1], == ,4321);
+
+    /* Regular expression, combined with the category */
+    filter.substrings = NULL;
+    filter.regex = g_regex_new("^Message 99[0-9]9$", G_REGEX_RAW, 0, NULL);
+    g_assert_cmpuint(dbus_log_store_select(store, &filter, 0, rows,
+        G_N_ELEMENTS(rows)), == ,10);
+    for (i = 0; i < 10; i++) {
+        g_assert_cmpuint(rows[i], == ,9909 + 10 * i);
+    }
+    filter.categories = &category;
+    filter.n_categories = 1;
+    g_assert_cmpuint(dbus_log_store_count(store, &filter), == ,3);
+    g_regex_unref(filter.regex);
+
+    /* Nothing like that */
+    filter.regex = g_regex_new("Massage", G_REGEX_RAW, 0, NULL);
+    g_assert(!dbus_log_store_count(store, &filter));
+    g_regex_unref(filter.regex);
+
+    /* Optional UTF-8 character and group */
+    filter.categories = NULL;
+    filter.n_categories = 0;
+    filter.regex = g_regex_new("^Message 1234\xc3\xa9?(5)?$", 0, 0, NULL);
+    g_assert_cmpuint(dbus_log_store_count(store, &filter), == ,1);
+    g_regex_unref(filter.regex);
+}
+
+static
+void
+test_text(
+    void)
+{
+    const guint count = 10000;
+    DBusLogStore* store = dbus_log_store_new(0);
+    DBusLogStore* indexed = dbus_log_store_new(0);
+    guint i;
+
+    /* Same results with and without the index */
+    for (i = 0; i < count; i++) {
+        test_store_add(store, i);
+        test_store_add(indexed, i);
+        if (i == 100) {
+            /* The chunk being filled gets indexed too */
+            dbus_log_store_index_text(indexed, TRUE);
+        }
+    }
+    test_text_check(store);
+    test_text_check(indexed);
+    dbus_log_store_free(store);
+    dbus_log_store_free(indexed);
+}
+
+/*==========================================================================*
+ * Format
+ *==========================================================================*/
+
+static
+DBusLogMessage*
+test_format_message(
+    DBusLogFormat* format,
+    ...)
+{
+    DBusLogMessage* msg;
+    va_list va;
+
+    va_start(va, format);
+    msg = dbus_log_message_new_format(format, va);
+    va_end(va);
+    return msg;
+}
+
+static
+void
+test_format(
+    void)
+{
+    static const char text[] = "Deferred 42 text";
+    DBusLogStore* store = dbus_log_store_new(0);
+    DBusLogFormat* format = dbus_log_format_new("Deferred %d %s", 1);
+    DBusLogMessage* msg = test_format_message(format, 42, "text");
+    DBusLogStoreFilter filter;
+    DBusLogStoreEntry entry;
+
+    /* The text is formatted when the message gets stored */
+    g_assert(format->can_pack);
+    g_assert(!msg->string);
+    dbus_log_store_index_text(store, TRUE);
+    g_assert(dbus_log_store_add(store, msg));
+    g_assert(dbus_log_store_get(store, 0, &entry));
+    g_assert_cmpuint(entry.length, == ,strlen(text));
+    g_assert_cmpstr(entry.text, == ,text);
+
+    /* And indexed */
+    memset(&filter, 0, sizeof(filter));
+    filter.regex = g_regex_new("42 text", 0, 0, NULL);
+    g_assert_cmpuint(dbus_log_store_count(store, &filter), == ,1);
+    g_regex_unref(filter.regex);
+
+    dbus_log_message_unref(msg);
+    dbus_log_format_unref(format);
+    dbus_log_store_free(store);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/store/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("null"), test_null);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("filter"), test_filter);
+    g_test_add_func(TEST_("limit"), test_limit);
+    g_test_add_func(TEST_("text"), test_text);
+    g_test_add_func(TEST_("format"), test_format);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
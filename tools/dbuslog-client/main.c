@@ -31,6 +31,7 @@
  */
 
 #include <dbuslog_client.h>
+#include <dbuslog_capture.h>
 #include <gutil_macros.h>
 #include <gutil_strv.h>
 #include <gutil_log.h>
@@ -42,20 +43,59 @@
 #define RET_CANCEL  (2)
 #define RET_TIMEOUT (3)
 
+/*
+ * Messages from several services are merged in timestamp order. Each
+ * service has its own queue, the oldest message overall gets printed
+ * when every service has something queued, or when it has waited for
+ * the reorder window, or when a queue is full. Each service's messages
+ * are output in the order they have arrived. Timestamps going backwards
+ * within one service (e.g. when the service's clock has been adjusted)
+ * are not sorted out.
+ */
+#define APP_MERGE_QUEUE_SIZE (4096)
+#define APP_DEFAULT_WINDOW   (200) /* ms */
+
 enum {
     APP_EVENT_ERROR,
     APP_EVENT_CONNECT,
     APP_EVENT_MESSAGE,
+    APP_EVENT_STARTED,
     APP_N_EVENTS
 };
 
+typedef struct app App;
 typedef struct app_action AppAction;
 typedef DBusLogClientCall* (*AppActionRunFunc)(AppAction* action);
 typedef void (*AppActionFreeFunc)(AppAction* action);
 
-typedef struct app {
-    GMainLoop* loop;
+typedef struct app_message {
+    DBusLogCategory* category;
+    DBusLogMessage* message;
+    gint64 received;            /* Monotonic time */
+} AppMessage;
+
+typedef struct app_source {
+    App* app;
+    char* service;
+    char* label;                /* Empty if there's only one service */
     DBusLogClient* client;
+    gulong event_id[APP_N_EVENTS];
+    AppMessage* queue;
+    guint head;
+    guint count;
+} AppSource;
+
+struct app {
+    GMainLoop* loop;
+    DBusLogClient* client;      /* The first source's client */
+    AppSource* sources;
+    guint n_sources;
+    guint* heap;                /* Sources with queued messages */
+    guint heap_size;
+    gint window;
+    guint merge_id;
+    gint64 merge_deadline;
+    gboolean following;
     DBusLogClientCall* call;
     AppAction* actions;
     gboolean follow;
@@ -63,15 +103,25 @@ typedef struct app {
     gboolean timestamp;
     gboolean print_log_level;
     gboolean print_backlog;
+    gint history;
+    char** grep;
+    char* regex_str;
+    GRegex* regex;
     char* out_filename;
     FILE* out_file;
-    gulong event_id[APP_N_EVENTS];
+    char* capture_filename;
+    DBusLogCaptureWriter* capture;
+    gboolean index_text;
+    char* read_filename;
+    char* since_str;
+    gint64 since;
+    char* only_category;
     gint timeout;
     guint timeout_id;
     guint sigterm_id;
     guint sigint_id;
     int ret;
-} App;
+};
 
 struct app_action {
     AppAction* next;
@@ -405,15 +455,50 @@ app_print(
     }
 }
 
+static
+gboolean
+app_match(
+    App* app,
+    const DBusLogMessage* message)
+{
+    /* The server filters too, if it can. This catches the rest */
+    if (app->grep || app->regex) {
+        if (app->grep) {
+            char** ptr;
+            for (ptr = app->grep; *ptr; ptr++) {
+                if (strstr(message->string, *ptr)) {
+                    return TRUE;
+                }
+            }
+        }
+        return app->regex && g_regex_match_full(app->regex, message->string,
+            message->length, 0, 0, NULL, NULL);
+    }
+    return TRUE;
+}
+
 static
 void
-client_message(
+client_started(
     DBusLogClient* client,
-    DBusLogCategory* category,
-    DBusLogMessage* message,
     gpointer user_data)
 {
-    App* app = user_data;
+    AppSource* src = user_data;
+    App* app = src->app;
+    if (client->started && (app->grep || app->regex)) {
+        dbus_log_client_session_set_content_filter(client, app->grep,
+            app->regex_str, NULL, NULL);
+    }
+}
+
+static
+void
+app_print_message(
+    App* app,
+    const char* label,
+    DBusLogCategory* category,
+    DBusLogMessage* message)
+{
     const char* prefix;
     char buf[32];
     if (app->timestamp || app->datetime) {
@@ -432,25 +517,253 @@ client_message(
         prefix = "";
     }
     if (category && !(category->flags & DBUSLOG_CATEGORY_FLAG_HIDE_NAME)) {
-        app_print(app, "%s%s: %s\n", prefix, category->name, message->string);
+        app_print(app, "%s%s%s: %s\n", prefix, label, category->name,
+            message->string);
     } else {
-        app_print(app, "%s%s\n", prefix, message->string);
+        app_print(app, "%s%s%s\n", prefix, label, message->string);
     }
 }
 
 static
 void
-app_follow(
+app_output(
+    App* app,
+    AppSource* src,
+    DBusLogCategory* category,
+    DBusLogMessage* message)
+{
+    if (app->capture) {
+        dbus_log_capture_writer_write(app->capture, category, message);
+    }
+    app_print_message(app, src->label, category, message);
+}
+
+static
+gboolean
+app_merge_less(
+    App* app,
+    guint i1,
+    guint i2)
+{
+    const AppSource* s1 = app->sources + i1;
+    const AppSource* s2 = app->sources + i2;
+    const gint64 t1 = s1->queue[s1->head].message->timestamp;
+    const gint64 t2 = s2->queue[s2->head].message->timestamp;
+    return t1 < t2 || (t1 == t2 && i1 < i2);
+}
+
+static
+void
+app_merge_swap(
+    App* app,
+    guint pos1,
+    guint pos2)
+{
+    const guint tmp = app->heap[pos1];
+    app->heap[pos1] = app->heap[pos2];
+    app->heap[pos2] = tmp;
+}
+
+static
+void
+app_merge_sift_up(
+    App* app,
+    guint pos)
+{
+    while (pos > 0) {
+        const guint parent = (pos - 1) / 2;
+        if (!app_merge_less(app, app->heap[pos], app->heap[parent])) {
+            break;
+        }
+        app_merge_swap(app, pos, parent);
+        pos = parent;
+    }
+}
+
+static
+void
+app_merge_sift_down(
+    App* app,
+    guint pos)
+{
+    for (;;) {
+        const guint left = 2 * pos + 1;
+        const guint right = left + 1;
+        guint min = pos;
+        if (left < app->heap_size &&
+            app_merge_less(app, app->heap[left], app->heap[min])) {
+            min = left;
+        }
+        if (right < app->heap_size &&
+            app_merge_less(app, app->heap[right], app->heap[min])) {
+            min = right;
+        }
+        if (min == pos) {
+            break;
+        }
+        app_merge_swap(app, pos, min);
+        pos = min;
+    }
+}
+
+/* Outputs the oldest queued message */
+static
+void
+app_merge_pop(
     App* app)
 {
-    if (!app->event_id[APP_EVENT_MESSAGE]) {
-        app->event_id[APP_EVENT_MESSAGE] =
-            dbus_log_client_add_message_handler(app->client,
-                client_message, app);
+    AppSource* src = app->sources + app->heap[0];
+    AppMessage* m = src->queue + src->head;
+
+    app_output(app, src, m->category, m->message);
+    dbus_log_category_unref(m->category);
+    dbus_log_message_unref(m->message);
+    src->head = (src->head + 1) % APP_MERGE_QUEUE_SIZE;
+    if (!--(src->count)) {
+        app->heap[0] = app->heap[--(app->heap_size)];
+    }
+    app_merge_sift_down(app, 0);
+}
+
+static
+void
+app_merge_push(
+    App* app,
+    AppSource* src,
+    DBusLogCategory* category,
+    DBusLogMessage* message)
+{
+    AppMessage* m;
+
+    /* Make room for the new one */
+    while (src->count == APP_MERGE_QUEUE_SIZE) {
+        app_merge_pop(app);
+    }
+    m = src->queue + (src->head + src->count) % APP_MERGE_QUEUE_SIZE;
+    m->category = dbus_log_category_ref(category);
+    m->message = dbus_log_message_ref(message);
+    m->received = g_get_monotonic_time();
+    if (!(src->count++)) {
+        app->heap[app->heap_size] = src - app->sources;
+        app_merge_sift_up(app, app->heap_size++);
     }
-    if (!app->client->started) {
-        GDEBUG("Starting live capture...");
-        dbus_log_client_start(app->client, NULL, NULL);
+}
+
+static
+gboolean
+app_merge_timeout(
+    gpointer user_data);
+
+static
+void
+app_merge(
+    App* app,
+    gboolean flush)
+{
+    const gint64 window = (gint64)app->window * 1000;
+    const gint64 now = g_get_monotonic_time();
+
+    while (app->heap_size) {
+        const AppSource* src = app->sources + app->heap[0];
+        const gint64 received = src->queue[src->head].received;
+
+        /* Nothing older can show up if every service has spoken */
+        if (flush || app->heap_size == app->n_sources ||
+            (now - received) >= window) {
+            app_merge_pop(app);
+        } else {
+            const gint64 deadline = received + window;
+
+            /* The head may have changed since the timer was set */
+            if (app->merge_id && app->merge_deadline != deadline) {
+                g_source_remove(app->merge_id);
+                app->merge_id = 0;
+            }
+            if (!app->merge_id) {
+                app->merge_deadline = deadline;
+                app->merge_id = g_timeout_add((guint)
+                    ((deadline - now + 999) / 1000),
+                    app_merge_timeout, app);
+            }
+            break;
+        }
+    }
+}
+
+static
+gboolean
+app_merge_timeout(
+    gpointer user_data)
+{
+    App* app = user_data;
+    app->merge_id = 0;
+    app_merge(app, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+client_messages(
+    DBusLogClient* client,
+    const DBusLogClientMessage* messages,
+    guint count,
+    gpointer user_data)
+{
+    AppSource* src = user_data;
+    App* app = src->app;
+    guint i;
+    for (i = 0; i < count; i++) {
+        DBusLogCategory* category = messages[i].category;
+        DBusLogMessage* message = messages[i].message;
+        if (app_match(app, message)) {
+            if (app->n_sources > 1) {
+                app_merge_push(app, src, category, message);
+            } else {
+                app_output(app, src, category, message);
+            }
+        }
+    }
+    if (app->n_sources > 1) {
+        app_merge(app, FALSE);
+    }
+}
+
+static
+void
+app_follow_source(
+    AppSource* src)
+{
+    App* app = src->app;
+    DBusLogClient* client = src->client;
+    if (!src->event_id[APP_EVENT_MESSAGE]) {
+        src->event_id[APP_EVENT_MESSAGE] =
+            dbus_log_client_add_messages_handler(client,
+                client_messages, src);
+    }
+    if (!src->event_id[APP_EVENT_STARTED]) {
+        src->event_id[APP_EVENT_STARTED] =
+            dbus_log_client_add_started_handler(client,
+                client_started, src);
+    }
+    if (!client->started) {
+        GDEBUG("Starting live capture of %s...", src->service);
+        if (app->history > 0) {
+            dbus_log_client_start_with_history(client, 0, app->history,
+                NULL, NULL);
+        } else {
+            dbus_log_client_start(client, NULL, NULL);
+        }
+    }
+}
+
+static
+void
+app_follow(
+    App* app)
+{
+    guint i;
+    if (!app->following) {
+        app->following = TRUE;
         if (app->out_filename && !app->out_file) {
             app->out_file = fopen(app->out_filename, "w");
             if (app->out_file) {
@@ -461,6 +774,21 @@ app_follow(
                 app->out_filename = NULL;
             }
         }
+        if (app->capture_filename && !app->capture) {
+            app->capture = dbus_log_capture_writer_new(app->capture_filename);
+            if (app->capture) {
+                GDEBUG("Capturing to %s", app->capture_filename);
+                if (app->index_text) {
+                    dbus_log_capture_writer_index_text(app->capture);
+                }
+            }
+        }
+    }
+    /* The rest get started as they show up */
+    for (i = 0; i < app->n_sources; i++) {
+        if (app->sources[i].client->connected) {
+            app_follow_source(app->sources + i);
+        }
     }
 }
 
@@ -470,9 +798,14 @@ client_connected_cb(
     DBusLogClient* client,
     gpointer user_data)
 {
-    App* app = user_data;
+    AppSource* src = user_data;
+    App* app = src->app;
     if (client->connected) {
-        client_connected(app);
+        if (src == app->sources) {
+            client_connected(app);
+        } else if (app->following) {
+            app_follow_source(src);
+        }
     } else {
         GDEBUG("Disconnected!");
     }
@@ -485,7 +818,8 @@ client_connect_error(
     const GError* error,
     gpointer user_data)
 {
-    App* app = user_data;
+    AppSource* src = user_data;
+    App* app = src->app;
     app->ret = RET_ERR;
     app_quit(app);
 }
@@ -552,16 +886,20 @@ app_run(
     App* app)
 {
     gboolean run_loop = TRUE;
+    guint i;
 
     app->loop = g_main_loop_new(NULL, FALSE);
     app->sigterm_id = g_unix_signal_add(SIGTERM, app_sigterm, app);
     app->sigint_id = g_unix_signal_add(SIGINT, app_sigint, app);
-    app->event_id[APP_EVENT_ERROR] =
-        dbus_log_client_add_connect_error_handler(app->client,
-            client_connect_error, app);
-    app->event_id[APP_EVENT_CONNECT] =
-        dbus_log_client_add_connected_handler(app->client,
-            client_connected_cb, app);
+    for (i = 0; i < app->n_sources; i++) {
+        AppSource* src = app->sources + i;
+        src->event_id[APP_EVENT_ERROR] =
+            dbus_log_client_add_connect_error_handler(src->client,
+                client_connect_error, src);
+        src->event_id[APP_EVENT_CONNECT] =
+            dbus_log_client_add_connected_handler(src->client,
+                client_connected_cb, src);
+    }
     if (app->client->connected) {
         client_connected(app);
         run_loop = app->follow;
@@ -579,13 +917,91 @@ app_run(
     if (app->sigterm_id) g_source_remove(app->sigterm_id);
     if (app->sigint_id) g_source_remove(app->sigint_id);
     if (app->timeout_id) g_source_remove(app->timeout_id);
+    if (app->merge_id) g_source_remove(app->merge_id);
 
-    dbus_log_client_remove_handlers(app->client, app->event_id, APP_N_EVENTS);
-    dbus_log_client_unref(app->client);
+    /* Whatever is still waiting in the queues */
+    app_merge(app, TRUE);
+    for (i = 0; i < app->n_sources; i++) {
+        AppSource* src = app->sources + i;
+        dbus_log_client_remove_handlers(src->client, src->event_id,
+            APP_N_EVENTS);
+    }
     g_main_loop_unref(app->loop);
     return app->ret;
 }
 
+static
+int
+app_read(
+    App* app)
+{
+    DBusLogCaptureReader* reader =
+        dbus_log_capture_reader_new(app->read_filename);
+    DBusLogCategory* category;
+    DBusLogMessage* message;
+    GError* error = NULL;
+    if (!reader) {
+        return RET_ERR;
+    }
+    if (app->only_category) {
+        category = dbus_log_capture_reader_find_category(reader,
+            app->only_category);
+        if (!category) {
+            GERR("No category \'%s\' in %s", app->only_category,
+                app->read_filename);
+            dbus_log_capture_reader_free(reader);
+            return RET_ERR;
+        }
+        dbus_log_capture_reader_set_category(reader, category->id);
+    }
+    if (app->since_str) {
+        dbus_log_capture_reader_seek_time(reader, app->since);
+    }
+    /* Uses the text index, if there is one */
+    if (!dbus_log_capture_reader_set_content_filter(reader,
+        (const GStrV*)app->grep, app->regex_str, &error)) {
+        GERR("%s", error->message);
+        g_error_free(error);
+        dbus_log_capture_reader_free(reader);
+        return RET_ERR;
+    }
+    while ((message = dbus_log_capture_reader_next(reader, &category))) {
+        app_print_message(app, "", category, message);
+        dbus_log_message_unref(message);
+    }
+    dbus_log_capture_reader_free(reader);
+    return RET_OK;
+}
+
+static
+gboolean
+app_parse_time(
+    const char* str,
+    gint64* time,
+    GError** error)
+{
+    int y, mon, d, h = 0, min = 0, sec = 0, n = 0;
+    char* end = NULL;
+    const gint64 value = g_ascii_strtoll(str, &end, 10);
+    if (end != str && !*end) {
+        /* Seconds since the epoch */
+        *time = value * G_USEC_PER_SEC;
+        return TRUE;
+    } else if ((sscanf(str, "%d-%d-%d %d:%d:%d%n", &y, &mon, &d,
+        &h, &min, &sec, &n) == 6 && !str[n]) ||
+        (sscanf(str, "%d-%d-%d%n", &y, &mon, &d, &n) == 3 && !str[n])) {
+        GDateTime* dt = g_date_time_new_local(y, mon, d, h, min, sec);
+        if (dt) {
+            *time = g_date_time_to_unix(dt) * G_USEC_PER_SEC;
+            g_date_time_unref(dt);
+            return TRUE;
+        }
+    }
+    g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+        "Invalid time \'%s\'", str);
+    return FALSE;
+}
+
 static
 gboolean
 app_option_enable_all(
@@ -714,6 +1130,9 @@ app_init(
     gboolean session_bus = FALSE;
     gboolean verbose = FALSE;
     gboolean list = FALSE;
+    gboolean thread = FALSE;
+    gboolean shm = FALSE;
+    guint n_services = 0;
     GOptionEntry entries[] = {
         { "session", 0, 0, G_OPTION_ARG_NONE, &session_bus,
           "Use session bus (default is system)", NULL },
@@ -721,6 +1140,12 @@ app_init(
           "Enable verbose output", NULL },
         { "timeout", 't', 0, G_OPTION_ARG_INT, &app->timeout,
           "Timeout in seconds", "SEC" },
+        { "thread", 0, 0, G_OPTION_ARG_NONE, &thread,
+          "Receive messages on a separate thread", NULL },
+        { "shm", 0, 0, G_OPTION_ARG_NONE, &shm,
+          "Receive messages through shared memory if possible", NULL },
+        { "window", 0, 0, G_OPTION_ARG_INT, &app->window,
+          "Reorder window for several services (default 200)", "MS" },
         { NULL }
     };
     GOptionEntry action_entries[] = {
@@ -728,10 +1153,27 @@ app_init(
           "Print log messages to stdout (default action)", NULL },
         { "write", 'w', 0, G_OPTION_ARG_FILENAME, &app->out_filename,
           "Write message to file too (requires -f)", "FILE" },
+        { "write-binary", 'W', 0, G_OPTION_ARG_FILENAME,
+          &app->capture_filename,
+          "Write messages to binary capture file (requires -f)", "FILE" },
+        { "index-text", 0, 0, G_OPTION_ARG_NONE, &app->index_text,
+          "Index message text in the capture file (requires -W)", NULL },
+        { "read", 'R', 0, G_OPTION_ARG_FILENAME, &app->read_filename,
+          "Print messages from binary capture file", "FILE" },
+        { "since", 0, 0, G_OPTION_ARG_STRING, &app->since_str,
+          "Skip messages logged before TIME (requires -R)", "TIME" },
+        { "only-category", 0, 0, G_OPTION_ARG_STRING, &app->only_category,
+          "Only print messages from category NAME (requires -R)", "NAME" },
+        { "history", 'H', 0, G_OPTION_ARG_INT, &app->history,
+          "Print up to COUNT earlier messages first (requires -f)", "COUNT" },
         { "timestamp", 'T', 0, G_OPTION_ARG_NONE, &app->timestamp,
           "Print message time (use -D to print the date too)", NULL },
         { "date", 'D', 0, G_OPTION_ARG_NONE, &app->datetime,
           "Print message time and date", NULL },
+        { "grep", 'g', 0, G_OPTION_ARG_STRING_ARRAY, &app->grep,
+          "Only print messages containing TEXT (repeatable)", "TEXT" },
+        { "regex", 'E', 0, G_OPTION_ARG_STRING, &app->regex_str,
+          "Only print messages matching REGEX", "REGEX" },
         { "categories", 'c', 0, G_OPTION_ARG_NONE, &list,
           "List log categories", NULL },
         { "print-log-level", 'L', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK,
@@ -755,39 +1197,113 @@ app_init(
         { NULL }
     };
     GError* error = NULL;
-    GOptionContext* options = g_option_context_new("[PATH] SERVICE");
+    GOptionContext* options = g_option_context_new("[PATH] SERVICE...");
     GOptionGroup* actions = g_option_group_new("actions",
         "Action Options:", "Show all actions", app, NULL);
     g_option_context_add_main_entries(options, entries, NULL);
     g_option_group_add_entries(actions, action_entries);
     g_option_context_add_group(options, actions);
+    app->window = APP_DEFAULT_WINDOW;
     if (g_option_context_parse(options, &argc, &argv, &error)) {
-        if (argc >= 2 && argc <= 3) {
-            const char* path;
-            const char* service;
-            if (argc == 2) {
-                path = "/";
-                service = argv[1];
-            } else {
-                path = argv[1];
-                service = argv[2];
+        int i;
+
+        /* Each SERVICE may be preceded by its PATH */
+        for (i = 1; i < argc; i++) {
+            if (argv[i][0] != '/') {
+                n_services++;
+            } else if (i == argc - 1 || argv[i + 1][0] == '/') {
+                n_services = 0;
+                break;
             }
+        }
+        if (app->read_filename ? (argc == 1) : (n_services > 0)) {
             if (verbose) gutil_log_default.level = GLOG_LEVEL_VERBOSE;
-            app->client = dbus_log_client_new(session_bus ?
-                G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM, service, path, 0);
-            if (list) {
-                app_add_action(app, app_action_new(app, app_action_list));
+            if (!app->read_filename) {
+                const char* path = "/";
+                guint k = 0;
+
+                app->n_sources = n_services;
+                app->sources = g_new0(AppSource, n_services);
+                for (i = 1; i < argc; i++) {
+                    if (argv[i][0] == '/') {
+                        path = argv[i];
+                    } else {
+                        AppSource* src = app->sources + (k++);
+                        src->app = app;
+                        src->service = g_strdup(argv[i]);
+                        src->label = (n_services > 1) ?
+                            g_strdup_printf("[%s] ", argv[i]) : g_strdup("");
+                        src->client = dbus_log_client_new(session_bus ?
+                            G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM,
+                            argv[i], path,
+                            (thread ? DBUSLOG_CLIENT_FLAG_THREAD : 0) |
+                            (shm ? DBUSLOG_CLIENT_FLAG_SHM : 0));
+                        path = "/";
+                    }
+                }
+                app->client = app->sources[0].client;
+                if (n_services > 1) {
+                    /* Allocated once, no allocations per message */
+                    for (k = 0; k < n_services; k++) {
+                        app->sources[k].queue = g_new(AppMessage,
+                            APP_MERGE_QUEUE_SIZE);
+                    }
+                    app->heap = g_new(guint, n_services);
+                    app->window = MAX(app->window, 0);
+                    if (app->actions || list || app->print_log_level ||
+                        app->print_backlog) {
+                        GWARN("Several services can only be followed");
+                        list = app->print_log_level =
+                            app->print_backlog = FALSE;
+                        while (app->actions) {
+                            AppAction* action = app->actions;
+                            app->actions = action->next;
+                            action->fn_free(action);
+                        }
+                    }
+                    if (app->capture_filename) {
+                        /* Category ids are only unique per service */
+                        GWARN("Ignoring -W option (one service only)");
+                        g_free(app->capture_filename);
+                        app->capture_filename = NULL;
+                    }
+                }
+                if (list) {
+                    app_add_action(app, app_action_new(app, app_action_list));
+                }
+                if (!app->actions && !app->print_log_level &&
+                    !app->print_backlog) {
+                    /* Default action */
+                    app->follow = TRUE;
+                }
+                if (app->out_filename && !app->follow) {
+                    GWARN("Ignoring -w option (it requires -f)");
+                    g_free(app->out_filename);
+                    app->out_filename = NULL;
+                }
+                if (app->capture_filename && !app->follow) {
+                    GWARN("Ignoring -W option (it requires -f)");
+                    g_free(app->capture_filename);
+                    app->capture_filename = NULL;
+                }
+                if (app->index_text && !app->capture_filename) {
+                    GWARN("Ignoring --index-text option (it requires -W)");
+                    app->index_text = FALSE;
+                }
             }
-            if (!app->actions && !app->print_log_level && !app->print_backlog) {
-                /* Default action */
-                app->follow = TRUE;
+            if (app->regex_str) {
+                app->regex = g_regex_new(app->regex_str, G_REGEX_RAW |
+                    G_REGEX_OPTIMIZE, 0, &error);
             }
-            if (app->out_filename && !app->follow) {
-                GWARN("Ignoring -w option (it requires -f)");
-                g_free(app->out_filename);
-                app->out_filename = NULL;
+            if (!error && app->since_str) {
+                app_parse_time(app->since_str, &app->since, &error);
+            }
+            if (error) {
+                GERR("%s", error->message);
+                g_error_free(error);
+            } else {
+                ok = TRUE;
             }
-            ok = TRUE;
         } else {
             char* help = g_option_context_get_help(options, TRUE, NULL);
             fprintf(stderr, "%s", help);
@@ -814,11 +1330,48 @@ app_destroy(
         g_free(app->out_filename);
         app->out_filename = NULL;
     }
+    if (app->capture) {
+        dbus_log_capture_writer_close(app->capture);
+        app->capture = NULL;
+    }
+    g_free(app->capture_filename);
+    g_free(app->read_filename);
+    g_free(app->since_str);
+    g_free(app->only_category);
+    app->capture_filename = NULL;
+    app->read_filename = NULL;
+    app->since_str = NULL;
+    app->only_category = NULL;
+    if (app->regex) {
+        g_regex_unref(app->regex);
+        app->regex = NULL;
+    }
+    g_strfreev(app->grep);
+    g_free(app->regex_str);
+    app->grep = NULL;
+    app->regex_str = NULL;
     while (app->actions) {
         AppAction* action = app->actions;
         app->actions = action->next;
         action->fn_free(action);
     }
+    if (app->sources) {
+        guint i;
+        for (i = 0; i < app->n_sources; i++) {
+            AppSource* src = app->sources + i;
+            GASSERT(!src->count);
+            dbus_log_client_unref(src->client);
+            g_free(src->queue);
+            g_free(src->label);
+            g_free(src->service);
+        }
+        g_free(app->sources);
+        g_free(app->heap);
+        app->sources = NULL;
+        app->client = NULL;
+        app->heap = NULL;
+        app->n_sources = 0;
+    }
 }
 
 int main(int argc, char* argv[])
@@ -830,7 +1383,7 @@ int main(int argc, char* argv[])
     gutil_log_set_type(GLOG_TYPE_STDOUT, "dbuslog");
     gutil_log_default.level = GLOG_LEVEL_DEFAULT;
     if (app_init(&app, argc, argv)) {
-        ret = app_run(&app);
+        ret = app.read_filename ? app_read(&app) : app_run(&app);
     }
     app_destroy(&app);
     return ret;